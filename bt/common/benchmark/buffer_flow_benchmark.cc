@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "osi/include/allocator.h"
+#include "osi/include/fixed_queue.h"
+
+using ::benchmark::State;
+
+// BT_DEFAULT_BUFFER_SIZE, which the A2DP source uses for each media packet
+#define MEDIA_BUFFER_SIZE (4096 + 16)
+// Size of the buffer of the Number Of Completed Packets event of each packet
+#define EVENT_BUFFER_SIZE 64
+#define TX_QUEUE_SIZE 16
+#define NUM_PACKETS_PER_ITERATION 1000
+
+static void* const g_end_of_stream = (void*)&g_end_of_stream;
+
+// Sustained A2DP source flow: the encoder thread allocates a media buffer for
+// each packet and queues it, the thread which sends the packets frees it and
+// the buffer of the event which completes it. The allocation time of each
+// buffer is measured to show the jitter of the allocator.
+static void BM_A2dpSourceBufferFlow(State& state) {
+  fixed_queue_t* tx_queue = fixed_queue_new(TX_QUEUE_SIZE);
+  std::thread send_thread([tx_queue]() {
+    while (true) {
+      void* p_buf = fixed_queue_dequeue(tx_queue);
+      if (p_buf == g_end_of_stream) break;
+      osi_free(p_buf);
+      void* p_event = osi_malloc(EVENT_BUFFER_SIZE);
+      memset(p_event, 0, EVENT_BUFFER_SIZE);
+      osi_free(p_event);
+    }
+  });
+
+  int64_t max_alloc_ns = 0;
+  int64_t total_alloc_ns = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_PACKETS_PER_ITERATION; i++) {
+      auto start = std::chrono::steady_clock::now();
+      uint8_t* p_buf = static_cast<uint8_t*>(osi_malloc(MEDIA_BUFFER_SIZE));
+      auto alloc_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+      max_alloc_ns = std::max<int64_t>(max_alloc_ns, alloc_ns);
+      total_alloc_ns += alloc_ns;
+      // The encoder fills the packet
+      memset(p_buf, i, MEDIA_BUFFER_SIZE);
+      fixed_queue_enqueue(tx_queue, p_buf);
+    }
+  }
+
+  fixed_queue_enqueue(tx_queue, g_end_of_stream);
+  send_thread.join();
+  fixed_queue_free(tx_queue, nullptr);
+
+  int64_t num_packets = state.iterations() * NUM_PACKETS_PER_ITERATION;
+  state.SetItemsProcessed(num_packets);
+  state.counters["max_alloc_ns"] = max_alloc_ns;
+  state.counters["mean_alloc_ns"] =
+      num_packets == 0 ? 0 : total_alloc_ns / num_packets;
+  // The calls to the system allocator and the pool usage
+  osi_allocator_debug_dump(STDERR_FILENO);
+}
+BENCHMARK(BM_A2dpSourceBufferFlow);
+
+// The same packets, queued and freed on a single thread
+static void BM_BufferEnqueueDequeue(State& state) {
+  fixed_queue_t* queue = fixed_queue_new(SIZE_MAX);
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_PACKETS_PER_ITERATION; i++) {
+      fixed_queue_enqueue(queue, osi_malloc(MEDIA_BUFFER_SIZE));
+      if (fixed_queue_length(queue) > TX_QUEUE_SIZE) {
+        osi_free(fixed_queue_dequeue(queue));
+      }
+    }
+  }
+  fixed_queue_free(queue, osi_free);
+  state.SetItemsProcessed(state.iterations() * NUM_PACKETS_PER_ITERATION);
+}
+BENCHMARK(BM_BufferEnqueueDequeue);
+
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <vector>
+
+#include "oi_codec_sbc.h"
+#include "oi_status.h"
+#include "sbc_encoder.h"
+
+using ::benchmark::State;
+
+#define NUM_CHANNELS 2
+#define NUM_BLOCKS 16
+#define NUM_FRAMES_PER_ITERATION 100
+
+// The A2DP source configuration of the highest quality, with 4 or 8 subbands
+static void InitEncoder(SBC_ENC_PARAMS* params, int16_t num_subbands) {
+  *params = {};
+  params->s16SamplingFreq = SBC_sf44100;
+  params->s16ChannelMode = SBC_JOINT_STEREO;
+  params->s16NumOfSubBands = num_subbands;
+  params->s16NumOfBlocks = NUM_BLOCKS;
+  params->s16AllocationMethod = SBC_LOUDNESS;
+  params->u16BitRate = 328;
+  SBC_Encoder_Init(params);
+}
+
+// Interleaved stereo samples of NUM_FRAMES_PER_ITERATION frames
+static std::vector<int16_t> GenerateInput(int16_t num_subbands) {
+  std::vector<int16_t> pcm(NUM_FRAMES_PER_ITERATION * NUM_BLOCKS *
+                           num_subbands * NUM_CHANNELS);
+  uint32_t noise = 1;
+  for (size_t i = 0; i < pcm.size(); i++) {
+    noise = noise * 1103515245u + 12345u;
+    pcm[i] = static_cast<int16_t>((i * 331) % 32768 - 16384) / 2 +
+             static_cast<int16_t>(noise >> 16) / 4;
+  }
+  return pcm;
+}
+
+static void BM_SbcEncode(State& state) {
+  int16_t num_subbands = state.range(0);
+  SBC_ENC_PARAMS params;
+  InitEncoder(&params, num_subbands);
+  std::vector<int16_t> input = GenerateInput(num_subbands);
+  size_t samples_per_frame = NUM_BLOCKS * num_subbands * NUM_CHANNELS;
+  uint8_t frame[SBC_MAX_FRAME_LEN];
+
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_FRAMES_PER_ITERATION; i++) {
+      benchmark::DoNotOptimize(
+          SBC_Encode(&params, &input[i * samples_per_frame], frame));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_FRAMES_PER_ITERATION);
+  state.SetBytesProcessed(state.iterations() * input.size() * sizeof(int16_t));
+}
+BENCHMARK(BM_SbcEncode)->Arg(SUB_BANDS_4)->Arg(SUB_BANDS_8);
+
+static void BM_SbcDecode(State& state) {
+  int16_t num_subbands = state.range(0);
+  SBC_ENC_PARAMS params;
+  InitEncoder(&params, num_subbands);
+  std::vector<int16_t> input = GenerateInput(num_subbands);
+  size_t samples_per_frame = NUM_BLOCKS * num_subbands * NUM_CHANNELS;
+  std::vector<std::vector<uint8_t>> frames;
+  uint8_t frame[SBC_MAX_FRAME_LEN];
+  for (int i = 0; i < NUM_FRAMES_PER_ITERATION; i++) {
+    uint32_t frame_len =
+        SBC_Encode(&params, &input[i * samples_per_frame], frame);
+    frames.emplace_back(frame, frame + frame_len);
+  }
+
+  OI_CODEC_SBC_DECODER_CONTEXT context;
+  uint32_t context_data[CODEC_DATA_WORDS(NUM_CHANNELS,
+                                         SBC_CODEC_FAST_FILTER_BUFFERS)] = {};
+  if (!OI_SUCCESS(OI_CODEC_SBC_DecoderReset(&context, context_data,
+                                            sizeof(context_data), NUM_CHANNELS,
+                                            NUM_CHANNELS, false))) {
+    state.SkipWithError("OI_CODEC_SBC_DecoderReset failed");
+    return;
+  }
+  int16_t output[SBC_MAX_SAMPLES_PER_FRAME * SBC_MAX_CHANNELS];
+
+  for (auto _ : state) {
+    for (const auto& encoded : frames) {
+      const OI_BYTE* frame_data = encoded.data();
+      uint32_t frame_bytes = encoded.size();
+      uint32_t output_bytes = sizeof(output);
+      OI_CODEC_SBC_DecodeFrame(&context, &frame_data, &frame_bytes, output,
+                               &output_bytes);
+      benchmark::DoNotOptimize(output);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_FRAMES_PER_ITERATION);
+  state.SetBytesProcessed(state.iterations() * input.size() * sizeof(int16_t));
+}
+BENCHMARK(BM_SbcDecode)->Arg(SUB_BANDS_4)->Arg(SUB_BANDS_8);
+
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
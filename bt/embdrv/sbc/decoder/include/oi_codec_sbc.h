@@ -230,6 +230,10 @@ typedef struct {
     (sizeof(uint32_t) - 1)) /                                                  \
    sizeof(uint32_t))
 
+/** Used internally. Windowing of the synthesis filter, for 8 subbands. */
+typedef void (*OI_SBC_SYNTH_WINDOW)(int16_t* pcm, SBC_BUFFER_T const* buffer,
+                                    OI_UINT strideShift);
+
 /** Opaque parameter to decoding functions; maintains decoder context. */
 typedef struct {
   OI_CODEC_SBC_COMMON_CONTEXT common;
@@ -238,6 +242,8 @@ typedef struct {
   uint8_t restrictSubbands;
   uint8_t enhancedEnabled;
   uint8_t bufferedBlocks;
+  /* The fastest version the CPU supports, set by OI_CODEC_SBC_DecoderReset() */
+  OI_SBC_SYNTH_WINDOW synthWindow80;
 } OI_CODEC_SBC_DECODER_CONTEXT;
 
 typedef struct {
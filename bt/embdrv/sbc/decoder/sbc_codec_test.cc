@@ -0,0 +1,141 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+
+#include "oi_codec_sbc.h"
+#include "oi_status.h"
+#include "sbc_encoder.h"
+
+namespace {
+
+constexpr int kNumFrames = 200;
+
+struct SbcConfig {
+  int16_t sampling_freq;
+  int16_t channel_mode;
+  int16_t num_subbands;
+  int16_t num_blocks;
+  int16_t allocation_method;
+  uint16_t bit_rate;
+  // FNV-1a hashes of the frames and of the decoded samples, as produced by
+  // the portable C filters
+  uint32_t encoded_hash;
+  uint32_t decoded_hash;
+};
+
+const SbcConfig kConfigs[] = {
+    {SBC_sf44100, SBC_JOINT_STEREO, 8, 16, SBC_LOUDNESS, 328, 0x83fed28e,
+     0xab43a3d1},
+    {SBC_sf44100, SBC_STEREO, 8, 16, SBC_LOUDNESS, 328, 0xcca9edd6, 0x4cf94cfa},
+    {SBC_sf48000, SBC_DUAL, 8, 12, SBC_SNR, 345, 0x0b0c6289, 0xdb1bf882},
+    {SBC_sf44100, SBC_MONO, 8, 8, SBC_LOUDNESS, 198, 0xf93365c2, 0x0e68187e},
+    {SBC_sf16000, SBC_MONO, 8, 16, SBC_LOUDNESS, 64, 0xbc497d30, 0x734036db},
+    {SBC_sf32000, SBC_STEREO, 4, 16, SBC_SNR, 200, 0xb040148f, 0xdcd34165},
+    {SBC_sf48000, SBC_STEREO, 4, 12, SBC_LOUDNESS, 229, 0x8fcb9a28, 0x9571e9e5},
+    {SBC_sf16000, SBC_MONO, 4, 4, SBC_LOUDNESS, 64, 0xfb3e35ee, 0x22d9e050},
+};
+
+uint32_t Fnv1a(uint32_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Two triangle waves and some noise, with an envelope which goes above full
+// scale so that the filters also see clipped input. Only integer arithmetic is
+// used, so that the input is the same on every platform.
+std::vector<int16_t> GenerateInput(size_t num_samples, int num_channels) {
+  std::vector<int16_t> pcm(num_samples * num_channels);
+  uint32_t noise = 0x12345678;
+  for (size_t n = 0; n < num_samples; n++) {
+    int32_t envelope = (n / 64) % 48;  // in 1/32 of full scale
+    for (int ch = 0; ch < num_channels; ch++) {
+      uint32_t period = ch == 0 ? 97 : 331;
+      int32_t phase = (n * 65536 / period) % 65536;
+      int32_t triangle = phase < 32768 ? phase - 16384 : 49152 - phase;
+      noise = noise * 1103515245u + 12345u;
+      int32_t sample = triangle * 2 * envelope / 32 +
+                       static_cast<int16_t>(noise >> 16) / 16;
+      if (sample > INT16_MAX) sample = INT16_MAX;
+      if (sample < INT16_MIN) sample = INT16_MIN;
+      pcm[n * num_channels + ch] = static_cast<int16_t>(sample);
+    }
+  }
+  return pcm;
+}
+
+class SbcCodecTest : public ::testing::TestWithParam<SbcConfig> {};
+
+// The filters picked for the CPU must produce the same frames and samples as
+// the portable C ones, bit for bit.
+TEST_P(SbcCodecTest, MatchesReferenceOutput) {
+  const SbcConfig& config = GetParam();
+  SBC_ENC_PARAMS params = {};
+  params.s16SamplingFreq = config.sampling_freq;
+  params.s16ChannelMode = config.channel_mode;
+  params.s16NumOfSubBands = config.num_subbands;
+  params.s16NumOfBlocks = config.num_blocks;
+  params.s16AllocationMethod = config.allocation_method;
+  params.u16BitRate = config.bit_rate;
+  SBC_Encoder_Init(&params);
+
+  int num_channels = params.s16NumOfChannels;
+  size_t samples_per_frame = config.num_subbands * config.num_blocks;
+  std::vector<int16_t> input =
+      GenerateInput(samples_per_frame * kNumFrames, num_channels);
+
+  OI_CODEC_SBC_DECODER_CONTEXT context;
+  // The decoder does not clear the history of the synthesis filter
+  uint32_t context_data[CODEC_DATA_WORDS(2, SBC_CODEC_FAST_FILTER_BUFFERS)] =
+      {};
+  ASSERT_TRUE(OI_SUCCESS(OI_CODEC_SBC_DecoderReset(
+      &context, context_data, sizeof(context_data), 2, num_channels, false)));
+
+  uint32_t encoded_hash = 2166136261u;
+  uint32_t decoded_hash = 2166136261u;
+  uint8_t frame[SBC_MAX_FRAME_LEN];
+  int16_t output[SBC_MAX_SAMPLES_PER_FRAME * SBC_MAX_CHANNELS];
+  for (int i = 0; i < kNumFrames; i++) {
+    uint32_t frame_len = SBC_Encode(
+        &params, &input[i * samples_per_frame * num_channels], frame);
+    ASSERT_GT(frame_len, 0u);
+    encoded_hash = Fnv1a(encoded_hash, frame, frame_len);
+
+    const OI_BYTE* frame_data = frame;
+    uint32_t frame_bytes = frame_len;
+    uint32_t output_bytes = sizeof(output);
+    ASSERT_TRUE(OI_SUCCESS(OI_CODEC_SBC_DecodeFrame(
+        &context, &frame_data, &frame_bytes, output, &output_bytes)));
+    ASSERT_EQ(samples_per_frame * num_channels * sizeof(int16_t),
+              output_bytes);
+    decoded_hash = Fnv1a(decoded_hash, output, output_bytes);
+  }
+
+  EXPECT_EQ(config.encoded_hash, encoded_hash)
+      << std::hex << "encoded hash 0x" << encoded_hash;
+  EXPECT_EQ(config.decoded_hash, decoded_hash)
+      << std::hex << "decoded hash 0x" << decoded_hash;
+}
+
+INSTANTIATE_TEST_SUITE_P(SbcConfigs, SbcCodecTest,
+                         ::testing::ValuesIn(kConfigs));
+
+}  // namespace
@@ -75,7 +75,7 @@ INLINE OI_STATUS internal_DecoderReset(OI_CODEC_SBC_DECODER_CONTEXT* context,
   context->limitFrameFormat = FALSE;
   OI_SBC_ExpandFrameFields(&context->common.frameInfo);
 
-  /*PLATFORM_DECODER_RESET(context);*/
+  context->synthWindow80 = OI_SBC_GetSynthWindow80();
 
   return OI_OK;
 }
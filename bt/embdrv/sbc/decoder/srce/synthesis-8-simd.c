@@ -0,0 +1,219 @@
+/******************************************************************************
+ *
+ *  Copyright 2021 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/** @file
+@ingroup codec_internal
+*/
+
+/**@addgroup codec_internal*/
+/**@{*/
+
+/*
+ * NEON and AVX2 versions of SynthWindow80_generated(). The 8 samples of a
+ * block are computed in parallel, each one being the sum of 10 products of the
+ * filter buffer by the coefficients and shifts of synthesis-8-generated.c.
+ * The integer operations are the same, so is the output.
+ *
+ * Sample j of the block is the sum over m = 0..4 of the products of
+ * buffer[16 * m + 4 + j] by SynthWindow80Coef[2 * m][j] and of
+ * buffer[16 * m + 12 - j] by SynthWindow80Coef[2 * m + 1][j], each one shifted
+ * left by SynthWindow80Shift, or right when it is negative.
+ */
+
+#include "oi_codec_sbc_private.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SBC_SYNTH_NEON
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+/* SSE2 has no shift by a different count in each lane, AVX2 is checked for at
+ * runtime */
+#define SBC_SYNTH_AVX2
+#endif
+
+PRIVATE void SynthWindow80_generated(int16_t* pcm,
+                                     SBC_BUFFER_T const* RESTRICT buffer,
+                                     OI_UINT strideShift);
+
+#if defined(SBC_SYNTH_NEON) || defined(SBC_SYNTH_AVX2)
+static const int16_t SynthWindow80Coef[10][8] = {
+    {0, -3263, -10385, -16457, 10445, -8443, -10337, -6087},
+    {8235, 29293, 24995, 19083, 0, 16913, 11167, 9293},
+    {-23167, -5229, -309, -23641, -5297, -301, -30605, -2893},
+    {26479, 30835, 9161, -29015, 0, 3687, 1917, 1247},
+    {-17397, -27021, -23063, -12889, 22299, 10255, 9553, 18055},
+    {9399, 31633, 27561, 6145, 0, 15447, 8317, 23671},
+    {17397, 17319, 2309, 24211, 10603, 9405, 16383, 1747},
+    {26479, 26663, 12705, 23469, 0, -18233, 22117, 11537},
+    {23167, 4555, 6239, 21223, 9539, 26189, 8603, 8721},
+    {8235, 12419, 9251, 26913, 0, 1499, 7543, 685},
+};
+
+/* Stores the 8 samples of the block, interleaved with the samples of the other
+ * channel when strideShift is 1 */
+static void SynthWindow80_store(int16_t* pcm, const int16_t* samples,
+                                OI_UINT strideShift) {
+  OI_UINT j;
+  for (j = 0; j < 8; j++) {
+    pcm[j << strideShift] = samples[j];
+  }
+}
+#endif
+
+#ifdef SBC_SYNTH_NEON
+static const int32_t SynthWindow80Shift[10][8] = {
+    {0, -5, -6, -6, -4, -7, -4, -2},
+    {-3, -5, -5, -5, 0, -5, -4, -3},
+    {-3, 0, 4, -2, 1, 5, -1, 3},
+    {-2, -3, -3, -4, 0, 1, 2, 3},
+    {1, 1, 1, 2, 2, 2, 2, 1},
+    {3, 1, 1, 3, 0, 2, 3, 2},
+    {1, 1, 3, -1, 0, -1, -2, 1},
+    {-2, -2, -1, -2, 0, -3, -4, -1},
+    {-3, -1, -3, -8, -4, -7, -6, -7},
+    {-3, -4, -4, -6, 0, -1, -3, 1},
+};
+
+PRIVATE void SynthWindow80_neon(int16_t* pcm,
+                                SBC_BUFFER_T const* RESTRICT buffer,
+                                OI_UINT strideShift) {
+  int32x4_t lo = vdupq_n_s32(0);
+  int32x4_t hi = vdupq_n_s32(0);
+  int16x8_t a, b, coef;
+  int16x8_t samples;
+  OI_UINT m, t;
+
+  for (m = 0; m < 5; m++) {
+    t = 2 * m;
+    a = vld1q_s16(buffer + 16 * m + 4);
+    /* buffer[16 * m + 12 - j] for j = 0..7 */
+    b = vrev64q_s16(vld1q_s16(buffer + 16 * m + 5));
+    b = vcombine_s16(vget_high_s16(b), vget_low_s16(b));
+
+    coef = vld1q_s16(SynthWindow80Coef[t]);
+    lo = vaddq_s32(lo, vshlq_s32(vmull_s16(vget_low_s16(a), vget_low_s16(coef)),
+                                 vld1q_s32(SynthWindow80Shift[t])));
+    hi = vaddq_s32(hi,
+                   vshlq_s32(vmull_s16(vget_high_s16(a), vget_high_s16(coef)),
+                             vld1q_s32(SynthWindow80Shift[t] + 4)));
+    coef = vld1q_s16(SynthWindow80Coef[t + 1]);
+    lo = vaddq_s32(lo, vshlq_s32(vmull_s16(vget_low_s16(b), vget_low_s16(coef)),
+                                 vld1q_s32(SynthWindow80Shift[t + 1])));
+    hi = vaddq_s32(hi,
+                   vshlq_s32(vmull_s16(vget_high_s16(b), vget_high_s16(coef)),
+                             vld1q_s32(SynthWindow80Shift[t + 1] + 4)));
+  }
+
+  /* pcm /= 32768, rounded toward zero as the C division */
+  lo = vaddq_s32(lo, vreinterpretq_s32_u32(vshrq_n_u32(
+                         vreinterpretq_u32_s32(vshrq_n_s32(lo, 31)), 17)));
+  hi = vaddq_s32(hi, vreinterpretq_s32_u32(vshrq_n_u32(
+                         vreinterpretq_u32_s32(vshrq_n_s32(hi, 31)), 17)));
+  lo = vshrq_n_s32(lo, 15);
+  hi = vshrq_n_s32(hi, 15);
+  samples = vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi));
+
+  if (strideShift == 0) {
+    vst1q_s16(pcm, samples);
+  } else {
+    int16_t block[8];
+    vst1q_s16(block, samples);
+    SynthWindow80_store(pcm, block, strideShift);
+  }
+}
+#endif /* SBC_SYNTH_NEON */
+
+#ifdef SBC_SYNTH_AVX2
+static const int32_t SynthWindow80ShiftLeft[10][8] = {
+    {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 4, 0, 1, 5, 0, 3}, {0, 0, 0, 0, 0, 1, 2, 3},
+    {1, 1, 1, 2, 2, 2, 2, 1}, {3, 1, 1, 3, 0, 2, 3, 2},
+    {1, 1, 3, 0, 0, 0, 0, 1}, {0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 1},
+};
+static const int32_t SynthWindow80ShiftRight[10][8] = {
+    {0, 5, 6, 6, 4, 7, 4, 2}, {3, 5, 5, 5, 0, 5, 4, 3},
+    {3, 0, 0, 2, 0, 0, 1, 0}, {2, 3, 3, 4, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 1, 0, 1, 2, 0}, {2, 2, 1, 2, 0, 3, 4, 1},
+    {3, 1, 3, 8, 4, 7, 6, 7}, {3, 4, 4, 6, 0, 1, 3, 0},
+};
+
+__attribute__((target("avx2"))) static inline __m256i SynthWindow80_tap_avx2(
+    __m128i samples, OI_UINT t) {
+  __m256i product = _mm256_mullo_epi32(
+      _mm256_cvtepi16_epi32(samples),
+      _mm256_cvtepi16_epi32(
+          _mm_loadu_si128((const __m128i*)SynthWindow80Coef[t])));
+  product = _mm256_sllv_epi32(
+      product,
+      _mm256_loadu_si256((const __m256i*)SynthWindow80ShiftLeft[t]));
+  return _mm256_srav_epi32(
+      product,
+      _mm256_loadu_si256((const __m256i*)SynthWindow80ShiftRight[t]));
+}
+
+__attribute__((target("avx2"))) PRIVATE void SynthWindow80_avx2(
+    int16_t* pcm, SBC_BUFFER_T const* RESTRICT buffer, OI_UINT strideShift) {
+  const __m128i reverse =
+      _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+  __m256i acc = _mm256_setzero_si256();
+  __m128i a, b, samples;
+  OI_UINT m;
+
+  for (m = 0; m < 5; m++) {
+    a = _mm_loadu_si128((const __m128i*)(buffer + 16 * m + 4));
+    /* buffer[16 * m + 12 - j] for j = 0..7 */
+    b = _mm_shuffle_epi8(
+        _mm_loadu_si128((const __m128i*)(buffer + 16 * m + 5)), reverse);
+    acc = _mm256_add_epi32(acc, SynthWindow80_tap_avx2(a, 2 * m));
+    acc = _mm256_add_epi32(acc, SynthWindow80_tap_avx2(b, 2 * m + 1));
+  }
+
+  /* pcm /= 32768, rounded toward zero as the C division */
+  acc = _mm256_srai_epi32(
+      _mm256_add_epi32(acc, _mm256_srli_epi32(_mm256_srai_epi32(acc, 31), 17)),
+      15);
+  samples = _mm_packs_epi32(_mm256_castsi256_si128(acc),
+                            _mm256_extracti128_si256(acc, 1));
+
+  if (strideShift == 0) {
+    _mm_storeu_si128((__m128i*)pcm, samples);
+  } else {
+    int16_t block[8];
+    _mm_storeu_si128((__m128i*)block, samples);
+    SynthWindow80_store(pcm, block, strideShift);
+  }
+}
+#endif /* SBC_SYNTH_AVX2 */
+
+PRIVATE OI_SBC_SYNTH_WINDOW OI_SBC_GetSynthWindow80(void) {
+#if defined(SBC_SYNTH_NEON)
+  return SynthWindow80_neon;
+#elif defined(SBC_SYNTH_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    return SynthWindow80_avx2;
+  }
+  return SynthWindow80_generated;
+#else
+  return SynthWindow80_generated;
+#endif
+}
+
+/**@}*/
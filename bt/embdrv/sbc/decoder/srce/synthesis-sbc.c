@@ -266,7 +266,7 @@ typedef void (*SYNTH_FRAME)(OI_CODEC_SBC_DECODER_CONTEXT* context, int16_t* pcm,
 #endif
 
 #ifndef SYNTH80
-#define SYNTH80 SynthWindow80_generated
+#define SYNTH80 context->synthWindow80
 #endif
 
 #ifndef SYNTH112
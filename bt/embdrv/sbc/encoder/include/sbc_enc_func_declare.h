@@ -35,6 +35,32 @@ extern const int32_t gas32CoeffFor4SBs[];
 extern const int32_t gas32CoeffFor8SBs[];
 #endif
 
+/* The SIMD analysis filter gives the same output as this configuration only */
+#if (SBC_SIMD_OPT == TRUE && SBC_ARM_ASM_OPT == FALSE &&               \
+     SBC_IPAQ_OPT == TRUE && SBC_IS_64_MULT_IN_WINDOW_ACCU == FALSE && \
+     SBC_FAST_DCT == TRUE && SBC_IS_64_MULT_IN_IDCT == FALSE)
+#define SBC_SIMD_ANALYSIS TRUE
+/* Window coeffs of the IPAQ filter, as16Coeff[k * 2 * NumOfSubBands + i]
+ * weighting the sample k * 2 * NumOfSubBands + i of the window */
+extern const int16_t gas16WindowFor4SBs[];
+extern const int16_t gas16WindowFor8SBs[];
+#else
+#define SBC_SIMD_ANALYSIS FALSE
+#endif
+
+/* Windowing of the samples of one channel into the input of the DCT */
+typedef void (*SBC_WINDOW_FUNC)(const int16_t* ps16X, int32_t* ps32DCTY);
+/* DCT of the windowed samples of s32NumOfVect channels and blocks */
+typedef void (*SBC_DCT_FUNC)(int32_t* ps32DCTY, int32_t* ps32SbBuf,
+                             int32_t s32NumOfVect);
+
+typedef struct {
+  SBC_WINDOW_FUNC Window4;
+  SBC_WINDOW_FUNC Window8;
+  SBC_DCT_FUNC FastIDCT4;
+  SBC_DCT_FUNC FastIDCT8;
+} SBC_ANALYSIS_FUNCS;
+
 /* Global functions*/
 
 extern void sbc_enc_bit_alloc_mono(SBC_ENC_PARAMS* CodecParams);
@@ -48,6 +74,11 @@ extern void SbcAnalysisFilter8(SBC_ENC_PARAMS* strEncParams, int16_t* input);
 extern void SBC_FastIDCT8(int32_t* pInVect, int32_t* pOutVect);
 extern void SBC_FastIDCT4(int32_t* x0, int32_t* pOutVect);
 
+#if (SBC_SIMD_ANALYSIS == TRUE)
+/* Replaces the functions of pFuncs by SIMD ones if the CPU supports them */
+extern void SbcAnalysisSimdInit(SBC_ANALYSIS_FUNCS* pFuncs);
+#endif
+
 extern uint32_t EncPacking(SBC_ENC_PARAMS* strEncParams, uint8_t* output);
 extern void EncQuantizer(SBC_ENC_PARAMS*);
 #if (SBC_DSP_OPT == TRUE)
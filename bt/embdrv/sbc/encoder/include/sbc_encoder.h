@@ -138,6 +138,14 @@
 #define SBC_FAST_DCT TRUE
 #endif /*SBC_FAST_DCT */
 
+/* Set SBC_SIMD_OPT to TRUE to run the windowing and the DCT of the analysis
+ * filter with SSE2 or NEON when the CPU has it */
+/* CAUTION: It only apply if SBC_IPAQ_OPT and SBC_FAST_DCT are set to TRUE and
+ * the 64 bits multiplications are not used, the output is then the same */
+#ifndef SBC_SIMD_OPT
+#define SBC_SIMD_OPT TRUE
+#endif /*SBC_SIMD_OPT */
+
 /* In case we do not use joint stereo mode the flag save some RAM and ROM in
  * case it is set to FALSE */
 #ifndef SBC_JOINT_STE_INCLUDED
@@ -0,0 +1,333 @@
+/******************************************************************************
+ *
+ *  Copyright 2021 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  SSE2 and NEON versions of the windowing and of the fast DCT of the
+ *  analysis filter. They compute the same integer operations as the C
+ *  versions, so the output does not depend on the one which is used.
+ *
+ *  This file is included by sbc_analysis.c, it is not built on its own.
+ *
+ ******************************************************************************/
+#include "sbc_dct.h"
+#include "sbc_enc_func_declare.h"
+#include "sbc_encoder.h"
+
+#if (SBC_SIMD_ANALYSIS == TRUE)
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SBC_SIMD_SSE2 TRUE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SBC_SIMD_NEON TRUE
+#endif
+
+#if (SBC_SIMD_SSE2 == TRUE || SBC_SIMD_NEON == TRUE)
+
+/* 4 lanes of int32_t, one lane for each of the vectors processed together */
+#if (SBC_SIMD_SSE2 == TRUE)
+typedef __m128i SBC_V32;
+#define SBC_V_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define SBC_V_STORE(p, a) _mm_storeu_si128((__m128i*)(p), a)
+#define SBC_V_ADD(a, b) _mm_add_epi32(a, b)
+#define SBC_V_SUB(a, b) _mm_sub_epi32(a, b)
+#define SBC_V_SHL1(a) _mm_slli_epi32(a, 1)
+#define SBC_V_SHR1(a) _mm_srai_epi32(a, 1)
+#else
+typedef int32x4_t SBC_V32;
+#define SBC_V_LOAD(p) vld1q_s32(p)
+#define SBC_V_STORE(p, a) vst1q_s32(p, a)
+#define SBC_V_ADD(a, b) vaddq_s32(a, b)
+#define SBC_V_SUB(a, b) vsubq_s32(a, b)
+#define SBC_V_SHL1(a) vshlq_n_s32(a, 1)
+#define SBC_V_SHR1(a) vshrq_n_s32(a, 1)
+#endif
+
+/* SBC_MULT_32_16_SIMPLIFIED of each lane: (int32_t)(((int64_t)c * x) >> 15) */
+static inline SBC_V32 SbcVMult(int32_t c, SBC_V32 x) {
+#if (SBC_SIMD_SSE2 == TRUE)
+  /* c * x = ((x >> 16) * c << 16) + (x & 0xFFFF) * c, with 0 <= c < 0x8000 so
+   * that the 16 bits products are exact */
+  __m128i coeff = _mm_set1_epi32(c);
+  __m128i hi = _mm_madd_epi16(_mm_srai_epi32(x, 16), coeff);
+  __m128i lo = _mm_and_si128(x, _mm_set1_epi32(0xFFFF));
+  __m128i lo_hi = _mm_slli_epi32(_mm_mulhi_epu16(lo, coeff), 1);
+  __m128i lo_lo = _mm_srli_epi32(_mm_mullo_epi16(lo, coeff), 15);
+  return _mm_add_epi32(_mm_slli_epi32(hi, 1), _mm_or_si128(lo_hi, lo_lo));
+#else
+  int32x2_t coeff = vdup_n_s32(c);
+  return vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(x), coeff), 15),
+                      vshrn_n_s64(vmull_s32(vget_high_s32(x), coeff), 15));
+#endif
+}
+
+static inline void SbcVTranspose(SBC_V32* r0, SBC_V32* r1, SBC_V32* r2,
+                                 SBC_V32* r3) {
+#if (SBC_SIMD_SSE2 == TRUE)
+  __m128i t0 = _mm_unpacklo_epi32(*r0, *r1);
+  __m128i t1 = _mm_unpacklo_epi32(*r2, *r3);
+  __m128i t2 = _mm_unpackhi_epi32(*r0, *r1);
+  __m128i t3 = _mm_unpackhi_epi32(*r2, *r3);
+  *r0 = _mm_unpacklo_epi64(t0, t1);
+  *r1 = _mm_unpackhi_epi64(t0, t1);
+  *r2 = _mm_unpacklo_epi64(t2, t3);
+  *r3 = _mm_unpackhi_epi64(t2, t3);
+#else
+  int32x4x2_t t01 = vtrnq_s32(*r0, *r1);
+  int32x4x2_t t23 = vtrnq_s32(*r2, *r3);
+  *r0 = vcombine_s32(vget_low_s32(t01.val[0]), vget_low_s32(t23.val[0]));
+  *r1 = vcombine_s32(vget_low_s32(t01.val[1]), vget_low_s32(t23.val[1]));
+  *r2 = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0]));
+  *r3 = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1]));
+#endif
+}
+
+/* Loads the elements First to First + 3 of 4 vectors of Stride elements, the
+ * element First + i of each vector in the lanes of ps32Y[i] */
+static inline void SbcVLoad4x4(const int32_t* ps32In, int32_t Stride,
+                               SBC_V32* ps32Y) {
+  ps32Y[0] = SBC_V_LOAD(ps32In);
+  ps32Y[1] = SBC_V_LOAD(ps32In + Stride);
+  ps32Y[2] = SBC_V_LOAD(ps32In + 2 * Stride);
+  ps32Y[3] = SBC_V_LOAD(ps32In + 3 * Stride);
+  SbcVTranspose(&ps32Y[0], &ps32Y[1], &ps32Y[2], &ps32Y[3]);
+}
+
+static inline void SbcVStore4x4(int32_t* ps32Out, int32_t Stride, SBC_V32 r0,
+                                SBC_V32 r1, SBC_V32 r2, SBC_V32 r3) {
+  SbcVTranspose(&r0, &r1, &r2, &r3);
+  SBC_V_STORE(ps32Out, r0);
+  SBC_V_STORE(ps32Out + Stride, r1);
+  SBC_V_STORE(ps32Out + 2 * Stride, r2);
+  SBC_V_STORE(ps32Out + 3 * Stride, r3);
+}
+
+/*******************************************************************************
+ *
+ * Function         SbcWindowSimd
+ *
+ * Description      Windowing of 8 consecutive samples, the samples of the 5
+ *                  rows of the window being Stride samples apart
+ *
+ ******************************************************************************/
+static inline void SbcWindowSimd(const int16_t* ps16X,
+                                 const int16_t* ps16Coeff, int32_t Stride,
+                                 int32_t* ps32DCTY) {
+#if (SBC_SIMD_SSE2 == TRUE)
+  /* The products of two rows are added in pairs by pmaddwd, the products and
+   * the sums are done modulo 2^32 as in WINDOW_ACCU */
+  __m128i zero = _mm_setzero_si128();
+  __m128i x0 = _mm_loadu_si128((const __m128i*)ps16X);
+  __m128i x1 = _mm_loadu_si128((const __m128i*)(ps16X + Stride));
+  __m128i x2 = _mm_loadu_si128((const __m128i*)(ps16X + 2 * Stride));
+  __m128i x3 = _mm_loadu_si128((const __m128i*)(ps16X + 3 * Stride));
+  __m128i x4 = _mm_loadu_si128((const __m128i*)(ps16X + 4 * Stride));
+  __m128i c0 = _mm_loadu_si128((const __m128i*)ps16Coeff);
+  __m128i c1 = _mm_loadu_si128((const __m128i*)(ps16Coeff + Stride));
+  __m128i c2 = _mm_loadu_si128((const __m128i*)(ps16Coeff + 2 * Stride));
+  __m128i c3 = _mm_loadu_si128((const __m128i*)(ps16Coeff + 3 * Stride));
+  __m128i c4 = _mm_loadu_si128((const __m128i*)(ps16Coeff + 4 * Stride));
+  __m128i lo, hi;
+
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(x0, x1), _mm_unpacklo_epi16(c0, c1));
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(x0, x1), _mm_unpackhi_epi16(c0, c1));
+  lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(x2, x3),
+                                        _mm_unpacklo_epi16(c2, c3)));
+  hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(x2, x3),
+                                        _mm_unpackhi_epi16(c2, c3)));
+  lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(x4, zero),
+                                        _mm_unpacklo_epi16(c4, zero)));
+  hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(x4, zero),
+                                        _mm_unpackhi_epi16(c4, zero)));
+  _mm_storeu_si128((__m128i*)ps32DCTY, lo);
+  _mm_storeu_si128((__m128i*)(ps32DCTY + 4), hi);
+#else
+  int32x4_t lo, hi;
+  int16x8_t x, c;
+  int32_t k;
+
+  x = vld1q_s16(ps16X);
+  c = vld1q_s16(ps16Coeff);
+  lo = vmull_s16(vget_low_s16(x), vget_low_s16(c));
+  hi = vmull_s16(vget_high_s16(x), vget_high_s16(c));
+  for (k = 1; k < 5; k++) {
+    x = vld1q_s16(ps16X + k * Stride);
+    c = vld1q_s16(ps16Coeff + k * Stride);
+    lo = vmlal_s16(lo, vget_low_s16(x), vget_low_s16(c));
+    hi = vmlal_s16(hi, vget_high_s16(x), vget_high_s16(c));
+  }
+  vst1q_s32(ps32DCTY, lo);
+  vst1q_s32(ps32DCTY + 4, hi);
+#endif
+}
+
+static void SbcWindow4Simd(const int16_t* ps16X, int32_t* ps32DCTY) {
+  SbcWindowSimd(ps16X, gas16WindowFor4SBs, SUB_BANDS_4 * 2, ps32DCTY);
+}
+
+static void SbcWindow8Simd(const int16_t* ps16X, int32_t* ps32DCTY) {
+  SbcWindowSimd(ps16X, gas16WindowFor8SBs, SUB_BANDS_8 * 2, ps32DCTY);
+  SbcWindowSimd(ps16X + 8, gas16WindowFor8SBs + 8, SUB_BANDS_8 * 2,
+                ps32DCTY + 8);
+}
+
+/*******************************************************************************
+ *
+ * Function         SbcFastIDCT4Simd
+ *
+ * Description      SBC_FastIDCT4 of 4 vectors at a time, the remaining ones
+ *                  with SBC_FastIDCT4
+ *
+ ******************************************************************************/
+static void SbcFastIDCT4Simd(int32_t* ps32DCTY, int32_t* ps32SbBuf,
+                             int32_t s32NumOfVect) {
+  SBC_V32 y[8], x2, temp, tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+
+  for (; s32NumOfVect >= 4; s32NumOfVect -= 4) {
+    SbcVLoad4x4(ps32DCTY, SUB_BANDS_4 * 2, &y[0]);
+    SbcVLoad4x4(ps32DCTY + 4, SUB_BANDS_4 * 2, &y[4]);
+
+    x2 = SBC_V_SHR1(y[2]);
+    tmp0 = SbcVMult(SBC_COS_PI_SUR_4 >> 1, SBC_V_ADD(y[0], y[4]));
+    tmp1 = SBC_V_SUB(x2, tmp0);
+    tmp0 = SBC_V_ADD(tmp0, x2);
+    temp = SBC_V_ADD(y[1], y[3]);
+    tmp3 = SbcVMult(SBC_COS_3PI_SUR_8 >> 1, temp);
+    tmp2 = SbcVMult(SBC_COS_PI_SUR_8 >> 1, temp);
+    temp = SBC_V_SUB(y[5], y[7]);
+    tmp5 = SbcVMult(SBC_COS_3PI_SUR_8 >> 1, temp);
+    tmp4 = SbcVMult(SBC_COS_PI_SUR_8 >> 1, temp);
+    tmp6 = SBC_V_ADD(tmp2, tmp5);
+    tmp7 = SBC_V_SUB(tmp3, tmp4);
+
+    SbcVStore4x4(ps32SbBuf, SUB_BANDS_4, SBC_V_ADD(tmp0, tmp6),
+                 SBC_V_ADD(tmp1, tmp7), SBC_V_SUB(tmp1, tmp7),
+                 SBC_V_SUB(tmp0, tmp6));
+
+    ps32DCTY += 4 * SUB_BANDS_4 * 2;
+    ps32SbBuf += 4 * SUB_BANDS_4;
+  }
+
+  for (; s32NumOfVect > 0; s32NumOfVect--) {
+    SBC_FastIDCT4(ps32DCTY, ps32SbBuf);
+    ps32DCTY += SUB_BANDS_4 * 2;
+    ps32SbBuf += SUB_BANDS_4;
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         SbcFastIDCT8Simd
+ *
+ * Description      SBC_FastIDCT8 of 4 vectors at a time, the remaining ones
+ *                  with SBC_FastIDCT8
+ *
+ ******************************************************************************/
+static void SbcFastIDCT8Simd(int32_t* ps32DCTY, int32_t* ps32SbBuf,
+                             int32_t s32NumOfVect) {
+  SBC_V32 y[16], x0, x1, x2, x3, x4, x5, x6, x7, temp;
+  SBC_V32 res_even[4], res_odd[4];
+
+  for (; s32NumOfVect >= 4; s32NumOfVect -= 4) {
+    SbcVLoad4x4(ps32DCTY, SUB_BANDS_8 * 2, &y[0]);
+    SbcVLoad4x4(ps32DCTY + 4, SUB_BANDS_8 * 2, &y[4]);
+    SbcVLoad4x4(ps32DCTY + 8, SUB_BANDS_8 * 2, &y[8]);
+    SbcVLoad4x4(ps32DCTY + 12, SUB_BANDS_8 * 2, &y[12]);
+
+    x0 = SbcVMult(SBC_COS_PI_SUR_4, y[4]);
+    x1 = SBC_V_SHR1(SBC_V_ADD(y[3], y[5]));
+    x2 = SBC_V_SHR1(SBC_V_ADD(y[2], y[6]));
+    x3 = SBC_V_SHR1(SBC_V_ADD(y[1], y[7]));
+    x4 = SBC_V_SHR1(SBC_V_ADD(y[0], y[8]));
+    x5 = SBC_V_SHR1(SBC_V_SUB(y[9], y[15]));
+    x6 = SBC_V_SHR1(SBC_V_SUB(y[10], y[14]));
+    x7 = SBC_V_SHR1(SBC_V_SUB(y[11], y[13]));
+
+    /* The same steps as SBC_FastIDCT8 */
+    temp = x0;
+    x0 = SbcVMult(SBC_COS_PI_SUR_4, SBC_V_ADD(x0, x4));
+    x4 = SbcVMult(SBC_COS_PI_SUR_4, SBC_V_SUB(temp, x4));
+
+    x2 = SBC_V_SUB(x2, x6);
+    x6 = SbcVMult(SBC_COS_PI_SUR_4, SBC_V_SHL1(x6));
+    temp = x2;
+    x2 = SbcVMult(SBC_COS_PI_SUR_8, SBC_V_ADD(x2, x6));
+    x6 = SbcVMult(SBC_COS_3PI_SUR_8, SBC_V_SUB(temp, x6));
+
+    res_even[0] = SBC_V_ADD(x0, x2);
+    res_even[1] = SBC_V_ADD(x4, x6);
+    res_even[2] = SBC_V_SUB(x4, x6);
+    res_even[3] = SBC_V_SUB(x0, x2);
+
+    x7 = SBC_V_SHL1(x7);
+    x5 = SBC_V_SUB(SBC_V_SHL1(x5), x7);
+    x3 = SBC_V_SUB(SBC_V_SHL1(x3), x5);
+    x1 = SBC_V_SUB(x1, SBC_V_SHR1(x3));
+
+    x5 = SbcVMult(SBC_COS_PI_SUR_4, x5);
+    temp = x1;
+    x1 = SBC_V_ADD(x1, x5);
+    x5 = SBC_V_SUB(temp, x5);
+
+    x3 = SBC_V_SUB(x3, x7);
+    x7 = SbcVMult(SBC_COS_PI_SUR_4, SBC_V_SHL1(x7));
+    temp = x3;
+    x3 = SbcVMult(SBC_COS_PI_SUR_8, SBC_V_ADD(x3, x7));
+    x7 = SbcVMult(SBC_COS_3PI_SUR_8, SBC_V_SUB(temp, x7));
+
+    res_odd[0] = SbcVMult(SBC_COS_PI_SUR_16, SBC_V_ADD(x1, x3));
+    res_odd[1] = SbcVMult(SBC_COS_3PI_SUR_16, SBC_V_ADD(x5, x7));
+    res_odd[2] = SbcVMult(SBC_COS_5PI_SUR_16, SBC_V_SUB(x5, x7));
+    res_odd[3] = SbcVMult(SBC_COS_7PI_SUR_16, SBC_V_SUB(x1, x3));
+
+    SbcVStore4x4(ps32SbBuf, SUB_BANDS_8, SBC_V_ADD(res_even[0], res_odd[0]),
+                 SBC_V_ADD(res_even[1], res_odd[1]),
+                 SBC_V_ADD(res_even[2], res_odd[2]),
+                 SBC_V_ADD(res_even[3], res_odd[3]));
+    SbcVStore4x4(ps32SbBuf + 4, SUB_BANDS_8, SBC_V_SUB(res_even[3], res_odd[3]),
+                 SBC_V_SUB(res_even[2], res_odd[2]),
+                 SBC_V_SUB(res_even[1], res_odd[1]),
+                 SBC_V_SUB(res_even[0], res_odd[0]));
+
+    ps32DCTY += 4 * SUB_BANDS_8 * 2;
+    ps32SbBuf += 4 * SUB_BANDS_8;
+  }
+
+  for (; s32NumOfVect > 0; s32NumOfVect--) {
+    SBC_FastIDCT8(ps32DCTY, ps32SbBuf);
+    ps32DCTY += SUB_BANDS_8 * 2;
+    ps32SbBuf += SUB_BANDS_8;
+  }
+}
+
+#endif /* SBC_SIMD_SSE2 || SBC_SIMD_NEON */
+
+void SbcAnalysisSimdInit(SBC_ANALYSIS_FUNCS* pFuncs) {
+#if (SBC_SIMD_SSE2 == TRUE || SBC_SIMD_NEON == TRUE)
+  pFuncs->Window4 = SbcWindow4Simd;
+  pFuncs->Window8 = SbcWindow8Simd;
+  pFuncs->FastIDCT4 = SbcFastIDCT4Simd;
+  pFuncs->FastIDCT8 = SbcFastIDCT8Simd;
+#else
+  (void)pFuncs;
+#endif
+}
+
+#endif /* SBC_SIMD_ANALYSIS */
@@ -16,8 +16,12 @@
 
 #include "hci/acl_manager/acl_fragmenter.h"
 
+#include <algorithm>
+
 #include "os/log.h"
-#include "packet/fragmenting_inserter.h"
+#include "packet/bit_inserter.h"
+#include "packet/buffer_chain.h"
+#include "packet/view.h"
 
 namespace bluetooth {
 namespace hci {
@@ -26,11 +30,18 @@ namespace acl_manager {
 AclFragmenter::AclFragmenter(size_t mtu, std::unique_ptr<packet::BasePacketBuilder> packet)
     : mtu_(mtu), packet_(std::move(packet)) {}
 
-std::vector<std::unique_ptr<packet::RawBuilder>> AclFragmenter::GetFragments() {
-  std::vector<std::unique_ptr<packet::RawBuilder>> to_return;
-  packet::FragmentingInserter fragmenting_inserter(mtu_, std::back_insert_iterator(to_return));
-  packet_->Serialize(fragmenting_inserter);
-  fragmenting_inserter.finalize();
+std::vector<std::unique_ptr<packet::BasePacketBuilder>> AclFragmenter::GetFragments() {
+  auto bytes = std::make_shared<std::vector<uint8_t>>();
+  bytes->reserve(packet_->size());
+  packet::BitInserter it(*bytes);
+  packet_->Serialize(it);
+
+  std::vector<std::unique_ptr<packet::BasePacketBuilder>> to_return;
+  for (size_t begin = 0; begin < bytes->size(); begin += mtu_) {
+    auto fragment = std::make_unique<packet::BufferChain>();
+    fragment->Append(packet::View(bytes, begin, std::min(begin + mtu_, bytes->size())));
+    to_return.push_back(std::move(fragment));
+  }
   return to_return;
 }
 
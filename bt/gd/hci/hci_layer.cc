@@ -16,6 +16,8 @@
 
 #include "hci/hci_layer.h"
 
+#include <array>
+
 #include "common/bind.h"
 #include "common/init_flags.h"
 #include "hci/hci_metrics_logging.h"
@@ -241,22 +243,27 @@ struct HciLayer::impl {
         "Can not register handler for %02hhx (%s)",
         EventCode::LE_META_EVENT,
         EventCodeText(EventCode::LE_META_EVENT).c_str());
-    ASSERT_LOG(event_handlers_.count(event) == 0, "Can not register a second handler for %02hhx (%s)", event,
+    size_t index = EventCodeTableIndex(event);
+    ASSERT_LOG(index < kEventCodeTableSize, "Can not register handler for unknown event %02hhx", event);
+    ASSERT_LOG(event_handlers_[index].IsEmpty(), "Can not register a second handler for %02hhx (%s)", event,
                EventCodeText(event).c_str());
-    event_handlers_[event] = handler;
+    event_handlers_[index] = handler;
   }
 
   void unregister_event(EventCode event) {
-    event_handlers_.erase(event);
+    size_t index = EventCodeTableIndex(event);
+    if (index < kEventCodeTableSize) {
+      event_handlers_[index] = {};
+    }
   }
 
   void register_le_meta_event(ContextualCallback<void(EventView)> handler) {
     ASSERT_LOG(
-        event_handlers_.count(EventCode::LE_META_EVENT) == 0,
+        event_handlers_[EventCodeTableIndex(EventCode::LE_META_EVENT)].IsEmpty(),
         "Can not register a second handler for %02hhx (%s)",
         EventCode::LE_META_EVENT,
         EventCodeText(EventCode::LE_META_EVENT).c_str());
-    event_handlers_[EventCode::LE_META_EVENT] = handler;
+    event_handlers_[EventCodeTableIndex(EventCode::LE_META_EVENT)] = handler;
   }
 
   void unregister_le_meta_event() {
@@ -264,13 +271,18 @@ struct HciLayer::impl {
   }
 
   void register_le_event(SubeventCode event, ContextualCallback<void(LeMetaEventView)> handler) {
-    ASSERT_LOG(subevent_handlers_.count(event) == 0, "Can not register a second handler for %02hhx (%s)", event,
+    size_t index = SubeventCodeTableIndex(event);
+    ASSERT_LOG(index < kSubeventCodeTableSize, "Can not register handler for unknown le subevent %02hhx", event);
+    ASSERT_LOG(subevent_handlers_[index].IsEmpty(), "Can not register a second handler for %02hhx (%s)", event,
                SubeventCodeText(event).c_str());
-    subevent_handlers_[event] = handler;
+    subevent_handlers_[index] = handler;
   }
 
   void unregister_le_event(SubeventCode event) {
-    subevent_handlers_.erase(subevent_handlers_.find(event));
+    size_t index = SubeventCodeTableIndex(event);
+    if (index < kSubeventCodeTableSize) {
+      subevent_handlers_[index] = {};
+    }
   }
 
   static void abort_after_root_inflammation(uint8_t vse_error) {
@@ -312,22 +324,24 @@ struct HciLayer::impl {
         }
       }
     }
-    if (event_handlers_.find(event_code) == event_handlers_.end()) {
+    size_t index = EventCodeTableIndex(event_code);
+    if (index == kEventCodeTableSize || event_handlers_[index].IsEmpty()) {
       LOG_WARN("Unhandled event of type 0x%02hhx (%s)", event_code, EventCodeText(event_code).c_str());
       return;
     }
-    event_handlers_[event_code].Invoke(event);
+    event_handlers_[index].Invoke(event);
   }
 
   void on_le_meta_event(EventView event) {
     LeMetaEventView meta_event_view = LeMetaEventView::Create(event);
     ASSERT(meta_event_view.IsValid());
     SubeventCode subevent_code = meta_event_view.GetSubeventCode();
-    if (subevent_handlers_.find(subevent_code) == subevent_handlers_.end()) {
+    size_t index = SubeventCodeTableIndex(subevent_code);
+    if (index == kSubeventCodeTableSize || subevent_handlers_[index].IsEmpty()) {
       LOG_WARN("Unhandled le subevent of type 0x%02hhx (%s)", subevent_code, SubeventCodeText(subevent_code).c_str());
       return;
     }
-    subevent_handlers_[subevent_code].Invoke(meta_event_view);
+    subevent_handlers_[index].Invoke(meta_event_view);
   }
 
   hal::HciHal* hal_;
@@ -336,8 +350,9 @@ struct HciLayer::impl {
   // Command Handling
   std::list<CommandQueueEntry> command_queue_;
 
-  std::map<EventCode, ContextualCallback<void(EventView)>> event_handlers_;
-  std::map<SubeventCode, ContextualCallback<void(LeMetaEventView)>> subevent_handlers_;
+  // Indexed by EventCodeTableIndex() and SubeventCodeTableIndex()
+  std::array<ContextualCallback<void(EventView)>, kEventCodeTableSize> event_handlers_{};
+  std::array<ContextualCallback<void(LeMetaEventView)>, kSubeventCodeTableSize> subevent_handlers_{};
   OpCode waiting_command_{OpCode::NONE};
   uint8_t command_credits_{1};  // Send reset first
   Alarm* hci_timeout_alarm_{nullptr};
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "hal/snoop_logger.h"
+#include "hci/hci_packets.h"
+#include "packet/packet_view.h"
+
+using ::benchmark::State;
+using ::bluetooth::hal::SnoopLogger;
+using ::bluetooth::packet::kLittleEndian;
+using ::bluetooth::packet::PacketView;
+
+namespace bluetooth {
+namespace hci {
+namespace {
+
+// Set to the path of a btsnoop log (HCI UART datalink) to parse its packets instead of the packets below
+constexpr char kSnoopLogEnvironmentVariable[] = "BT_HCI_PACKETS_BENCHMARK_SNOOP_LOG";
+
+struct CapturedPacket {
+  SnoopLogger::PacketType type;
+  std::vector<uint8_t> bytes;
+};
+
+// The packets of hci_packets_test, and the events and data which come in between them during a scan and a connection
+const std::vector<CapturedPacket> kCapturedPackets = {
+    {SnoopLogger::PacketType::CMD, {0x0b, 0x20, 0x07, 0x01, 0x12, 0x00, 0x12, 0x00, 0x01, 0x00}},
+    {SnoopLogger::PacketType::EVT, {0x0e, 0x04, 0x01, 0x0b, 0x20, 0x00}},
+    {SnoopLogger::PacketType::CMD, {0x0c, 0x20, 0x02, 0x01, 0x00}},
+    {SnoopLogger::PacketType::EVT, {0x0e, 0x04, 0x01, 0x0c, 0x20, 0x00}},
+    {SnoopLogger::PacketType::CMD, {0x53, 0xfd, 0x00}},
+    {SnoopLogger::PacketType::EVT,
+     {0x0e, 0x0c, 0x01, 0x53, 0xfd, 0x00, 0x05, 0x01, 0x00, 0x04, 0x80, 0x01, 0x10, 0x01}},
+    {SnoopLogger::PacketType::EVT, {0x0e, 0x05, 0x01, 0x36, 0x20, 0x00, 0xf5}},
+    {SnoopLogger::PacketType::EVT, {0x0f, 0x04, 0x00, 0x01, 0x43, 0x20}},
+    {SnoopLogger::PacketType::EVT,
+     {0x3e, 0x0a, 0x03, 0x00, 0x02, 0x00, 0x18, 0x00, 0x00, 0x00, 0x48, 0x00}},
+    {SnoopLogger::PacketType::ACL, {0x02, 0x20, 0x08, 0x00, 0x04, 0x00, 0x40, 0x00, 0x01, 0x02, 0x03, 0x04}},
+    {SnoopLogger::PacketType::ACL, {0x02, 0x20, 0x08, 0x00, 0x04, 0x00, 0x40, 0x00, 0x05, 0x06, 0x07, 0x08}},
+    {SnoopLogger::PacketType::EVT, {0x13, 0x05, 0x01, 0x02, 0x00, 0x02, 0x00}},
+};
+
+std::vector<CapturedPacket> ReadSnoopLog(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<char> log((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  std::vector<CapturedPacket> packets;
+  size_t offset = sizeof(SnoopLogger::FileHeaderType);
+  while (offset + sizeof(SnoopLogger::PacketHeaderType) <= log.size()) {
+    SnoopLogger::PacketHeaderType header;
+    std::memcpy(&header, log.data() + offset, sizeof(header));
+    // The captured length counts the type byte, which is part of the header, so it can't be 0 in a valid log
+    size_t length_captured = ntohl(header.length_captured);
+    if (length_captured == 0) {
+      break;
+    }
+    size_t length = length_captured - 1;
+    offset += sizeof(header);
+    if (length > log.size() - offset) {
+      break;
+    }
+    packets.push_back({static_cast<SnoopLogger::PacketType>(header.type),
+                       std::vector<uint8_t>(log.begin() + offset, log.begin() + offset + length)});
+    offset += length;
+  }
+  return packets;
+}
+
+std::vector<CapturedPacket> GetCapturedPackets() {
+  const char* path = std::getenv(kSnoopLogEnvironmentVariable);
+  return path == nullptr ? kCapturedPackets : ReadSnoopLog(path);
+}
+
+// What the HCI layer reads from each event before passing it on
+void ParseEvent(EventView event) {
+  switch (event.GetEventCode()) {
+    case EventCode::COMMAND_COMPLETE: {
+      auto complete = CommandCompleteView::Create(event);
+      if (complete.IsValid()) {
+        benchmark::DoNotOptimize(complete.GetNumHciCommandPackets());
+        benchmark::DoNotOptimize(complete.GetCommandOpCode());
+      }
+      break;
+    }
+    case EventCode::COMMAND_STATUS: {
+      auto status = CommandStatusView::Create(event);
+      if (status.IsValid()) {
+        benchmark::DoNotOptimize(status.GetStatus());
+        benchmark::DoNotOptimize(status.GetCommandOpCode());
+      }
+      break;
+    }
+    case EventCode::LE_META_EVENT: {
+      auto meta_event = LeMetaEventView::Create(event);
+      if (meta_event.IsValid()) {
+        benchmark::DoNotOptimize(meta_event.GetSubeventCode());
+      }
+      break;
+    }
+    default:
+      benchmark::DoNotOptimize(EventCodeTableIndex(event.GetEventCode()));
+  }
+}
+
+void ParsePacket(const CapturedPacket& captured) {
+  PacketView<kLittleEndian> packet(std::make_shared<std::vector<uint8_t>>(captured.bytes));
+  switch (captured.type) {
+    case SnoopLogger::PacketType::CMD: {
+      auto command = CommandView::Create(packet);
+      if (command.IsValid()) {
+        benchmark::DoNotOptimize(command.GetOpCode());
+      }
+      break;
+    }
+    case SnoopLogger::PacketType::EVT: {
+      auto event = EventView::Create(packet);
+      if (event.IsValid()) {
+        ParseEvent(event);
+      }
+      break;
+    }
+    case SnoopLogger::PacketType::ACL: {
+      auto acl = AclView::Create(packet);
+      if (acl.IsValid()) {
+        benchmark::DoNotOptimize(acl.GetHandle());
+        benchmark::DoNotOptimize(acl.GetPacketBoundaryFlag());
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+static void BM_ParseSnoopLog(State& state) {
+  std::vector<CapturedPacket> packets = GetCapturedPackets();
+  size_t num_bytes = 0;
+  for (const auto& packet : packets) {
+    num_bytes += packet.bytes.size();
+  }
+  for (auto _ : state) {
+    for (const auto& packet : packets) {
+      ParsePacket(packet);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * packets.size());
+  state.SetBytesProcessed(state.iterations() * num_bytes);
+}
+BENCHMARK(BM_ParseSnoopLog);
+
+// Dispatch the events of the log through a flat table, the way the HCI layer does
+static void BM_DispatchEvents(State& state) {
+  std::vector<EventView> events;
+  for (const auto& packet : GetCapturedPackets()) {
+    if (packet.type != SnoopLogger::PacketType::EVT) {
+      continue;
+    }
+    auto event = EventView::Create(PacketView<kLittleEndian>(std::make_shared<std::vector<uint8_t>>(packet.bytes)));
+    if (event.IsValid()) {
+      events.push_back(event);
+    }
+  }
+  std::array<void (*)(EventView), kEventCodeTableSize> handlers{};
+  handlers[EventCodeTableIndex(EventCode::COMMAND_COMPLETE)] = ParseEvent;
+  handlers[EventCodeTableIndex(EventCode::COMMAND_STATUS)] = ParseEvent;
+  handlers[EventCodeTableIndex(EventCode::LE_META_EVENT)] = ParseEvent;
+  handlers[EventCodeTableIndex(EventCode::NUMBER_OF_COMPLETED_PACKETS)] = ParseEvent;
+  for (auto _ : state) {
+    for (const auto& event : events) {
+      size_t index = EventCodeTableIndex(event.GetEventCode());
+      if (index < kEventCodeTableSize && handlers[index] != nullptr) {
+        handlers[index](event);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_DispatchEvents);
+
+}  // namespace hci
+}  // namespace bluetooth
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -33,6 +34,9 @@ namespace os {
 // A message-queue style handler for reactor-based thread to handle incoming events from different threads. When it's
 // constructed, it will register a reactable on the specified thread; when it's destroyed, it will unregister itself
 // from the thread.
+//
+// Posting is lock-free: closures are linked into an intrusive multi-producer single-consumer queue, and the reactor is
+// only woken up once for all the closures posted until it runs them, in batches.
 class Handler : public common::IPostableContext {
  public:
   // Create and register a handler on given thread
@@ -97,15 +101,38 @@ class Handler : public common::IPostableContext {
   friend class RepeatingAlarm;
 
  private:
+  // A posted closure, linked into the queue of the handler
+  struct Task {
+    std::atomic<Task*> next{nullptr};
+    common::OnceClosure closure;
+  };
+
   inline bool was_cleared() const {
-    return tasks_ == nullptr;
+    return cleared_->load();
   };
-  std::queue<common::OnceClosure>* tasks_;
+  // Link |task| at the end of the queue. Safe to call from any thread.
+  void push(Task* task);
+  // Unlink the task at the front of the queue, or return nullptr if there is none. |busy| is set if a task is being
+  // pushed but can't be unlinked yet. Must be called with |mutex_| held.
+  Task* pop(bool* busy);
+  // Make the reactor call handle_next_event(), unless it's already going to
+  void wake_up();
+  void handle_next_event();
+
+  // Producers swap |head_|, the consumer owns |tail_|. |stub_| is linked whenever the queue would become empty, so
+  // that neither end is ever null.
+  std::atomic<Task*> head_;
+  Task* tail_;
+  Task stub_;
+  // Whether |fd_| was written and handle_next_event() hasn't started yet
+  std::atomic<bool> wakeup_pending_;
+  // Shared with handle_next_event(), which checks it after running each closure even if the handler is gone
+  std::shared_ptr<std::atomic<bool>> cleared_;
   Thread* thread_;
   int fd_;
   Reactor::Reactable* reactable_;
+  // Serializes the consumers of the queue: handle_next_event() and Clear()
   mutable std::mutex mutex_;
-  void handle_next_event();
 };
 
 }  // namespace os
@@ -20,6 +20,7 @@
 #include <unistd.h>
 
 #include <cstring>
+#include <thread>
 
 #include "common/bind.h"
 #include "common/callback.h"
@@ -27,16 +28,23 @@
 #include "os/reactor.h"
 #include "os/utils.h"
 
-#ifndef EFD_SEMAPHORE
-#define EFD_SEMAPHORE 1
-#endif
-
 namespace bluetooth {
 namespace os {
 using common::OnceClosure;
 
+namespace {
+// Upper bound on the closures run for a single reactor event, so that a flooded handler doesn't starve the other
+// reactables of its thread
+constexpr size_t kMaxTasksPerWakeup = 64;
+}  // namespace
+
 Handler::Handler(Thread* thread)
-    : tasks_(new std::queue<OnceClosure>()), thread_(thread), fd_(eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK)) {
+    : head_(&stub_),
+      tail_(&stub_),
+      wakeup_pending_(false),
+      cleared_(std::make_shared<std::atomic<bool>>(false)),
+      thread_(thread),
+      fd_(eventfd(0, EFD_NONBLOCK)) {
   ASSERT(fd_ != -1);
   reactable_ = thread_->GetReactor()->Register(
       fd_, common::Bind(&Handler::handle_next_event, common::Unretained(this)), common::Closure());
@@ -46,6 +54,17 @@ Handler::~Handler() {
   {
     std::lock_guard<std::mutex> lock(mutex_);
     ASSERT_LOG(was_cleared(), "Handlers must be cleared before they are destroyed");
+    // Closures posted while the handler was being cleared, including ones still being pushed
+    bool busy;
+    do {
+      busy = false;
+      while (Task* task = pop(&busy)) {
+        delete task;
+      }
+      if (busy) {
+        std::this_thread::yield();
+      }
+    } while (busy);
   }
 
   int close_status;
@@ -54,27 +73,26 @@ Handler::~Handler() {
 }
 
 void Handler::Post(OnceClosure closure) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (was_cleared()) {
-      LOG_WARN("Posting to a handler which has been cleared");
-      return;
-    }
-    tasks_->emplace(std::move(closure));
+  if (was_cleared()) {
+    LOG_WARN("Posting to a handler which has been cleared");
+    return;
   }
-  uint64_t val = 1;
-  auto write_result = eventfd_write(fd_, val);
-  ASSERT(write_result != -1);
+  Task* task = new Task();
+  task->closure = std::move(closure);
+  push(task);
+  wake_up();
 }
 
 void Handler::Clear() {
-  std::queue<OnceClosure>* tmp = nullptr;
   {
     std::lock_guard<std::mutex> lock(mutex_);
     ASSERT_LOG(!was_cleared(), "Handlers must only be cleared once");
-    std::swap(tasks_, tmp);
+    cleared_->store(true);
+    bool busy = false;
+    while (Task* task = pop(&busy)) {
+      delete task;
+    }
   }
-  delete tmp;
 
   uint64_t val;
   while (eventfd_read(fd_, &val) == 0) {
@@ -89,8 +107,59 @@ void Handler::WaitUntilStopped(std::chrono::milliseconds timeout) {
   ASSERT(thread_->GetReactor()->WaitForUnregisteredReactable(timeout));
 }
 
+void Handler::push(Task* task) {
+  task->next.store(nullptr, std::memory_order_relaxed);
+  Task* prev = head_.exchange(task, std::memory_order_acq_rel);
+  prev->next.store(task, std::memory_order_release);
+}
+
+Handler::Task* Handler::pop(bool* busy) {
+  Task* tail = tail_;
+  Task* next = tail->next.load(std::memory_order_acquire);
+  if (tail == &stub_) {
+    if (next == nullptr) {
+      *busy = head_.load(std::memory_order_acquire) != &stub_;
+      return nullptr;
+    }
+    tail_ = next;
+    tail = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next != nullptr) {
+    tail_ = next;
+    return tail;
+  }
+  if (tail != head_.load(std::memory_order_acquire)) {
+    // A producer swapped |head_| but hasn't linked its task yet
+    *busy = true;
+    return nullptr;
+  }
+  // |tail| is the last task: link the stub after it so that it can be unlinked
+  push(&stub_);
+  next = tail->next.load(std::memory_order_acquire);
+  if (next != nullptr) {
+    tail_ = next;
+    return tail;
+  }
+  *busy = true;
+  return nullptr;
+}
+
+void Handler::wake_up() {
+  // Pairs with the exchange in handle_next_event(): either it sees this flag and the task pushed before it, or this
+  // exchange sees it reset and writes a new event
+  if (wakeup_pending_.exchange(true, std::memory_order_seq_cst)) {
+    return;
+  }
+  auto write_result = eventfd_write(fd_, 1);
+  ASSERT(write_result != -1);
+}
+
 void Handler::handle_next_event() {
-  common::OnceClosure closure;
+  // The handler may be cleared and destroyed by one of the closures, keep the flag around to check it
+  std::shared_ptr<std::atomic<bool>> cleared = cleared_;
+  Task* tasks[kMaxTasksPerWakeup];
+  size_t num_tasks = 0;
   {
     std::lock_guard<std::mutex> lock(mutex_);
     uint64_t val = 0;
@@ -101,10 +170,30 @@ void Handler::handle_next_event() {
     }
     ASSERT_LOG(read_result != -1, "eventfd read error %d %s", errno, strerror(errno));
 
-    closure = std::move(tasks_->front());
-    tasks_->pop();
+    // Posts from now on need a new event; the ones already in the queue are run below or by the next event. This has to
+    // be a read-modify-write: a plain store could become visible after the pops below, and a Post() in between would
+    // then neither be popped nor write an event.
+    wakeup_pending_.exchange(false, std::memory_order_seq_cst);
+    bool busy = false;
+    while (num_tasks < kMaxTasksPerWakeup) {
+      Task* task = pop(&busy);
+      if (task == nullptr) {
+        break;
+      }
+      tasks[num_tasks++] = task;
+    }
+    if (num_tasks == kMaxTasksPerWakeup || busy) {
+      // Let the reactor come back for the rest after the other ready reactables
+      wake_up();
+    }
+  }
+
+  for (size_t i = 0; i < num_tasks; i++) {
+    if (!cleared->load()) {
+      std::move(tasks[i]->closure).Run();
+    }
+    delete tasks[i];
   }
-  std::move(closure).Run();
 }
 
 }  // namespace os
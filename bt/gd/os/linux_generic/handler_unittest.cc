@@ -20,6 +20,7 @@
 
 #include <future>
 #include <thread>
+#include <vector>
 
 #include "common/bind.h"
 #include "common/callback.h"
@@ -110,6 +111,72 @@ TEST_F(HandlerTest, callback_with_promise) {
   handler_->Clear();
 }
 
+TEST_F(HandlerTest, post_tasks_run_in_order) {
+  // More tasks than are run for a single wakeup of the reactor
+  constexpr int kNumTasks = 1000;
+  std::vector<int> order;
+  std::promise<void> promise;
+  auto future = promise.get_future();
+  for (int i = 0; i < kNumTasks; i++) {
+    handler_->Post(common::BindOnce([](std::vector<int>* order, int i) { order->push_back(i); },
+                                    common::Unretained(&order), i));
+  }
+  handler_->Post(common::BindOnce(&std::promise<void>::set_value, common::Unretained(&promise)));
+  future.wait();
+  ASSERT_EQ(order.size(), static_cast<size_t>(kNumTasks));
+  for (int i = 0; i < kNumTasks; i++) {
+    ASSERT_EQ(order[i], i);
+  }
+  handler_->Clear();
+}
+
+TEST_F(HandlerTest, post_tasks_from_multiple_threads) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumTasksPerThread = 1000;
+  // Only accessed from the handler thread
+  std::vector<int> next_task(kNumThreads, 0);
+  int num_tasks_run = 0;
+  std::promise<void> promise;
+  auto future = promise.get_future();
+  auto task = [&](int thread, int i) {
+    ASSERT_EQ(next_task[thread], i);
+    next_task[thread]++;
+    if (++num_tasks_run == kNumThreads * kNumTasksPerThread) {
+      promise.set_value();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kNumThreads; thread++) {
+    threads.emplace_back([this, &task, thread]() {
+      for (int i = 0; i < kNumTasksPerThread; i++) {
+        handler_->Post(common::BindOnce(task, thread, i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  future.wait();
+  for (int thread = 0; thread < kNumThreads; thread++) {
+    ASSERT_EQ(next_task[thread], kNumTasksPerThread);
+  }
+  handler_->Clear();
+}
+
+TEST_F(HandlerTest, post_task_from_task) {
+  std::promise<void> promise;
+  auto future = promise.get_future();
+  handler_->Post(common::BindOnce(
+      [](Handler* handler, std::promise<void>* promise) {
+        handler->Post(common::BindOnce(&std::promise<void>::set_value, common::Unretained(promise)));
+      },
+      common::Unretained(handler_),
+      common::Unretained(&promise)));
+  future.wait();
+  handler_->Clear();
+}
+
 // For Death tests, all the threading needs to be done in the ASSERT_DEATH call
 class HandlerDeathTest : public ::testing::Test {
  protected:
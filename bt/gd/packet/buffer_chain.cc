@@ -0,0 +1,119 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet/buffer_chain.h"
+
+#include <algorithm>
+
+#include "os/log.h"
+
+namespace bluetooth {
+namespace packet {
+
+BufferChain::BufferChain(const PacketView<kLittleEndian>& packet) {
+  Append(packet);
+}
+
+size_t BufferChain::size() const {
+  return size_;
+}
+
+void BufferChain::Serialize(BitInserter& it) const {
+  for (const auto& fragment : fragments_) {
+    const uint8_t* bytes = fragment.data();
+    for (size_t i = 0; i < fragment.size(); i++) {
+      it.insert_byte(bytes[i]);
+    }
+  }
+}
+
+uint8_t* BufferChain::Prepend(size_t num_bytes) {
+  size_ += num_bytes;
+  // The headroom is free as long as nothing was prepended to the buffer since the first fragment was made
+  if (front_buffer_ != nullptr && fragments_.front().data() == front_buffer_->data() &&
+      num_bytes <= front_buffer_->headroom()) {
+    size_t fragment_size = fragments_.front().size();
+    uint8_t* bytes = front_buffer_->Prepend(num_bytes);
+    fragments_.front() = View(front_buffer_, 0, num_bytes + fragment_size);
+    return bytes;
+  }
+  front_buffer_ = PacketBuffer::Create(num_bytes);
+  fragments_.emplace_front(front_buffer_, 0, num_bytes);
+  if (fragments_.size() == 1) {
+    back_buffer_ = front_buffer_;
+  }
+  return front_buffer_->data();
+}
+
+uint8_t* BufferChain::Append(size_t num_bytes) {
+  size_ += num_bytes;
+  if (back_buffer_ != nullptr && num_bytes <= back_buffer_->tailroom()) {
+    const View& back = fragments_.back();
+    size_t offset = back.data() - back_buffer_->data();
+    // Same as for Prepend(), the fragment must end where the buffer does
+    if (offset + back.size() == back_buffer_->size()) {
+      uint8_t* bytes = back_buffer_->Append(num_bytes);
+      fragments_.back() = View(back_buffer_, offset, offset + back.size() + num_bytes);
+      return bytes;
+    }
+  }
+  back_buffer_ = PacketBuffer::Create(num_bytes, 0, PacketBuffer::kDefaultTailroom);
+  fragments_.emplace_back(back_buffer_, 0, num_bytes);
+  if (fragments_.size() == 1) {
+    front_buffer_ = back_buffer_;
+  }
+  return back_buffer_->data();
+}
+
+void BufferChain::Append(const View& view) {
+  if (view.size() == 0) {
+    return;
+  }
+  fragments_.push_back(view);
+  size_ += view.size();
+  back_buffer_ = nullptr;
+}
+
+void BufferChain::Append(const PacketView<kLittleEndian>& packet) {
+  for (const auto& fragment : packet.fragments_) {
+    Append(fragment);
+  }
+}
+
+std::unique_ptr<BufferChain> BufferChain::Slice(size_t begin, size_t end) const {
+  ASSERT(begin <= end);
+  ASSERT(end <= size_);
+
+  auto slice = std::make_unique<BufferChain>();
+  size_t length = end - begin;
+  for (const auto& fragment : fragments_) {
+    if (length == 0) {
+      break;
+    }
+    if (begin >= fragment.size()) {
+      begin -= fragment.size();
+      continue;
+    }
+    size_t fragment_length = std::min(length, fragment.size() - begin);
+    slice->Append(View(fragment, begin, begin + fragment_length));
+    length -= fragment_length;
+    begin = 0;
+  }
+  return slice;
+}
+
+}  // namespace packet
+}  // namespace bluetooth
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "packet/bit_inserter.h"
+#include "packet/packet_buffer.h"
+#include "packet/packet_builder.h"
+#include "packet/packet_view.h"
+#include "packet/view.h"
+
+namespace bluetooth {
+namespace packet {
+
+// A packet made of slices of shared buffers (a scatter/gather list), which are only copied when the packet is
+// serialized. Received payloads can be forwarded and big packets fragmented without copying their bytes into the
+// builder of each layer.
+class BufferChain : public PacketBuilder<kLittleEndian> {
+ public:
+  BufferChain() = default;
+  explicit BufferChain(const PacketView<kLittleEndian>& packet);
+  BufferChain(const BufferChain&) = delete;
+  BufferChain& operator=(const BufferChain&) = delete;
+  virtual ~BufferChain() = default;
+
+  virtual size_t size() const override;
+
+  virtual void Serialize(BitInserter& it) const override;
+
+  // Add |num_bytes| bytes in front of the chain, and return them to be written. They are taken from the headroom of
+  // the first buffer if it was added by a previous call, otherwise from a new buffer.
+  uint8_t* Prepend(size_t num_bytes);
+
+  // Add |num_bytes| bytes at the end of the chain, and return them to be written. They are taken from the tailroom of
+  // the last buffer if it was added by a previous call, otherwise from a new buffer.
+  uint8_t* Append(size_t num_bytes);
+
+  // Add the bytes of |view| at the end of the chain, without copying them
+  void Append(const View& view);
+
+  void Append(const PacketView<kLittleEndian>& packet);
+
+  // Return the bytes in [begin, end) of the chain, without copying them
+  std::unique_ptr<BufferChain> Slice(size_t begin, size_t end) const;
+
+ private:
+  std::deque<View> fragments_;
+  size_t size_{0};
+  // Buffers created by this chain, which it can grow in place while they are at either end of the chain
+  std::shared_ptr<PacketBuffer> front_buffer_;
+  std::shared_ptr<PacketBuffer> back_buffer_;
+};
+
+}  // namespace packet
+}  // namespace bluetooth
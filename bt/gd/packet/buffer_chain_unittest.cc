@@ -0,0 +1,133 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet/buffer_chain.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+
+using std::vector;
+
+namespace {
+vector<uint8_t> count = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+};
+
+}  // namespace
+
+namespace bluetooth {
+namespace packet {
+
+static vector<uint8_t> Serialize(const BufferChain& chain) {
+  vector<uint8_t> bytes;
+  BitInserter it(bytes);
+  chain.Serialize(it);
+  return bytes;
+}
+
+TEST(BufferChainTest, fromPacketViewTest) {
+  auto bytes = std::make_shared<vector<uint8_t>>(count);
+  PacketView<kLittleEndian> packet(bytes);
+  BufferChain chain(packet.GetLittleEndianSubview(4, 20));
+  ASSERT_EQ(16u, chain.size());
+  ASSERT_EQ(vector<uint8_t>(count.begin() + 4, count.begin() + 20), Serialize(chain));
+}
+
+TEST(BufferChainTest, appendViewsTest) {
+  auto bytes = std::make_shared<vector<uint8_t>>(count);
+  BufferChain chain;
+  chain.Append(View(bytes, 0, 10));
+  chain.Append(View(bytes, 10, 10));
+  chain.Append(View(bytes, 10, count.size()));
+  ASSERT_EQ(count.size(), chain.size());
+  ASSERT_EQ(count, Serialize(chain));
+}
+
+TEST(BufferChainTest, prependHeadersInPlaceTest) {
+  auto bytes = std::make_shared<vector<uint8_t>>(count);
+  BufferChain chain;
+  chain.Append(View(bytes, 4, count.size()));
+
+  uint8_t* header = chain.Prepend(2);
+  header[0] = 0x02;
+  header[1] = 0x03;
+  const uint8_t* first_header = header;
+  header = chain.Prepend(2);
+  header[0] = 0x00;
+  header[1] = 0x01;
+  // The second header went in the headroom of the buffer of the first one
+  ASSERT_EQ(first_header - 2, header);
+
+  ASSERT_EQ(count.size(), chain.size());
+  ASSERT_EQ(count, Serialize(chain));
+}
+
+TEST(BufferChainTest, appendTrailersInPlaceTest) {
+  auto bytes = std::make_shared<vector<uint8_t>>(count);
+  BufferChain chain;
+  chain.Append(View(bytes, 0, 28));
+
+  uint8_t* trailer = chain.Append(2);
+  trailer[0] = 0x1c;
+  trailer[1] = 0x1d;
+  const uint8_t* first_trailer = trailer;
+  trailer = chain.Append(2);
+  trailer[0] = 0x1e;
+  trailer[1] = 0x1f;
+  ASSERT_EQ(first_trailer + 2, trailer);
+
+  ASSERT_EQ(count.size(), chain.size());
+  ASSERT_EQ(count, Serialize(chain));
+}
+
+TEST(BufferChainTest, sliceTest) {
+  auto bytes = std::make_shared<vector<uint8_t>>(count);
+  BufferChain chain;
+  chain.Append(View(bytes, 0, 5));
+  chain.Append(View(bytes, 5, 17));
+  chain.Append(View(bytes, 17, count.size()));
+
+  for (size_t begin = 0; begin < count.size(); begin += 7) {
+    size_t end = std::min(begin + 7, count.size());
+    auto slice = chain.Slice(begin, end);
+    ASSERT_EQ(end - begin, slice->size());
+    ASSERT_EQ(vector<uint8_t>(count.begin() + begin, count.begin() + end), Serialize(*slice));
+  }
+  ASSERT_EQ(0u, chain.Slice(3, 3)->size());
+}
+
+TEST(BufferChainTest, sliceDoesNotShareHeadroomTest) {
+  BufferChain chain;
+  uint8_t* payload = chain.Prepend(4);
+  for (size_t i = 0; i < 4; i++) {
+    payload[i] = 0x10 + i;
+  }
+  auto slice = chain.Slice(0, 4);
+
+  // Prepending to the slice must not overwrite the header of the chain
+  uint8_t* header = chain.Prepend(1);
+  header[0] = 0x0f;
+  header = slice->Prepend(1);
+  header[0] = 0xff;
+
+  ASSERT_EQ(vector<uint8_t>({0x0f, 0x10, 0x11, 0x12, 0x13}), Serialize(chain));
+  ASSERT_EQ(vector<uint8_t>({0xff, 0x10, 0x11, 0x12, 0x13}), Serialize(*slice));
+}
+
+}  // namespace packet
+}  // namespace bluetooth
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet/packet_buffer.h"
+
+#include <array>
+#include <mutex>
+#include <vector>
+
+#include "os/log.h"
+
+namespace bluetooth {
+namespace packet {
+
+namespace {
+
+// Sizes of the slab blocks: LE and classic ACL packets, and the L2CAP SDUs made of them. Bigger buffers come from the
+// heap.
+constexpr std::array<size_t, 4> kBlockSizes = {256, 1024, 4096, 16384};
+// Number of free blocks kept per size, beyond which blocks are given back to the heap
+constexpr size_t kMaxFreeBlocks = 32;
+
+class Slab {
+ public:
+  // Return the index of the smallest block size fitting |capacity|, or kBlockSizes.size() if there is none
+  static size_t SizeClass(size_t capacity) {
+    size_t size_class = 0;
+    while (size_class < kBlockSizes.size() && kBlockSizes[size_class] < capacity) {
+      size_class++;
+    }
+    return size_class;
+  }
+
+  uint8_t* Allocate(size_t size_class) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto& free_blocks = free_blocks_[size_class];
+      if (!free_blocks.empty()) {
+        uint8_t* block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+      }
+    }
+    return new uint8_t[kBlockSizes[size_class]];
+  }
+
+  void Free(size_t size_class, uint8_t* block) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto& free_blocks = free_blocks_[size_class];
+      if (free_blocks.size() < kMaxFreeBlocks) {
+        free_blocks.push_back(block);
+        return;
+      }
+    }
+    delete[] block;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::array<std::vector<uint8_t*>, kBlockSizes.size()> free_blocks_;
+};
+
+// Never destroyed, as buffers may be released from static destructors
+Slab* GetSlab() {
+  static Slab* slab = new Slab();
+  return slab;
+}
+
+}  // namespace
+
+std::shared_ptr<PacketBuffer> PacketBuffer::Create(size_t size, size_t headroom, size_t tailroom) {
+  size_t capacity = headroom + size + tailroom;
+  size_t size_class = Slab::SizeClass(capacity);
+  uint8_t* storage;
+  if (size_class < kBlockSizes.size()) {
+    storage = GetSlab()->Allocate(size_class);
+    capacity = kBlockSizes[size_class];
+  } else {
+    storage = new uint8_t[capacity];
+  }
+  return std::make_shared<PacketBuffer>(ConstructorTag(), storage, capacity, headroom, headroom + size);
+}
+
+PacketBuffer::PacketBuffer(ConstructorTag, uint8_t* storage, size_t capacity, size_t begin, size_t end)
+    : storage_(storage), capacity_(capacity), begin_(begin), end_(end) {}
+
+PacketBuffer::~PacketBuffer() {
+  size_t size_class = Slab::SizeClass(capacity_);
+  if (size_class < kBlockSizes.size() && kBlockSizes[size_class] == capacity_) {
+    GetSlab()->Free(size_class, storage_);
+  } else {
+    delete[] storage_;
+  }
+}
+
+uint8_t* PacketBuffer::Prepend(size_t num_bytes) {
+  ASSERT_LOG(num_bytes <= headroom(), "Prepending %zu bytes with %zu bytes of headroom", num_bytes, headroom());
+  begin_ -= num_bytes;
+  return data();
+}
+
+uint8_t* PacketBuffer::Append(size_t num_bytes) {
+  ASSERT_LOG(num_bytes <= tailroom(), "Appending %zu bytes with %zu bytes of tailroom", num_bytes, tailroom());
+  uint8_t* appended = storage_ + end_;
+  end_ += num_bytes;
+  return appended;
+}
+
+}  // namespace packet
+}  // namespace bluetooth
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace bluetooth {
+namespace packet {
+
+// Contiguous bytes of a packet, with room reserved in front of and after them so that headers and trailers can be
+// added without moving the data. The storage comes from per-size slabs and is recycled when the last reference to the
+// buffer goes away, so that buffers of the usual ACL and SDU sizes don't hit the heap.
+//
+// Buffers are shared between views and builders through std::shared_ptr. The bytes seen by a view are never modified,
+// but whoever created the buffer may keep growing it into its headroom and tailroom.
+class PacketBuffer {
+  struct ConstructorTag {};
+
+ public:
+  // Enough for the HCI ACL and the L2CAP headers in front of a payload
+  static constexpr size_t kDefaultHeadroom = 16;
+  // Enough for the L2CAP FCS and the trailers of a payload
+  static constexpr size_t kDefaultTailroom = 16;
+
+  // Create a buffer of |size| bytes, which can grow by |headroom| bytes at the front and |tailroom| bytes at the back.
+  // The bytes are not initialized.
+  static std::shared_ptr<PacketBuffer> Create(size_t size, size_t headroom = kDefaultHeadroom, size_t tailroom = 0);
+
+  PacketBuffer(ConstructorTag, uint8_t* storage, size_t capacity, size_t begin, size_t end);
+  PacketBuffer(const PacketBuffer&) = delete;
+  PacketBuffer& operator=(const PacketBuffer&) = delete;
+  ~PacketBuffer();
+
+  uint8_t* data() {
+    return storage_ + begin_;
+  }
+  const uint8_t* data() const {
+    return storage_ + begin_;
+  }
+  size_t size() const {
+    return end_ - begin_;
+  }
+  size_t headroom() const {
+    return begin_;
+  }
+  size_t tailroom() const {
+    return capacity_ - end_;
+  }
+
+  // Grow the buffer by |num_bytes| at the front, and return a pointer to the new bytes
+  uint8_t* Prepend(size_t num_bytes);
+
+  // Grow the buffer by |num_bytes| at the back, and return a pointer to the new bytes
+  uint8_t* Append(size_t num_bytes);
+
+ private:
+  uint8_t* storage_;
+  size_t capacity_;
+  size_t begin_;
+  size_t end_;
+};
+
+}  // namespace packet
+}  // namespace bluetooth
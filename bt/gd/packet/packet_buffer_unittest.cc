@@ -0,0 +1,96 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet/packet_buffer.h"
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <memory>
+
+#include "packet/packet_view.h"
+#include "packet/view.h"
+
+namespace bluetooth {
+namespace packet {
+
+TEST(PacketBufferTest, createTest) {
+  auto buffer = PacketBuffer::Create(10, 4, 2);
+  ASSERT_EQ(10u, buffer->size());
+  ASSERT_EQ(4u, buffer->headroom());
+  ASSERT_LE(2u, buffer->tailroom());
+}
+
+TEST(PacketBufferTest, bigBufferTest) {
+  auto buffer = PacketBuffer::Create(100000, 0, 0);
+  ASSERT_EQ(100000u, buffer->size());
+  ASSERT_EQ(0u, buffer->tailroom());
+  memset(buffer->data(), 0xab, buffer->size());
+}
+
+TEST(PacketBufferTest, prependAppendTest) {
+  auto buffer = PacketBuffer::Create(2, 2, 0);
+  buffer->data()[0] = 0x02;
+  buffer->data()[1] = 0x03;
+  uint8_t* tail = buffer->Append(1);
+  tail[0] = 0x04;
+  uint8_t* head = buffer->Prepend(2);
+  head[0] = 0x00;
+  head[1] = 0x01;
+
+  ASSERT_EQ(0u, buffer->headroom());
+  ASSERT_EQ(5u, buffer->size());
+  for (size_t i = 0; i < buffer->size(); i++) {
+    ASSERT_EQ(i, buffer->data()[i]);
+  }
+}
+
+TEST(PacketBufferTest, viewTest) {
+  auto buffer = PacketBuffer::Create(4, 2);
+  for (size_t i = 0; i < buffer->size(); i++) {
+    buffer->data()[i] = i + 2;
+  }
+  View view(buffer, 1, 3);
+  ASSERT_EQ(2u, view.size());
+  ASSERT_EQ(3, view[0]);
+  ASSERT_EQ(4, view[1]);
+
+  // Views keep seeing the same bytes when the buffer grows
+  uint8_t* head = buffer->Prepend(2);
+  head[0] = 0;
+  head[1] = 1;
+  ASSERT_EQ(3, view[0]);
+  ASSERT_EQ(buffer->data() + 3, view.data());
+
+  PacketView<kLittleEndian> packet_view(buffer);
+  ASSERT_EQ(6u, packet_view.size());
+  for (size_t i = 0; i < packet_view.size(); i++) {
+    ASSERT_EQ(i, packet_view[i]);
+  }
+}
+
+TEST(PacketBufferTest, reuseTest) {
+  uint8_t* data;
+  {
+    auto buffer = PacketBuffer::Create(100, 0);
+    data = buffer->data();
+  }
+  // The block of a released buffer is handed out again for the same size
+  auto buffer = PacketBuffer::Create(100, 0);
+  ASSERT_EQ(data, buffer->data());
+}
+
+}  // namespace packet
+}  // namespace bluetooth
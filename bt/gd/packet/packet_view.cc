@@ -26,7 +26,7 @@ namespace packet {
 template <bool little_endian>
 PacketView<little_endian>::PacketView(const std::forward_list<class View> fragments)
     : fragments_(fragments), length_(0) {
-  for (auto fragment : fragments_) {
+  for (const auto& fragment : fragments_) {
     length_ += fragment.size();
   }
 }
@@ -35,6 +35,10 @@ template <bool little_endian>
 PacketView<little_endian>::PacketView(std::shared_ptr<std::vector<uint8_t>> packet)
     : fragments_({View(packet, 0, packet->size())}), length_(packet->size()) {}
 
+template <bool little_endian>
+PacketView<little_endian>::PacketView(std::shared_ptr<const PacketBuffer> packet)
+    : fragments_({View(packet, 0, packet->size())}), length_(packet->size()) {}
+
 template <bool little_endian>
 Iterator<little_endian> PacketView<little_endian>::begin() const {
   return Iterator<little_endian>(this->fragments_, 0);
@@ -18,8 +18,11 @@
 
 #include <cstdint>
 #include <forward_list>
+#include <type_traits>
 
+#include "packet/custom_field_fixed_size_interface.h"
 #include "packet/iterator.h"
+#include "packet/packet_buffer.h"
 #include "packet/view.h"
 
 namespace bluetooth {
@@ -27,6 +30,8 @@ namespace packet {
 
 static const bool kLittleEndian = true;
 
+class BufferChain;
+
 // Abstract base class that is subclassed to provide type-specifc accessors.
 // Holds a shared pointer to the underlying data.
 // The template parameter little_endian controls the generation of extract().
@@ -36,6 +41,7 @@ class PacketView {
   explicit PacketView(std::forward_list<View> fragments);
   PacketView(const PacketView& PacketView) = default;
   explicit PacketView(std::shared_ptr<std::vector<uint8_t>> packet);
+  explicit PacketView(std::shared_ptr<const PacketBuffer> packet);
   PacketView<little_endian>() = delete;
   virtual ~PacketView() = default;
 
@@ -53,10 +59,43 @@ class PacketView {
 
   PacketView<false> GetBigEndianSubview(size_t begin, size_t end) const;
 
+  // Same as (begin() + byte_offset).extract<T>(), without copying the fragment list when the bytes are all in the first
+  // fragment. Generated views use it for the fields which have a fixed offset in the packet.
+  template <typename FixedWidthPODType, typename std::enable_if<std::is_pod<FixedWidthPODType>::value, int>::type = 0>
+  FixedWidthPODType extract_at(size_t byte_offset) const {
+    if (fragments_.empty() || byte_offset + sizeof(FixedWidthPODType) > fragments_.front().size()) {
+      return (begin() + byte_offset).template extract<FixedWidthPODType>();
+    }
+    FixedWidthPODType extracted_value{};
+    uint8_t* value_ptr = (uint8_t*)&extracted_value;
+    const uint8_t* bytes = fragments_.front().data() + byte_offset;
+    for (size_t i = 0; i < sizeof(FixedWidthPODType); i++) {
+      size_t index = (little_endian ? i : sizeof(FixedWidthPODType) - i - 1);
+      value_ptr[index] = bytes[i];
+    }
+    return extracted_value;
+  }
+
+  template <typename T, typename std::enable_if<std::is_base_of_v<CustomFieldFixedSizeInterface<T>, T>, int>::type = 0>
+  T extract_at(size_t byte_offset) const {
+    size_t length = CustomFieldFixedSizeInterface<T>::length();
+    if (fragments_.empty() || byte_offset + length > fragments_.front().size()) {
+      return (begin() + byte_offset).template extract<T>();
+    }
+    T extracted_value{};
+    const uint8_t* bytes = fragments_.front().data() + byte_offset;
+    for (size_t i = 0; i < length; i++) {
+      size_t index = (little_endian ? i : length - i - 1);
+      extracted_value.data()[index] = bytes[i];
+    }
+    return extracted_value;
+  }
+
  protected:
   void Append(PacketView to_add);
 
  private:
+  friend class BufferChain;
   std::forward_list<View> fragments_;
   size_t length_;
   std::forward_list<View> GetSubviewList(size_t begin, size_t end) const;
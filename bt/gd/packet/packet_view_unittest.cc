@@ -157,6 +157,28 @@ TEST(IteratorExtractTest, extractBeTest) {
   ASSERT_EQ(0x16, general_case.extract<uint8_t>());
 }
 
+TEST(IteratorExtractTest, extractAtLeTest) {
+  PacketView<true> packet({View(std::make_shared<const vector<uint8_t>>(count_all), 0, count_all.size())});
+
+  ASSERT_EQ(0x00, packet.extract_at<uint8_t>(0));
+  ASSERT_EQ(0x0201, packet.extract_at<uint16_t>(1));
+  ASSERT_EQ(0x06050403u, packet.extract_at<uint32_t>(3));
+  ASSERT_EQ(0x0e0d0c0b0a090807u, packet.extract_at<uint64_t>(7));
+  Address raw({0x10, 0x11, 0x12, 0x13, 0x14, 0x15});
+  ASSERT_EQ(raw, packet.extract_at<Address>(16));
+}
+
+TEST(IteratorExtractTest, extractAtBeTest) {
+  PacketView<false> packet({View(std::make_shared<const vector<uint8_t>>(count_all), 0, count_all.size())});
+
+  ASSERT_EQ(0x00, packet.extract_at<uint8_t>(0));
+  ASSERT_EQ(0x0102, packet.extract_at<uint16_t>(1));
+  ASSERT_EQ(0x03040506u, packet.extract_at<uint32_t>(3));
+  ASSERT_EQ(0x0708090a0b0c0d0eu, packet.extract_at<uint64_t>(7));
+  Address raw({0x15, 0x14, 0x13, 0x12, 0x11, 0x10});
+  ASSERT_EQ(raw, packet.extract_at<Address>(16));
+}
+
 TYPED_TEST(IteratorTest, extractBoundsDeathTest) {
   auto bounds_test = this->packet->end();
 
@@ -545,6 +567,14 @@ TEST_F(PacketViewMultiViewTest, dereferenceTestBigEndian) {
   ASSERT_DEATH(*multi_itr, "");
 }
 
+TEST_F(PacketViewMultiViewTest, extractAtTest) {
+  // Across fragments, and past the first one
+  for (size_t i = 0; i + sizeof(uint32_t) <= count_all.size(); i++) {
+    ASSERT_EQ(single_view.extract_at<uint32_t>(i), multi_view.extract_at<uint32_t>(i));
+  }
+  ASSERT_EQ(single_view.extract_at<Address>(1), multi_view.extract_at<Address>(1));
+}
+
 TEST_F(PacketViewMultiViewTest, arrayOperatorTest) {
   for (size_t i = 0; i < single_view.size(); i++) {
     ASSERT_EQ(single_view[i], multi_view[i]);
@@ -60,6 +60,23 @@ void EnumGen::GenLogging(std::ostream& stream) {
   stream << "}\n";
 }
 
+void EnumGen::GenIndex(std::ostream& stream) {
+  // Number the constants from 0, so that tables keyed by the enum can be flat arrays instead of maps.
+  stream << "constexpr size_t k" << e_.name_ << "TableSize = " << e_.constants_.size() << ";";
+  stream << "\n";
+  stream << "constexpr size_t " << e_.name_ << "TableIndex(const " << e_.name_ << "& param) {";
+  stream << "switch (param) {";
+  size_t index = 0;
+  for (const auto& pair : e_.constants_) {
+    stream << "case " << e_.name_ << "::" << pair.second << ":";
+    stream << "  return " << index++ << ";";
+  }
+  stream << "default:";
+  stream << "  return k" << e_.name_ << "TableSize;";
+  stream << "}";
+  stream << "}\n";
+}
+
 void EnumGen::GenRustDef(std::ostream& stream) {
   stream << "#[derive(FromPrimitive, ToPrimitive, Debug, Hash, Eq, PartialEq, Clone, Copy)]\n";
   stream << "pub enum " << e_.name_ << " {";
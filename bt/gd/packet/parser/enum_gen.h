@@ -31,6 +31,10 @@ class EnumGen {
 
   void GenLogging(std::ostream& stream);
 
+  // Generates k<Enum>TableSize and <Enum>TableIndex(), which maps the constants to [0, k<Enum>TableSize) and any
+  // other value to k<Enum>TableSize.
+  void GenIndex(std::ostream& stream);
+
   void GenRustDef(std::ostream& stream);
 
   EnumDef e_;
@@ -52,6 +52,10 @@ void CustomFieldFixedSize::GenExtractor(std::ostream& s, int, bool) const {
   s << "*" << GetName() << "_ptr = " << GetName() << "_it.extract<" << GetDataType() << ">();";
 }
 
+void CustomFieldFixedSize::GenFixedOffsetExtractor(std::ostream& s, int byte_offset, int) const {
+  s << "*" << GetName() << "_ptr = extract_at<" << GetDataType() << ">(" << byte_offset << ");";
+}
+
 bool CustomFieldFixedSize::HasParameterValidator() const {
   return false;
 }
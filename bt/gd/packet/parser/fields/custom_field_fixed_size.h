@@ -33,6 +33,8 @@ class CustomFieldFixedSize : public ScalarField {
 
   virtual void GenExtractor(std::ostream& s, int num_leading_bits, bool for_struct) const override;
 
+  virtual void GenFixedOffsetExtractor(std::ostream& s, int byte_offset, int num_leading_bits) const override;
+
   virtual bool HasParameterValidator() const override;
 
   virtual void GenParameterValidator(std::ostream&) const override;
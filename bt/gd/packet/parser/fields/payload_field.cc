@@ -89,7 +89,7 @@ bool PayloadField::BuilderParameterMustBeMoved() const {
 }
 
 void PayloadField::GenBuilderParameterFromView(std::ostream& s) const {
-  s << "std::make_unique<RawBuilder>(std::vector<uint8_t>(view.GetPayload().begin(), view.GetPayload().end()))";
+  s << "std::make_unique<BufferChain>(view.GetPayload())";
 }
 
 bool PayloadField::HasParameterValidator() const {
@@ -73,7 +73,17 @@ void ScalarField::GenExtractor(std::ostream& s, int num_leading_bits, bool) cons
   // current field to start in the middle of a byte.
   std::string extract_type = util::GetTypeForSize(size.bits() + num_leading_bits);
   s << "auto extracted_value = " << GetName() << "_it.extract<" << extract_type << ">();";
+  GenExtractedValue(s, num_leading_bits);
+}
+
+void ScalarField::GenFixedOffsetExtractor(std::ostream& s, int byte_offset, int num_leading_bits) const {
+  std::string extract_type = util::GetTypeForSize(GetSize().bits() + num_leading_bits);
+  s << "auto extracted_value = extract_at<" << extract_type << ">(" << byte_offset << ");";
+  GenExtractedValue(s, num_leading_bits);
+}
 
+void ScalarField::GenExtractedValue(std::ostream& s, int num_leading_bits) const {
+  Size size = GetSize();
   // Right shift the result to remove leading bits.
   if (num_leading_bits != 0) {
     s << "extracted_value >>= " << num_leading_bits << ";";
@@ -99,11 +109,20 @@ std::string ScalarField::GetGetterFunctionName() const {
 void ScalarField::GenGetter(std::ostream& s, Size start_offset, Size end_offset) const {
   s << GetDataType() << " " << GetGetterFunctionName() << "() const {";
   s << "ASSERT(was_validated_);";
-  s << "auto to_bound = begin();";
-  int num_leading_bits = GenBounds(s, start_offset, end_offset, GetSize());
+  // When the offset is known here, the bytes are read from the packet without making iterators.
+  bool fixed_offset = !start_offset.empty() && !start_offset.has_dynamic();
+  int num_leading_bits = 0;
+  if (!fixed_offset) {
+    s << "auto to_bound = begin();";
+    num_leading_bits = GenBounds(s, start_offset, end_offset, GetSize());
+  }
   s << GetDataType() << " " << GetName() << "_value{};";
   s << GetDataType() << "* " << GetName() << "_ptr = &" << GetName() << "_value;";
-  GenExtractor(s, num_leading_bits, false);
+  if (fixed_offset) {
+    GenFixedOffsetExtractor(s, start_offset.bits() / 8, start_offset.bits() % 8);
+  } else {
+    GenExtractor(s, num_leading_bits, false);
+  }
   s << "return " << GetName() << "_value;";
   s << "}";
 }
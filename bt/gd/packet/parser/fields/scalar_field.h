@@ -35,6 +35,9 @@ class ScalarField : public PacketField {
 
   virtual void GenExtractor(std::ostream& s, int num_leading_bits, bool for_struct) const override;
 
+  // Like GenExtractor(), for a field of a packet view which starts at a constant offset from the start of the packet.
+  virtual void GenFixedOffsetExtractor(std::ostream& s, int byte_offset, int num_leading_bits) const;
+
   virtual std::string GetGetterFunctionName() const override;
 
   virtual void GenGetter(std::ostream& s, Size start_offset, Size end_offset) const override;
@@ -67,5 +70,8 @@ class ScalarField : public PacketField {
   }
 
  private:
+  // Shift, mask, and store the extracted_value read by the extractors
+  void GenExtractedValue(std::ostream& s, int num_leading_bits) const;
+
   const int size_;
 };
@@ -91,6 +91,7 @@ bool generate_cpp_headers_one_file(
 #include "os/log.h"
 #include "packet/base_packet_builder.h"
 #include "packet/bit_inserter.h"
+#include "packet/buffer_chain.h"
 #include "packet/custom_field_fixed_size_interface.h"
 #include "packet/iterator.h"
 #include "packet/packet_builder.h"
@@ -129,6 +130,7 @@ bool generate_cpp_headers_one_file(
 
 using ::bluetooth::packet::BasePacketBuilder;
 using ::bluetooth::packet::BitInserter;
+using ::bluetooth::packet::BufferChain;
 using ::bluetooth::packet::CustomFieldFixedSizeInterface;
 using ::bluetooth::packet::CustomTypeChecker;
 using ::bluetooth::packet::Iterator;
@@ -158,6 +160,8 @@ using ::bluetooth::packet::parser::ChecksumTypeChecker;
       const auto* enum_def = static_cast<const EnumDef*>(e.second);
       EnumGen gen(*enum_def);
       gen.GenLogging(out_file);
+      out_file << "\n";
+      gen.GenIndex(out_file);
       out_file << "\n\n";
     }
   }
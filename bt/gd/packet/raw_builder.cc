@@ -45,20 +45,19 @@ bool RawBuilder::AddOctets(const vector<uint8_t>& bytes) {
 }
 
 bool RawBuilder::AddOctets(size_t octets, uint64_t value) {
-  vector<uint8_t> val_vector;
+  if (octets > sizeof(uint64_t)) return false;
 
-  uint64_t v = value;
+  if (octets < sizeof(uint64_t) && (value >> (octets * 8)) != 0) return false;
 
-  if (octets > sizeof(uint64_t)) return false;
+  if (payload_.size() + octets > max_bytes_) return false;
 
+  // Called for every byte of the fragments made by FragmentingInserter, so don't go through a temporary vector
   for (size_t i = 0; i < octets; i++) {
-    val_vector.push_back(v & 0xff);
-    v = v >> 8;
+    payload_.push_back(value & 0xff);
+    value = value >> 8;
   }
 
-  if (v != 0) return false;
-
-  return AddOctets(octets, val_vector);
+  return true;
 }
 
 bool RawBuilder::AddAddress(const Address& address) {
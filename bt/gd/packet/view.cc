@@ -25,7 +25,12 @@ View::View(std::shared_ptr<const std::vector<uint8_t>> data, size_t begin, size_
     : data_(data), begin_(begin < data_->size() ? begin : data_->size()),
       end_(end < data_->size() ? end : data_->size()) {}
 
-View::View(const View& view, size_t begin, size_t end) : data_(view.data_) {
+View::View(std::shared_ptr<const PacketBuffer> buffer, size_t begin, size_t end)
+    : buffer_(buffer), buffer_data_(buffer_->data()), begin_(begin < buffer_->size() ? begin : buffer_->size()),
+      end_(end < buffer_->size() ? end : buffer_->size()) {}
+
+View::View(const View& view, size_t begin, size_t end)
+    : data_(view.data_), buffer_(view.buffer_), buffer_data_(view.buffer_data_) {
   begin_ = (begin < view.size() ? begin : view.size());
   begin_ += view.begin_;
   end_ = (end < view.size() ? end : view.size());
@@ -34,11 +39,21 @@ View::View(const View& view, size_t begin, size_t end) : data_(view.data_) {
 
 uint8_t View::operator[](size_t i) const {
   ASSERT_LOG(i + begin_ < end_, "Out of bounds access at %zu", i);
+  if (buffer_data_ != nullptr) {
+    return buffer_data_[i + begin_];
+  }
   return data_->operator[](i + begin_);
 }
 
 size_t View::size() const {
   return end_ - begin_;
 }
+
+const uint8_t* View::data() const {
+  if (buffer_data_ != nullptr) {
+    return buffer_data_ + begin_;
+  }
+  return data_->data() + begin_;
+}
 }  // namespace packet
 }  // namespace bluetooth
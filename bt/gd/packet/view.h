@@ -20,13 +20,17 @@
 #include <memory>
 #include <vector>
 
+#include "packet/packet_buffer.h"
+
 namespace bluetooth {
 namespace packet {
 
 // Base class that holds a shared pointer to data with bounds.
+// The data is either a vector or a PacketBuffer; slicing a view shares it without copying.
 class View {
  public:
   View(std::shared_ptr<const std::vector<uint8_t>> data, size_t begin, size_t end);
+  View(std::shared_ptr<const PacketBuffer> buffer, size_t begin, size_t end);
   View(const View& view, size_t begin, size_t end);
   View(const View& view) = default;
   virtual ~View() = default;
@@ -35,8 +39,14 @@ class View {
 
   size_t size() const;
 
+  // The size() bytes of the view, which are contiguous
+  const uint8_t* data() const;
+
  private:
   std::shared_ptr<const std::vector<uint8_t>> data_;
+  std::shared_ptr<const PacketBuffer> buffer_;
+  // The bytes of |buffer_| when the view was created, which stay in place when the buffer grows
+  const uint8_t* buffer_data_{nullptr};
   size_t begin_;
   size_t end_;
 };
@@ -37,6 +37,26 @@ extern const allocator_t allocator_calloc;
 char* osi_strdup(const char* str);
 char* osi_strndup(const char* str, size_t len);
 
+// Allocations of the usual buffer sizes are served from pools of fixed-size
+// blocks, cached per thread. Memory from these functions must be released with
+// |osi_free|, never with free(3).
+//
+// ASan and HWASan can't see overflows or uses after free inside the pools, so
+// sanitized builds, and builds defining OSI_ALLOCATOR_USE_POOLS to 0, use the
+// system allocator for everything.
+#ifndef OSI_ALLOCATOR_USE_POOLS
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_HWADDRESS__)
+#define OSI_ALLOCATOR_USE_POOLS 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(hwaddress_sanitizer)
+#define OSI_ALLOCATOR_USE_POOLS 0
+#endif
+#endif
+#endif
+#ifndef OSI_ALLOCATOR_USE_POOLS
+#define OSI_ALLOCATOR_USE_POOLS 1
+#endif
+
 void* osi_malloc(size_t size);
 void* osi_calloc(size_t size);
 void osi_free(void* ptr);
@@ -47,7 +67,7 @@ void osi_free(void* ptr);
 // |p_ptr| cannot be NULL.
 void osi_free_and_reset(void** p_ptr);
 
-// Dump allocation-related statistics and debug info to the |fd| file
-// descriptor.
+// Dump allocation-related statistics and debug info, including the usage of
+// the pools, to the |fd| file descriptor.
 // The information is in user-readable text format. The |fd| must be valid.
 void osi_allocator_debug_dump(int fd);
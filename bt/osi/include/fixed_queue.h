@@ -98,11 +98,14 @@ void* fixed_queue_try_peek_last(fixed_queue_t* queue);
 // otherwise NULL.
 void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data);
 
-// Returns the iterateable list with all entries in the |queue|. This function
+// Returns an iterateable list with all entries in the |queue|. This function
 // will never block the caller. |queue| may not be NULL.
 //
 // NOTE: The return result of this function is not thread safe: the list could
-// be modified by another thread, and the result would be unpredictable.
+// be modified by another thread, and the result would be unpredictable. The
+// same list is returned by every call, and entries added to or removed from
+// the |queue| are added to or removed from it, so the node of a removed entry
+// must not be used anymore. The list must not be modified directly.
 // TODO: The usage of this function should be refactored, and the function
 // itself should be removed.
 list_t* fixed_queue_get_list(fixed_queue_t* queue);
@@ -16,18 +16,233 @@
  *
  ******************************************************************************/
 #include <base/logging.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <mutex>
 
 #include "osi/include/allocation_tracker.h"
 #include "osi/include/allocator.h"
 
 static const allocator_id_t alloc_allocator_id = 42;
 
+// Allocations up to the biggest of these sizes come from pools of fixed-size
+// blocks instead of the system allocator. The sizes fit the usual BT_HDR
+// buffers (HCI commands and events, BT_SMALL_BUFFER_SIZE, the L2CAP MTU and
+// BT_DEFAULT_BUFFER_SIZE) with room for the allocation tracker canaries.
+typedef struct {
+  size_t block_size;
+  size_t num_blocks;
+} pool_config_t;
+
+static const pool_config_t pool_configs[] = {
+    {64, 4096}, {256, 2048}, {768, 1024}, {2048, 512}, {4224, 512},
+};
+static const size_t num_pools = sizeof(pool_configs) / sizeof(pool_configs[0]);
+
+// Each thread keeps up to this many free blocks of each size, so that most
+// allocations and frees don't take the pool lock.
+static const size_t magazine_size = 32;
+
+// The blocks of all the pools are carved out of a single reserved range, so
+// that osi_free can tell pooled blocks from system allocations by address.
+// Pages are only backed when blocks are first handed out.
+typedef struct {
+  uint8_t* begin;
+  uint8_t* pool_end[num_pools];
+} arena_t;
+
+typedef struct {
+  std::mutex mutex;
+  void* free_list;  // Linked through the first word of each block
+  size_t free_count;
+  size_t num_carved;
+  // Statistics
+  size_t refills;
+  size_t flushes;
+  size_t exhausted;
+} pool_t;
+
+typedef struct {
+  void* blocks[magazine_size];
+  size_t count;
+} magazine_t;
+
+typedef struct {
+  magazine_t magazines[num_pools];
+  bool registered;  // |thread_cache_flusher| is constructed
+  bool exited;      // The thread is exiting, bypass the magazines
+} thread_cache_t;
+
+static pool_t pools[num_pools];
+static thread_local thread_cache_t thread_cache;
+static std::atomic<size_t> system_alloc_counter(0);
+static std::atomic<size_t> system_free_counter(0);
+
+static void pool_flush(size_t index, magazine_t* magazine, size_t count);
+
+// Returns the blocks of the thread to the pools when the thread exits.
+struct thread_cache_flusher_t {
+  ~thread_cache_flusher_t() {
+    for (size_t i = 0; i < num_pools; i++) {
+      magazine_t* magazine = &thread_cache.magazines[i];
+      if (magazine->count > 0) pool_flush(i, magazine, magazine->count);
+    }
+    thread_cache.exited = true;
+  }
+};
+static thread_local thread_cache_flusher_t thread_cache_flusher;
+
+static arena_t reserve_arena() {
+  arena_t arena = {};
+  size_t size = 0;
+  for (size_t i = 0; i < num_pools; i++)
+    size += pool_configs[i].block_size * pool_configs[i].num_blocks;
+
+  void* begin = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  // Without the arena, everything goes to the system allocator
+  if (begin == MAP_FAILED) return arena;
+
+  arena.begin = static_cast<uint8_t*>(begin);
+  uint8_t* end = arena.begin;
+  for (size_t i = 0; i < num_pools; i++) {
+    end += pool_configs[i].block_size * pool_configs[i].num_blocks;
+    arena.pool_end[i] = end;
+  }
+  return arena;
+}
+
+static const arena_t& get_arena() {
+  static const arena_t arena = reserve_arena();
+  return arena;
+}
+
+static uint8_t* pool_begin(const arena_t& arena, size_t index) {
+  return index == 0 ? arena.begin : arena.pool_end[index - 1];
+}
+
+// Returns the pool of |ptr|, or num_pools if it was not allocated from one.
+static size_t pool_of(const void* ptr) {
+  if (!OSI_ALLOCATOR_USE_POOLS) return num_pools;
+
+  const arena_t& arena = get_arena();
+  const uint8_t* p = static_cast<const uint8_t*>(ptr);
+  if (arena.begin == NULL || p < arena.begin ||
+      p >= arena.pool_end[num_pools - 1])
+    return num_pools;
+  size_t index = 0;
+  while (p >= arena.pool_end[index]) index++;
+  return index;
+}
+
+// Makes sure that the magazines of the thread are flushed when it exits.
+static void register_thread_cache() {
+  if (thread_cache.registered || thread_cache.exited) return;
+  thread_cache.registered = true;
+  // Using the thread_local object constructs it, and registers its destructor
+  static_cast<void>(&thread_cache_flusher);
+}
+
+// Moves blocks from the pool to |magazine| and returns one of them, or returns
+// NULL if the pool has no free blocks left.
+static void* pool_refill(size_t index, magazine_t* magazine) {
+  const arena_t& arena = get_arena();
+  if (arena.begin == NULL) return NULL;
+
+  // A magazine filled after the thread flushed it would never be emptied
+  size_t target = thread_cache.exited ? 1 : magazine_size / 2;
+  register_thread_cache();
+
+  pool_t* pool = &pools[index];
+  const pool_config_t& config = pool_configs[index];
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  pool->refills++;
+  while (magazine->count < target) {
+    void* block;
+    if (pool->free_list != NULL) {
+      block = pool->free_list;
+      pool->free_list = *static_cast<void**>(block);
+      pool->free_count--;
+    } else if (pool->num_carved < config.num_blocks) {
+      block = pool_begin(arena, index) + pool->num_carved * config.block_size;
+      pool->num_carved++;
+    } else {
+      break;
+    }
+    magazine->blocks[magazine->count++] = block;
+  }
+
+  if (magazine->count == 0) {
+    pool->exhausted++;
+    return NULL;
+  }
+  return magazine->blocks[--magazine->count];
+}
+
+// Moves the last |count| blocks of |magazine| back to the pool.
+static void pool_flush(size_t index, magazine_t* magazine, size_t count) {
+  pool_t* pool = &pools[index];
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  pool->flushes++;
+  for (size_t i = 0; i < count; i++) {
+    void* block = magazine->blocks[--magazine->count];
+    *static_cast<void**>(block) = pool->free_list;
+    pool->free_list = block;
+    pool->free_count++;
+  }
+}
+
+static void* pool_alloc(size_t size) {
+  if (!OSI_ALLOCATOR_USE_POOLS) return NULL;
+
+  size_t index = 0;
+  while (index < num_pools && size > pool_configs[index].block_size) index++;
+  if (index == num_pools) return NULL;
+
+  magazine_t* magazine = &thread_cache.magazines[index];
+  if (magazine->count > 0) return magazine->blocks[--magazine->count];
+  return pool_refill(index, magazine);
+}
+
+// Returns false if |ptr| does not belong to a pool.
+static bool pool_free(void* ptr) {
+  size_t index = pool_of(ptr);
+  if (index == num_pools) return false;
+
+  register_thread_cache();
+  magazine_t* magazine = &thread_cache.magazines[index];
+  if (magazine->count == magazine_size) {
+    pool_flush(index, magazine, magazine_size / 2);
+  }
+  magazine->blocks[magazine->count++] = ptr;
+  if (thread_cache.exited) pool_flush(index, magazine, magazine->count);
+  return true;
+}
+
+static void* allocate(size_t size, bool zeroed) {
+  void* ptr = pool_alloc(size);
+  if (ptr != NULL) {
+    if (zeroed) memset(ptr, 0, size);
+    return ptr;
+  }
+  system_alloc_counter.fetch_add(1, std::memory_order_relaxed);
+  return zeroed ? calloc(1, size) : malloc(size);
+}
+
+static void deallocate(void* ptr) {
+  if (ptr == NULL || pool_free(ptr)) return;
+  system_free_counter.fetch_add(1, std::memory_order_relaxed);
+  free(ptr);
+}
+
 char* osi_strdup(const char* str) {
   size_t size = strlen(str) + 1;  // + 1 for the null terminator
   size_t real_size = allocation_tracker_resize_for_canary(size);
-  void* ptr = malloc(real_size);
+  void* ptr = allocate(real_size, false);
   CHECK(ptr);
 
   char* new_string = static_cast<char*>(
@@ -43,7 +258,7 @@ char* osi_strndup(const char* str, size_t len) {
   if (len < size) size = len;
 
   size_t real_size = allocation_tracker_resize_for_canary(size + 1);
-  void* ptr = malloc(real_size);
+  void* ptr = allocate(real_size, false);
   CHECK(ptr);
 
   char* new_string = static_cast<char*>(
@@ -57,20 +272,20 @@ char* osi_strndup(const char* str, size_t len) {
 
 void* osi_malloc(size_t size) {
   size_t real_size = allocation_tracker_resize_for_canary(size);
-  void* ptr = malloc(real_size);
+  void* ptr = allocate(real_size, false);
   CHECK(ptr);
   return allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size);
 }
 
 void* osi_calloc(size_t size) {
   size_t real_size = allocation_tracker_resize_for_canary(size);
-  void* ptr = calloc(1, real_size);
+  void* ptr = allocate(real_size, true);
   CHECK(ptr);
   return allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size);
 }
 
 void osi_free(void* ptr) {
-  free(allocation_tracker_notify_free(alloc_allocator_id, ptr));
+  deallocate(allocation_tracker_notify_free(alloc_allocator_id, ptr));
 }
 
 void osi_free_and_reset(void** p_ptr) {
@@ -79,6 +294,27 @@ void osi_free_and_reset(void** p_ptr) {
   *p_ptr = NULL;
 }
 
+void osi_allocator_debug_dump(int fd) {
+  dprintf(fd, "\nBluetooth Memory Allocation Statistics:\n");
+
+  allocation_tracker_debug_dump(fd);
+
+  dprintf(fd, "  System allocator allocate/free calls : %zu / %zu\n",
+          system_alloc_counter.load(std::memory_order_relaxed),
+          system_free_counter.load(std::memory_order_relaxed));
+  dprintf(fd,
+          "  Pool block size : carved / max blocks, free, refills, flushes, "
+          "exhausted\n");
+  for (size_t i = 0; i < num_pools; i++) {
+    pool_t* pool = &pools[i];
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    dprintf(fd, "  %15zu : %zu / %zu, %zu, %zu, %zu, %zu\n",
+            pool_configs[i].block_size, pool->num_carved,
+            pool_configs[i].num_blocks, pool->free_count, pool->refills,
+            pool->flushes, pool->exhausted);
+  }
+}
+
 const allocator_t allocator_calloc = {osi_calloc, osi_free};
 
 const allocator_t allocator_malloc = {osi_malloc, osi_free};
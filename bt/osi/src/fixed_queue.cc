@@ -28,8 +28,16 @@
 #include "osi/include/reactor.h"
 #include "osi/include/semaphore.h"
 
+// Elements are kept in a ring buffer which grows with the number of elements,
+// so that enqueueing doesn't allocate a list node per element.
+static const size_t initial_slots = 16;
+
 typedef struct fixed_queue_t {
-  list_t* list;
+  void** slots;
+  size_t num_slots;  // Always a power of two
+  size_t head;       // Slot of the first element
+  size_t length;
+  list_t* list;  // Kept in sync with the slots once fixed_queue_get_list asks
   semaphore_t* enqueue_sem;
   semaphore_t* dequeue_sem;
   std::mutex* mutex;
@@ -42,6 +50,53 @@ typedef struct fixed_queue_t {
 
 static void internal_dequeue_ready(void* context);
 
+static void* slot_at(const fixed_queue_t* queue, size_t index) {
+  return queue->slots[(queue->head + index) & (queue->num_slots - 1)];
+}
+
+static void push_back(fixed_queue_t* queue, void* data) {
+  if (queue->length == queue->num_slots) {
+    void** slots =
+        static_cast<void**>(osi_malloc(2 * queue->num_slots * sizeof(void*)));
+    for (size_t i = 0; i < queue->length; i++) slots[i] = slot_at(queue, i);
+    osi_free(queue->slots);
+    queue->slots = slots;
+    queue->num_slots *= 2;
+    queue->head = 0;
+  }
+  queue->slots[(queue->head + queue->length) & (queue->num_slots - 1)] = data;
+  queue->length++;
+  if (queue->list != NULL) list_append(queue->list, data);
+}
+
+static void* pop_front(fixed_queue_t* queue) {
+  void* data = queue->slots[queue->head];
+  queue->head = (queue->head + 1) & (queue->num_slots - 1);
+  queue->length--;
+  if (queue->list != NULL) list_remove(queue->list, data);
+  return data;
+}
+
+// Returns the index of |data| in the queue, or the length of the queue if it
+// is not there.
+static size_t index_of(const fixed_queue_t* queue, void* data) {
+  size_t index = 0;
+  while (index < queue->length && slot_at(queue, index) != data) index++;
+  return index;
+}
+
+static void remove_at(fixed_queue_t* queue, size_t index) {
+  // |index| is the first occurrence of its data, as is the node list_remove
+  // unlinks
+  if (queue->list != NULL) list_remove(queue->list, slot_at(queue, index));
+  // Close the gap by moving the following elements forward
+  for (; index + 1 < queue->length; index++) {
+    queue->slots[(queue->head + index) & (queue->num_slots - 1)] =
+        slot_at(queue, index + 1);
+  }
+  queue->length--;
+}
+
 fixed_queue_t* fixed_queue_new(size_t capacity) {
   fixed_queue_t* ret =
       static_cast<fixed_queue_t*>(osi_calloc(sizeof(fixed_queue_t)));
@@ -49,8 +104,10 @@ fixed_queue_t* fixed_queue_new(size_t capacity) {
   ret->mutex = new std::mutex;
   ret->capacity = capacity;
 
-  ret->list = list_new(NULL);
-  if (!ret->list) goto error;
+  ret->num_slots = 1;
+  while (ret->num_slots < capacity && ret->num_slots < initial_slots)
+    ret->num_slots *= 2;
+  ret->slots = static_cast<void**>(osi_malloc(ret->num_slots * sizeof(void*)));
 
   ret->enqueue_sem = semaphore_new(capacity);
   if (!ret->enqueue_sem) goto error;
@@ -71,10 +128,9 @@ void fixed_queue_free(fixed_queue_t* queue, fixed_queue_free_cb free_cb) {
   fixed_queue_unregister_dequeue(queue);
 
   if (free_cb)
-    for (const list_node_t* node = list_begin(queue->list);
-         node != list_end(queue->list); node = list_next(node))
-      free_cb(list_node(node));
+    for (size_t i = 0; i < queue->length; i++) free_cb(slot_at(queue, i));
 
+  osi_free(queue->slots);
   list_free(queue->list);
   semaphore_free(queue->enqueue_sem);
   semaphore_free(queue->dequeue_sem);
@@ -97,14 +153,14 @@ bool fixed_queue_is_empty(fixed_queue_t* queue) {
   if (queue == NULL) return true;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_is_empty(queue->list);
+  return queue->length == 0;
 }
 
 size_t fixed_queue_length(fixed_queue_t* queue) {
   if (queue == NULL) return 0;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_length(queue->list);
+  return queue->length;
 }
 
 size_t fixed_queue_capacity(fixed_queue_t* queue) {
@@ -121,7 +177,7 @@ void fixed_queue_enqueue(fixed_queue_t* queue, void* data) {
 
   {
     std::lock_guard<std::mutex> lock(*queue->mutex);
-    list_append(queue->list, data);
+    push_back(queue, data);
   }
 
   semaphore_post(queue->dequeue_sem);
@@ -135,8 +191,7 @@ void* fixed_queue_dequeue(fixed_queue_t* queue) {
   void* ret = NULL;
   {
     std::lock_guard<std::mutex> lock(*queue->mutex);
-    ret = list_front(queue->list);
-    list_remove(queue->list, ret);
+    ret = pop_front(queue);
   }
 
   semaphore_post(queue->enqueue_sem);
@@ -152,7 +207,7 @@ bool fixed_queue_try_enqueue(fixed_queue_t* queue, void* data) {
 
   {
     std::lock_guard<std::mutex> lock(*queue->mutex);
-    list_append(queue->list, data);
+    push_back(queue, data);
   }
 
   semaphore_post(queue->dequeue_sem);
@@ -167,8 +222,7 @@ void* fixed_queue_try_dequeue(fixed_queue_t* queue) {
   void* ret = NULL;
   {
     std::lock_guard<std::mutex> lock(*queue->mutex);
-    ret = list_front(queue->list);
-    list_remove(queue->list, ret);
+    ret = pop_front(queue);
   }
 
   semaphore_post(queue->enqueue_sem);
@@ -180,14 +234,14 @@ void* fixed_queue_try_peek_first(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_is_empty(queue->list) ? NULL : list_front(queue->list);
+  return queue->length == 0 ? NULL : slot_at(queue, 0);
 }
 
 void* fixed_queue_try_peek_last(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_is_empty(queue->list) ? NULL : list_back(queue->list);
+  return queue->length == 0 ? NULL : slot_at(queue, queue->length - 1);
 }
 
 void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data) {
@@ -196,10 +250,10 @@ void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data) {
   bool removed = false;
   {
     std::lock_guard<std::mutex> lock(*queue->mutex);
-    if (list_contains(queue->list, data) &&
-        semaphore_try_wait(queue->dequeue_sem)) {
-      removed = list_remove(queue->list, data);
-      CHECK(removed);
+    size_t index = index_of(queue, data);
+    if (index < queue->length && semaphore_try_wait(queue->dequeue_sem)) {
+      remove_at(queue, index);
+      removed = true;
     }
   }
 
@@ -214,8 +268,15 @@ list_t* fixed_queue_get_list(fixed_queue_t* queue) {
   CHECK(queue != NULL);
 
   // NOTE: Using the list in this way is not thread-safe.
-  // Using this list in any context where threads can call other functions
-  // to the queue can break our assumptions and the queue in general.
+  // From the first call on, every change to the queue is mirrored in the list,
+  // so the same list is returned every time and callers can call back into
+  // this function while they go through it.
+  std::lock_guard<std::mutex> lock(*queue->mutex);
+  if (queue->list == NULL) {
+    queue->list = list_new(NULL);
+    for (size_t i = 0; i < queue->length; i++)
+      list_append(queue->list, slot_at(queue, i));
+  }
   return queue->list;
 }
 
@@ -16,6 +16,7 @@
  *
  ******************************************************************************/
 #include <cstring>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -50,3 +51,49 @@ TEST_F(AllocatorTest, test_osi_strndup) {
   EXPECT_EQ(0, strcmp(str, copy_str));
   osi_free(copy_str);
 }
+
+// Without the pools, freed buffers are up to the system allocator
+#if OSI_ALLOCATOR_USE_POOLS
+TEST_F(AllocatorTest, test_osi_malloc_reuses_freed_buffers) {
+  void* ptr = osi_malloc(1000);
+  osi_free(ptr);
+  // The buffer comes back from the cache of the thread
+  void* ptr2 = osi_malloc(1000);
+  EXPECT_EQ(ptr, ptr2);
+  osi_free(ptr2);
+}
+#endif
+
+TEST_F(AllocatorTest, test_osi_calloc_clears_reused_buffers) {
+  uint8_t* ptr = static_cast<uint8_t*>(osi_malloc(200));
+  memset(ptr, 0xff, 200);
+  osi_free(ptr);
+
+  uint8_t* zeroed = static_cast<uint8_t*>(osi_calloc(200));
+  for (size_t i = 0; i < 200; i++) EXPECT_EQ(0, zeroed[i]);
+  osi_free(zeroed);
+}
+
+TEST_F(AllocatorTest, test_osi_malloc_sizes) {
+  // From the smallest pool to past the biggest one
+  for (size_t size = 1; size <= 64 * 1024; size *= 2) {
+    uint8_t* ptr = static_cast<uint8_t*>(osi_malloc(size));
+    memset(ptr, 0xab, size);
+    osi_free(ptr);
+  }
+}
+
+TEST_F(AllocatorTest, test_osi_free_on_other_thread) {
+  static const size_t num_buffers = 200;
+  void* buffers[num_buffers];
+  for (size_t i = 0; i < num_buffers; i++) buffers[i] = osi_malloc(4096);
+
+  // Buffers freed by a thread go back to the pool when the thread exits
+  std::thread thread([&buffers]() {
+    for (size_t i = 0; i < num_buffers; i++) osi_free(buffers[i]);
+  });
+  thread.join();
+
+  for (size_t i = 0; i < num_buffers; i++) buffers[i] = osi_malloc(4096);
+  for (size_t i = 0; i < num_buffers; i++) osi_free(buffers[i]);
+}
@@ -291,6 +291,59 @@ TEST_F(FixedQueueTest, test_fixed_queue_try_remove_from_queue) {
   fixed_queue_free(queue, NULL);
 }
 
+TEST_F(FixedQueueTest, test_fixed_queue_grow) {
+  fixed_queue_t* queue = fixed_queue_new(SIZE_MAX);
+  ASSERT_TRUE(queue != NULL);
+
+  // Wrap around the ring buffer before it grows
+  static const uintptr_t num_elements = 100;
+  for (uintptr_t i = 1; i <= 10; i++) fixed_queue_enqueue(queue, (void*)i);
+  for (uintptr_t i = 1; i <= 10; i++)
+    EXPECT_EQ((void*)i, fixed_queue_dequeue(queue));
+  for (uintptr_t i = 1; i <= num_elements; i++)
+    fixed_queue_enqueue(queue, (void*)i);
+  EXPECT_EQ(num_elements, fixed_queue_length(queue));
+  EXPECT_EQ((void*)num_elements, fixed_queue_try_peek_last(queue));
+  EXPECT_EQ((void*)50, fixed_queue_try_remove_from_queue(queue, (void*)50));
+
+  for (uintptr_t i = 1; i <= num_elements; i++) {
+    if (i == 50) continue;
+    EXPECT_EQ((void*)i, fixed_queue_dequeue(queue));
+  }
+  EXPECT_TRUE(fixed_queue_is_empty(queue));
+
+  fixed_queue_free(queue, NULL);
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_get_list) {
+  fixed_queue_t* queue = fixed_queue_new(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING1);
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING2);
+  list_t* list = fixed_queue_get_list(queue);
+  ASSERT_EQ((size_t)2, list_length(list));
+  EXPECT_EQ(DUMMY_DATA_STRING1, list_front(list));
+  EXPECT_EQ(DUMMY_DATA_STRING2, list_back(list));
+
+  // Getting the list again while going through it doesn't invalidate it
+  const list_node_t* node = list_next(list_begin(list));
+  EXPECT_EQ(list, fixed_queue_get_list(queue));
+  EXPECT_EQ(DUMMY_DATA_STRING2, list_node(node));
+
+  // The list follows the changes to the queue
+  EXPECT_EQ(DUMMY_DATA_STRING1, fixed_queue_try_remove_from_queue(
+                                    queue, (void*)DUMMY_DATA_STRING1));
+  ASSERT_EQ((size_t)1, list_length(list));
+  EXPECT_EQ(DUMMY_DATA_STRING2, list_front(list));
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING3);
+  EXPECT_EQ((void*)DUMMY_DATA_STRING2, fixed_queue_dequeue(queue));
+  ASSERT_EQ((size_t)1, list_length(list));
+  EXPECT_EQ(DUMMY_DATA_STRING3, list_front(list));
+
+  fixed_queue_free(queue, NULL);
+}
+
 TEST_F(FixedQueueTest, test_fixed_queue_get_enqueue_dequeue_fd) {
   fixed_queue_t* queue = fixed_queue_new(TEST_QUEUE_SIZE);
   ASSERT_TRUE(queue != NULL);
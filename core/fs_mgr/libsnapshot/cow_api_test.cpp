@@ -313,7 +313,67 @@ TEST_P(CompressionTest, HorribleSink) {
     ASSERT_EQ(sink.stream(), data);
 }
 
-INSTANTIATE_TEST_SUITE_P(CowApi, CompressionTest, testing::Values("none", "gz", "brotli"));
+TEST_P(CompressionTest, ThreadedCompression) {
+    CowOptions options;
+    options.compression = GetParam();
+    options.cluster_ops = 16;
+
+    // More blocks than one batch of 4 threads (1024 blocks), so the writer's
+    // threads are reused, with some data that compresses badly.
+    std::string data;
+    for (size_t i = 0; i < 1100; i++) {
+        std::string block = "Block " + std::to_string(i);
+        block.resize(options.block_size, static_cast<char>(i));
+        for (size_t j = 0; j < block.size(); j += 3) {
+            block[j] = static_cast<char>(i * j * 2654435761u >> 24);
+        }
+        data += block;
+    }
+
+    auto write_cow = [&](uint32_t num_compress_threads, int fd) -> void {
+        options.num_compress_threads = num_compress_threads;
+        CowWriter writer(options);
+        ASSERT_TRUE(writer.Initialize(fd));
+        ASSERT_TRUE(writer.AddRawBlocks(100, data.data(), data.size()));
+        ASSERT_TRUE(writer.AddLabel(1));
+        ASSERT_TRUE(writer.Finalize());
+    };
+
+    TemporaryFile threaded_cow;
+    ASSERT_GE(threaded_cow.fd, 0) << strerror(errno);
+    ASSERT_NO_FATAL_FAILURE(write_cow(0, cow_->fd));
+    ASSERT_NO_FATAL_FAILURE(write_cow(4, threaded_cow.fd));
+
+    // The thread count must not change the output.
+    std::string expected, actual;
+    ASSERT_TRUE(android::base::ReadFileToString(cow_->path, &expected));
+    ASSERT_TRUE(android::base::ReadFileToString(threaded_cow.path, &actual));
+    ASSERT_EQ(expected, actual);
+
+    ASSERT_EQ(lseek(threaded_cow.fd, 0, SEEK_SET), 0);
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(threaded_cow.fd));
+
+    auto iter = reader.GetOpIter();
+    ASSERT_NE(iter, nullptr);
+    size_t num_blocks = 0;
+    for (; !iter->Done(); iter->Next()) {
+        const auto& op = iter->Get();
+        if (op.type != kCowReplaceOp) {
+            continue;
+        }
+        ASSERT_EQ(op.new_block, 100 + num_blocks);
+
+        StringSink sink;
+        ASSERT_TRUE(reader.ReadData(op, &sink));
+        ASSERT_EQ(sink.stream(), data.substr(num_blocks * options.block_size, options.block_size));
+        num_blocks++;
+    }
+    ASSERT_EQ(num_blocks, data.size() / options.block_size);
+}
+
+INSTANTIATE_TEST_SUITE_P(CowApi, CompressionTest,
+                         testing::Values("none", "gz", "brotli", "lz4", "zstd"));
 
 TEST_F(CowTest, GetSize) {
     CowOptions options;
@@ -16,15 +16,27 @@
 
 #include "cow_decompress.h"
 
+#include <string.h>
+
+#include <string>
 #include <utility>
 
 #include <android-base/logging.h>
 #include <brotli/decode.h>
+#include <lz4.h>
 #include <zlib.h>
+#include <zstd.h>
 
 namespace android {
 namespace snapshot {
 
+bool MemoryByteStream::Read(void* buffer, size_t length, size_t* read) {
+    *read = std::min(length, size_ - offset_);
+    memcpy(buffer, data_ + offset_, *read);
+    offset_ += *read;
+    return true;
+}
+
 class NoDecompressor final : public IDecompressor {
   public:
     bool Decompress(size_t) override;
@@ -260,5 +272,165 @@ std::unique_ptr<IDecompressor> IDecompressor::Brotli() {
     return std::unique_ptr<IDecompressor>(new BrotliDecompressor());
 }
 
+class ZstdDecompressor final : public StreamDecompressor {
+  public:
+    ~ZstdDecompressor();
+
+    bool Init() override;
+    bool DecompressInput(const uint8_t* data, size_t length) override;
+    bool Done() override { return ended_; }
+
+  private:
+    ZSTD_DStream* dstream_ = nullptr;
+    bool ended_ = false;
+};
+
+bool ZstdDecompressor::Init() {
+    dstream_ = ZSTD_createDStream();
+    if (!dstream_) {
+        LOG(ERROR) << "ZSTD_createDStream failed";
+        return false;
+    }
+    return true;
+}
+
+ZstdDecompressor::~ZstdDecompressor() {
+    if (dstream_) {
+        ZSTD_freeDStream(dstream_);
+    }
+}
+
+bool ZstdDecompressor::DecompressInput(const uint8_t* data, size_t length) {
+    ZSTD_inBuffer input = {data, length, 0};
+
+    bool needs_more_output = false;
+    while (input.pos < input.size || needs_more_output) {
+        if (!output_buffer_remaining_ && !GetFreshBuffer()) {
+            return false;
+        }
+
+        ZSTD_outBuffer output = {output_buffer_, output_buffer_remaining_, 0};
+        size_t rv = ZSTD_decompressStream(dstream_, &output, &input);
+        if (ZSTD_isError(rv)) {
+            LOG(ERROR) << "zstd decode failed: " << ZSTD_getErrorName(rv);
+            return false;
+        }
+        if (!sink_->ReturnData(output_buffer_, output.pos)) {
+            LOG(ERROR) << "Could not return buffer to sink";
+            return false;
+        }
+        output_buffer_ += output.pos;
+        output_buffer_remaining_ -= output.pos;
+
+        if (rv == 0) {
+            if (input.pos < input.size) {
+                LOG(ERROR) << "zstd stream ended prematurely";
+                return false;
+            }
+            ended_ = true;
+            return true;
+        }
+        // A full output buffer may hide more data buffered in the decoder.
+        needs_more_output = (output.pos == output.size);
+    }
+    return true;
+}
+
+std::unique_ptr<IDecompressor> IDecompressor::Zstd() {
+    return std::unique_ptr<IDecompressor>(new ZstdDecompressor());
+}
+
+// LZ4 blocks can only be decoded in one go, so the whole op is read first.
+// The output goes straight into the sink when it hands out a buffer that is
+// big enough, which is the common case.
+class Lz4Decompressor final : public IDecompressor {
+  public:
+    bool Decompress(size_t output_bytes) override;
+};
+
+bool Lz4Decompressor::Decompress(size_t output_bytes) {
+    std::string input(stream_->Size(), '\0');
+    size_t input_pos = 0;
+    while (input_pos < input.size()) {
+        size_t read;
+        if (!stream_->Read(input.data() + input_pos, input.size() - input_pos, &read)) {
+            return false;
+        }
+        if (!read) {
+            LOG(ERROR) << "Stream ended prematurely";
+            return false;
+        }
+        input_pos += read;
+    }
+
+    size_t buffer_size;
+    auto buffer = reinterpret_cast<char*>(sink_->GetBuffer(output_bytes, &buffer_size));
+    if (!buffer) {
+        LOG(ERROR) << "Could not acquire buffer from sink";
+        return false;
+    }
+
+    std::string output;
+    char* output_pos = buffer;
+    if (buffer_size < output_bytes) {
+        output.resize(output_bytes);
+        output_pos = output.data();
+    }
+
+    int rv = LZ4_decompress_safe(input.data(), output_pos, input.size(), output_bytes);
+    if (rv < 0 || static_cast<size_t>(rv) != output_bytes) {
+        LOG(ERROR) << "lz4 decode failed, returned " << rv << ", expected " << output_bytes;
+        return false;
+    }
+    if (output.empty()) {
+        if (!sink_->ReturnData(buffer, output_bytes)) {
+            LOG(ERROR) << "Could not return buffer to sink";
+            return false;
+        }
+        return true;
+    }
+
+    // The sink wants the data in smaller pieces.
+    while (true) {
+        size_t length = std::min(buffer_size, output_bytes);
+        memcpy(buffer, output_pos, length);
+        if (!sink_->ReturnData(buffer, length)) {
+            LOG(ERROR) << "Could not return buffer to sink";
+            return false;
+        }
+        output_pos += length;
+        output_bytes -= length;
+        if (!output_bytes) {
+            return true;
+        }
+        buffer = reinterpret_cast<char*>(sink_->GetBuffer(output_bytes, &buffer_size));
+        if (!buffer) {
+            LOG(ERROR) << "Could not acquire buffer from sink";
+            return false;
+        }
+    }
+}
+
+std::unique_ptr<IDecompressor> IDecompressor::Lz4() {
+    return std::unique_ptr<IDecompressor>(new Lz4Decompressor());
+}
+
+std::unique_ptr<IDecompressor> IDecompressor::FromType(uint8_t compression) {
+    switch (compression) {
+        case kCowCompressNone:
+            return Uncompressed();
+        case kCowCompressGz:
+            return Gz();
+        case kCowCompressBrotli:
+            return Brotli();
+        case kCowCompressLz4:
+            return Lz4();
+        case kCowCompressZstd:
+            return Zstd();
+        default:
+            return nullptr;
+    }
+}
+
 }  // namespace snapshot
 }  // namespace android
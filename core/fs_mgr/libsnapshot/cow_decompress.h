@@ -33,6 +33,21 @@ class IByteStream {
     virtual size_t Size() const = 0;
 };
 
+// Stream over data that has already been read into memory.
+class MemoryByteStream final : public IByteStream {
+  public:
+    MemoryByteStream(const void* data, size_t size)
+        : data_(reinterpret_cast<const uint8_t*>(data)), size_(size) {}
+
+    bool Read(void* buffer, size_t length, size_t* read) override;
+    size_t Size() const override { return size_; }
+
+  private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_ = 0;
+};
+
 class IDecompressor {
   public:
     virtual ~IDecompressor() {}
@@ -41,6 +56,12 @@ class IDecompressor {
     static std::unique_ptr<IDecompressor> Uncompressed();
     static std::unique_ptr<IDecompressor> Gz();
     static std::unique_ptr<IDecompressor> Brotli();
+    static std::unique_ptr<IDecompressor> Lz4();
+    static std::unique_ptr<IDecompressor> Zstd();
+
+    // Returns the decompressor for a CowOperation compression type, or null
+    // if the type is unknown.
+    static std::unique_ptr<IDecompressor> FromType(uint8_t compression);
 
     // |output_bytes| is the expected total number of bytes to sink.
     virtual bool Decompress(size_t output_bytes) = 0;
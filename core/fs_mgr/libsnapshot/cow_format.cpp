@@ -48,6 +48,10 @@ std::ostream& operator<<(std::ostream& os, CowOperation const& op) {
         os << "kCowCompressGz,     ";
     else if (op.compression == kCowCompressBrotli)
         os << "kCowCompressBrotli, ";
+    else if (op.compression == kCowCompressLz4)
+        os << "kCowCompressLz4,    ";
+    else if (op.compression == kCowCompressZstd)
+        os << "kCowCompressZstd,   ";
     else
         os << (int)op.compression << "?, ";
     os << "data_length:" << op.data_length << ",\t";
@@ -538,20 +538,10 @@ class CowDataStream final : public IByteStream {
 };
 
 bool CowReader::ReadData(const CowOperation& op, IByteSink* sink) {
-    std::unique_ptr<IDecompressor> decompressor;
-    switch (op.compression) {
-        case kCowCompressNone:
-            decompressor = IDecompressor::Uncompressed();
-            break;
-        case kCowCompressGz:
-            decompressor = IDecompressor::Gz();
-            break;
-        case kCowCompressBrotli:
-            decompressor = IDecompressor::Brotli();
-            break;
-        default:
-            LOG(ERROR) << "Unknown compression type: " << op.compression;
-            return false;
+    std::unique_ptr<IDecompressor> decompressor = IDecompressor::FromType(op.compression);
+    if (!decompressor) {
+        LOG(ERROR) << "Unknown compression type: " << op.compression;
+        return false;
     }
 
     CowDataStream stream(this, op.source, op.data_length);
@@ -21,10 +21,13 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <string_view>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/unique_fd.h>
@@ -98,9 +101,11 @@ class CowSnapuserdTest final {
     bool Setup();
     bool SetupCopyOverlap_1();
     bool SetupCopyOverlap_2();
+    bool SetupCopyOverlap_3();
     bool Merge();
     void ValidateMerge();
     void ReadSnapshotDeviceAndValidate();
+    void RandomReadDuringMerge();
     void Shutdown();
     void MergeInterrupt();
 
@@ -118,6 +123,7 @@ class CowSnapuserdTest final {
     void CreateCowDevice();
     void CreateCowDeviceWithCopyOverlap_1();
     void CreateCowDeviceWithCopyOverlap_2();
+    void CreateCowDeviceWithCopyOverlap_3();
     bool SetupDaemon();
     void CreateBaseDevice();
     void InitCowDevice();
@@ -208,6 +214,12 @@ bool CowSnapuserdTest::SetupCopyOverlap_2() {
     return SetupDaemon();
 }
 
+bool CowSnapuserdTest::SetupCopyOverlap_3() {
+    CreateBaseDevice();
+    CreateCowDeviceWithCopyOverlap_3();
+    return SetupDaemon();
+}
+
 bool CowSnapuserdTest::SetupDaemon() {
     SetDeviceControlName();
 
@@ -339,6 +351,44 @@ void CowSnapuserdTest::CreateCowDeviceWithCopyOverlap_2() {
     }
 }
 
+void CowSnapuserdTest::CreateCowDeviceWithCopyOverlap_3() {
+    std::string path = android::base::GetExecutableDirectory();
+    cow_system_ = std::make_unique<TemporaryFile>(path);
+
+    CowOptions options;
+    options.compression = "gz";
+    CowWriter writer(options);
+
+    ASSERT_TRUE(writer.Initialize(cow_system_->fd));
+
+    // Construct the buffer required for validation
+    orig_buffer_ = std::make_unique<uint8_t[]>(total_base_size_);
+
+    // Read the entire base device
+    ASSERT_EQ(android::base::ReadFullyAtOffset(base_fd_, orig_buffer_.get(), total_base_size_, 0),
+              true);
+
+    // Runs of overlapping copy operations, each moving its blocks up by one,
+    // with untouched blocks in between. Every read-ahead region then holds
+    // several runs, which are read from separate places on the base device.
+    size_t num_blocks = size_ / options.block_size;
+    size_t run_blocks = 32;
+    size_t gap_blocks = 8;
+    for (size_t start = 0; start + run_blocks < num_blocks; start += run_blocks + gap_blocks) {
+        for (size_t blk_src_copy = start + run_blocks; blk_src_copy-- > start;) {
+            ASSERT_TRUE(writer.AddCopy(blk_src_copy + 1, blk_src_copy));
+
+            // Merged operations required for validation
+            memmove((char*)orig_buffer_.get() + (blk_src_copy + 1) * options.block_size,
+                    (char*)orig_buffer_.get() + blk_src_copy * options.block_size,
+                    options.block_size);
+        }
+    }
+
+    // Flush operations
+    ASSERT_TRUE(writer.Finalize());
+}
+
 void CowSnapuserdTest::CreateCowDeviceWithCopyOverlap_1() {
     std::string path = android::base::GetExecutableDirectory();
     cow_system_ = std::make_unique<TemporaryFile>(path);
@@ -557,6 +607,35 @@ void CowSnapuserdTest::MergeImpl() {
     merge_ok_ = true;
 }
 
+// Issue random 4k reads against the snapshot device while the merge
+// is in progress, and check that every read returns the original data.
+void CowSnapuserdTest::RandomReadDuringMerge() {
+    std::atomic<bool> done(false);
+
+    std::thread reader([&]() -> void {
+        unique_fd snapshot_fd(open(snapshot_dev_->path().c_str(), O_RDONLY | O_DIRECT));
+        ASSERT_TRUE(snapshot_fd > 0);
+
+        void* buffer;
+        ASSERT_EQ(posix_memalign(&buffer, BLOCK_SZ, BLOCK_SZ), 0);
+        std::unique_ptr<void, decltype(&free)> buffer_holder(buffer, free);
+
+        std::mt19937 gen(total_base_size_);
+        std::uniform_int_distribution<uint64_t> dist(0, (total_base_size_ / BLOCK_SZ) - 1);
+        while (!done) {
+            loff_t offset = dist(gen) * BLOCK_SZ;
+            ASSERT_TRUE(ReadFullyAtOffset(snapshot_fd, buffer, BLOCK_SZ, offset));
+            ASSERT_EQ(memcmp(buffer, (char*)orig_buffer_.get() + offset, BLOCK_SZ), 0);
+        }
+    });
+
+    MergeImpl();
+    done = true;
+    reader.join();
+
+    ASSERT_TRUE(merge_ok_);
+}
+
 void CowSnapuserdTest::ValidateMerge() {
     merged_buffer_ = std::make_unique<uint8_t[]>(total_base_size_);
     ASSERT_EQ(android::base::ReadFullyAtOffset(base_fd_, merged_buffer_.get(), total_base_size_, 0),
@@ -885,6 +964,14 @@ TEST(Snapuserd_Test, Snapshot_IO_TEST) {
     harness.Shutdown();
 }
 
+TEST(Snapuserd_Test, Snapshot_Random_Read_During_Merge) {
+    CowSnapuserdTest harness;
+    ASSERT_TRUE(harness.Setup());
+    harness.RandomReadDuringMerge();
+    harness.ValidateMerge();
+    harness.Shutdown();
+}
+
 TEST(Snapuserd_Test, Snapshot_COPY_Overlap_TEST_1) {
     CowSnapuserdTest harness;
     ASSERT_TRUE(harness.SetupCopyOverlap_1());
@@ -901,6 +988,14 @@ TEST(Snapuserd_Test, Snapshot_COPY_Overlap_TEST_2) {
     harness.Shutdown();
 }
 
+TEST(Snapuserd_Test, Snapshot_COPY_Overlap_TEST_3) {
+    CowSnapuserdTest harness;
+    ASSERT_TRUE(harness.SetupCopyOverlap_3());
+    ASSERT_TRUE(harness.Merge());
+    harness.ValidateMerge();
+    harness.Shutdown();
+}
+
 TEST(Snapuserd_Test, Snapshot_COPY_Overlap_Merge_Resume_TEST) {
     CowSnapuserdTest harness;
     ASSERT_TRUE(harness.SetupCopyOverlap_1());
@@ -909,6 +1004,53 @@ TEST(Snapuserd_Test, Snapshot_COPY_Overlap_Merge_Resume_TEST) {
     harness.Shutdown();
 }
 
+TEST(Snapuserd_Test, ChunkIndex) {
+    std::vector<CowOperation> ops(1000);
+    std::vector<chunk_t> chunks;
+    ChunkIndex index;
+
+    // Skip a chunk every now and then, as metadata chunks are
+    chunk_t chunk = 2;
+    for (size_t i = 0; i < ops.size(); i++) {
+        ASSERT_TRUE(index.Add(chunk, &ops[i]));
+        chunks.push_back(chunk);
+        chunk += (i % 7 == 0) ? 2 : 1;
+    }
+    // Chunks have to be added in increasing order
+    ASSERT_FALSE(index.Add(chunks.back(), &ops[0]));
+    index.Finalize();
+
+    ASSERT_EQ(index.size(), ops.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        ASSERT_EQ(index.Find(chunks[i]), &ops[i]);
+        if (i + 1 < chunks.size() && chunks[i] + 1 != chunks[i + 1]) {
+            ASSERT_EQ(index.Find(chunks[i] + 1), nullptr);
+        }
+    }
+    ASSERT_EQ(index.Find(0), nullptr);
+    ASSERT_EQ(index.Find(chunk), nullptr);
+    ASSERT_EQ(index.Find(chunk * 1000), nullptr);
+}
+
+TEST(Snapuserd_Test, ReadAheadIndex) {
+    std::vector<uint8_t> buffer(3 * BLOCK_SZ);
+    ReadAheadIndex index;
+
+    index.Add(20, &buffer[0]);
+    index.Add(10, &buffer[BLOCK_SZ]);
+    index.Add(20, &buffer[2 * BLOCK_SZ]);
+    index.Finalize();
+
+    ASSERT_EQ(index.size(), 2u);
+    ASSERT_EQ(index.Find(10), &buffer[BLOCK_SZ]);
+    ASSERT_EQ(index.Find(20), &buffer[2 * BLOCK_SZ]);
+    ASSERT_EQ(index.Find(15), nullptr);
+    ASSERT_EQ(index.Find(30), nullptr);
+
+    index.Clear();
+    ASSERT_EQ(index.Find(10), nullptr);
+}
+
 }  // namespace snapshot
 }  // namespace android
 
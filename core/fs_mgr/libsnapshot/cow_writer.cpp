@@ -17,8 +17,13 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
 #include <limits>
+#include <mutex>
 #include <queue>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -26,7 +31,9 @@
 #include <brotli/encode.h>
 #include <libsnapshot/cow_reader.h>
 #include <libsnapshot/cow_writer.h>
+#include <lz4.h>
 #include <zlib.h>
+#include <zstd.h>
 
 namespace android {
 namespace snapshot {
@@ -79,10 +86,92 @@ bool ICowWriter::ValidateNewBlock(uint64_t new_block) {
     return true;
 }
 
+// Threads that run the tasks of one Run() call at a time, alongside the thread
+// calling Run().
+class CowWriter::CompressThreadPool {
+  public:
+    explicit CompressThreadPool(size_t num_threads) {
+        for (size_t i = 0; i < num_threads; i++) {
+            threads_.emplace_back([this]() { ThreadMain(); });
+        }
+    }
+
+    ~CompressThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // Calls |task| for every index in [0, num_tasks), and returns false if any
+    // of those calls did.
+    bool Run(size_t num_tasks, const std::function<bool(size_t)>& task) {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            task_ = &task;
+            num_tasks_ = num_tasks;
+            next_task_ = 0;
+            tasks_done_ = 0;
+            ok_ = true;
+        }
+        cv_.notify_all();
+
+        std::unique_lock<std::mutex> lock(lock_);
+        RunTasks(lock);
+        done_cv_.wait(lock, [this]() { return tasks_done_ == num_tasks_; });
+        task_ = nullptr;
+        return ok_;
+    }
+
+  private:
+    void ThreadMain() {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (true) {
+            cv_.wait(lock, [this]() { return stopping_ || (task_ && next_task_ < num_tasks_); });
+            if (stopping_) {
+                return;
+            }
+            RunTasks(lock);
+        }
+    }
+
+    // Runs tasks of the current Run() call until there are none left to start.
+    void RunTasks(std::unique_lock<std::mutex>& lock) {
+        while (next_task_ < num_tasks_) {
+            size_t index = next_task_++;
+            const auto& task = *task_;
+            lock.unlock();
+            bool ok = task(index);
+            lock.lock();
+            ok_ = ok_ && ok;
+            if (++tasks_done_ == num_tasks_) {
+                done_cv_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    bool stopping_ = false;
+    const std::function<bool(size_t)>* task_ = nullptr;
+    size_t num_tasks_ = 0;
+    size_t next_task_ = 0;
+    size_t tasks_done_ = 0;
+    bool ok_ = true;
+};
+
 CowWriter::CowWriter(const CowOptions& options) : ICowWriter(options), fd_(-1) {
     SetupHeaders();
 }
 
+CowWriter::~CowWriter() {}
+
 void CowWriter::SetupHeaders() {
     header_ = {};
     header_.magic = kCowMagicNumber;
@@ -105,6 +194,10 @@ bool CowWriter::ParseOptions() {
         compression_ = kCowCompressGz;
     } else if (options_.compression == "brotli") {
         compression_ = kCowCompressBrotli;
+    } else if (options_.compression == "lz4") {
+        compression_ = kCowCompressLz4;
+    } else if (options_.compression == "zstd") {
+        compression_ = kCowCompressZstd;
     } else if (options_.compression == "none") {
         compression_ = kCowCompressNone;
     } else if (!options_.compression.empty()) {
@@ -270,40 +363,93 @@ bool CowWriter::EmitCopy(uint64_t new_block, uint64_t old_block) {
 bool CowWriter::EmitRawBlocks(uint64_t new_block_start, const void* data, size_t size) {
     const uint8_t* iter = reinterpret_cast<const uint8_t*>(data);
     CHECK(!merge_in_progress_);
+    if (compression_) {
+        return EmitCompressedBlocks(new_block_start, iter, size / header_.block_size);
+    }
     for (size_t i = 0; i < size / header_.block_size; i++) {
         CowOperation op = {};
         op.type = kCowReplaceOp;
         op.new_block = new_block_start + i;
         op.source = next_data_pos_;
+        op.data_length = static_cast<uint16_t>(header_.block_size);
+        if (!WriteOperation(op, iter, header_.block_size)) {
+            PLOG(ERROR) << "AddRawBlocks: write failed";
+            return false;
+        }
 
-        if (compression_) {
-            auto data = Compress(iter, header_.block_size);
-            if (data.empty()) {
-                PLOG(ERROR) << "AddRawBlocks: compression failed";
-                return false;
-            }
-            if (data.size() > std::numeric_limits<uint16_t>::max()) {
-                LOG(ERROR) << "Compressed block is too large: " << data.size() << " bytes";
+        iter += header_.block_size;
+    }
+    return true;
+}
+
+// Number of blocks each compression thread is handed at a time. This bounds
+// the memory held by compressed blocks that are waiting to be written.
+static constexpr size_t kCompressBlocksPerThread = 256;
+
+bool CowWriter::EmitCompressedBlocks(uint64_t new_block_start, const uint8_t* data,
+                                     size_t num_blocks) {
+    size_t batch_size = std::max(options_.num_compress_threads, 1u) * kCompressBlocksPerThread;
+    std::vector<std::basic_string<uint8_t>> compressed;
+    for (size_t i = 0; i < num_blocks; i += batch_size) {
+        size_t batch_blocks = std::min(batch_size, num_blocks - i);
+        if (!CompressBlocks(data + i * header_.block_size, batch_blocks, &compressed)) {
+            LOG(ERROR) << "AddRawBlocks: compression failed";
+            return false;
+        }
+
+        // Blocks are written in order once the whole batch is compressed, so
+        // the COW does not depend on the number of threads.
+        for (size_t j = 0; j < batch_blocks; j++) {
+            const auto& block = compressed[j];
+            if (block.size() > std::numeric_limits<uint16_t>::max()) {
+                LOG(ERROR) << "Compressed block is too large: " << block.size() << " bytes";
                 return false;
             }
-            op.compression = compression_;
-            op.data_length = static_cast<uint16_t>(data.size());
 
-            if (!WriteOperation(op, data.data(), data.size())) {
+            CowOperation op = {};
+            op.type = kCowReplaceOp;
+            op.new_block = new_block_start + i + j;
+            op.source = next_data_pos_;
+            op.compression = compression_;
+            op.data_length = static_cast<uint16_t>(block.size());
+            if (!WriteOperation(op, block.data(), block.size())) {
                 PLOG(ERROR) << "AddRawBlocks: write failed";
                 return false;
             }
-        } else {
-            op.data_length = static_cast<uint16_t>(header_.block_size);
-            if (!WriteOperation(op, iter, header_.block_size)) {
-                PLOG(ERROR) << "AddRawBlocks: write failed";
+        }
+    }
+    return true;
+}
+
+bool CowWriter::CompressBlocks(const uint8_t* data, size_t num_blocks,
+                               std::vector<std::basic_string<uint8_t>>* compressed) {
+    compressed->resize(num_blocks);
+    auto compress_range = [&](size_t begin, size_t end) -> bool {
+        for (size_t i = begin; i < end; i++) {
+            (*compressed)[i] = Compress(data + i * header_.block_size, header_.block_size);
+            if ((*compressed)[i].empty()) {
                 return false;
             }
         }
+        return true;
+    };
 
-        iter += header_.block_size;
+    size_t num_threads = std::clamp<size_t>(options_.num_compress_threads, 1, num_blocks);
+    if (num_threads == 1) {
+        return compress_range(0, num_blocks);
     }
-    return true;
+
+    // The calling thread compresses a range too, so the pool needs one thread
+    // fewer than requested.
+    if (!compress_pool_) {
+        compress_pool_ = std::make_unique<CompressThreadPool>(options_.num_compress_threads - 1);
+    }
+    size_t blocks_per_thread = (num_blocks + num_threads - 1) / num_threads;
+    size_t num_ranges = (num_blocks + blocks_per_thread - 1) / blocks_per_thread;
+    return compress_pool_->Run(num_ranges, [&](size_t range) -> bool {
+        size_t begin = range * blocks_per_thread;
+        return compress_range(begin, std::min(begin + blocks_per_thread, num_blocks));
+    });
 }
 
 bool CowWriter::EmitZeroBlocks(uint64_t new_block_start, uint64_t num_blocks) {
@@ -342,7 +488,7 @@ bool CowWriter::EmitClusterIfNeeded() {
     return true;
 }
 
-std::basic_string<uint8_t> CowWriter::Compress(const void* data, size_t length) {
+std::basic_string<uint8_t> CowWriter::Compress(const void* data, size_t length) const {
     switch (compression_) {
         case kCowCompressGz: {
             auto bound = compressBound(length);
@@ -375,6 +521,35 @@ std::basic_string<uint8_t> CowWriter::Compress(const void* data, size_t length)
             }
             return std::basic_string<uint8_t>(buffer.get(), encoded_size);
         }
+        case kCowCompressLz4: {
+            auto bound = LZ4_compressBound(length);
+            if (!bound) {
+                LOG(ERROR) << "LZ4_compressBound returned 0";
+                return {};
+            }
+            auto buffer = std::make_unique<uint8_t[]>(bound);
+
+            auto encoded_size = LZ4_compress_default(reinterpret_cast<const char*>(data),
+                                                     reinterpret_cast<char*>(buffer.get()),
+                                                     length, bound);
+            if (encoded_size <= 0) {
+                LOG(ERROR) << "LZ4_compress_default failed";
+                return {};
+            }
+            return std::basic_string<uint8_t>(buffer.get(), encoded_size);
+        }
+        case kCowCompressZstd: {
+            auto bound = ZSTD_compressBound(length);
+            auto buffer = std::make_unique<uint8_t[]>(bound);
+
+            auto encoded_size =
+                    ZSTD_compress(buffer.get(), bound, data, length, ZSTD_CLEVEL_DEFAULT);
+            if (ZSTD_isError(encoded_size)) {
+                LOG(ERROR) << "ZSTD_compress failed: " << ZSTD_getErrorName(encoded_size);
+                return {};
+            }
+            return std::basic_string<uint8_t>(buffer.get(), encoded_size);
+        }
         default:
             LOG(ERROR) << "unhandled compression type: " << compression_;
             break;
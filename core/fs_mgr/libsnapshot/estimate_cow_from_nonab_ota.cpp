@@ -36,7 +36,7 @@
 
 DEFINE_string(source_tf, "", "Source target files (dir or zip file)");
 DEFINE_string(ota_tf, "", "Target files of the build for an OTA");
-DEFINE_string(compression, "gz", "Compression (options: none, gz, brotli)");
+DEFINE_string(compression, "gz", "Compression (options: none, gz, brotli, lz4, zstd)");
 
 namespace android {
 namespace snapshot {
@@ -153,6 +153,8 @@ static constexpr uint8_t kCowFooterOp = -1;
 static constexpr uint8_t kCowCompressNone = 0;
 static constexpr uint8_t kCowCompressGz = 1;
 static constexpr uint8_t kCowCompressBrotli = 2;
+static constexpr uint8_t kCowCompressLz4 = 3;
+static constexpr uint8_t kCowCompressZstd = 4;
 
 static constexpr uint8_t kCowReadAheadNotStarted = 0;
 static constexpr uint8_t kCowReadAheadInProgress = 1;
@@ -19,6 +19,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <libsnapshot/cow_format.h>
@@ -38,6 +39,10 @@ struct CowOptions {
     uint32_t cluster_ops = 200;
 
     bool scratch_space = true;
+
+    // Number of threads used to compress blocks, 0 or 1 to compress them on
+    // the calling thread. The resulting COW is the same either way.
+    uint32_t num_compress_threads = 0;
 };
 
 // Interface for writing to a snapuserd COW. All operations are ordered; merges
@@ -88,6 +93,7 @@ class ICowWriter {
 class CowWriter : public ICowWriter {
   public:
     explicit CowWriter(const CowOptions& options);
+    ~CowWriter() override;
 
     // Set up the writer.
     // The file starts from the beginning.
@@ -125,7 +131,10 @@ class CowWriter : public ICowWriter {
     bool WriteRawData(const void* data, size_t size);
     bool WriteOperation(const CowOperation& op, const void* data = nullptr, size_t size = 0);
     void AddOperation(const CowOperation& op);
-    std::basic_string<uint8_t> Compress(const void* data, size_t length);
+    bool EmitCompressedBlocks(uint64_t new_block_start, const uint8_t* data, size_t num_blocks);
+    bool CompressBlocks(const uint8_t* data, size_t num_blocks,
+                        std::vector<std::basic_string<uint8_t>>* compressed);
+    std::basic_string<uint8_t> Compress(const void* data, size_t length) const;
     void InitPos();
 
     bool SetFd(android::base::borrowed_fd fd);
@@ -133,6 +142,8 @@ class CowWriter : public ICowWriter {
     bool Truncate(off_t length);
 
   private:
+    class CompressThreadPool;
+
     android::base::unique_fd owned_fd_;
     android::base::borrowed_fd fd_;
     CowHeader header_{};
@@ -150,6 +161,10 @@ class CowWriter : public ICowWriter {
     // :TODO: this is not efficient, but stringstream ubsan aborts because some
     // bytes overflow a signed char.
     std::basic_string<uint8_t> ops_;
+
+    // Started by the first CompressBlocks() call that uses more than one
+    // thread, and kept until the writer is destroyed.
+    std::unique_ptr<CompressThreadPool> compress_pool_;
 };
 
 }  // namespace snapshot
@@ -16,6 +16,7 @@
 
 #include "snapuserd.h"
 
+#include <algorithm>
 #include <csignal>
 #include <optional>
 #include <set>
@@ -41,7 +42,9 @@ Snapuserd::Snapuserd(const std::string& misc_name, const std::string& cow_device
 }
 
 bool Snapuserd::InitializeWorkers() {
-    for (int i = 0; i < NUM_THREADS_PER_PARTITION; i++) {
+    int num_threads = std::clamp<int>(std::thread::hardware_concurrency(),
+                                      NUM_THREADS_PER_PARTITION, MAX_THREADS_PER_PARTITION);
+    for (int i = 0; i < num_threads; i++) {
         std::unique_ptr<WorkerThread> wt = std::make_unique<WorkerThread>(
                 cow_device_, backing_store_device_, control_device_, misc_name_, GetSharedPtr());
 
@@ -94,11 +97,11 @@ bool Snapuserd::GetRABuffer(std::unique_lock<std::mutex>* lock, uint64_t block,
         SNAP_LOG(ERROR) << "GetRABuffer - Lock not held";
         return false;
     }
-    std::unordered_map<uint64_t, void*>::iterator it = read_ahead_buffer_map_.find(block);
+    void* bufptr = read_ahead_index_.Find(block);
 
     // This will be true only for IO's generated as part of reading a root
     // filesystem. IO's related to merge should always be in read-ahead cache.
-    if (it == read_ahead_buffer_map_.end()) {
+    if (bufptr == nullptr) {
         return false;
     }
 
@@ -106,7 +109,7 @@ bool Snapuserd::GetRABuffer(std::unique_lock<std::mutex>* lock, uint64_t block,
     // all the way to the kernel without memcpy. However, if the IO is
     // un-aligned, the wrapper function will need to touch the read-ahead
     // buffers and transitions will be bit more complicated.
-    memcpy(buffer, it->second, BLOCK_SZ);
+    memcpy(buffer, bufptr, BLOCK_SZ);
     return true;
 }
 
@@ -412,7 +415,9 @@ bool Snapuserd::ReadMetadata() {
 
 
         // Store operation pointer.
-        chunk_vec_.push_back(std::make_pair(ChunkToSector(data_chunk_id), cow_op));
+        if (!chunk_index_.Add(data_chunk_id, cow_op)) {
+            return false;
+        }
         num_ops += 1;
         offset += sizeof(struct disk_exception);
         cowop_riter_->Next();
@@ -587,7 +592,9 @@ bool Snapuserd::ReadMetadata() {
             de->new_chunk = data_chunk_id;
 
             // Store operation pointer.
-            chunk_vec_.push_back(std::make_pair(ChunkToSector(data_chunk_id), it->second));
+            if (!chunk_index_.Add(data_chunk_id, it->second)) {
+                return false;
+            }
             offset += sizeof(struct disk_exception);
             num_ops += 1;
             copy_ops++;
@@ -649,13 +656,12 @@ bool Snapuserd::ReadMetadata() {
                         << "Areas : " << vec_.size();
     }
 
-    chunk_vec_.shrink_to_fit();
+    // Chunk-ids are assigned in increasing order, so the index is
+    // already sorted; only the rank directory is left to build.
+    chunk_index_.Finalize();
     vec_.shrink_to_fit();
     read_ahead_ops_.shrink_to_fit();
 
-    // Sort the vector based on sectors as we need this during un-aligned access
-    std::sort(chunk_vec_.begin(), chunk_vec_.end(), compare);
-
     SNAP_LOG(INFO) << "ReadMetadata completed. Final-chunk-id: " << data_chunk_id
                    << " Num Sector: " << ChunkToSector(data_chunk_id)
                    << " Replace-ops: " << replace_ops << " Zero-ops: " << zero_ops
@@ -14,10 +14,12 @@
 
 #pragma once
 
+#include <linux/io_uring.h>
 #include <linux/types.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 
 #include <bitset>
 #include <condition_variable>
@@ -30,8 +32,6 @@
 #include <mutex>
 #include <string>
 #include <thread>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include <android-base/file.h>
@@ -59,6 +59,18 @@ static_assert(PAYLOAD_SIZE >= BLOCK_SZ);
  */
 static constexpr int NUM_THREADS_PER_PARTITION = 4;
 
+/*
+ * Devices with more cores get one worker thread per core,
+ * up to this limit.
+ */
+static constexpr int MAX_THREADS_PER_PARTITION = 8;
+
+/*
+ * Number of reads each worker and read-ahead thread can
+ * have in flight.
+ */
+static constexpr unsigned BATCH_READER_QUEUE_DEPTH = 64;
+
 /*
  * State transitions between worker threads and read-ahead
  * threads.
@@ -107,6 +119,124 @@ class BufferSink : public IByteSink {
     size_t buffer_size_;
 };
 
+/*
+ * Reads a batch of extents from the COW and the base device.
+ * The reads go through an io_uring ring so that they are all in
+ * flight at the same time; if the kernel does not provide
+ * io_uring, they are done one by one with pread().
+ */
+class BatchReader {
+  public:
+    BatchReader() = default;
+    ~BatchReader();
+
+    BatchReader(const BatchReader&) = delete;
+    BatchReader& operator=(const BatchReader&) = delete;
+
+    void Initialize(unsigned queue_depth);
+
+    // Queue a read. A read that continues the previous one, both on
+    // disk and in memory, is merged into it.
+    void AddRead(int fd, void* buffer, size_t size, uint64_t offset);
+
+    // Issue all queued reads and wait for them. Fails if any read
+    // fails or comes up short.
+    bool Submit();
+
+    bool IsUringEnabled() const { return ring_fd_ >= 0; }
+
+  private:
+    struct Request {
+        int fd;
+        struct iovec iov;
+        uint64_t offset;
+    };
+
+    bool InitializeUring(unsigned queue_depth);
+    void FreeUring();
+    bool SubmitUring();
+    bool SubmitSync();
+    bool FinishRequest(const Request& request, size_t done);
+
+    std::vector<Request> requests_;
+
+    unique_fd ring_fd_;
+    void* sq_ring_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = MAP_FAILED;
+    size_t cq_ring_size_ = 0;
+    struct io_uring_sqe* sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size_ = 0;
+    unsigned sq_entries_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    struct io_uring_cqe* cqes_ = nullptr;
+};
+
+/*
+ * Maps the chunk-ids exposed to dm-snapshot to their COW operations.
+ *
+ * Chunk-ids are handed out in increasing order by ReadMetadata() and are
+ * dense, except for the metadata chunks and the read-ahead boundaries which
+ * are skipped. Instead of storing the sector of every operation, we keep
+ * one bit per chunk-id along with the number of bits set before each 512
+ * bit block. The operation of a chunk is then found in a flat array at the
+ * index given by the number of set bits before it; a lookup touches one
+ * cache line of the bitmap and one entry of the array.
+ */
+class ChunkIndex {
+  public:
+    // Chunks have to be added in strictly increasing order.
+    bool Add(chunk_t chunk, const CowOperation* cow_op);
+
+    // Build the rank directory. Must be called once all the chunks are
+    // added and before any lookup.
+    void Finalize();
+    void Clear();
+
+    // Returns nullptr if there is no operation at this chunk.
+    const CowOperation* Find(chunk_t chunk) const;
+
+    size_t size() const { return ops_.size(); }
+    size_t MemoryUsage() const;
+
+  private:
+    static constexpr int kWordsPerBlock = 8;
+
+    std::vector<uint64_t> bits_;
+    std::vector<uint32_t> block_rank_;
+    std::vector<const CowOperation*> ops_;
+};
+
+/*
+ * Maps the blocks of the current read-ahead region to their data in the
+ * scratch space. A region holds at most GetBufferDataSize() / BLOCK_SZ
+ * blocks, so a sorted array is both smaller and faster to search than a
+ * hash table; it is rebuilt for every region.
+ */
+class ReadAheadIndex {
+  public:
+    void Clear() { entries_.clear(); }
+    void Add(uint64_t block, void* buffer) { entries_.emplace_back(block, buffer); }
+
+    // Sort the blocks. Must be called once the region is populated and
+    // before any lookup. If a block was added twice, the last one wins.
+    void Finalize();
+
+    // Returns nullptr if the block is not in this region.
+    void* Find(uint64_t block) const;
+
+    size_t size() const { return entries_.size(); }
+
+  private:
+    std::vector<std::pair<uint64_t, void*>> entries_;
+};
+
 class Snapuserd;
 
 class ReadAheadThread {
@@ -131,7 +261,7 @@ class ReadAheadThread {
     bool ReadAheadIOStart();
     void PrepareReadAhead(uint64_t* source_block, int* pending_ops, std::vector<uint64_t>& blocks);
     bool ReconstructDataFromCow();
-    void CheckOverlap(const CowOperation* cow_op);
+    void CheckOverlap();
 
     void* read_ahead_buffer_;
     void* metadata_buffer_;
@@ -145,9 +275,13 @@ class ReadAheadThread {
 
     std::shared_ptr<Snapuserd> snapuserd_;
 
-    std::unordered_set<uint64_t> dest_blocks_;
-    std::unordered_set<uint64_t> source_blocks_;
+    // Source and destination blocks of the ops in the current region,
+    // along with the op they belong to.
+    std::vector<std::pair<uint64_t, const CowOperation*>> source_blocks_;
+    std::vector<std::pair<uint64_t, const CowOperation*>> dest_blocks_;
     bool overlap_;
+
+    BatchReader batch_reader_;
 };
 
 class WorkerThread {
@@ -161,9 +295,9 @@ class WorkerThread {
     // Initialization
     void InitializeBufsink();
     bool InitializeFds();
-    bool InitReader();
     void CloseFds() {
         ctrl_fd_ = {};
+        cow_fd_ = {};
         backing_store_fd_ = {};
     }
 
@@ -181,17 +315,11 @@ class WorkerThread {
     // IO Path
     bool ProcessIORequest();
     int ReadData(sector_t sector, size_t size);
-    int ReadUnalignedSector(sector_t sector, size_t size,
-                            std::vector<std::pair<sector_t, const CowOperation*>>::iterator& it);
+    int ReadUnalignedSector(sector_t sector, size_t size, const CowOperation* cow_op);
 
     // Processing COW operations
-    bool ProcessCowOp(const CowOperation* cow_op);
-    bool ProcessReplaceOp(const CowOperation* cow_op);
-    bool ProcessCopyOp(const CowOperation* cow_op);
-    bool ProcessZeroOp();
-
-    bool ReadFromBaseDevice(const CowOperation* cow_op);
-    bool GetReadAheadPopulatedBuffer(const CowOperation* cow_op);
+    bool ProcessCowOps(const std::vector<const CowOperation*>& cow_ops);
+    bool DecompressReplaceOp(const CowOperation* cow_op, const void* data, size_t block_index);
 
     // Merge related functions
     bool ProcessMergeComplete(chunk_t chunk, void* buffer);
@@ -201,11 +329,19 @@ class WorkerThread {
     int GetNumberOfMergedOps(void* merged_buffer, void* unmerged_buffer, loff_t offset,
                              int unmerged_exceptions, bool* copy_op, bool* commit);
 
+    // Returns the COW operation starting exactly at this sector
+    const CowOperation* FindCowOp(sector_t sector);
+
     sector_t ChunkToSector(chunk_t chunk) { return chunk << CHUNK_SHIFT; }
     chunk_t SectorToChunk(sector_t sector) { return sector >> CHUNK_SHIFT; }
+    bool IsSectorChunkAligned(sector_t sector) {
+        return (sector & ((1ULL << CHUNK_SHIFT) - 1)) == 0;
+    }
 
-    std::unique_ptr<CowReader> reader_;
     BufferSink bufsink_;
+    BatchReader batch_reader_;
+    std::vector<const CowOperation*> cow_ops_;
+    std::vector<uint8_t> compressed_data_;
 
     std::string cow_device_;
     std::string backing_store_device_;
@@ -215,6 +351,7 @@ class WorkerThread {
     unique_fd cow_fd_;
     unique_fd backing_store_fd_;
     unique_fd ctrl_fd_;
+    uint64_t cow_size_ = 0;
 
     std::shared_ptr<Snapuserd> snapuserd_;
     uint32_t exceptions_per_area_;
@@ -246,20 +383,15 @@ class Snapuserd : public std::enable_shared_from_this<Snapuserd> {
     bool InitializeWorkers();
     std::shared_ptr<Snapuserd> GetSharedPtr() { return shared_from_this(); }
 
-    std::vector<std::pair<sector_t, const CowOperation*>>& GetChunkVec() { return chunk_vec_; }
+    const ChunkIndex& GetChunkIndex() const { return chunk_index_; }
     const std::vector<std::unique_ptr<uint8_t[]>>& GetMetadataVec() const { return vec_; }
 
-    static bool compare(std::pair<sector_t, const CowOperation*> p1,
-                        std::pair<sector_t, const CowOperation*> p2) {
-        return p1.first < p2.first;
-    }
-
     void UnmapBufferRegion();
     bool MmapMetadata();
 
     // Read-ahead related functions
     std::vector<const CowOperation*>& GetReadAheadOpsVec() { return read_ahead_ops_; }
-    std::unordered_map<uint64_t, void*>& GetReadAheadMap() { return read_ahead_buffer_map_; }
+    ReadAheadIndex& GetReadAheadIndex() { return read_ahead_index_; }
     void* GetMappedAddr() { return mapped_addr_; }
     bool IsReadAheadFeaturePresent() { return read_ahead_feature_; }
     void PrepareReadAhead();
@@ -314,9 +446,9 @@ class Snapuserd : public std::enable_shared_from_this<Snapuserd> {
     // mapping of old-chunk to new-chunk
     std::vector<std::unique_ptr<uint8_t[]>> vec_;
 
-    // chunk_vec stores the pseudo mapping of sector
+    // chunk_index stores the pseudo mapping of chunk-id
     // to COW operations.
-    std::vector<std::pair<sector_t, const CowOperation*>> chunk_vec_;
+    ChunkIndex chunk_index_;
 
     std::mutex lock_;
     std::condition_variable cv;
@@ -326,7 +458,7 @@ class Snapuserd : public std::enable_shared_from_this<Snapuserd> {
 
     std::vector<std::unique_ptr<WorkerThread>> worker_threads_;
     // Read-ahead related
-    std::unordered_map<uint64_t, void*> read_ahead_buffer_map_;
+    ReadAheadIndex read_ahead_index_;
     std::vector<const CowOperation*> read_ahead_ops_;
     bool populate_data_from_cow_ = false;
     bool read_ahead_feature_;
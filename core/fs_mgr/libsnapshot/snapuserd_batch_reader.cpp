@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "snapuserd.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace android {
+namespace snapshot {
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+BatchReader::~BatchReader() {
+    FreeUring();
+}
+
+void BatchReader::Initialize(unsigned queue_depth) {
+    requests_.reserve(queue_depth);
+    if (!InitializeUring(queue_depth)) {
+        FreeUring();
+    }
+}
+
+bool BatchReader::InitializeUring(unsigned queue_depth) {
+    struct io_uring_params params = {};
+    ring_fd_.reset(io_uring_setup(queue_depth, &params));
+    if (ring_fd_ < 0) {
+        PLOG(INFO) << "io_uring is not available, reads will be synchronous";
+        return false;
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        cq_ring_size_ = 0;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_.get(), IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        PLOG(ERROR) << "mmap of io_uring submission queue failed";
+        return false;
+    }
+
+    if (cq_ring_size_) {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_.get(), IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            PLOG(ERROR) << "mmap of io_uring completion queue failed";
+            return false;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, ring_fd_.get(),
+                                                   IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+        PLOG(ERROR) << "mmap of io_uring submission entries failed";
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    char* cq = cq_ring_size_ ? static_cast<char*>(cq_ring_) : sq;
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void BatchReader::FreeUring() {
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    if (cq_ring_ != MAP_FAILED) {
+        munmap(cq_ring_, cq_ring_size_);
+        cq_ring_ = MAP_FAILED;
+    }
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = MAP_FAILED;
+    }
+    ring_fd_ = {};
+}
+
+void BatchReader::AddRead(int fd, void* buffer, size_t size, uint64_t offset) {
+    if (!requests_.empty()) {
+        Request& last = requests_.back();
+        if (last.fd == fd && last.offset + last.iov.iov_len == offset &&
+            static_cast<char*>(last.iov.iov_base) + last.iov.iov_len == buffer) {
+            last.iov.iov_len += size;
+            return;
+        }
+    }
+    requests_.push_back({fd, {buffer, size}, offset});
+}
+
+bool BatchReader::Submit() {
+    bool ret = IsUringEnabled() ? SubmitUring() : SubmitSync();
+    requests_.clear();
+    return ret;
+}
+
+// Complete a request that the kernel only partly read.
+bool BatchReader::FinishRequest(const Request& request, size_t done) {
+    if (done == request.iov.iov_len) {
+        return true;
+    }
+    if (!android::base::ReadFullyAtOffset(request.fd,
+                                          static_cast<char*>(request.iov.iov_base) + done,
+                                          request.iov.iov_len - done, request.offset + done)) {
+        PLOG(ERROR) << "Read of " << request.iov.iov_len << " bytes at offset "
+                    << request.offset << " failed";
+        return false;
+    }
+    return true;
+}
+
+bool BatchReader::SubmitSync() {
+    for (const auto& request : requests_) {
+        if (!FinishRequest(request, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BatchReader::SubmitUring() {
+    bool ret = true;
+    size_t next = 0;
+    // SQEs in the ring that the kernel has not consumed yet, and SQEs it has
+    // consumed whose completions have not been reaped.
+    unsigned pending = 0;
+    unsigned in_flight = 0;
+
+    // Once a read has failed no more are queued, but every read already
+    // handed to the kernel is reaped: it writes into the caller's buffers.
+    while ((ret && next < requests_.size()) || pending || in_flight) {
+        if (ret) {
+            // Fill up the submission queue.
+            unsigned tail = *sq_tail_;
+            while (next < requests_.size() && pending + in_flight < sq_entries_) {
+                unsigned index = tail & *sq_mask_;
+                struct io_uring_sqe* sqe = &sqes_[index];
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_READV;
+                sqe->fd = requests_[next].fd;
+                sqe->addr = reinterpret_cast<uint64_t>(&requests_[next].iov);
+                sqe->len = 1;
+                sqe->off = requests_[next].offset;
+                sqe->user_data = next;
+                sq_array_[index] = index;
+
+                tail++;
+                next++;
+                pending++;
+            }
+            __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        }
+
+        // The kernel may consume only some of the SQEs, the rest are passed
+        // to it again on the next round.
+        int rc = TEMP_FAILURE_RETRY(
+                io_uring_enter(ring_fd_.get(), pending, 1, IORING_ENTER_GETEVENTS));
+        if (rc >= 0) {
+            pending -= rc;
+            in_flight += rc;
+        } else if ((errno == EAGAIN || errno == EBUSY) && in_flight) {
+            // Out of resources or the completion queue is full. Reaping below
+            // makes room.
+        } else if (pending) {
+            PLOG(ERROR) << "io_uring_enter failed";
+            ret = false;
+            // Take back the SQEs the kernel never saw, they point at requests
+            // that are about to be cleared.
+            __atomic_store_n(sq_tail_, *sq_tail_ - pending, __ATOMIC_RELEASE);
+            pending = 0;
+        } else {
+            // Returning would let the kernel write to buffers the caller is
+            // about to reuse.
+            PLOG(FATAL) << "io_uring_enter failed waiting for " << in_flight << " reads";
+        }
+
+        // Reap whatever has completed.
+        unsigned head = *cq_head_;
+        unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++) {
+            const struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+            const Request& request = requests_[cqe->user_data];
+            if (cqe->res < 0) {
+                errno = -cqe->res;
+                PLOG(ERROR) << "Read of " << request.iov.iov_len << " bytes at offset "
+                            << request.offset << " failed";
+                ret = false;
+            } else if (!FinishRequest(request, cqe->res)) {
+                ret = false;
+            }
+            in_flight--;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return ret;
+}
+
+}  // namespace snapshot
+}  // namespace android
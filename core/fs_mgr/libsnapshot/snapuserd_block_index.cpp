@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "snapuserd.h"
+
+#include <algorithm>
+
+namespace android {
+namespace snapshot {
+
+bool ChunkIndex::Add(chunk_t chunk, const CowOperation* cow_op) {
+    size_t word = chunk / 64;
+    uint64_t bit = 1ULL << (chunk % 64);
+
+    if (word < bits_.size()) {
+        // Anything at or after this chunk in the last word means that
+        // the chunks are not added in increasing order.
+        if (word + 1 != bits_.size() || bits_[word] >= bit) {
+            LOG(ERROR) << "ChunkIndex: chunk " << chunk << " added out of order";
+            return false;
+        }
+    } else {
+        bits_.resize(word + 1, 0);
+    }
+    if (ops_.size() == std::numeric_limits<uint32_t>::max()) {
+        LOG(ERROR) << "ChunkIndex: too many operations";
+        return false;
+    }
+
+    bits_[word] |= bit;
+    ops_.push_back(cow_op);
+    return true;
+}
+
+void ChunkIndex::Finalize() {
+    size_t num_blocks = (bits_.size() + kWordsPerBlock - 1) / kWordsPerBlock;
+    // Pad to a whole block so that lookups never have to check bounds
+    // within a block.
+    bits_.resize(num_blocks * kWordsPerBlock, 0);
+    bits_.shrink_to_fit();
+    ops_.shrink_to_fit();
+
+    block_rank_.resize(num_blocks);
+    block_rank_.shrink_to_fit();
+    uint32_t rank = 0;
+    for (size_t i = 0; i < num_blocks; i++) {
+        block_rank_[i] = rank;
+        for (int j = 0; j < kWordsPerBlock; j++) {
+            rank += __builtin_popcountll(bits_[i * kWordsPerBlock + j]);
+        }
+    }
+}
+
+void ChunkIndex::Clear() {
+    bits_.clear();
+    block_rank_.clear();
+    ops_.clear();
+}
+
+const CowOperation* ChunkIndex::Find(chunk_t chunk) const {
+    size_t word = chunk / 64;
+    if (word >= bits_.size()) {
+        return nullptr;
+    }
+
+    uint64_t bit = 1ULL << (chunk % 64);
+    if (!(bits_[word] & bit)) {
+        return nullptr;
+    }
+
+    size_t block = word / kWordsPerBlock;
+    uint32_t rank = block_rank_[block];
+    for (size_t i = block * kWordsPerBlock; i < word; i++) {
+        rank += __builtin_popcountll(bits_[i]);
+    }
+    rank += __builtin_popcountll(bits_[word] & (bit - 1));
+    return ops_[rank];
+}
+
+size_t ChunkIndex::MemoryUsage() const {
+    return bits_.capacity() * sizeof(uint64_t) + block_rank_.capacity() * sizeof(uint32_t) +
+           ops_.capacity() * sizeof(const CowOperation*);
+}
+
+void ReadAheadIndex::Finalize() {
+    std::stable_sort(entries_.begin(), entries_.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // Keep the last entry of each block, as assigning to a map would.
+    auto last = std::unique(entries_.rbegin(), entries_.rend(),
+                            [](const auto& a, const auto& b) { return a.first == b.first; });
+    entries_.erase(entries_.begin(), last.base());
+}
+
+void* ReadAheadIndex::Find(uint64_t block) const {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), block,
+                               [](const auto& entry, uint64_t b) { return entry.first < b; });
+    if (it == entries_.end() || it->first != block) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+}  // namespace snapshot
+}  // namespace android
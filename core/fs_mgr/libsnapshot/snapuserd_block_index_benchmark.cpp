@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the memory use and lookup time of the snapuserd block indexes
+// against the sorted vector and hash table they replaced.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <libsnapshot/cow_reader.h>
+#include <libsnapshot/cow_writer.h>
+
+#include "snapuserd.h"
+
+namespace android {
+namespace snapshot {
+
+static size_t allocated_bytes = 0;
+
+// Allocator which counts the bytes held by the containers being measured.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        allocated_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        allocated_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>&) const {
+        return false;
+    }
+};
+
+using ChunkVec = std::vector<std::pair<sector_t, const CowOperation*>,
+                             CountingAllocator<std::pair<sector_t, const CowOperation*>>>;
+using ReadAheadMap =
+        std::unordered_map<uint64_t, void*, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                           CountingAllocator<std::pair<const uint64_t, void*>>>;
+
+static constexpr uint32_t kExceptionsPerArea =
+        (CHUNK_SIZE << SECTOR_SHIFT) / sizeof(struct disk_exception);
+
+struct CowFixture {
+    TemporaryFile file;
+    CowReader reader;
+    // Chunk-id of every data op, in the order snapuserd assigns them.
+    std::vector<std::pair<chunk_t, const CowOperation*>> chunks;
+};
+
+static chunk_t NextChunk(chunk_t chunk) {
+    chunk += 1;
+    if (chunk % (kExceptionsPerArea + 1) == NUM_SNAPSHOT_HDR_CHUNKS) {
+        chunk += 1;
+    }
+    return chunk;
+}
+
+// Writes a COW with |num_ops| zero and copy ops and assigns chunk-ids the
+// way Snapuserd::ReadMetadata() does: skipping the metadata chunks, and a
+// chunk at the end of each batch of copy ops.
+static CowFixture* GetCow(size_t num_ops) {
+    static std::map<size_t, std::unique_ptr<CowFixture>> cache;
+    auto& fixture = cache[num_ops];
+    if (fixture) {
+        return fixture.get();
+    }
+    fixture = std::make_unique<CowFixture>();
+
+    CowOptions options;
+    CowWriter writer(options);
+    if (!writer.Initialize(fixture->file.fd)) {
+        abort();
+    }
+    std::mt19937 rng(num_ops);
+    for (size_t i = 0; i < num_ops; i++) {
+        bool ok = (i % 2) ? writer.AddCopy(i, (i + num_ops) + rng() % 16)
+                          : writer.AddZeroBlocks(i, 1);
+        if (!ok) {
+            abort();
+        }
+    }
+    if (!writer.Finalize() || lseek(fixture->file.fd, 0, SEEK_SET) < 0 ||
+        !fixture->reader.Parse(fixture->file.fd)) {
+        abort();
+    }
+
+    chunk_t chunk = NUM_SNAPSHOT_HDR_CHUNKS + 1;
+    auto iter = fixture->reader.GetRevOpIter();
+    for (size_t n = 0; !iter->Done(); iter->Next()) {
+        const CowOperation* op = &iter->Get();
+        if (IsMetadataOp(*op)) {
+            continue;
+        }
+        fixture->chunks.emplace_back(chunk, op);
+        chunk = NextChunk(chunk);
+        if (op->type == kCowCopyOp && (++n % 8) == 0) {
+            chunk = NextChunk(chunk);
+        }
+    }
+    return fixture.get();
+}
+
+static std::vector<chunk_t> RandomChunks(const CowFixture* cow) {
+    std::mt19937 rng(0);
+    std::vector<chunk_t> keys(4096);
+    for (auto& key : keys) {
+        key = cow->chunks[rng() % cow->chunks.size()].first;
+    }
+    return keys;
+}
+
+static void BM_ChunkLookup_SortedVector(benchmark::State& state) {
+    CowFixture* cow = GetCow(state.range(0));
+    size_t before = allocated_bytes;
+
+    ChunkVec chunk_vec;
+    for (const auto& [chunk, op] : cow->chunks) {
+        chunk_vec.emplace_back(chunk << CHUNK_SHIFT, op);
+    }
+    chunk_vec.shrink_to_fit();
+    auto compare = [](const auto& a, const auto& b) { return a.first < b.first; };
+    std::sort(chunk_vec.begin(), chunk_vec.end(), compare);
+    state.counters["bytes"] = allocated_bytes - before;
+
+    std::vector<chunk_t> keys = RandomChunks(cow);
+    size_t i = 0;
+    for (auto _ : state) {
+        sector_t sector = keys[i++ % keys.size()] << CHUNK_SHIFT;
+        auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(),
+                                   std::make_pair(sector, nullptr), compare);
+        benchmark::DoNotOptimize(it->second);
+    }
+}
+BENCHMARK(BM_ChunkLookup_SortedVector)->Arg(1 << 16)->Arg(1 << 18)->Arg(1 << 20);
+
+static void BM_ChunkLookup_ChunkIndex(benchmark::State& state) {
+    CowFixture* cow = GetCow(state.range(0));
+
+    ChunkIndex index;
+    for (const auto& [chunk, op] : cow->chunks) {
+        if (!index.Add(chunk, op)) {
+            state.SkipWithError("ChunkIndex::Add failed");
+            return;
+        }
+    }
+    index.Finalize();
+    state.counters["bytes"] = index.MemoryUsage();
+
+    std::vector<chunk_t> keys = RandomChunks(cow);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.Find(keys[i++ % keys.size()]));
+    }
+}
+BENCHMARK(BM_ChunkLookup_ChunkIndex)->Arg(1 << 16)->Arg(1 << 18)->Arg(1 << 20);
+
+// A read-ahead region of |range(0)| blocks, each one looked up once per
+// merged block as GetNumberOfMergedOps() and GetRABuffer() do.
+static std::vector<uint64_t> RegionBlocks(size_t count) {
+    std::mt19937 rng(count);
+    std::vector<uint64_t> blocks;
+    uint64_t block = rng() % 4096;
+    while (blocks.size() < count) {
+        // Runs of consecutive blocks, as copy ops usually come in
+        for (size_t run = 1 + rng() % 32; run && blocks.size() < count; run--) {
+            blocks.push_back(block++);
+        }
+        block += 1 + rng() % 256;
+    }
+    return blocks;
+}
+
+static void BM_ReadAheadLookup_UnorderedMap(benchmark::State& state) {
+    std::vector<uint64_t> blocks = RegionBlocks(state.range(0));
+    std::vector<uint8_t> buffer(BLOCK_SZ);
+
+    size_t before = allocated_bytes;
+    ReadAheadMap map;
+    for (uint64_t block : blocks) {
+        map[block] = buffer.data();
+    }
+    state.counters["bytes"] = allocated_bytes - before;
+
+    for (auto _ : state) {
+        for (uint64_t block : blocks) {
+            benchmark::DoNotOptimize(map.find(block)->second);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * blocks.size());
+}
+BENCHMARK(BM_ReadAheadLookup_UnorderedMap)->Arg(64)->Arg(256)->Arg(512);
+
+static void BM_ReadAheadLookup_ReadAheadIndex(benchmark::State& state) {
+    std::vector<uint64_t> blocks = RegionBlocks(state.range(0));
+    std::vector<uint8_t> buffer(BLOCK_SZ);
+
+    ReadAheadIndex index;
+    for (uint64_t block : blocks) {
+        index.Add(block, buffer.data());
+    }
+    index.Finalize();
+    state.counters["bytes"] = index.size() * sizeof(std::pair<uint64_t, void*>);
+
+    for (auto _ : state) {
+        for (uint64_t block : blocks) {
+            benchmark::DoNotOptimize(index.Find(block));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * blocks.size());
+}
+BENCHMARK(BM_ReadAheadLookup_ReadAheadIndex)->Arg(64)->Arg(256)->Arg(512);
+
+}  // namespace snapshot
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -16,6 +16,7 @@
 
 #include "snapuserd.h"
 
+#include <algorithm>
 #include <csignal>
 #include <optional>
 #include <set>
@@ -171,13 +172,35 @@ ReadAheadThread::ReadAheadThread(const std::string& cow_device, const std::strin
     snapuserd_ = snapuserd;
 }
 
-void ReadAheadThread::CheckOverlap(const CowOperation* cow_op) {
-    if (dest_blocks_.count(cow_op->new_block) || source_blocks_.count(cow_op->source)) {
-        overlap_ = true;
+/*
+ * The region overlaps if an op writes to a block which another op of the
+ * same region reads from. Blocks are collected while the region is
+ * prepared; both lists are then sorted and walked together.
+ */
+void ReadAheadThread::CheckOverlap() {
+    auto compare = [](const auto& a, const auto& b) { return a.first < b.first; };
+    std::sort(source_blocks_.begin(), source_blocks_.end(), compare);
+    std::sort(dest_blocks_.begin(), dest_blocks_.end(), compare);
+
+    auto src = source_blocks_.begin();
+    auto dst = dest_blocks_.begin();
+    while (src != source_blocks_.end() && dst != dest_blocks_.end()) {
+        if (src->first < dst->first) {
+            src++;
+        } else if (dst->first < src->first) {
+            dst++;
+        } else {
+            auto src_end = std::upper_bound(src, source_blocks_.end(), *src, compare);
+            auto dst_end = std::upper_bound(dst, dest_blocks_.end(), *dst, compare);
+            // An op copying a block onto itself doesn't overlap with itself
+            if (src_end - src > 1 || dst_end - dst > 1 || src->second != dst->second) {
+                overlap_ = true;
+                return;
+            }
+            src = src_end;
+            dst = dst_end;
+        }
     }
-
-    dest_blocks_.insert(cow_op->source);
-    source_blocks_.insert(cow_op->new_block);
 }
 
 void ReadAheadThread::PrepareReadAhead(uint64_t* source_block, int* pending_ops,
@@ -193,10 +216,8 @@ void ReadAheadThread::PrepareReadAhead(uint64_t* source_block, int* pending_ops,
         num_ops -= 1;
         nr_consecutive = 1;
         blocks.push_back(cow_op->new_block);
-
-        if (!overlap_) {
-            CheckOverlap(cow_op);
-        }
+        source_blocks_.emplace_back(cow_op->source, cow_op);
+        dest_blocks_.emplace_back(cow_op->new_block, cow_op);
 
         /*
          * Find number of consecutive blocks working backwards.
@@ -209,18 +230,16 @@ void ReadAheadThread::PrepareReadAhead(uint64_t* source_block, int* pending_ops,
             nr_consecutive += 1;
             num_ops -= 1;
             blocks.push_back(op->new_block);
+            source_blocks_.emplace_back(op->source, op);
+            dest_blocks_.emplace_back(op->new_block, op);
             IterNext();
-
-            if (!overlap_) {
-                CheckOverlap(op);
-            }
         }
     }
 }
 
 bool ReadAheadThread::ReconstructDataFromCow() {
-    std::unordered_map<uint64_t, void*>& read_ahead_buffer_map = snapuserd_->GetReadAheadMap();
-    read_ahead_buffer_map.clear();
+    ReadAheadIndex& read_ahead_index = snapuserd_->GetReadAheadIndex();
+    read_ahead_index.Clear();
     loff_t metadata_offset = 0;
     loff_t start_data_offset = snapuserd_->GetBufferDataOffset();
     int num_ops = 0;
@@ -237,19 +256,20 @@ bool ReadAheadThread::ReconstructDataFromCow() {
 
         loff_t buffer_offset = bm->file_offset - start_data_offset;
         void* bufptr = static_cast<void*>((char*)read_ahead_buffer_ + buffer_offset);
-        read_ahead_buffer_map[bm->new_block] = bufptr;
+        read_ahead_index.Add(bm->new_block, bufptr);
         num_ops += 1;
         total_blocks_merged += 1;
 
         metadata_offset += sizeof(struct ScratchMetadata);
     }
+    read_ahead_index.Finalize();
 
     // We are done re-constructing the mapping; however, we need to make sure
     // all the COW operations to-be merged are present in the re-constructed
     // mapping.
     while (!IterDone()) {
         const CowOperation* op = GetIterOp();
-        if (read_ahead_buffer_map.find(op->new_block) != read_ahead_buffer_map.end()) {
+        if (read_ahead_index.Find(op->new_block) != nullptr) {
             num_ops -= 1;
             snapuserd_->SetFinalBlockMerged(op->new_block);
             IterNext();
@@ -289,8 +309,8 @@ bool ReadAheadThread::ReadAheadIOStart() {
         return ReconstructDataFromCow();
     }
 
-    std::unordered_map<uint64_t, void*>& read_ahead_buffer_map = snapuserd_->GetReadAheadMap();
-    read_ahead_buffer_map.clear();
+    ReadAheadIndex& read_ahead_index = snapuserd_->GetReadAheadIndex();
+    read_ahead_index.Clear();
 
     int num_ops = (snapuserd_->GetBufferDataSize()) / BLOCK_SZ;
     loff_t metadata_offset = 0;
@@ -341,7 +361,7 @@ bool ReadAheadThread::ReadAheadIOStart() {
             blocks.pop_back();
             // Assign the mapping
             void* bufptr = static_cast<void*>((char*)read_ahead_buffer_ + offset);
-            read_ahead_buffer_map[new_block] = bufptr;
+            read_ahead_index.Add(new_block, bufptr);
             offset += BLOCK_SZ;
 
             bm = reinterpret_cast<struct ScratchMetadata*>((char*)metadata_buffer_ +
@@ -355,17 +375,10 @@ bool ReadAheadThread::ReadAheadIOStart() {
             linear_blocks -= 1;
         }
 
-        // Read from the base device consecutive set of blocks in one shot
-        if (!android::base::ReadFullyAtOffset(backing_store_fd_,
-                                              (char*)read_ahead_buffer_ + buffer_offset, io_size,
-                                              source_block * BLOCK_SZ)) {
-            SNAP_PLOG(ERROR) << "Copy-op failed. Read from backing store: " << backing_store_device_
-                             << "at block :" << source_block << " buffer_offset : " << buffer_offset
-                             << " io_size : " << io_size << " buf-addr : " << read_ahead_buffer_;
-
-            snapuserd_->ReadAheadIOFailed();
-            return false;
-        }
+        // Queue the read of this consecutive set of blocks; all the
+        // sets in the region are read together once the loop is done
+        batch_reader_.AddRead(backing_store_fd_.get(), (char*)read_ahead_buffer_ + buffer_offset,
+                              io_size, source_block * BLOCK_SZ);
 
         // This is important - explicitly set the contents to zero. This is used
         // when re-constructing the data after crash. This indicates end of
@@ -377,6 +390,17 @@ bool ReadAheadThread::ReadAheadIOStart() {
         buffer_offset += io_size;
     }
 
+    // Read all the copy-ops of the region from the base device
+    if (!batch_reader_.Submit()) {
+        SNAP_LOG(ERROR) << "Copy-op failed. Read from backing store: " << backing_store_device_
+                        << " failed for " << total_blocks_merged << " blocks";
+        snapuserd_->ReadAheadIOFailed();
+        return false;
+    }
+
+    read_ahead_index.Finalize();
+    CheckOverlap();
+
     snapuserd_->SetTotalRaBlocksMerged(total_blocks_merged);
 
     // Flush the data only if we have a overlapping blocks in the region
@@ -430,6 +454,7 @@ bool ReadAheadThread::InitializeFds() {
         return false;
     }
 
+    batch_reader_.Initialize(BATCH_READER_QUEUE_DEPTH);
     return true;
 }
 
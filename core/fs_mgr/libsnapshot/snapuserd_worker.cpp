@@ -22,6 +22,8 @@
 
 #include <libsnapshot/snapuserd_client.h>
 
+#include "cow_decompress.h"
+
 namespace android {
 namespace snapshot {
 
@@ -95,21 +97,20 @@ bool WorkerThread::InitializeFds() {
         return false;
     }
 
-    ctrl_fd_.reset(open(control_device_.c_str(), O_RDWR));
-    if (ctrl_fd_ < 0) {
-        SNAP_PLOG(ERROR) << "Unable to open " << control_device_;
+    off_t cow_size = lseek(cow_fd_.get(), 0, SEEK_END);
+    if (cow_size < 0) {
+        SNAP_PLOG(ERROR) << "lseek failed: " << cow_device_;
         return false;
     }
+    cow_size_ = cow_size;
 
-    return true;
-}
-
-bool WorkerThread::InitReader() {
-    reader_ = std::make_unique<CowReader>();
-    if (!reader_->InitForMerge(std::move(cow_fd_))) {
+    ctrl_fd_.reset(open(control_device_.c_str(), O_RDWR));
+    if (ctrl_fd_ < 0) {
+        SNAP_PLOG(ERROR) << "Unable to open " << control_device_;
         return false;
     }
 
+    batch_reader_.Initialize(BATCH_READER_QUEUE_DEPTH);
     return true;
 }
 
@@ -130,117 +131,141 @@ void WorkerThread::ConstructKernelCowHeader() {
     dh->chunk_size = CHUNK_SIZE;
 }
 
-// Start the replace operation. This will read the
-// internal COW format and if the block is compressed,
-// it will be de-compressed.
-bool WorkerThread::ProcessReplaceOp(const CowOperation* cow_op) {
-    if (!reader_->ReadData(*cow_op, &bufsink_)) {
-        SNAP_LOG(ERROR) << "ProcessReplaceOp failed for block " << cow_op->new_block;
+// Decompress a replace operation whose compressed data has
+// already been read, into block "block_index" of the payload.
+bool WorkerThread::DecompressReplaceOp(const CowOperation* cow_op, const void* data,
+                                       size_t block_index) {
+    std::unique_ptr<IDecompressor> decompressor = IDecompressor::FromType(cow_op->compression);
+    if (!decompressor) {
+        SNAP_LOG(ERROR) << "Unknown compression type: " << cow_op->compression
+                        << " for block " << cow_op->new_block;
         return false;
     }
 
-    return true;
-}
-
-bool WorkerThread::ReadFromBaseDevice(const CowOperation* cow_op) {
-    void* buffer = bufsink_.GetPayloadBuffer(BLOCK_SZ);
-    if (buffer == nullptr) {
-        SNAP_LOG(ERROR) << "ReadFromBaseDevice: Failed to get payload buffer";
-        return false;
-    }
-    SNAP_LOG(DEBUG) << " ReadFromBaseDevice...: new-block: " << cow_op->new_block
-                    << " Source: " << cow_op->source;
-    if (!android::base::ReadFullyAtOffset(backing_store_fd_, buffer, BLOCK_SZ,
-                                          cow_op->source * BLOCK_SZ)) {
-        SNAP_PLOG(ERROR) << "Copy-op failed. Read from backing store: " << backing_store_device_
-                         << "at block :" << cow_op->source;
-        return false;
-    }
+    MemoryByteStream stream(data, cow_op->data_length);
+    decompressor->set_stream(&stream);
+    decompressor->set_sink(&bufsink_);
 
-    return true;
-}
+    bufsink_.ResetBufferOffset();
+    bufsink_.UpdateBufferOffset(block_index * BLOCK_SZ);
+    bool ret = decompressor->Decompress(BLOCK_SZ);
+    bufsink_.ResetBufferOffset();
 
-bool WorkerThread::GetReadAheadPopulatedBuffer(const CowOperation* cow_op) {
-    void* buffer = bufsink_.GetPayloadBuffer(BLOCK_SZ);
-    if (buffer == nullptr) {
-        SNAP_LOG(ERROR) << "GetReadAheadPopulatedBuffer: Failed to get payload buffer";
-        return false;
+    if (!ret) {
+        SNAP_LOG(ERROR) << "Decompression failed for block " << cow_op->new_block;
     }
+    return ret;
+}
 
-    if (!snapuserd_->GetReadAheadPopulatedBuffer(cow_op->new_block, buffer)) {
+// Fill consecutive blocks of the payload, one per COW operation.
+// Zero blocks and blocks held by the read-ahead cache are filled
+// right away; everything else is queued on the batch reader so
+// that all the reads of a request are in flight together.
+// Compressed data is staged in compressed_data_ and decompressed
+// once all the reads have completed.
+bool WorkerThread::ProcessCowOps(const std::vector<const CowOperation*>& cow_ops) {
+    uint8_t* payload =
+            reinterpret_cast<uint8_t*>(bufsink_.GetPayloadBuffer(cow_ops.size() * BLOCK_SZ));
+    if (payload == nullptr) {
+        SNAP_LOG(ERROR) << "ProcessCowOps: Failed to get payload buffer for " << cow_ops.size()
+                        << " blocks";
         return false;
     }
 
-    return true;
-}
-
-// Start the copy operation. This will read the backing
-// block device which is represented by cow_op->source.
-bool WorkerThread::ProcessCopyOp(const CowOperation* cow_op) {
-    if (!GetReadAheadPopulatedBuffer(cow_op)) {
-        SNAP_LOG(DEBUG) << " GetReadAheadPopulatedBuffer failed..."
-                        << " new_block: " << cow_op->new_block;
-        if (!ReadFromBaseDevice(cow_op)) {
-            return false;
+    size_t compressed_size = 0;
+    for (const CowOperation* cow_op : cow_ops) {
+        if (cow_op->type == kCowReplaceOp && cow_op->compression != kCowCompressNone) {
+            compressed_size += cow_op->data_length;
         }
     }
+    if (compressed_data_.size() < compressed_size) {
+        compressed_data_.resize(compressed_size);
+    }
 
-    return true;
-}
+    size_t compressed_offset = 0;
+    for (size_t i = 0; i < cow_ops.size(); i++) {
+        const CowOperation* cow_op = cow_ops[i];
+        uint8_t* block = payload + i * BLOCK_SZ;
 
-bool WorkerThread::ProcessZeroOp() {
-    // Zero out the entire block
-    void* buffer = bufsink_.GetPayloadBuffer(BLOCK_SZ);
-    if (buffer == nullptr) {
-        SNAP_LOG(ERROR) << "ProcessZeroOp: Failed to get payload buffer";
-        return false;
-    }
+        switch (cow_op->type) {
+            case kCowZeroOp: {
+                memset(block, 0, BLOCK_SZ);
+                break;
+            }
 
-    memset(buffer, 0, BLOCK_SZ);
-    return true;
-}
+            case kCowCopyOp: {
+                if (snapuserd_->GetReadAheadPopulatedBuffer(cow_op->new_block, block)) {
+                    break;
+                }
+                SNAP_LOG(DEBUG) << " GetReadAheadPopulatedBuffer failed..."
+                                << " new_block: " << cow_op->new_block;
+                batch_reader_.AddRead(backing_store_fd_.get(), block, BLOCK_SZ,
+                                      cow_op->source * BLOCK_SZ);
+                break;
+            }
 
-bool WorkerThread::ProcessCowOp(const CowOperation* cow_op) {
-    if (cow_op == nullptr) {
-        SNAP_LOG(ERROR) << "ProcessCowOp: Invalid cow_op";
-        return false;
-    }
+            case kCowReplaceOp: {
+                if (cow_op->source + cow_op->data_length > cow_size_) {
+                    SNAP_LOG(ERROR) << "Replace-op for block " << cow_op->new_block
+                                    << " is past the end of the COW device";
+                    return false;
+                }
+                if (cow_op->compression == kCowCompressNone) {
+                    if (cow_op->data_length != BLOCK_SZ) {
+                        SNAP_LOG(ERROR) << "Invalid data length " << cow_op->data_length
+                                        << " for uncompressed block " << cow_op->new_block;
+                        return false;
+                    }
+                    batch_reader_.AddRead(cow_fd_.get(), block, BLOCK_SZ, cow_op->source);
+                } else {
+                    uint8_t* data = compressed_data_.data() + compressed_offset;
+                    batch_reader_.AddRead(cow_fd_.get(), data, cow_op->data_length,
+                                          cow_op->source);
+                    compressed_offset += cow_op->data_length;
+                }
+                break;
+            }
 
-    switch (cow_op->type) {
-        case kCowReplaceOp: {
-            return ProcessReplaceOp(cow_op);
+            default: {
+                SNAP_LOG(ERROR) << "Unknown operation-type found: " << cow_op->type;
+                return false;
+            }
         }
+    }
 
-        case kCowZeroOp: {
-            return ProcessZeroOp();
-        }
+    if (!batch_reader_.Submit()) {
+        SNAP_LOG(ERROR) << "ProcessCowOps: Read failed for " << cow_ops.size() << " blocks";
+        return false;
+    }
 
-        case kCowCopyOp: {
-            return ProcessCopyOp(cow_op);
+    compressed_offset = 0;
+    for (size_t i = 0; i < cow_ops.size(); i++) {
+        const CowOperation* cow_op = cow_ops[i];
+        if (cow_op->type != kCowReplaceOp || cow_op->compression == kCowCompressNone) {
+            continue;
         }
-
-        default: {
-            SNAP_LOG(ERROR) << "Unknown operation-type found: " << cow_op->type;
+        if (!DecompressReplaceOp(cow_op, compressed_data_.data() + compressed_offset, i)) {
+            return false;
         }
+        compressed_offset += cow_op->data_length;
     }
-    return false;
+    return true;
 }
 
-int WorkerThread::ReadUnalignedSector(
-        sector_t sector, size_t size,
-        std::vector<std::pair<sector_t, const CowOperation*>>::iterator& it) {
+int WorkerThread::ReadUnalignedSector(sector_t sector, size_t size, const CowOperation* cow_op) {
     size_t skip_sector_size = 0;
+    sector_t aligned_sector = ChunkToSector(SectorToChunk(sector));
 
     SNAP_LOG(DEBUG) << "ReadUnalignedSector: sector " << sector << " size: " << size
-                    << " Aligned sector: " << it->first;
+                    << " Aligned sector: " << aligned_sector;
 
-    if (!ProcessCowOp(it->second)) {
+    if (!ProcessCowOps({cow_op})) {
         SNAP_LOG(ERROR) << "ReadUnalignedSector: " << sector << " failed of size: " << size
-                        << " Aligned sector: " << it->first;
+                        << " Aligned sector: " << aligned_sector;
         return -1;
     }
 
-    int num_sectors_skip = sector - it->first;
+    int num_sectors_skip = sector - aligned_sector;
 
     if (num_sectors_skip > 0) {
         skip_sector_size = num_sectors_skip << SECTOR_SHIFT;
@@ -249,7 +274,7 @@ int WorkerThread::ReadUnalignedSector(
 
         if (skip_sector_size == BLOCK_SZ) {
             SNAP_LOG(ERROR) << "Invalid un-aligned IO request at sector: " << sector
-                            << " Base-sector: " << it->first;
+                            << " Base-sector: " << aligned_sector;
             return -1;
         }
 
@@ -272,34 +297,25 @@ int WorkerThread::ReadUnalignedSector(
  *
  */
 int WorkerThread::ReadData(sector_t sector, size_t size) {
-    std::vector<std::pair<sector_t, const CowOperation*>>& chunk_vec = snapuserd_->GetChunkVec();
-    std::vector<std::pair<sector_t, const CowOperation*>>::iterator it;
+    const ChunkIndex& chunk_index = snapuserd_->GetChunkIndex();
     /*
-     * chunk_map stores COW operation at 4k granularity.
+     * chunk_index stores COW operation at 4k granularity.
      * If the requested IO with the sector falls on the 4k
      * boundary, then we can read the COW op directly without
      * any issue.
      *
      * However, if the requested sector is not 4K aligned,
-     * then we will have the find the nearest COW operation
-     * and chop the 4K block to fetch the requested sector.
+     * then we will have the find the COW operation of the
+     * enclosing 4K block and chop it to fetch the requested sector.
      */
-    it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(), std::make_pair(sector, nullptr),
-                          Snapuserd::compare);
+    const CowOperation* cow_op = chunk_index.Find(SectorToChunk(sector));
 
-    if (!(it != chunk_vec.end())) {
-        SNAP_LOG(ERROR) << "ReadData: Sector " << sector << " not found in chunk_vec";
+    if (cow_op == nullptr) {
+        SNAP_LOG(ERROR) << "ReadData: Sector " << sector << " not found in chunk_index";
         return -1;
     }
 
-    // We didn't find the required sector; hence find the previous sector
-    // as lower_bound will gives us the value greater than
-    // the requested sector
-    if (it->first != sector) {
-        if (it != chunk_vec.begin()) {
-            --it;
-        }
-
+    if (!IsSectorChunkAligned(sector)) {
         /*
          * If the IO is spanned between two COW operations,
          * split the IO into two parts:
@@ -323,38 +339,34 @@ int WorkerThread::ReadData(sector_t sector, size_t size) {
          * 1: IO of size 512B from offset 3584 bytes (COW OP-1)
          * 2: IO of size 512B from offset 4096 bytes (COW OP-2)
          */
-        return ReadUnalignedSector(sector, size, it);
+        return ReadUnalignedSector(sector, size, cow_op);
     }
 
     int num_ops = DIV_ROUND_UP(size, BLOCK_SZ);
-    sector_t read_sector = sector;
+    chunk_t chunk = SectorToChunk(sector);
+    cow_ops_.clear();
     while (num_ops) {
         // We have to make sure that the reads are
         // sequential; there shouldn't be a data
         // request merged with a metadata IO.
-        if (it->first != read_sector) {
-            SNAP_LOG(ERROR) << "Invalid IO request: read_sector: " << read_sector
-                            << " cow-op sector: " << it->first;
-            return -1;
-        } else if (!ProcessCowOp(it->second)) {
+        if (cow_op == nullptr) {
+            SNAP_LOG(ERROR) << "Invalid IO request at sector " << sector
+                            << " No COW op at sector: " << ChunkToSector(chunk)
+                            << " pending read-request: " << num_ops;
             return -1;
         }
+        cow_ops_.push_back(cow_op);
         num_ops -= 1;
-        read_sector += (BLOCK_SZ >> SECTOR_SHIFT);
+        chunk += 1;
 
-        it++;
-
-        if (it == chunk_vec.end() && num_ops) {
-            SNAP_LOG(ERROR) << "Invalid IO request at sector " << sector
-                            << " COW ops completed; pending read-request: " << num_ops;
-            return -1;
+        if (num_ops) {
+            cow_op = chunk_index.Find(chunk);
         }
-        // Update the buffer offset
-        bufsink_.UpdateBufferOffset(BLOCK_SZ);
     }
 
-    // Reset the buffer offset
-    bufsink_.ResetBufferOffset();
+    if (!ProcessCowOps(cow_ops_)) {
+        return -1;
+    }
     return size;
 }
 
@@ -472,9 +484,9 @@ loff_t WorkerThread::GetMergeStartOffset(void* merged_buffer, void* unmerged_buf
 int WorkerThread::GetNumberOfMergedOps(void* merged_buffer, void* unmerged_buffer, loff_t offset,
                                        int unmerged_exceptions, bool* copy_op, bool* commit) {
     int merged_ops_cur_iter = 0;
-    std::unordered_map<uint64_t, void*>& read_ahead_buffer_map = snapuserd_->GetReadAheadMap();
+    const ReadAheadIndex& read_ahead_index = snapuserd_->GetReadAheadIndex();
     *copy_op = false;
-    std::vector<std::pair<sector_t, const CowOperation*>>& chunk_vec = snapuserd_->GetChunkVec();
+    const ChunkIndex& chunk_index = snapuserd_->GetChunkIndex();
 
     // Find the operations which are merged in this cycle.
     while ((unmerged_exceptions + merged_ops_cur_iter) < exceptions_per_area_) {
@@ -496,26 +508,18 @@ int WorkerThread::GetNumberOfMergedOps(void* merged_buffer, void* unmerged_buffe
         if (cow_de->new_chunk != 0) {
             merged_ops_cur_iter += 1;
             offset += sizeof(struct disk_exception);
-            auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(),
-                                       std::make_pair(ChunkToSector(cow_de->new_chunk), nullptr),
-                                       Snapuserd::compare);
+            const CowOperation* cow_op = chunk_index.Find(cow_de->new_chunk);
 
-            if (!(it != chunk_vec.end())) {
+            if (cow_op == nullptr) {
                 SNAP_LOG(ERROR) << "Sector not found: " << ChunkToSector(cow_de->new_chunk);
                 return -1;
             }
 
-            if (!(it->first == ChunkToSector(cow_de->new_chunk))) {
-                SNAP_LOG(ERROR) << "Invalid sector: " << ChunkToSector(cow_de->new_chunk);
-                return -1;
-            }
-            const CowOperation* cow_op = it->second;
-
             if (snapuserd_->IsReadAheadFeaturePresent() && cow_op->type == kCowCopyOp) {
                 *copy_op = true;
                 // Every single copy operation has to come from read-ahead
                 // cache.
-                if (read_ahead_buffer_map.find(cow_op->new_block) == read_ahead_buffer_map.end()) {
+                if (read_ahead_index.Find(cow_op->new_block) == nullptr) {
                     SNAP_LOG(ERROR)
                             << " Block: " << cow_op->new_block << " not found in read-ahead cache"
                             << " Source: " << cow_op->source;
@@ -648,6 +652,13 @@ bool WorkerThread::ReadDmUserPayload(void* buffer, size_t size) {
     return true;
 }
 
+const CowOperation* WorkerThread::FindCowOp(sector_t sector) {
+    if (!IsSectorChunkAligned(sector)) {
+        return nullptr;
+    }
+    return snapuserd_->GetChunkIndex().Find(SectorToChunk(sector));
+}
+
 bool WorkerThread::DmuserWriteRequest() {
     struct dm_user_header* header = bufsink_.GetHeaderPtr();
 
@@ -679,15 +690,11 @@ bool WorkerThread::DmuserWriteRequest() {
         return true;
     }
 
-    std::vector<std::pair<sector_t, const CowOperation*>>& chunk_vec = snapuserd_->GetChunkVec();
     size_t remaining_size = header->len;
     size_t read_size = std::min(PAYLOAD_SIZE, remaining_size);
 
     chunk_t chunk = SectorToChunk(header->sector);
-    auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(),
-                               std::make_pair(header->sector, nullptr), Snapuserd::compare);
-
-    bool not_found = (it == chunk_vec.end() || it->first != header->sector);
+    bool not_found = (FindCowOp(header->sector) == nullptr);
 
     if (not_found) {
         void* buffer = bufsink_.GetPayloadBuffer(read_size);
@@ -727,7 +734,6 @@ bool WorkerThread::DmuserReadRequest() {
     size_t remaining_size = header->len;
     loff_t offset = 0;
     sector_t sector = header->sector;
-    std::vector<std::pair<sector_t, const CowOperation*>>& chunk_vec = snapuserd_->GetChunkVec();
     bool header_response = true;
     do {
         size_t read_size = std::min(PAYLOAD_SIZE, remaining_size);
@@ -750,9 +756,7 @@ bool WorkerThread::DmuserReadRequest() {
                 header->type = DM_USER_RESP_ERROR;
             }
         } else {
-            auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(),
-                                       std::make_pair(header->sector, nullptr), Snapuserd::compare);
-            bool not_found = (it == chunk_vec.end() || it->first != header->sector);
+            bool not_found = (FindCowOp(header->sector) == nullptr);
             if (!offset && (read_size == BLOCK_SZ) && not_found) {
                 if (!ReadDiskExceptions(chunk, read_size)) {
                     SNAP_LOG(ERROR) << "ReadDiskExceptions failed for chunk id: " << chunk
@@ -824,10 +828,6 @@ bool WorkerThread::RunThread() {
         return false;
     }
 
-    if (!InitReader()) {
-        return false;
-    }
-
     // Start serving IO
     while (true) {
         if (!ProcessIORequest()) {
@@ -836,7 +836,6 @@ bool WorkerThread::RunThread() {
     }
 
     CloseFds();
-    reader_->CloseCowFd();
 
     return true;
 }
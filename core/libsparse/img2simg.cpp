@@ -18,6 +18,7 @@
 #define _LARGEFILE64_SOURCE 1
 
 #include <fcntl.h>
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,6 +27,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <thread>
+
+#include <android-base/parseint.h>
 #include <sparse/sparse.h>
 
 #ifndef O_BINARY
@@ -37,8 +42,12 @@
 #define off64_t off_t
 #endif
 
+/* More threads than this can't be kept busy by the single reader or writer. */
+static constexpr unsigned int kMaxThreads = 256;
+
 void usage() {
-  fprintf(stderr, "Usage: img2simg <raw_image_file> <sparse_image_file> [<block_size>]\n");
+  fprintf(stderr,
+          "Usage: img2simg [-j <threads>] <raw_image_file> <sparse_image_file> [<block_size>]\n");
 }
 
 int main(int argc, char* argv[]) {
@@ -47,7 +56,26 @@ int main(int argc, char* argv[]) {
   int ret;
   struct sparse_file* s;
   unsigned int block_size = 4096;
+  unsigned int threads = std::clamp(std::thread::hardware_concurrency(), 1u, kMaxThreads);
   off64_t len;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:")) != -1) {
+    switch (opt) {
+      case 'j':
+        if (!android::base::ParseUint(optarg, &threads, kMaxThreads) || threads < 1) {
+          fprintf(stderr, "Invalid thread count %s\n", optarg);
+          usage();
+          exit(-1);
+        }
+        break;
+      default:
+        usage();
+        exit(-1);
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
 
   if (argc < 3 || argc > 4) {
     usage();
@@ -93,6 +121,7 @@ int main(int argc, char* argv[]) {
   }
 
   sparse_file_verbose(s);
+  sparse_file_set_threads(s, threads);
   ret = sparse_file_read(s, in, false, false);
   if (ret) {
     fprintf(stderr, "Failed to read file\n");
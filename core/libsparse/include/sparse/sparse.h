@@ -236,8 +236,9 @@ int sparse_file_foreach_chunk(struct sparse_file *s, bool sparse, bool crc,
  * Reads a file into a sparse file cookie.  If sparse is true, the file is
  * assumed to be in the Android sparse file format.  If sparse is false, the
  * file will be sparsed by looking for block aligned chunks of all zeros or
- * another 32 bit value.  If crc is true, the crc of the sparse file will be
- * verified.
+ * another 32 bit value, and holes the filesystem reports through SEEK_DATA
+ * and SEEK_HOLE are treated as zeros without being read.  If crc is true, the
+ * crc of the sparse file will be verified.
  *
  * Returns 0 on success, negative errno on error.
  */
@@ -328,6 +329,22 @@ int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
  */
 void sparse_file_verbose(struct sparse_file *s);
 
+/**
+ * sparse_file_set_threads - process blocks on worker threads
+ *
+ * @s - sparse file cookie
+ * @threads - number of worker threads
+ *
+ * With more than one thread, sparse_file_read() of a raw image detects fill
+ * blocks on worker threads while the next blocks are read, and
+ * sparse_file_write() maps, checksums and gzips blocks on worker threads
+ * while earlier blocks are written out.  The output is written in order and
+ * is the same as with a single thread, except that gzipped output is made of
+ * independently compressed segments.  The default is 1, which does all the
+ * work on the calling thread.
+ */
+void sparse_file_set_threads(struct sparse_file *s, unsigned int threads);
+
 /**
  * sparse_print_verbose - function called to print verbose errors
  *
@@ -30,10 +30,19 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#ifdef __linux__
+#include <linux/falloc.h>
+#include <sys/syscall.h>
+#endif
+
+#include <memory>
+#include <vector>
+
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
 #include "sparse_format.h"
+#include "sparse_pipeline.h"
 
 #include <android-base/mapped_file.h>
 
@@ -62,10 +71,18 @@ struct output_file_ops {
   int (*pad)(struct output_file*, int64_t);
   int (*write)(struct output_file*, void*, size_t);
   void (*close)(struct output_file*);
+  /*
+   * Optional. copy copies up to len bytes from fd at offset straight to the
+   * output and returns how many it managed, which may be fewer if the kernel
+   * can't do it. zero skips over len bytes of output leaving them zeroed, or
+   * returns an error if it can't. Callers write the data themselves instead.
+   */
+  int64_t (*copy)(struct output_file*, int fd, int64_t offset, uint64_t len);
+  int (*zero)(struct output_file*, uint64_t len);
 };
 
 struct sparse_file_ops {
-  int (*write_data_chunk)(struct output_file* out, uint64_t len, void* data);
+  int (*write_data_chunk)(struct output_file* out, uint64_t len, void* data, const uint32_t* crc);
   int (*write_fill_chunk)(struct output_file* out, uint64_t len, uint32_t fill_val);
   int (*write_skip_chunk)(struct output_file* out, uint64_t len);
   int (*write_end_chunk)(struct output_file* out);
@@ -92,9 +109,21 @@ struct output_file_gz {
 
 #define to_output_file_gz(_o) container_of((_o), struct output_file_gz, out)
 
+class ParallelGzWriter;
+
+struct output_file_gz_parallel {
+  struct output_file out;
+  unsigned int threads;
+  ParallelGzWriter* writer;
+};
+
+#define to_output_file_gz_parallel(_o) container_of((_o), struct output_file_gz_parallel, out)
+
 struct output_file_normal {
   struct output_file out;
   int fd;
+  bool no_copy;
+  bool no_zero;
 };
 
 #define to_output_file_normal(_o) container_of((_o), struct output_file_normal, out)
@@ -165,12 +194,70 @@ static void file_close(struct output_file* out) {
   free(outn);
 }
 
+#ifdef __linux__
+static int64_t file_copy(struct output_file* out, int fd, int64_t offset, uint64_t len) {
+  struct output_file_normal* outn = to_output_file_normal(out);
+  loff_t in_off = offset;
+  uint64_t copied = 0;
+
+  /*
+   * Lets the kernel move the data, or share extents on filesystems that can,
+   * instead of mapping the input and writing it back out through userspace.
+   */
+  while (!outn->no_copy && copied < len) {
+    size_t copy_len = std::min(len - copied, (uint64_t)INT_MAX & ~(uint64_t)4095);
+    ssize_t ret = syscall(__NR_copy_file_range, fd, &in_off, outn->fd, nullptr, copy_len, 0);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      /* Most likely EXDEV, ENOSYS or EINVAL, which won't change for later chunks */
+      if (copied == 0) {
+        outn->no_copy = true;
+      }
+      break;
+    }
+    copied += ret;
+  }
+
+  return copied;
+}
+
+static int file_zero(struct output_file* out, uint64_t len) {
+  struct output_file_normal* outn = to_output_file_normal(out);
+
+  if (outn->no_zero) {
+    return -EOPNOTSUPP;
+  }
+
+  off64_t pos = lseek64(outn->fd, 0, SEEK_CUR);
+  if (pos < 0) {
+    return -errno;
+  }
+
+  /*
+   * Punching a hole leaves the range reading back as zeros whether or not it
+   * was written before, without writing or caching any zeros.
+   */
+  if (fallocate(outn->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len) < 0) {
+    outn->no_zero = true;
+    return -errno;
+  }
+
+  return file_skip(out, len);
+}
+#endif
+
 static struct output_file_ops file_ops = {
     .open = file_open,
     .skip = file_skip,
     .pad = file_pad,
     .write = file_write,
     .close = file_close,
+#ifdef __linux__
+    .copy = file_copy,
+    .zero = file_zero,
+#endif
 };
 
 static int gz_file_open(struct output_file* out, int fd) {
@@ -252,6 +339,218 @@ static struct output_file_ops gz_file_ops = {
     .close = gz_file_close,
 };
 
+/*
+ * With more than one thread gzipped output is compressed the way pigz does
+ * it. The stream is cut into segments that are deflated in parallel, each
+ * primed with the end of the previous segment as its dictionary and ended
+ * with a sync flush, so that they concatenate into a single gzip member.
+ */
+#define GZ_SEGMENT_SIZE (1024 * 1024)
+#define GZ_WINDOW_SIZE 32768
+
+class ParallelGzWriter {
+ public:
+  ParallelGzWriter(int fd, unsigned int threads)
+      : fd_(fd), pipeline_(threads, 2 * threads) {
+    segment_.reserve(GZ_SEGMENT_SIZE);
+  }
+
+  int64_t Tell() const { return len_; }
+
+  int Write(const void* data, size_t len) {
+    const char* p = reinterpret_cast<const char*>(data);
+    while (len > 0) {
+      size_t n = std::min(len, GZ_SEGMENT_SIZE - segment_.size());
+      segment_.insert(segment_.end(), p, p + n);
+      p += n;
+      len -= n;
+      len_ += n;
+      if (segment_.size() == GZ_SEGMENT_SIZE) {
+        int ret = Submit(false);
+        if (ret < 0) return ret;
+      }
+    }
+    return 0;
+  }
+
+  int WriteZeros(int64_t len) {
+    while (len > 0) {
+      size_t n = std::min<int64_t>(len, GZ_SEGMENT_SIZE - segment_.size());
+      segment_.resize(segment_.size() + n);
+      len -= n;
+      len_ += n;
+      if (segment_.size() == GZ_SEGMENT_SIZE) {
+        int ret = Submit(false);
+        if (ret < 0) return ret;
+      }
+    }
+    return 0;
+  }
+
+  int Close() {
+    int ret = Submit(true);
+    if (ret < 0) return ret;
+    return pipeline_.Drain();
+  }
+
+ private:
+  struct Segment {
+    std::vector<char> in;
+    std::vector<char> dictionary;
+    std::vector<char> out;
+    uint32_t crc;
+    bool last;
+    int error;
+  };
+
+  int Submit(bool last) {
+    auto segment = std::make_shared<Segment>();
+    segment->in = std::move(segment_);
+    segment->dictionary = window_;
+    segment->last = last;
+    segment->error = 0;
+
+    /* The next segment's dictionary is the last 32K of input so far. */
+    size_t tail = std::min<size_t>(segment->in.size(), GZ_WINDOW_SIZE);
+    window_.insert(window_.end(), segment->in.end() - tail, segment->in.end());
+    if (window_.size() > GZ_WINDOW_SIZE) {
+      window_.erase(window_.begin(), window_.end() - GZ_WINDOW_SIZE);
+    }
+    segment_.clear();
+    segment_.reserve(GZ_SEGMENT_SIZE);
+
+    return pipeline_.Add([segment] { Deflate(segment.get()); },
+                         [this, segment] { return WriteSegment(segment.get()); });
+  }
+
+  static void Deflate(Segment* segment) {
+    z_stream zs = {};
+    if (deflateInit2(&zs, 9, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      segment->error = -ENOMEM;
+      return;
+    }
+    if (!segment->dictionary.empty()) {
+      deflateSetDictionary(&zs, reinterpret_cast<Bytef*>(segment->dictionary.data()),
+                           segment->dictionary.size());
+    }
+
+    /* The bound doesn't cover the empty block a sync flush ends with. */
+    segment->out.resize(deflateBound(&zs, segment->in.size()) + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(segment->in.data());
+    zs.avail_in = segment->in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(segment->out.data());
+    zs.avail_out = segment->out.size();
+    int ret = deflate(&zs, segment->last ? Z_FINISH : Z_SYNC_FLUSH);
+    if ((segment->last && ret != Z_STREAM_END) || (!segment->last && ret != Z_OK) ||
+        zs.avail_in != 0 || zs.avail_out == 0) {
+      segment->error = -EIO;
+    }
+    segment->out.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    segment->crc = sparse_crc32(0, segment->in.data(), segment->in.size());
+  }
+
+  int WriteSegment(Segment* segment) {
+    if (segment->error) {
+      error("deflate failed");
+      return segment->error;
+    }
+    if (!header_written_) {
+      static const unsigned char header[] = {0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 2, 3};
+      if (WriteAll(header, sizeof(header)) < 0) return -1;
+      header_written_ = true;
+    }
+    if (WriteAll(segment->out.data(), segment->out.size()) < 0) return -1;
+    crc_ = sparse_crc32_combine(crc_, segment->crc, segment->in.size());
+    written_len_ += segment->in.size();
+
+    if (segment->last) {
+      unsigned char trailer[8];
+      for (int i = 0; i < 4; i++) {
+        trailer[i] = crc_ >> (8 * i);
+        trailer[4 + i] = written_len_ >> (8 * i);
+      }
+      if (WriteAll(trailer, sizeof(trailer)) < 0) return -1;
+    }
+    return 0;
+  }
+
+  int WriteAll(const void* data, size_t len) {
+    const char* p = reinterpret_cast<const char*>(data);
+    while (len > 0) {
+      ssize_t ret = write(fd_, p, len);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        error_errno("write");
+        return -1;
+      }
+      p += ret;
+      len -= ret;
+    }
+    return 0;
+  }
+
+  int fd_;
+  int64_t len_ = 0;
+  std::vector<char> segment_;
+  std::vector<char> window_;
+
+  /* Only used while finishing segments, in order. */
+  bool header_written_ = false;
+  uint32_t crc_ = 0;
+  uint64_t written_len_ = 0;
+
+  /* Last, so that it is destroyed before anything its jobs use. */
+  OrderedPipeline pipeline_;
+};
+
+static int gz_parallel_file_open(struct output_file* out, int fd) {
+  struct output_file_gz_parallel* outgz = to_output_file_gz_parallel(out);
+
+  outgz->writer = new ParallelGzWriter(fd, outgz->threads);
+  return 0;
+}
+
+static int gz_parallel_file_skip(struct output_file* out, int64_t cnt) {
+  struct output_file_gz_parallel* outgz = to_output_file_gz_parallel(out);
+
+  return outgz->writer->WriteZeros(cnt);
+}
+
+static int gz_parallel_file_pad(struct output_file* out, int64_t len) {
+  struct output_file_gz_parallel* outgz = to_output_file_gz_parallel(out);
+
+  if (outgz->writer->Tell() >= len) {
+    return 0;
+  }
+  return outgz->writer->WriteZeros(len - outgz->writer->Tell());
+}
+
+static int gz_parallel_file_write(struct output_file* out, void* data, size_t len) {
+  struct output_file_gz_parallel* outgz = to_output_file_gz_parallel(out);
+
+  return outgz->writer->Write(data, len);
+}
+
+static void gz_parallel_file_close(struct output_file* out) {
+  struct output_file_gz_parallel* outgz = to_output_file_gz_parallel(out);
+
+  if (outgz->writer->Close() < 0) {
+    error("failed to finish gzip stream");
+  }
+  delete outgz->writer;
+  free(outgz);
+}
+
+static struct output_file_ops gz_parallel_file_ops = {
+    .open = gz_parallel_file_open,
+    .skip = gz_parallel_file_skip,
+    .pad = gz_parallel_file_pad,
+    .write = gz_parallel_file_write,
+    .close = gz_parallel_file_close,
+};
+
 static int callback_file_open(struct output_file* out __unused, int fd __unused) {
   return 0;
 }
@@ -362,7 +661,8 @@ static int write_sparse_fill_chunk(struct output_file* out, uint64_t len, uint32
 
   if (out->use_crc) {
     count = out->block_size / sizeof(uint32_t);
-    while (count--) out->crc32 = sparse_crc32(out->crc32, &fill_val, sizeof(uint32_t));
+    while (count--) out->fill_buf[count] = fill_val;
+    out->crc32 = sparse_crc32(out->crc32, out->fill_buf, out->block_size);
   }
 
   out->cur_out_ptr += rnd_up_len;
@@ -371,7 +671,8 @@ static int write_sparse_fill_chunk(struct output_file* out, uint64_t len, uint32
   return 0;
 }
 
-static int write_sparse_data_chunk(struct output_file* out, uint64_t len, void* data) {
+static int write_sparse_data_chunk(struct output_file* out, uint64_t len, void* data,
+                                   const uint32_t* crc) {
   chunk_header_t chunk_header;
   uint64_t rnd_up_len, zero_len;
   int ret;
@@ -396,7 +697,11 @@ static int write_sparse_data_chunk(struct output_file* out, uint64_t len, void*
   }
 
   if (out->use_crc) {
-    out->crc32 = sparse_crc32(out->crc32, data, len);
+    if (crc) {
+      out->crc32 = sparse_crc32_combine(out->crc32, *crc, len);
+    } else {
+      out->crc32 = sparse_crc32(out->crc32, data, len);
+    }
     if (zero_len) out->crc32 = sparse_crc32(out->crc32, out->zero_buf, zero_len);
   }
 
@@ -438,7 +743,8 @@ static struct sparse_file_ops sparse_file_ops = {
     .write_end_chunk = write_sparse_end_chunk,
 };
 
-static int write_normal_data_chunk(struct output_file* out, uint64_t len, void* data) {
+static int write_normal_data_chunk(struct output_file* out, uint64_t len, void* data,
+                                   const uint32_t* crc __unused) {
   int ret;
   uint64_t rnd_up_len = ALIGN(len, out->block_size);
 
@@ -459,6 +765,10 @@ static int write_normal_fill_chunk(struct output_file* out, uint64_t len, uint32
   unsigned int i;
   uint64_t write_len;
 
+  if (fill_val == 0 && out->ops->zero && out->ops->zero(out, len) == 0) {
+    return 0;
+  }
+
   /* Initialize fill_buf with the fill_val */
   for (i = 0; i < out->block_size / sizeof(uint32_t); i++) {
     out->fill_buf[i] = fill_val;
@@ -575,6 +885,20 @@ static struct output_file* output_file_new_gz(void) {
   return &outgz->out;
 }
 
+static struct output_file* output_file_new_gz_parallel(unsigned int threads) {
+  struct output_file_gz_parallel* outgz = reinterpret_cast<struct output_file_gz_parallel*>(
+      calloc(1, sizeof(struct output_file_gz_parallel)));
+  if (!outgz) {
+    error_errno("malloc struct outgz");
+    return nullptr;
+  }
+
+  outgz->out.ops = &gz_parallel_file_ops;
+  outgz->threads = threads;
+
+  return &outgz->out;
+}
+
 static struct output_file* output_file_new_normal(void) {
   struct output_file_normal* outn =
       reinterpret_cast<struct output_file_normal*>(calloc(1, sizeof(struct output_file_normal)));
@@ -615,11 +939,13 @@ struct output_file* output_file_open_callback(int (*write)(void*, const void*, s
 }
 
 struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t len, int gz,
-                                        int sparse, int chunks, int crc) {
+                                        int sparse, int chunks, int crc, unsigned int threads) {
   int ret;
   struct output_file* out;
 
-  if (gz) {
+  if (gz && threads > 1) {
+    out = output_file_new_gz_parallel(threads);
+  } else if (gz) {
     out = output_file_new_gz();
   } else {
     out = output_file_new_normal();
@@ -632,6 +958,9 @@ struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t
 
   ret = output_file_init(out, block_size, len, sparse, chunks, crc);
   if (ret < 0) {
+    if (gz && threads > 1) {
+      delete to_output_file_gz_parallel(out)->writer;
+    }
     free(out);
     return nullptr;
   }
@@ -641,7 +970,12 @@ struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t
 
 /* Write a contiguous region of data blocks from a memory buffer */
 int write_data_chunk(struct output_file* out, uint64_t len, void* data) {
-  return out->sparse_ops->write_data_chunk(out, len, data);
+  return out->sparse_ops->write_data_chunk(out, len, data, nullptr);
+}
+
+/* Write a contiguous region of data blocks whose crc32 is already known */
+int write_data_chunk_crc(struct output_file* out, uint64_t len, void* data, uint32_t crc) {
+  return out->sparse_ops->write_data_chunk(out, len, data, &crc);
 }
 
 /* Write a contiguous region of data blocks with a fill value */
@@ -649,11 +983,40 @@ int write_fill_chunk(struct output_file* out, uint64_t len, uint32_t fill_val) {
   return out->sparse_ops->write_fill_chunk(out, len, fill_val);
 }
 
+/*
+ * Write a contiguous region of data blocks from a file descriptor. Raw output
+ * has the kernel copy them where it can, so they never pass through userspace.
+ */
 int write_fd_chunk(struct output_file* out, uint64_t len, int fd, int64_t offset) {
-  auto m = android::base::MappedFile::FromFd(fd, offset, len, PROT_READ);
-  if (!m) return -errno;
+  uint64_t copied = 0;
+  int ret;
+
+  if (out->sparse_ops == &normal_file_ops && out->ops->copy) {
+    copied = out->ops->copy(out, fd, offset, len);
+  }
+
+  if (copied < len) {
+    auto m = android::base::MappedFile::FromFd(fd, offset + copied, len - copied, PROT_READ);
+    if (!m) return -errno;
+
+    if (copied == 0) {
+      return out->sparse_ops->write_data_chunk(out, m->size(), m->data(), nullptr);
+    }
+
+    /* Finish a raw chunk the kernel stopped copying part of the way through */
+    ret = out->ops->write(out, m->data(), m->size());
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  /* Like write_normal_data_chunk(), skip the rest of the last block */
+  uint64_t rnd_up_len = ALIGN(len, out->block_size);
+  if (rnd_up_len > len) {
+    return out->ops->skip(out, rnd_up_len - len);
+  }
 
-  return out->sparse_ops->write_data_chunk(out, m->size(), m->data());
+  return 0;
 }
 
 /* Write a contiguous region of data blocks from a file */
@@ -26,11 +26,12 @@ extern "C" {
 struct output_file;
 
 struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t len, int gz,
-                                        int sparse, int chunks, int crc);
+                                        int sparse, int chunks, int crc, unsigned int threads);
 struct output_file* output_file_open_callback(int (*write)(void*, const void*, size_t), void* priv,
                                               unsigned int block_size, int64_t len, int gz,
                                               int sparse, int chunks, int crc);
 int write_data_chunk(struct output_file* out, uint64_t len, void* data);
+int write_data_chunk_crc(struct output_file* out, uint64_t len, void* data, uint32_t crc);
 int write_fill_chunk(struct output_file* out, uint64_t len, uint32_t fill_val);
 int write_file_chunk(struct output_file* out, uint64_t len, const char* file, int64_t offset);
 int write_fd_chunk(struct output_file* out, uint64_t len, int fd, int64_t offset);
@@ -15,8 +15,13 @@
  */
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <unistd.h>
 
+#include <memory>
+
+#include <android-base/mapped_file.h>
 #include <sparse/sparse.h>
 
 #include "defs.h"
@@ -24,8 +29,14 @@
 
 #include "backed_block.h"
 #include "output_file.h"
+#include "sparse_crc32.h"
 #include "sparse_defs.h"
 #include "sparse_format.h"
+#include "sparse_pipeline.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 struct sparse_file* sparse_file_new(unsigned int block_size, int64_t len) {
   struct sparse_file* s = reinterpret_cast<sparse_file*>(calloc(sizeof(struct sparse_file), 1));
@@ -136,6 +147,113 @@ static int write_all_blocks(struct sparse_file* s, struct output_file* out) {
   return 0;
 }
 
+/*
+ * A backed block prepared by a worker thread: mapped if it comes from a file,
+ * and checksummed if the output needs a crc.
+ */
+struct prepared_block {
+  std::unique_ptr<android::base::MappedFile> map;
+  void* data;
+  uint32_t crc;
+  int error;
+};
+
+static void prepare_block(struct backed_block* bb, bool crc, struct prepared_block* prepared) {
+  uint64_t len = backed_block_len(bb);
+  int fd;
+
+  switch (backed_block_type(bb)) {
+    case BACKED_BLOCK_DATA:
+      prepared->data = backed_block_data(bb);
+      break;
+    case BACKED_BLOCK_FILE:
+      fd = open(backed_block_filename(bb), O_RDONLY | O_BINARY);
+      if (fd < 0) {
+        prepared->error = -errno;
+        return;
+      }
+      prepared->map = android::base::MappedFile::FromFd(fd, backed_block_file_offset(bb), len,
+                                                         PROT_READ);
+      if (!prepared->map) prepared->error = -errno;
+      close(fd);
+      break;
+    case BACKED_BLOCK_FD:
+      prepared->map = android::base::MappedFile::FromFd(backed_block_fd(bb),
+                                                         backed_block_file_offset(bb), len,
+                                                         PROT_READ);
+      if (!prepared->map) prepared->error = -errno;
+      break;
+    case BACKED_BLOCK_FILL:
+      return;
+  }
+  if (prepared->error) return;
+  if (prepared->map) prepared->data = prepared->map->data();
+
+  if (crc) {
+    prepared->crc = sparse_crc32(0, prepared->data, len);
+  } else {
+    /* Fault the data in here rather than when the writer gets to it. */
+    const volatile char* p = reinterpret_cast<const volatile char*>(prepared->data);
+    for (uint64_t i = 0; i < len; i += 4096) {
+      (void)p[i];
+    }
+  }
+}
+
+static int write_prepared_block(struct output_file* out, struct backed_block* bb, bool crc,
+                                struct prepared_block* prepared) {
+  if (prepared->error) return prepared->error;
+
+  switch (backed_block_type(bb)) {
+    case BACKED_BLOCK_FILL:
+      return write_fill_chunk(out, backed_block_len(bb), backed_block_fill_val(bb));
+    default:
+      if (crc) {
+        return write_data_chunk_crc(out, backed_block_len(bb), prepared->data, prepared->crc);
+      }
+      return write_data_chunk(out, backed_block_len(bb), prepared->data);
+  }
+}
+
+/*
+ * Like write_all_blocks(), with the blocks mapped and checksummed on worker
+ * threads ahead of the calling thread writing them out in order.
+ */
+static int write_all_blocks_pipelined(struct sparse_file* s, struct output_file* out, bool crc) {
+  struct backed_block* bb;
+  unsigned int last_block = 0;
+  int64_t pad;
+  int ret;
+
+  OrderedPipeline pipeline(s->threads, 2 * s->threads);
+  for (bb = backed_block_iter_new(s->backed_block_list); bb; bb = backed_block_iter_next(bb)) {
+    int64_t skip = 0;
+    if (backed_block_block(bb) > last_block) {
+      unsigned int blocks = backed_block_block(bb) - last_block;
+      skip = (int64_t)blocks * s->block_size;
+    }
+    last_block = backed_block_block(bb) + DIV_ROUND_UP(backed_block_len(bb), s->block_size);
+
+    auto prepared = std::make_shared<prepared_block>();
+    ret = pipeline.Add([bb, crc, prepared] { prepare_block(bb, crc, prepared.get()); },
+                       [out, bb, crc, skip, prepared] {
+                         if (skip) write_skip_chunk(out, skip);
+                         return write_prepared_block(out, bb, crc, prepared.get());
+                       });
+    if (ret) return ret;
+  }
+  ret = pipeline.Drain();
+  if (ret) return ret;
+
+  pad = s->len - (int64_t)last_block * s->block_size;
+  assert(pad >= 0);
+  if (pad > 0) {
+    write_skip_chunk(out, pad);
+  }
+
+  return 0;
+}
+
 /*
  * This is a workaround for 32-bit Windows: Limit the block size to 64 MB before
  * fastboot executable binary for windows 64-bit is released (b/156057250).
@@ -154,11 +272,19 @@ int sparse_file_write(struct sparse_file* s, int fd, bool gz, bool sparse, bool
   }
 
   chunks = sparse_count_chunks(s);
-  out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc);
+  out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc, s->threads);
 
   if (!out) return -ENOMEM;
 
-  ret = write_all_blocks(s, out);
+  /*
+   * Raw output has the kernel copy file backed blocks where it can, leaving
+   * nothing worth handing to worker threads.
+   */
+  if (s->threads > 1 && (gz || sparse)) {
+    ret = write_all_blocks_pipelined(s, out, sparse && crc);
+  } else {
+    ret = write_all_blocks(s, out);
+  }
 
   output_file_close(out);
 
@@ -358,3 +484,7 @@ int sparse_file_resparse(struct sparse_file* in_s, unsigned int max_len, struct
 void sparse_file_verbose(struct sparse_file* s) {
   s->verbose = true;
 }
+
+void sparse_file_set_threads(struct sparse_file* s, unsigned int threads) {
+  s->threads = threads;
+}
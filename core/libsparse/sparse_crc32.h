@@ -21,4 +21,11 @@
 
 uint32_t sparse_crc32(uint32_t crc, const void* buf, size_t size);
 
+/*
+ * Returns the crc of two pieces of data given crc1, the crc of the first, and
+ * crc2 and len2, the crc and length of the second, so that pieces can be
+ * checksummed in parallel.
+ */
+uint32_t sparse_crc32_combine(uint32_t crc1, uint32_t crc2, int64_t len2);
+
 #endif
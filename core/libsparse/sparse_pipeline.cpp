@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sparse_pipeline.h"
+
+#include <algorithm>
+#include <utility>
+
+OrderedPipeline::OrderedPipeline(unsigned int threads, size_t max_pending)
+    : max_pending_(std::max<size_t>(max_pending, 1)) {
+  threads = std::max(threads, 1u);
+  for (unsigned int i = 0; i < threads; i++) {
+    threads_.emplace_back(&OrderedPipeline::WorkerThread, this);
+  }
+}
+
+OrderedPipeline::~OrderedPipeline() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stop_ = true;
+  }
+  work_queued_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void OrderedPipeline::WorkerThread() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    work_queued_.wait(lock, [this] { return stop_ || !queued_.empty(); });
+    if (stop_) {
+      return;
+    }
+    std::shared_ptr<Job> job = std::move(queued_.front());
+    queued_.pop_front();
+
+    lock.unlock();
+    job->work();
+    lock.lock();
+
+    job->done = true;
+    work_done_.notify_all();
+  }
+}
+
+/*
+ * Finishes the oldest job, waiting for its work to be done if wait is set.
+ * Returns 1 if there was no job to finish.
+ */
+int OrderedPipeline::FinishOldest(bool wait) {
+  std::shared_ptr<Job> job;
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (pending_.empty() || (!wait && !pending_.front()->done)) {
+      return 1;
+    }
+    work_done_.wait(lock, [this] { return pending_.front()->done; });
+    job = std::move(pending_.front());
+    pending_.pop_front();
+  }
+  if (!error_) {
+    error_ = job->finish();
+  }
+  return 0;
+}
+
+int OrderedPipeline::Add(std::function<void()> work, std::function<int()> finish) {
+  if (error_) {
+    return error_;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->work = std::move(work);
+  job->finish = std::move(finish);
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    queued_.push_back(job);
+    pending_.push_back(std::move(job));
+  }
+  work_queued_.notify_one();
+
+  /* Keep output flowing by finishing whatever is already done. */
+  while (FinishOldest(false) == 0) {
+  }
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (pending_.size() < max_pending_) break;
+    }
+    FinishOldest(true);
+  }
+  return error_;
+}
+
+int OrderedPipeline::Drain() {
+  while (FinishOldest(true) == 0) {
+  }
+  return error_;
+}
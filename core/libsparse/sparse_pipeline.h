@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBSPARSE_SPARSE_PIPELINE_H_
+#define _LIBSPARSE_SPARSE_PIPELINE_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs jobs on a pool of worker threads and finishes them on the calling
+ * thread in the order they were added. The calling thread reads input and
+ * writes output while the workers do the expensive part of each job: fill
+ * detection, checksumming or compression.
+ */
+class OrderedPipeline {
+ public:
+  /* At most max_pending jobs are queued or running at any time. */
+  OrderedPipeline(unsigned int threads, size_t max_pending);
+
+  /* Jobs that have not been finished are discarded. */
+  ~OrderedPipeline();
+
+  /*
+   * Queues work to run on a worker thread, and finish to run on the calling
+   * thread once work and every job added before it are done. Blocks
+   * finishing the oldest jobs while the pipeline is full. Returns the error
+   * from the first finish that failed, after which no more jobs are finished.
+   */
+  int Add(std::function<void()> work, std::function<int()> finish);
+
+  /* Finishes every job that has been added. */
+  int Drain();
+
+ private:
+  struct Job {
+    std::function<void()> work;
+    std::function<int()> finish;
+    bool done = false;
+  };
+
+  void WorkerThread();
+  int FinishOldest(bool wait);
+
+  std::mutex lock_;
+  std::condition_variable work_queued_;
+  std::condition_variable work_done_;
+  std::deque<std::shared_ptr<Job>> queued_;
+  std::deque<std::shared_ptr<Job>> pending_;
+  size_t max_pending_;
+  bool stop_ = false;
+  int error_ = 0;
+  std::vector<std::thread> threads_;
+};
+
+#endif /* _LIBSPARSE_SPARSE_PIPELINE_H_ */
@@ -26,7 +26,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <sparse/sparse.h>
 
@@ -36,6 +38,7 @@
 #include "sparse_crc32.h"
 #include "sparse_file.h"
 #include "sparse_format.h"
+#include "sparse_pipeline.h"
 
 #if defined(__APPLE__) && defined(__MACH__)
 #define lseek64 lseek
@@ -410,6 +413,153 @@ static int sparse_file_read_sparse(struct sparse_file* s, SparseFileSource* sour
   return 0;
 }
 
+/* Returns true if a whole block repeats its first 32 bit value. */
+static bool is_fill_block(const uint32_t* buf, unsigned int block_size) {
+  /* Each value must match the next one, which memcmp checks quickly. */
+  return memcmp(buf, buf + 1, block_size - sizeof(*buf)) == 0;
+}
+
+/*
+ * Finds the data at or after offset in a raw image using SEEK_DATA and
+ * SEEK_HOLE, so that holes can be added as zero fills without reading them.
+ * On success *data is where the data starts and *hole where it ends, both len
+ * if there is no more data, and the file offset is left unspecified. Returns
+ * false if fd can't report its holes, in which case everything must be read.
+ */
+static bool find_data(int fd, int64_t offset, int64_t len, int64_t* data, int64_t* hole) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  off64_t ret = lseek64(fd, offset, SEEK_DATA);
+  if (ret < 0 && errno == ENXIO) {
+    *data = *hole = len;
+    return true;
+  }
+  if (ret < 0) {
+    return false;
+  }
+  *data = std::min<int64_t>(ret, len);
+
+  ret = lseek64(fd, *data, SEEK_HOLE);
+  if (ret < 0) {
+    lseek64(fd, offset, SEEK_SET);
+    return false;
+  }
+  *hole = std::min<int64_t>(ret, len);
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* Raw images are read this much at a time when using worker threads. */
+static constexpr int64_t READ_BATCH_SIZE = 4 * 1024 * 1024;
+
+/*
+ * Like sparse_file_read_normal(), with fill blocks detected on worker threads
+ * while the calling thread reads ahead and adds the blocks in order.
+ */
+static int sparse_file_read_normal_pipelined(struct sparse_file* s, int fd) {
+  struct read_batch {
+    std::vector<uint32_t> data;
+    std::vector<bool> fill;
+  };
+  const size_t max_pending = 2 * s->threads;
+  const int64_t batch_blocks = std::max<int64_t>(READ_BATCH_SIZE / s->block_size, 1);
+  const int64_t batch_size = batch_blocks * s->block_size;
+  unsigned int block = 0;
+  int64_t remain = s->len;
+  int64_t offset = 0;
+  int ret;
+
+  /*
+   * Only max_pending batches are in flight, and the oldest has been
+   * finished by the time its buffer comes round again.
+   */
+  std::vector<std::shared_ptr<read_batch>> batches(max_pending);
+  for (auto& batch : batches) {
+    batch = std::make_shared<read_batch>();
+    batch->data.resize(batch_size / sizeof(uint32_t));
+    batch->fill.resize(batch_blocks);
+  }
+
+  bool holes = true;
+  int64_t data_end = 0;
+
+  OrderedPipeline pipeline(s->threads, max_pending);
+  for (size_t n = 0; remain > 0;) {
+    if (holes && offset >= data_end) {
+      int64_t data;
+      holes = find_data(fd, offset, s->len, &data, &data_end);
+      if (holes) {
+        int64_t hole_blocks = (data - offset) / s->block_size;
+        if (hole_blocks > 0) {
+          /* Added in order with the batches, like everything else */
+          ret = pipeline.Add([] {},
+                             [s, hole_blocks, block] {
+                               return sparse_file_add_fill(s, 0, hole_blocks * s->block_size,
+                                                           block);
+                             });
+          if (ret < 0) {
+            return ret;
+          }
+          remain -= hole_blocks * s->block_size;
+          offset += hole_blocks * s->block_size;
+          block += hole_blocks;
+        }
+        if (lseek64(fd, offset, SEEK_SET) < 0) {
+          return -errno;
+        }
+        continue;
+      }
+    }
+
+    std::shared_ptr<read_batch> batch = batches[n++ % max_pending];
+    int64_t to_read = std::min(remain, batch_size);
+    if (holes) {
+      /* Stop at the next hole, rather than reading its zeros */
+      to_read = std::min<int64_t>(to_read, ALIGN(data_end - offset, s->block_size));
+    }
+    ret = read_all(fd, batch->data.data(), to_read);
+    if (ret < 0) {
+      error("failed to read sparse file");
+      return ret;
+    }
+
+    unsigned int block_size = s->block_size;
+    unsigned int blocks = DIV_ROUND_UP(to_read, block_size);
+    auto work = [batch, blocks, block_size, to_read] {
+      const size_t words = block_size / sizeof(uint32_t);
+      for (unsigned int i = 0; i < blocks; i++) {
+        batch->fill[i] = (i + 1) * (int64_t)block_size <= to_read &&
+                         is_fill_block(&batch->data[i * words], block_size);
+      }
+    };
+    auto finish = [s, fd, batch, blocks, block, offset, to_read] {
+      for (unsigned int i = 0; i < blocks; i++) {
+        int64_t block_offset = (int64_t)i * s->block_size;
+        if (batch->fill[i]) {
+          /* TODO: add flag to use skip instead of fill for buf[0] == 0 */
+          sparse_file_add_fill(s, batch->data[block_offset / sizeof(uint32_t)], s->block_size,
+                               block + i);
+        } else {
+          sparse_file_add_fd(s, fd, offset + block_offset,
+                             std::min<int64_t>(to_read - block_offset, s->block_size), block + i);
+        }
+      }
+      return 0;
+    };
+    ret = pipeline.Add(work, finish);
+    if (ret < 0) {
+      return ret;
+    }
+
+    remain -= to_read;
+    offset += to_read;
+    block += blocks;
+  }
+
+  return pipeline.Drain();
+}
+
 static int sparse_file_read_normal(struct sparse_file* s, int fd) {
   int ret;
   uint32_t* buf = (uint32_t*)malloc(s->block_size);
@@ -417,14 +567,34 @@ static int sparse_file_read_normal(struct sparse_file* s, int fd) {
   int64_t remain = s->len;
   int64_t offset = 0;
   unsigned int to_read;
-  unsigned int i;
   bool sparse_block;
+  bool holes = true;
+  int64_t data_end = 0;
 
   if (!buf) {
     return -ENOMEM;
   }
 
   while (remain > 0) {
+    if (holes && offset >= data_end) {
+      int64_t data;
+      holes = find_data(fd, offset, s->len, &data, &data_end);
+      if (holes) {
+        int64_t hole_blocks = (data - offset) / s->block_size;
+        if (hole_blocks > 0) {
+          sparse_file_add_fill(s, 0, hole_blocks * s->block_size, block);
+          remain -= hole_blocks * s->block_size;
+          offset += hole_blocks * s->block_size;
+          block += hole_blocks;
+        }
+        if (lseek64(fd, offset, SEEK_SET) < 0) {
+          free(buf);
+          return -errno;
+        }
+        continue;
+      }
+    }
+
     to_read = std::min(remain, (int64_t)(s->block_size));
     ret = read_all(fd, buf, to_read);
     if (ret < 0) {
@@ -433,17 +603,7 @@ static int sparse_file_read_normal(struct sparse_file* s, int fd) {
       return ret;
     }
 
-    if (to_read == s->block_size) {
-      sparse_block = true;
-      for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-        if (buf[0] != buf[i]) {
-          sparse_block = false;
-          break;
-        }
-      }
-    } else {
-      sparse_block = false;
-    }
+    sparse_block = to_read == s->block_size && is_fill_block(buf, s->block_size);
 
     if (sparse_block) {
       /* TODO: add flag to use skip instead of fill for buf[0] == 0 */
@@ -469,6 +629,8 @@ int sparse_file_read(struct sparse_file* s, int fd, bool sparse, bool crc) {
   if (sparse) {
     SparseFileFdSource source(fd);
     return sparse_file_read_sparse(s, &source, crc);
+  } else if (s->threads > 1) {
+    return sparse_file_read_normal_pipelined(s, fd);
   } else {
     return sparse_file_read_normal(s, fd);
   }
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sparse/sparse.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "sparse_pipeline.h"
+
+static constexpr unsigned int kBlockSize = 4096;
+static constexpr unsigned int kThreads = 4;
+
+TEST(OrderedPipelineTest, FinishesInOrder) {
+  OrderedPipeline pipeline(kThreads, 2 * kThreads);
+  std::vector<int> finished;
+  for (int i = 0; i < 64; i++) {
+    // Later jobs tend to finish their work first.
+    auto delay = std::chrono::microseconds((64 - i) % 7 * 200);
+    ASSERT_EQ(0, pipeline.Add([delay] { std::this_thread::sleep_for(delay); },
+                              [&finished, i] {
+                                finished.push_back(i);
+                                return 0;
+                              }));
+  }
+  ASSERT_EQ(0, pipeline.Drain());
+  ASSERT_EQ(64u, finished.size());
+  for (int i = 0; i < 64; i++) {
+    EXPECT_EQ(i, finished[i]);
+  }
+}
+
+TEST(OrderedPipelineTest, StopsAfterError) {
+  OrderedPipeline pipeline(kThreads, 2 * kThreads);
+  int finished = 0;
+  int ret = 0;
+  for (int i = 0; i < 64 && ret == 0; i++) {
+    ret = pipeline.Add([] {},
+                       [&finished, i] {
+                         finished++;
+                         return i == 10 ? -5 : 0;
+                       });
+  }
+  EXPECT_EQ(-5, pipeline.Drain());
+  EXPECT_EQ(11, finished);
+}
+
+/*
+ * Writes a raw image that spans several of the batches and gzip segments the
+ * threaded paths cut their work into: random data, zeros, 32 bit fills and
+ * blocks that are almost a fill, in runs of varying length.
+ */
+static std::string MakeRawImage() {
+  std::mt19937 rng(42);
+  std::string image;
+  while (image.size() < 13 * 1024 * 1024) {
+    size_t blocks = 1 + rng() % 300;
+    std::string block(kBlockSize, '\0');
+    switch (rng() % 4) {
+      case 0:
+        for (size_t i = 0; i < blocks; i++) {
+          for (auto& c : block) c = static_cast<char>(rng());
+          image += block;
+        }
+        continue;
+      case 1:
+        break;
+      case 2: {
+        uint32_t fill = rng();
+        for (size_t i = 0; i < kBlockSize; i += sizeof(fill)) memcpy(&block[i], &fill, sizeof(fill));
+        break;
+      }
+      case 3:
+        block[rng() % kBlockSize] = 1;
+        break;
+    }
+    for (size_t i = 0; i < blocks; i++) image += block;
+  }
+  return image;
+}
+
+class SparseThreadsTest : public ::testing::TestWithParam<std::tuple<bool, bool, bool>> {
+ protected:
+  static void SetUpTestSuite() {
+    raw_ = new std::string(MakeRawImage());
+    ASSERT_TRUE(android::base::WriteStringToFd(*raw_, raw_file_.fd));
+  }
+
+  static void TearDownTestSuite() {
+    delete raw_;
+    raw_ = nullptr;
+  }
+
+  /* Reads the raw image and writes it out again with the given threads. */
+  static std::string Convert(unsigned int threads, bool gz, bool sparse, bool crc) {
+    std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> s(
+        sparse_file_new(kBlockSize, raw_->size()), &sparse_file_destroy);
+    if (!s) return "";
+    sparse_file_set_threads(s.get(), threads);
+    if (lseek(raw_file_.fd, 0, SEEK_SET) != 0) return "";
+    if (sparse_file_read(s.get(), raw_file_.fd, false, false) < 0) return "";
+
+    TemporaryFile out;
+    if (sparse_file_write(s.get(), out.fd, gz, sparse, crc) < 0) return "";
+    std::string result;
+    if (!android::base::ReadFileToString(out.path, &result)) return "";
+    return result;
+  }
+
+  static std::string Gunzip(const std::string& compressed) {
+    z_stream stream = {};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) return "";
+    std::string result;
+    char buf[64 * 1024];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    stream.avail_in = compressed.size();
+    int ret;
+    do {
+      stream.next_out = reinterpret_cast<Bytef*>(buf);
+      stream.avail_out = sizeof(buf);
+      ret = inflate(&stream, Z_NO_FLUSH);
+      result.append(buf, sizeof(buf) - stream.avail_out);
+    } while (ret == Z_OK);
+    // The whole file must be a single gzip member.
+    bool ok = ret == Z_STREAM_END && stream.avail_in == 0;
+    inflateEnd(&stream);
+    return ok ? result : "";
+  }
+
+  static std::string* raw_;
+  static TemporaryFile raw_file_;
+};
+
+std::string* SparseThreadsTest::raw_;
+TemporaryFile SparseThreadsTest::raw_file_;
+
+TEST_P(SparseThreadsTest, SameOutputAsSingleThread) {
+  auto [gz, sparse, crc] = GetParam();
+  std::string single = Convert(1, gz, sparse, crc);
+  std::string threaded = Convert(kThreads, gz, sparse, crc);
+  ASSERT_FALSE(single.empty());
+  ASSERT_FALSE(threaded.empty());
+
+  if (gz) {
+    // Threaded gzip output is compressed in segments, so only the data inside
+    // it has to match.
+    single = Gunzip(single);
+    threaded = Gunzip(threaded);
+    ASSERT_FALSE(single.empty());
+    ASSERT_FALSE(threaded.empty());
+  }
+  // Compare sizes first so a mismatch doesn't print megabytes of data.
+  ASSERT_EQ(single.size(), threaded.size());
+  EXPECT_TRUE(single == threaded);
+  if (!sparse) {
+    EXPECT_TRUE(threaded == *raw_);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(GzSparseCrc, SparseThreadsTest,
+                         ::testing::Combine(::testing::Bool(), ::testing::Bool(),
+                                            ::testing::Bool()));
+
+TEST_F(SparseThreadsTest, SparseRoundTrip) {
+  std::string sparse_image = Convert(kThreads, false, true, false);
+  ASSERT_FALSE(sparse_image.empty());
+  TemporaryFile sparse_image_file;
+  ASSERT_TRUE(android::base::WriteStringToFd(sparse_image, sparse_image_file.fd));
+  ASSERT_EQ(0, lseek(sparse_image_file.fd, 0, SEEK_SET));
+
+  std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> s(
+      sparse_file_import(sparse_image_file.fd, false, false), &sparse_file_destroy);
+  ASSERT_TRUE(s);
+  sparse_file_set_threads(s.get(), kThreads);
+  TemporaryFile out;
+  ASSERT_EQ(0, sparse_file_write(s.get(), out.fd, false, false, false));
+  std::string expanded;
+  ASSERT_TRUE(android::base::ReadFileToString(out.path, &expanded));
+  ASSERT_EQ(raw_->size(), expanded.size());
+  EXPECT_TRUE(expanded == *raw_);
+}
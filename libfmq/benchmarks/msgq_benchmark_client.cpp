@@ -18,10 +18,16 @@
 
 #include <gtest/gtest.h>
 #include <utils/StrongPointer.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include <android/hardware/tests/msgq/1.0/IBenchmarkMsgQ.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hidl/ServiceManagement.h>
 
@@ -37,6 +43,7 @@ using std::cout;
 using std::endl;
 
 // libhidl
+using android::hardware::EventFlag;
 using android::hardware::kSynchronizedReadWrite;
 using android::hardware::MQDescriptorSync;
 using android::hardware::MessageQueue;
@@ -437,3 +444,65 @@ TEST_F(MQTestClient, BenchMarkMeasureServiceWriteClientRead) {
     service->sendTimeData(clientRcvTimeArray);
     delete[] data;
 }
+
+/*
+ * Several producer threads in this process write 64 byte packets into a local
+ * queue with writeBlockingMultiProducer() while one consumer drains it with
+ * readBlocking(). Each packet carries its send time, so both the throughput
+ * and the send to receive latency are measured for each producer count, with
+ * and without spinning before blocking.
+ */
+TEST(MQMultiProducerBenchmark, BenchMarkMeasureMultiProducerWrite) {
+    static constexpr uint32_t kNotFull = 1 << 0;
+    static constexpr uint32_t kNotEmpty = 1 << 1;
+    static constexpr uint32_t kPacketsPerProducer = 100 * kNumIterations;
+
+    for (bool spin : {false, true}) {
+        for (size_t numProducers : {1, 2, 4, 8}) {
+            MessageQueue<uint8_t, kSynchronizedReadWrite> fmq(kQueueSize, true /* eventFlag */);
+            ASSERT_TRUE(fmq.isValid());
+            fmq.setSpinBeforeBlocking(spin);
+            EventFlag* efGroup = nullptr;
+            ASSERT_EQ(OK, EventFlag::createEventFlag(fmq.getEventFlagWord(), &efGroup));
+
+            std::vector<std::thread> producers;
+            for (size_t i = 0; i < numProducers; i++) {
+                producers.emplace_back([&fmq, efGroup]() {
+                    uint8_t data[kPacketSize64] = {};
+                    for (uint32_t j = 0; j < kPacketsPerProducer; j++) {
+                        int64_t sendTime =
+                                std::chrono::steady_clock::now().time_since_epoch().count();
+                        memcpy(data, &sendTime, sizeof(sendTime));
+                        fmq.writeBlockingMultiProducer(data, kPacketSize64, kNotFull, kNotEmpty,
+                                                       0 /* timeOutNanos */, efGroup);
+                    }
+                });
+            }
+
+            uint32_t numPackets = numProducers * kPacketsPerProducer;
+            std::vector<int64_t> latencies(numPackets);
+            uint8_t data[kPacketSize64];
+            auto timeStart = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < numPackets; i++) {
+                ASSERT_TRUE(fmq.readBlocking(data, kPacketSize64, kNotFull, kNotEmpty,
+                                             0 /* timeOutNanos */, efGroup));
+                int64_t sendTime;
+                memcpy(&sendTime, data, sizeof(sendTime));
+                latencies[i] =
+                        std::chrono::steady_clock::now().time_since_epoch().count() - sendTime;
+            }
+            auto timeEnd = std::chrono::steady_clock::now();
+            for (auto& producer : producers) {
+                producer.join();
+            }
+            ASSERT_EQ(OK, EventFlag::deleteEventFlag(&efGroup));
+
+            std::sort(latencies.begin(), latencies.end());
+            int64_t elapsedNs = std::chrono::nanoseconds(timeEnd - timeStart).count();
+            cout << numProducers << " producers" << (spin ? ", spinning" : "") << ": "
+                 << numPackets * 1000000000LL / elapsedNs << " packets/s, p50 latency "
+                 << latencies[numPackets / 2] << "ns, p99 latency "
+                 << latencies[numPackets * 99 / 100] << "ns" << endl;
+        }
+    }
+}
@@ -23,6 +23,7 @@
 #include <sys/user.h>
 #include <utils/Log.h>
 #include <utils/SystemClock.h>
+#include <sched.h>
 #include <atomic>
 #include <new>
 
@@ -238,6 +239,18 @@ struct MessageQueueBase {
      */
     std::atomic<uint32_t>* getEventFlagWord() const { return mEvFlagWord; }
 
+    /**
+     * Let the blocking reads and writes made through this object retry for a
+     * short while before waiting on the EventFlag. This saves the futex
+     * wait and wake when the other side catches up within microseconds, at
+     * the cost of CPU time when it does not, so it is off by default.
+     *
+     * @param enable Whether to spin before blocking.
+     */
+    void setSpinBeforeBlocking(bool enable) {
+        mSpinBeforeBlocking.store(enable, std::memory_order_relaxed);
+    }
+
     /**
      * Describes a memory region in the FMQ.
      */
@@ -294,6 +307,7 @@ struct MessageQueueBase {
         MemTransaction& operator=(const MemTransaction& other) {
             first = other.first;
             second = other.second;
+            ticket = other.ticket;
             return *this;
         }
 
@@ -369,6 +383,14 @@ struct MessageQueueBase {
                                      T** secondBaseAddress);
         MemRegion first;
         MemRegion second;
+
+        /*
+         * Write pointer counter value the transaction starts at. Only used
+         * by the multi-producer write methods.
+         */
+        uint64_t ticket = 0;
+
+        friend struct MessageQueueBase;
     };
 
     /**
@@ -421,10 +443,94 @@ struct MessageQueueBase {
      */
     bool commitRead(size_t nMessages);
 
+    /**
+     * Multi-producer writes.
+     *
+     * The methods below can be called concurrently by any number of threads
+     * sharing this MessageQueue object. A writer reserves space by atomically
+     * advancing a reservation ticket, fills it in without holding a lock and
+     * commits it. Commits become visible to the reader in ticket order, so a
+     * commit waits, without a timeout, for the writers that reserved space
+     * before it. A writer must therefore commit its reservation promptly,
+     * must not block on anything another writer may hold in between, and
+     * must not be cancelled or killed in between.
+     *
+     * The reservation ticket lives in this object and not in the shared
+     * memory, so all producers must use the same MessageQueue object, and
+     * they must not be mixed with write(), writeBlocking() or
+     * beginWrite()/commitWrite() calls on the same queue.
+     *
+     * These methods should only be used with a MessageQueue of the flavor
+     * 'kSynchronizedReadWrite'.
+     */
+
+    /**
+     * Reserve space for 'nMessages' items of type T and get a MemTransaction
+     * object to write them in place. A successful call must always be
+     * followed by commitWriteMultiProducer() with the same MemTransaction,
+     * since the writers that reserve space after it wait for that commit.
+     *
+     * @param nMessages Number of messages of type T.
+     * @param memTx Pointer to MemTransaction struct that describes memory to
+     * write 'nMessages' items of type T. If there is not enough space, the
+     * base addresses in the MemTransaction object would be set to nullptr.
+     *
+     * @return Whether the space for 'nMessages' items of type T was reserved.
+     */
+    bool beginWriteMultiProducer(size_t nMessages, MemTransaction* memTx);
+
+    /**
+     * Commit a write reserved by beginWriteMultiProducer(). This blocks until
+     * every reservation made before this one has been committed.
+     *
+     * @param memTx The MemTransaction filled in by beginWriteMultiProducer().
+     *
+     * @return Whether the write operation succeeded.
+     */
+    bool commitWriteMultiProducer(const MemTransaction& memTx);
+
+    /**
+     * Non-blocking multi-producer write of 'count' items into the FMQ.
+     *
+     * @param data Pointer to the array of items of type T.
+     * @param count Number of items in array.
+     *
+     * @return Whether the write was successful.
+     */
+    bool writeMultiProducer(const T* data, size_t count);
+
+    /**
+     * Multi-producer version of writeBlocking(), with the same arguments and
+     * behavior.
+     */
+    bool writeBlockingMultiProducer(const T* data, size_t count, uint32_t readNotification,
+                                    uint32_t writeNotification, int64_t timeOutNanos = 0,
+                                    android::hardware::EventFlag* evFlag = nullptr);
+
+    bool writeBlockingMultiProducer(const T* data, size_t count, int64_t timeOutNanos = 0);
+
   private:
     size_t availableToWriteBytes() const;
     size_t availableToReadBytes() const;
 
+    void getMemTransaction(uint64_t ptr, size_t nMessages, MemTransaction* result) const;
+
+    template <typename WriteFn>
+    bool writeBlockingHelper(WriteFn tryWrite, size_t count, uint32_t readNotification,
+                             uint32_t writeNotification, int64_t timeOutNanos,
+                             android::hardware::EventFlag* evFlag, bool multiProducer);
+
+    /*
+     * Retries 'op' for a short while before a blocking read or write falls
+     * back to waiting on the EventFlag, if setSpinBeforeBlocking() enabled
+     * it. The number of tries adapts to how often this pays off. Besides
+     * saving the futex wait, a reader that does not have to wait leaves the
+     * notification bit set, which lets the writer's following wake() calls
+     * skip the futex syscall.
+     */
+    template <typename Op>
+    static bool spinBeforeWait(Op op, std::atomic<uint32_t>* spinBudget);
+
     MessageQueueBase(const MessageQueueBase& other) = delete;
     MessageQueueBase& operator=(const MessageQueueBase& other) = delete;
 
@@ -455,8 +561,39 @@ struct MessageQueueBase {
      * lifetime.
      */
     android::hardware::EventFlag* mEventFlag = nullptr;
+
+    /*
+     * Next free write pointer counter value for the multi-producer writes.
+     * It is ahead of mWritePtr by the space that has been reserved but not
+     * committed yet.
+     */
+    std::atomic<uint64_t> mWriteTicket = 0;
+
+    /*
+     * Whether the blocking reads and writes spin before waiting, and their
+     * spin budgets, see spinBeforeWait().
+     */
+    std::atomic<bool> mSpinBeforeBlocking = false;
+    static constexpr uint32_t kMinSpins = 16;
+    static constexpr uint32_t kMaxSpins = 1024;
+    std::atomic<uint32_t> mReadSpins = kMinSpins;
+    std::atomic<uint32_t> mWriteSpins = kMinSpins;
 };
 
+namespace hardware {
+namespace details {
+
+static inline void cpuRelax() {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+}  // namespace details
+}  // namespace hardware
+
 template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
 T* MessageQueueBase<MQDescriptorType, T, flavor>::MemTransaction::getSlot(size_t idx) {
     size_t firstRegionLength = first.getLength();
@@ -624,6 +761,7 @@ void MessageQueueBase<MQDescriptorType, T, flavor>::initMemory(bool resetPointer
         // Always reset the read pointer.
         mReadPtr->store(0, std::memory_order_release);
     }
+    mWriteTicket.store(mWritePtr->load(std::memory_order_acquire), std::memory_order_relaxed);
 
     mRing = reinterpret_cast<uint8_t*>(mapGrantorDescr(hardware::details::DATAPTRPOS));
     if (mRing == nullptr) {
@@ -814,11 +952,20 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlocking(
     static_assert(flavor == kSynchronizedReadWrite,
                   "writeBlocking can only be used with the "
                   "kSynchronizedReadWrite flavor.");
+    return writeBlockingHelper([this, data, count]() { return write(data, count); }, count,
+                               readNotification, writeNotification, timeOutNanos, evFlag,
+                               false /* multiProducer */);
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+template <typename WriteFn>
+bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlockingHelper(
+        WriteFn tryWrite, size_t count, uint32_t readNotification, uint32_t writeNotification,
+        int64_t timeOutNanos, android::hardware::EventFlag* evFlag, bool multiProducer) {
     /*
      * If evFlag is null and the FMQ does not have its own EventFlag object
      * return false;
-     * If the flavor is kSynchronizedReadWrite and the readNotification
-     * bit mask is zero return false;
+     * If the readNotification bit mask is zero return false;
      * If the count is greater than queue size, return false
      * to prevent blocking until timeOut.
      */
@@ -846,7 +993,8 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlocking(
      * be correctly cleared by the next writeBlocking() call.
      */
 
-    bool result = write(data, count);
+    bool result = tryWrite() || (mSpinBeforeBlocking.load(std::memory_order_relaxed) &&
+                                 spinBeforeWait(tryWrite, &mWriteSpins));
     if (result) {
         if (writeNotification) {
             evFlag->wake(writeNotification);
@@ -877,7 +1025,7 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlocking(
                  * Attempt write in case a context switch happened outside of
                  * evFlag->wait().
                  */
-                result = write(data, count);
+                result = tryWrite();
                 break;
             }
         }
@@ -904,8 +1052,15 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlocking(
          * If there is still insufficient space to write to the FMQ,
          * keep waiting for another readNotification.
          */
-        if ((efState & readNotification) && write(data, count)) {
+        if ((efState & readNotification) && tryWrite()) {
             result = true;
+            /*
+             * The wait() consumed the readNotification, pass it on to the
+             * other writers that may be waiting for space.
+             */
+            if (multiProducer) {
+                evFlag->wake(readNotification);
+            }
             break;
         }
     }
@@ -963,7 +1118,9 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::readBlocking(
      * readBlocking() call.
      */
 
-    bool result = read(data, count);
+    auto tryRead = [this, data, count]() { return read(data, count); };
+    bool result = tryRead() || (mSpinBeforeBlocking.load(std::memory_order_relaxed) &&
+                                spinBeforeWait(tryRead, &mReadSpins));
     if (result) {
         if (readNotification) {
             evFlag->wake(readNotification);
@@ -1068,14 +1225,20 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::beginWrite(size_t nMessages,
         return false;
     }
 
-    auto writePtr = mWritePtr->load(std::memory_order_relaxed);
-    size_t writeOffset = writePtr % mDesc->getSize();
+    getMemTransaction(mWritePtr->load(std::memory_order_relaxed), nMessages, result);
+    return true;
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+void MessageQueueBase<MQDescriptorType, T, flavor>::getMemTransaction(
+        uint64_t ptr, size_t nMessages, MemTransaction* result) const {
+    size_t offset = ptr % mDesc->getSize();
 
     /*
-     * From writeOffset, the number of messages that can be written
+     * From offset, the number of messages that can be written
      * contiguously without wrapping around the ring buffer are calculated.
      */
-    size_t contiguousMessages = (mDesc->getSize() - writeOffset) / sizeof(T);
+    size_t contiguousMessages = (mDesc->getSize() - offset) / sizeof(T);
 
     if (contiguousMessages < nMessages) {
         /*
@@ -1083,20 +1246,133 @@ bool MessageQueueBase<MQDescriptorType, T, flavor>::beginWrite(size_t nMessages,
          * populated.
          */
         *result = MemTransaction(
-                MemRegion(reinterpret_cast<T*>(mRing + writeOffset), contiguousMessages),
+                MemRegion(reinterpret_cast<T*>(mRing + offset), contiguousMessages),
                 MemRegion(reinterpret_cast<T*>(mRing), nMessages - contiguousMessages));
     } else {
         /*
          * A wrap around is not required to write nMessages. Only result.first
          * is populated.
          */
-        *result = MemTransaction(MemRegion(reinterpret_cast<T*>(mRing + writeOffset), nMessages),
+        *result = MemTransaction(MemRegion(reinterpret_cast<T*>(mRing + offset), nMessages),
                                  MemRegion());
     }
+    result->ticket = ptr;
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+/*
+ * Disable integer sanitization since integer overflow here is allowed
+ * and legal.
+ */
+__attribute__((no_sanitize("integer"))) bool
+MessageQueueBase<MQDescriptorType, T, flavor>::beginWriteMultiProducer(size_t nMessages,
+                                                                       MemTransaction* result) {
+    static_assert(flavor == kSynchronizedReadWrite,
+                  "beginWriteMultiProducer can only be used with the "
+                  "kSynchronizedReadWrite flavor.");
+    size_t nBytes = nMessages * sizeof(T);
+    if (nMessages > getQuantumCount()) {
+        *result = MemTransaction();
+        return false;
+    }
+
+    /*
+     * Space that has been reserved but not committed yet is not available,
+     * so the free space is measured from the ticket and not from mWritePtr.
+     * The acquire load of mReadPtr makes sure the reader is done with the
+     * space before it is handed out again.
+     */
+    auto ticket = mWriteTicket.load(std::memory_order_relaxed);
+    do {
+        auto readPtr = mReadPtr->load(std::memory_order_acquire);
+        if (mDesc->getSize() - (ticket - readPtr) < nBytes) {
+            *result = MemTransaction();
+            return false;
+        }
+    } while (!mWriteTicket.compare_exchange_weak(ticket, ticket + nBytes,
+                                                 std::memory_order_relaxed));
+
+    getMemTransaction(ticket, nMessages, result);
+    return true;
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+/*
+ * Disable integer sanitization since integer overflow here is allowed
+ * and legal.
+ */
+__attribute__((no_sanitize("integer"))) bool
+MessageQueueBase<MQDescriptorType, T, flavor>::commitWriteMultiProducer(
+        const MemTransaction& memTx) {
+    size_t nBytesWritten =
+            (memTx.getFirstRegion().getLength() + memTx.getSecondRegion().getLength()) * sizeof(T);
 
+    /*
+     * Wait for the writers that reserved space before this one to commit.
+     * They only have to finish copying their data in, so spin for a bit
+     * before giving up the CPU. There is no timeout, since this data cannot
+     * be published before theirs; see the multi-producer writes comment
+     * above. The acquire load makes their data visible to the reader through
+     * the release store below.
+     */
+    for (uint32_t spins = 0; mWritePtr->load(std::memory_order_acquire) != memTx.ticket;
+         spins++) {
+        if (spins < kMaxSpins) {
+            hardware::details::cpuRelax();
+        } else {
+            sched_yield();
+        }
+    }
+    mWritePtr->store(memTx.ticket + nBytesWritten, std::memory_order_release);
     return true;
 }
 
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+bool MessageQueueBase<MQDescriptorType, T, flavor>::writeMultiProducer(const T* data,
+                                                                       size_t nMessages) {
+    MemTransaction tx;
+    if (!beginWriteMultiProducer(nMessages, &tx)) {
+        return false;
+    }
+    /*
+     * The reservation has to be committed even if the copy fails, since the
+     * writers after it are waiting for it.
+     */
+    bool result = tx.copyTo(data, 0 /* startIdx */, nMessages);
+    return commitWriteMultiProducer(tx) && result;
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlockingMultiProducer(
+        const T* data, size_t count, uint32_t readNotification, uint32_t writeNotification,
+        int64_t timeOutNanos, android::hardware::EventFlag* evFlag) {
+    return writeBlockingHelper(
+            [this, data, count]() { return writeMultiProducer(data, count); }, count,
+            readNotification, writeNotification, timeOutNanos, evFlag, true /* multiProducer */);
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+bool MessageQueueBase<MQDescriptorType, T, flavor>::writeBlockingMultiProducer(
+        const T* data, size_t count, int64_t timeOutNanos) {
+    return writeBlockingMultiProducer(data, count, FMQ_NOT_FULL, FMQ_NOT_EMPTY, timeOutNanos);
+}
+
+template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
+template <typename Op>
+bool MessageQueueBase<MQDescriptorType, T, flavor>::spinBeforeWait(
+        Op op, std::atomic<uint32_t>* spinBudget) {
+    uint32_t spins = spinBudget->load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < spins; i++) {
+        hardware::details::cpuRelax();
+        if (op()) {
+            spinBudget->store(std::min(spins * 2, kMaxSpins), std::memory_order_relaxed);
+            return true;
+        }
+    }
+    spinBudget->store(std::max(spins / 2, kMinSpins), std::memory_order_relaxed);
+    return false;
+}
+
 template <template <typename, MQFlavor> typename MQDescriptorType, typename T, MQFlavor flavor>
 /*
  * Disable integer sanitization since integer overflow here is allowed
@@ -22,6 +22,7 @@
 #include <gtest/gtest-death-test.h>
 #include <gtest/gtest.h>
 #include <sys/resource.h>
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <sstream>
@@ -637,6 +638,102 @@ TYPED_TEST(BlockingReadWrites, BlockingTimeOutTest) {
     ASSERT_EQ(android::NO_ERROR, status);
 }
 
+/*
+ * Test that blocking multi-producer writes from several threads make
+ * progress when the queue is full most of the time.
+ */
+TYPED_TEST(BlockingReadWrites, MultiProducerBlocking) {
+    constexpr size_t kNumProducers = 4;
+    constexpr size_t kWritesPerProducer = 200;
+    constexpr size_t kWriteSize = 512;
+
+    android::hardware::EventFlag* efGroup = nullptr;
+    android::status_t status = android::hardware::EventFlag::createEventFlag(&this->mFw, &efGroup);
+    ASSERT_EQ(android::NO_ERROR, status);
+    ASSERT_NE(nullptr, efGroup);
+
+    std::vector<std::thread> producers;
+    std::atomic<size_t> failures = 0;
+    for (size_t id = 0; id < kNumProducers; id++) {
+        producers.emplace_back([&, id]() {
+            std::vector<uint8_t> data(kWriteSize, static_cast<uint8_t>(id));
+            for (size_t i = 0; i < kWritesPerProducer; i++) {
+                if (!this->mQueue->writeBlockingMultiProducer(
+                            &data[0], kWriteSize, static_cast<uint32_t>(kFmqNotFull),
+                            static_cast<uint32_t>(kFmqNotEmpty), 5000000000 /* timeOutNanos */,
+                            efGroup)) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    size_t counts[kNumProducers] = {};
+    std::vector<uint8_t> readData(kWriteSize);
+    for (size_t i = 0; i < kNumProducers * kWritesPerProducer; i++) {
+        ASSERT_TRUE(this->mQueue->readBlocking(&readData[0], kWriteSize,
+                                               static_cast<uint32_t>(kFmqNotFull),
+                                               static_cast<uint32_t>(kFmqNotEmpty),
+                                               5000000000 /* timeOutNanos */, efGroup));
+        ASSERT_LT(readData[0], kNumProducers);
+        ASSERT_EQ(std::vector<uint8_t>(kWriteSize, readData[0]), readData);
+        counts[readData[0]]++;
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    ASSERT_EQ(0UL, failures);
+    for (size_t id = 0; id < kNumProducers; id++) {
+        ASSERT_EQ(kWritesPerProducer, counts[id]);
+    }
+
+    status = android::hardware::EventFlag::deleteEventFlag(&efGroup);
+    ASSERT_EQ(android::NO_ERROR, status);
+}
+
+/*
+ * Test that blocking reads and writes still deliver all the data in order
+ * when they spin before blocking.
+ */
+TYPED_TEST(BlockingReadWrites, SpinBeforeBlocking) {
+    constexpr size_t kNumWrites = 1000;
+    constexpr size_t kWriteSize = 64;
+
+    android::hardware::EventFlag* efGroup = nullptr;
+    android::status_t status = android::hardware::EventFlag::createEventFlag(&this->mFw, &efGroup);
+    ASSERT_EQ(android::NO_ERROR, status);
+    ASSERT_NE(nullptr, efGroup);
+
+    this->mQueue->setSpinBeforeBlocking(true);
+    std::atomic<size_t> failures = 0;
+    std::thread writer([&]() {
+        std::vector<uint8_t> data(kWriteSize);
+        for (size_t i = 0; i < kNumWrites; i++) {
+            std::fill(data.begin(), data.end(), static_cast<uint8_t>(i));
+            if (!this->mQueue->writeBlocking(&data[0], kWriteSize,
+                                             static_cast<uint32_t>(kFmqNotFull),
+                                             static_cast<uint32_t>(kFmqNotEmpty),
+                                             5000000000 /* timeOutNanos */, efGroup)) {
+                failures++;
+            }
+        }
+    });
+
+    std::vector<uint8_t> readData(kWriteSize);
+    for (size_t i = 0; i < kNumWrites; i++) {
+        ASSERT_TRUE(this->mQueue->readBlocking(&readData[0], kWriteSize,
+                                               static_cast<uint32_t>(kFmqNotFull),
+                                               static_cast<uint32_t>(kFmqNotEmpty),
+                                               5000000000 /* timeOutNanos */, efGroup));
+        ASSERT_EQ(std::vector<uint8_t>(kWriteSize, static_cast<uint8_t>(i)), readData);
+    }
+    writer.join();
+    ASSERT_EQ(0UL, failures);
+
+    status = android::hardware::EventFlag::deleteEventFlag(&efGroup);
+    ASSERT_EQ(android::NO_ERROR, status);
+}
+
 /*
  * Test that odd queue sizes do not cause unaligned error
  * on access to EventFlag object.
@@ -977,6 +1074,100 @@ TYPED_TEST(SynchronizedReadWrites, ReadWriteWrapAround2) {
     ASSERT_EQ(data, readData);
 }
 
+/*
+ * Verify that multi-producer writes from several threads are neither lost
+ * nor reordered per producer.
+ */
+TYPED_TEST(SynchronizedReadWrites, MultiProducerWrite) {
+    constexpr size_t kNumProducers = 4;
+    constexpr size_t kMessagesPerProducer = 5000;
+    constexpr size_t kMessageSize = 4;
+
+    std::vector<std::thread> producers;
+    for (size_t id = 0; id < kNumProducers; id++) {
+        producers.emplace_back([this, id]() {
+            for (size_t seq = 0; seq < kMessagesPerProducer; seq++) {
+                uint8_t message[kMessageSize] = {static_cast<uint8_t>(id),
+                                                 static_cast<uint8_t>(seq & 0xFF),
+                                                 static_cast<uint8_t>((seq >> 8) & 0xFF),
+                                                 static_cast<uint8_t>(seq * 7)};
+                while (!this->mQueue->writeMultiProducer(message, kMessageSize)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    size_t nextSeq[kNumProducers] = {};
+    for (size_t received = 0; received < kNumProducers * kMessagesPerProducer;) {
+        uint8_t message[kMessageSize];
+        if (!this->mQueue->read(message, kMessageSize)) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_LT(message[0], kNumProducers);
+        size_t seq = nextSeq[message[0]]++;
+        ASSERT_EQ(seq & 0xFF, message[1]);
+        ASSERT_EQ((seq >> 8) & 0xFF, message[2]);
+        ASSERT_EQ(static_cast<uint8_t>(seq * 7), message[3]);
+        received++;
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    for (size_t id = 0; id < kNumProducers; id++) {
+        ASSERT_EQ(kMessagesPerProducer, nextSeq[id]);
+    }
+    ASSERT_EQ(0UL, this->mQueue->availableToRead());
+}
+
+/*
+ * Use the zero copy multi-producer APIs to verify that reserved space is not
+ * handed out twice, and that commits are published in reservation order.
+ */
+TYPED_TEST(SynchronizedReadWrites, MultiProducerCommitOrder) {
+    size_t dataLen = this->mNumMessagesMax / 2;
+    std::vector<uint8_t> data(this->mNumMessagesMax);
+    initData(&data[0], this->mNumMessagesMax);
+
+    typename TypeParam::MQType::MemTransaction tx1;
+    typename TypeParam::MQType::MemTransaction tx2;
+    typename TypeParam::MQType::MemTransaction tx3;
+    ASSERT_TRUE(this->mQueue->beginWriteMultiProducer(dataLen, &tx1));
+    ASSERT_TRUE(this->mQueue->beginWriteMultiProducer(this->mNumMessagesMax - dataLen, &tx2));
+    ASSERT_FALSE(this->mQueue->beginWriteMultiProducer(1, &tx3));
+    ASSERT_EQ(nullptr, tx3.getFirstRegion().getAddress());
+    ASSERT_EQ(tx1.getFirstRegion().getAddress() + dataLen, tx2.getFirstRegion().getAddress());
+
+    ASSERT_TRUE(tx1.copyTo(&data[0], 0 /* startIdx */, dataLen));
+    ASSERT_TRUE(tx2.copyTo(&data[dataLen], 0 /* startIdx */, this->mNumMessagesMax - dataLen));
+
+    // The second commit has to wait for the first one.
+    std::atomic<bool> committed = false;
+    std::thread committer([&]() {
+        this->mQueue->commitWriteMultiProducer(tx2);
+        committed = true;
+    });
+    struct timespec waitTime = {0, 50 * 1000000};
+    ASSERT_EQ(0, nanosleep(&waitTime, NULL));
+    ASSERT_FALSE(committed);
+    ASSERT_EQ(0UL, this->mQueue->availableToRead());
+
+    ASSERT_TRUE(this->mQueue->commitWriteMultiProducer(tx1));
+    committer.join();
+    ASSERT_EQ(this->mNumMessagesMax, this->mQueue->availableToRead());
+
+    std::vector<uint8_t> readData(this->mNumMessagesMax);
+    ASSERT_TRUE(this->mQueue->read(&readData[0], this->mNumMessagesMax));
+    ASSERT_EQ(data, readData);
+
+    // The space is handed out again once it has been read, wrapping around.
+    ASSERT_TRUE(this->mQueue->beginWriteMultiProducer(this->mNumMessagesMax, &tx3));
+    ASSERT_EQ(this->mNumMessagesMax,
+              tx3.getFirstRegion().getLength() + tx3.getSecondRegion().getLength());
+    ASSERT_TRUE(this->mQueue->commitWriteMultiProducer(tx3));
+}
+
 /*
  * Verify that a few bytes of data can be successfully written and read.
  */
@@ -26,6 +26,7 @@
 #include <sys/types.h>
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
 
@@ -173,6 +174,30 @@ int32_t OpenArchiveFdRange(const int fd, const char* debugFileName, ZipArchiveHa
 
 int32_t OpenArchiveFromMemory(const void* address, size_t length, const char* debugFileName,
                               ZipArchiveHandle* handle);
+/*
+ * Like OpenArchive, but looks up entries through the precomputed central
+ * directory index at |indexFileName| (see WriteCentralDirectoryIndex) instead
+ * of building a hash table. The index is memory mapped, and each lookup is a
+ * single probe. The central directory is still validated entry by entry, and
+ * each entry has to be found at its own offset through the index.
+ *
+ * If the index is missing, malformed or doesn't match the archive, this falls
+ * back to the regular scan.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle);
+
+/*
+ * Builds a minimal perfect hash index of the central directory of |archive|
+ * and writes it to |fd| at its current offset. The index is only valid for
+ * this exact archive, and is intended to be stored next to it.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t WriteCentralDirectoryIndex(ZipArchiveHandle archive, int fd);
+
 /*
  * Close archive, releasing resources associated with it. This will
  * unmap the central directory of the zipfile and free all internal
@@ -358,4 +383,70 @@ int32_t ExtractToWriter(ZipArchiveHandle handle, const ZipEntry64* entry,
  */
 int32_t Inflate(const Reader& reader, const uint64_t compressed_length,
                 const uint64_t uncompressed_length, Writer* writer, uint64_t* crc_out);
+
+#if !defined(_WIN32)
+/**
+ * Supplies the destination of every entry extracted by ExtractEntries().
+ * CreateWriter() is called from worker threads, concurrently for different
+ * entries.
+ */
+class EntrySink {
+ public:
+  // Returns the writer that entry |index| of the batch is extracted to, or
+  // nullptr if it can't be extracted.
+  virtual std::unique_ptr<Writer> CreateWriter(size_t index, const ZipEntry64& entry) = 0;
+  virtual ~EntrySink();
+
+ protected:
+  EntrySink() = default;
+
+ private:
+  EntrySink(const EntrySink&) = delete;
+  void operator=(const EntrySink&) = delete;
+};
+
+/**
+ * Extracts entry |i| of the batch to |fds[i]| at offset |offsets[i]| with
+ * pwrite(2), straight from the inflate buffer. The file positions aren't used
+ * and the files aren't truncated, so several entries can target disjoint
+ * ranges of the same file. Both arrays must outlive the sink.
+ */
+class FdEntrySink : public EntrySink {
+ public:
+  FdEntrySink(const int* fds, const off64_t* offsets) : fds_(fds), offsets_(offsets) {}
+  std::unique_ptr<Writer> CreateWriter(size_t index, const ZipEntry64& entry) override;
+
+ private:
+  const int* fds_;
+  const off64_t* offsets_;
+};
+
+/**
+ * Extracts entry |i| of the batch to the memory region of |sizes[i]| bytes at
+ * |begins[i]|, for example a shared mapping of the output file. Both arrays
+ * must outlive the sink.
+ */
+class MemoryEntrySink : public EntrySink {
+ public:
+  MemoryEntrySink(uint8_t* const* begins, const size_t* sizes) : begins_(begins), sizes_(sizes) {}
+  std::unique_ptr<Writer> CreateWriter(size_t index, const ZipEntry64& entry) override;
+
+ private:
+  uint8_t* const* begins_;
+  const size_t* sizes_;
+};
+
+/**
+ * Uncompresses the |count| entries at |entries| to the writers provided by
+ * |sink|. Entries are independent and are extracted concurrently on up to
+ * |num_threads| threads, including the calling one; 0 uses one thread per
+ * CPU.
+ *
+ * |results| must have room for |count| values and receives the status of
+ * every entry. Returns 0 if all entries were extracted, and the status of the
+ * first failed entry otherwise.
+ */
+int32_t ExtractEntries(ZipArchiveHandle handle, const ZipEntry64* entries, size_t count,
+                       EntrySink* sink, int32_t* results, size_t num_threads = 0);
+#endif  // !defined(_WIN32)
 }  // namespace zip_archive
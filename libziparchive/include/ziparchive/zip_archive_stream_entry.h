@@ -39,6 +39,18 @@ class ZipArchiveStreamEntry {
 
   virtual bool Init(const ZipEntry& entry);
 
+ public:
+  // Like Read(), but returns the next chunk in |data| and |size|, and false at
+  // the end of the entry or on error. Stored entries of archives opened with
+  // OpenArchiveFromMemory are returned without copying them: the chunks point
+  // into the archive and are only checksummed as they are handed out, so that
+  // Verify() can check the entry once it has been consumed.
+  //
+  // Declared after all the other virtual functions so that it doesn't change
+  // their vtable slots.
+  virtual bool ReadChunk(const uint8_t** data, size_t* size);
+
+ protected:
   ZipArchiveHandle handle_;
 
   off64_t offset_ = 0;
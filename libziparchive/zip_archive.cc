@@ -31,8 +31,11 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <optional>
+#include <thread>
 #include <vector>
 
 #if defined(__APPLE__)
@@ -49,6 +52,7 @@
 #include <android-base/mapped_file.h>
 #include <android-base/memory.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <android-base/utf8.h>
 #include <log/log.h>
 #include "zlib.h"
@@ -56,6 +60,7 @@
 #include "entry_name_utils-inl.h"
 #include "zip_archive_common.h"
 #include "zip_archive_private.h"
+#include "zip_crc32.h"
 
 // Used to turn on crc checks - verify that the content CRC matches the values
 // specified in the local file header and the central directory.
@@ -458,10 +463,38 @@ static ZipError ParseZip64ExtendedInfoInExtraField(
   return kInvalidFile;
 }
 
+/*
+ * Checks that the archive starts with a local file header.
+ *
+ * Returns 0 on success.
+ */
+static ZipError ValidateFirstLocalFileHeader(ZipArchive* archive) {
+  uint32_t lfh_start_bytes;
+  if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
+                                        sizeof(uint32_t), 0)) {
+    ALOGW("Zip: Unable to read header for entry at offset == 0.");
+    return kInvalidFile;
+  }
+
+  if (lfh_start_bytes != LocalFileHeader::kSignature) {
+    ALOGW("Zip: Entry at offset zero has invalid LFH signature %" PRIx32, lfh_start_bytes);
+#if defined(__ANDROID__)
+    android_errorWriteLog(0x534e4554, "64211847");
+#endif
+    return kInvalidFile;
+  }
+
+  return kSuccess;
+}
+
 /*
  * Parses the Zip archive's Central Directory.  Allocates and populates the
  * hash table.
  *
+ * If the entry map was already loaded from a precomputed index, every entry
+ * still goes through the same checks, and the index has to map its name back
+ * to that very entry instead of it being added to the map.
+ *
  * Returns 0 on success.
  */
 static ZipError ParseZipArchive(ZipArchive* archive) {
@@ -469,13 +502,16 @@ static ZipError ParseZipArchive(ZipArchive* archive) {
   const size_t cd_length = archive->central_directory.GetMapLength();
   const uint64_t num_entries = archive->num_entries;
 
-  if (num_entries <= UINT16_MAX) {
-    archive->cd_entry_map = CdEntryMapZip32::Create(static_cast<uint16_t>(num_entries));
-  } else {
-    archive->cd_entry_map = CdEntryMapZip64::Create();
-  }
-  if (archive->cd_entry_map == nullptr) {
-    return kAllocationFailed;
+  const bool verify_index = archive->cd_entry_map != nullptr;
+  if (!verify_index) {
+    if (num_entries <= UINT16_MAX) {
+      archive->cd_entry_map = CdEntryMapZip32::Create(static_cast<uint16_t>(num_entries));
+    } else {
+      archive->cd_entry_map = CdEntryMapZip64::Create();
+    }
+    if (archive->cd_entry_map == nullptr) {
+      return kAllocationFailed;
+    }
   }
 
   /*
@@ -545,11 +581,20 @@ static ZipError ParseZipArchive(ZipArchive* archive) {
       return kInvalidEntryName;
     }
 
-    // Add the CDE filename to the hash table.
     std::string_view entry_name{reinterpret_cast<const char*>(file_name), file_name_length};
-    if (auto add_result =
-            archive->cd_entry_map->AddToMap(entry_name, archive->central_directory.GetBasePtr());
-        add_result != 0) {
+    if (verify_index) {
+      // The index has exactly num_entries slots, so this also rules out
+      // duplicate names, which can only resolve to one of their entries.
+      const uint64_t name_offset = file_name - cd_ptr;
+      if (auto [find_result, offset] = archive->cd_entry_map->GetCdEntryOffset(entry_name, cd_ptr);
+          find_result != kSuccess || offset != name_offset) {
+        ALOGW("Zip: central directory index doesn't match entry %" PRIu64, i);
+        return kInvalidFile;
+      }
+    } else if (auto add_result = archive->cd_entry_map->AddToMap(
+                   entry_name, archive->central_directory.GetBasePtr());
+               add_result != 0) {
+      // Add the CDE filename to the hash table.
       ALOGW("Zip: Error adding entry to hash table %d", add_result);
       return add_result;
     }
@@ -561,19 +606,8 @@ static ZipError ParseZipArchive(ZipArchive* archive) {
     }
   }
 
-  uint32_t lfh_start_bytes;
-  if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
-                                        sizeof(uint32_t), 0)) {
-    ALOGW("Zip: Unable to read header for entry at offset == 0.");
-    return kInvalidFile;
-  }
-
-  if (lfh_start_bytes != LocalFileHeader::kSignature) {
-    ALOGW("Zip: Entry at offset zero has invalid LFH signature %" PRIx32, lfh_start_bytes);
-#if defined(__ANDROID__)
-    android_errorWriteLog(0x534e4554, "64211847");
-#endif
-    return kInvalidFile;
+  if (auto result = ValidateFirstLocalFileHeader(archive); result != kSuccess) {
+    return result;
   }
 
   ALOGV("+++ zip good scan %" PRIu64 " entries", num_entries);
@@ -581,6 +615,38 @@ static ZipError ParseZipArchive(ZipArchive* archive) {
   return kSuccess;
 }
 
+/*
+ * Populates the entry map from the central directory index in |index_fd|
+ * instead of building a hash table. The index comes from outside of the
+ * archive, so the central directory is still walked and validated as usual,
+ * and every entry is checked against the index.
+ *
+ * Returns 0 on success.
+ */
+static ZipError LoadCentralDirectoryIndex(ZipArchive* archive, int index_fd) {
+  const off64_t index_length = lseek64(index_fd, 0, SEEK_END);
+  if (index_length <= 0) {
+    ALOGW("Zip: unable to get the central directory index length: %s", strerror(errno));
+    return kIoError;
+  }
+
+  auto index = android::base::MappedFile::FromFd(index_fd, 0, static_cast<size_t>(index_length),
+                                                 PROT_READ);
+  if (index == nullptr) {
+    ALOGW("Zip: failed to map central directory index: %s", strerror(errno));
+    return kMmapFailed;
+  }
+
+  archive->cd_entry_map = CdEntryMapPerfectHash::Create(
+      std::move(index), archive->directory_offset, archive->central_directory.GetMapLength(),
+      archive->num_entries);
+  if (archive->cd_entry_map == nullptr) {
+    return kInvalidFile;
+  }
+
+  return ParseZipArchive(archive);
+}
+
 static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name) {
   int32_t result = MapCentralDirectory(debug_file_name, archive);
   return result != kSuccess ? result : ParseZipArchive(archive);
@@ -631,6 +697,66 @@ int32_t OpenArchiveFromMemory(const void* address, size_t length, const char* de
   return OpenArchiveInternal(archive, debug_file_name);
 }
 
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle) {
+  const int fd = ::android::base::utf8::open(fileName, O_RDONLY | O_BINARY | O_CLOEXEC, 0);
+  ZipArchive* archive = new ZipArchive(MappedZipFile(fd), true);
+  *handle = archive;
+
+  if (fd < 0) {
+    ALOGW("Unable to open '%s': %s", fileName, strerror(errno));
+    return kIoError;
+  }
+
+  if (int32_t result = MapCentralDirectory(fileName, archive); result != kSuccess) {
+    return result;
+  }
+
+  android::base::unique_fd index_fd(
+      ::android::base::utf8::open(indexFileName, O_RDONLY | O_BINARY | O_CLOEXEC, 0));
+  if (index_fd == -1) {
+    ALOGV("Unable to open index '%s': %s", indexFileName, strerror(errno));
+  } else if (LoadCentralDirectoryIndex(archive, index_fd.get()) == kSuccess) {
+    return kSuccess;
+  } else {
+    ALOGW("Zip: ignoring unusable central directory index '%s'", indexFileName);
+    archive->cd_entry_map.reset();
+  }
+
+  // Fall back to scanning the central directory.
+  return ParseZipArchive(archive);
+}
+
+int32_t WriteCentralDirectoryIndex(ZipArchiveHandle archive, int fd) {
+  if (archive == nullptr || archive->cd_entry_map == nullptr) {
+    ALOGW("Zip: Invalid ZipArchiveHandle");
+    return kInvalidHandle;
+  }
+
+  std::vector<std::pair<std::string_view, uint64_t>> entries;
+  entries.reserve(archive->num_entries);
+  const uint8_t* cd_start = archive->central_directory.GetBasePtr();
+  archive->cd_entry_map->ResetIteration();
+  for (auto entry = archive->cd_entry_map->Next(cd_start);
+       entry != std::pair<std::string_view, uint64_t>();
+       entry = archive->cd_entry_map->Next(cd_start)) {
+    entries.push_back(entry);
+  }
+  archive->cd_entry_map->ResetIteration();
+
+  std::vector<uint8_t> index;
+  if (!CdEntryMapPerfectHash::Build(entries, archive->directory_offset,
+                                    archive->central_directory.GetMapLength(), &index)) {
+    return kAllocationFailed;
+  }
+
+  if (!android::base::WriteFully(fd, index.data(), index.size())) {
+    ALOGW("Zip: failed to write central directory index: %s", strerror(errno));
+    return kIoError;
+  }
+  return kSuccess;
+}
+
 ZipArchiveInfo GetArchiveInfo(ZipArchiveHandle archive) {
   ZipArchiveInfo result;
   result.archive_size = archive->mapped_zip.GetFileLength();
@@ -1101,6 +1227,10 @@ class MemoryWriter : public zip_archive::Writer {
 
 // A Writer that appends data to a file |fd| at its current position.
 // The file will be truncated to the end of the written data.
+//
+// If a write offset is given, data is written there with pwrite(2) instead,
+// the file position isn't used or updated and the file is never truncated, so
+// that several writers can fill disjoint ranges of the same file concurrently.
 class FileWriter : public zip_archive::Writer {
  public:
   // Creates a FileWriter for |fd| and prepare to write |entry| to it,
@@ -1110,9 +1240,10 @@ class FileWriter : public zip_archive::Writer {
   // block device).
   //
   // Returns a valid FileWriter on success, |nullptr| if an error occurred.
-  static std::unique_ptr<FileWriter> Create(int fd, const ZipEntry64* entry) {
+  static std::unique_ptr<FileWriter> Create(int fd, const ZipEntry64* entry,
+                                            off64_t write_offset = -1) {
     const uint64_t declared_length = entry->uncompressed_length;
-    const off64_t current_offset = lseek64(fd, 0, SEEK_CUR);
+    const off64_t current_offset = write_offset >= 0 ? write_offset : lseek64(fd, 0, SEEK_CUR);
     if (current_offset == -1) {
       ALOGW("Zip: unable to seek to current location on fd %d: %s", fd, strerror(errno));
       return nullptr;
@@ -1150,7 +1281,7 @@ class FileWriter : public zip_archive::Writer {
     }
 
     // Block device doesn't support ftruncate(2).
-    if (!S_ISBLK(sb.st_mode)) {
+    if (!S_ISBLK(sb.st_mode) && write_offset < 0) {
       long result = TEMP_FAILURE_RETRY(ftruncate(fd, declared_length + current_offset));
       if (result == -1) {
         ALOGW("Zip: unable to truncate file to %" PRId64 ": %s",
@@ -1159,12 +1290,13 @@ class FileWriter : public zip_archive::Writer {
       }
     }
 
-    return std::unique_ptr<FileWriter>(new FileWriter(fd, declared_length));
+    return std::unique_ptr<FileWriter>(new FileWriter(fd, declared_length, write_offset));
   }
 
   FileWriter(FileWriter&& other) noexcept
       : fd_(other.fd_),
         declared_length_(other.declared_length_),
+        write_offset_(other.write_offset_),
         total_bytes_written_(other.total_bytes_written_) {
     other.fd_ = -1;
   }
@@ -1176,7 +1308,9 @@ class FileWriter : public zip_archive::Writer {
       return false;
     }
 
-    const bool result = android::base::WriteFully(fd_, buf, buf_size);
+    const bool result = write_offset_ >= 0
+                            ? WriteFullyAtOffset(buf, buf_size, write_offset_ + total_bytes_written_)
+                            : android::base::WriteFully(fd_, buf, buf_size);
     if (result) {
       total_bytes_written_ += buf_size;
     } else {
@@ -1187,16 +1321,40 @@ class FileWriter : public zip_archive::Writer {
   }
 
  private:
-  explicit FileWriter(const int fd = -1, const uint64_t declared_length = 0)
+  explicit FileWriter(const int fd = -1, const uint64_t declared_length = 0,
+                      const off64_t write_offset = -1)
       : Writer(),
         fd_(fd),
         declared_length_(static_cast<size_t>(declared_length)),
+        write_offset_(write_offset),
         total_bytes_written_(0) {
     CHECK_LE(declared_length, SIZE_MAX);
   }
 
+  bool WriteFullyAtOffset(const uint8_t* buf, size_t buf_size, off64_t offset) {
+#if defined(_WIN32)
+    // Positional writers are only created by ExtractEntries, which isn't
+    // available on Windows.
+    UNUSED(buf, buf_size, offset);
+    errno = ENOTSUP;
+    return false;
+#else
+    while (buf_size > 0) {
+      const ssize_t n = TEMP_FAILURE_RETRY(pwrite64(fd_, buf, buf_size, offset));
+      if (n <= 0) {
+        return false;
+      }
+      buf += n;
+      buf_size -= n;
+      offset += n;
+    }
+    return true;
+#endif
+  }
+
   int fd_;
   const size_t declared_length_;
+  const off64_t write_offset_;
   size_t total_bytes_written_;
 };
 
@@ -1273,7 +1431,7 @@ int32_t Inflate(const Reader& reader, const uint64_t compressed_length,
   std::unique_ptr<z_stream, decltype(zstream_deleter)> zstream_guard(&zstream, zstream_deleter);
 
   const bool compute_crc = (crc_out != nullptr);
-  uLong crc = 0;
+  uint32_t crc = 0;
   uint64_t remaining_bytes = compressed_length;
   uint64_t total_output = 0;
   do {
@@ -1309,7 +1467,7 @@ int32_t Inflate(const Reader& reader, const uint64_t compressed_length,
         return kIoError;
       } else if (compute_crc) {
         DCHECK_LE(write_size, kBufSize);
-        crc = crc32(crc, &write_buf[0], static_cast<uint32_t>(write_size));
+        crc = ComputeCrc32(crc, &write_buf[0], write_size);
       }
 
       total_output += kBufSize - zstream.avail_out;
@@ -1354,7 +1512,7 @@ static int32_t CopyEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry64* en
 
   const uint64_t length = entry->uncompressed_length;
   uint64_t count = 0;
-  uLong crc = 0;
+  uint32_t crc = 0;
   while (count < length) {
     uint64_t remaining = length - count;
     off64_t offset = entry->offset + count;
@@ -1364,7 +1522,10 @@ static int32_t CopyEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry64* en
         (remaining > kBufSize) ? kBufSize : static_cast<uint32_t>(remaining);
 
     // Make sure to read at offset to ensure concurrent access to the fd.
-    if (!mapped_zip.ReadAtOffset(buf.data(), block_size, offset)) {
+    const bool read_result = crc_out ? mapped_zip.ReadAtOffsetWithCrc(buf.data(), block_size,
+                                                                      offset, &crc)
+                                     : mapped_zip.ReadAtOffset(buf.data(), block_size, offset);
+    if (!read_result) {
       ALOGW("CopyFileToFile: copy read failed, block_size = %u, offset = %" PRId64 ": %s",
             block_size, static_cast<int64_t>(offset), strerror(errno));
       return kIoError;
@@ -1373,9 +1534,6 @@ static int32_t CopyEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry64* en
     if (!writer->Append(&buf[0], block_size)) {
       return kIoError;
     }
-    if (crc_out) {
-      crc = crc32(crc, &buf[0], block_size);
-    }
     count += block_size;
   }
 
@@ -1451,6 +1609,70 @@ int32_t ExtractEntryToFile(ZipArchiveHandle archive, const ZipEntry64* entry, in
   return ExtractToWriter(archive, entry, writer.get());
 }
 
+#if !defined(_WIN32)
+namespace zip_archive {
+
+EntrySink::~EntrySink() {}
+
+std::unique_ptr<Writer> FdEntrySink::CreateWriter(size_t index, const ZipEntry64& entry) {
+  return FileWriter::Create(fds_[index], &entry, offsets_[index]);
+}
+
+std::unique_ptr<Writer> MemoryEntrySink::CreateWriter(size_t index, const ZipEntry64& entry) {
+  return MemoryWriter::Create(begins_[index], sizes_[index], &entry);
+}
+
+int32_t ExtractEntries(ZipArchiveHandle handle, const ZipEntry64* entries, size_t count,
+                       EntrySink* sink, int32_t* results, size_t num_threads) {
+  if (count == 0) {
+    return kSuccess;
+  }
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, count);
+
+  // Hand out the largest entries first so that a single big entry picked up
+  // last doesn't leave the other workers idle.
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [entries](size_t lhs, size_t rhs) {
+    return entries[lhs].compressed_length > entries[rhs].compressed_length;
+  });
+
+  // Every entry is independent: reads go through ReadAtOffset, which is safe
+  // to call concurrently, and each entry has its own writer.
+  std::atomic<size_t> next_entry(0);
+  auto worker = [&]() {
+    for (size_t pos = next_entry++; pos < count; pos = next_entry++) {
+      const size_t index = order[pos];
+      auto writer = sink->CreateWriter(index, entries[index]);
+      results[index] = writer ? ExtractToWriter(handle, &entries[index], writer.get()) : kIoError;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (results[i] != kSuccess) {
+      ALOGW("Zip: failed to extract entry %zu of %zu: %s", i, count, ErrorCodeString(results[i]));
+      return results[i];
+    }
+  }
+  return kSuccess;
+}
+
+}  // namespace zip_archive
+#endif  // !defined(_WIN32)
+
 int GetFileDescriptor(const ZipArchiveHandle archive) {
   return archive->mapped_zip.GetFileDescriptor();
 }
@@ -1562,16 +1784,45 @@ bool MappedZipFile::ReadAtOffset(uint8_t* buf, size_t len, off64_t off) const {
       return false;
     }
   } else {
-    if (off < 0 || data_length_ < len || off > data_length_ - len) {
-      ALOGE("Zip: invalid offset: %" PRId64 ", read length: %zu, data length: %" PRId64, off, len,
-            data_length_);
+    const uint8_t* data = GetDataAtOffset(len, off);
+    if (data == nullptr) {
       return false;
     }
-    memcpy(buf, static_cast<const uint8_t*>(base_ptr_) + off, len);
+    memcpy(buf, data, len);
+  }
+  return true;
+}
+
+bool MappedZipFile::ReadAtOffsetWithCrc(uint8_t* buf, size_t len, off64_t off,
+                                        uint32_t* crc) const {
+  if (has_fd_) {
+    if (!ReadAtOffset(buf, len, off)) {
+      return false;
+    }
+    *crc = ComputeCrc32(*crc, buf, len);
+    return true;
   }
+
+  const uint8_t* data = GetDataAtOffset(len, off);
+  if (data == nullptr) {
+    return false;
+  }
+  *crc = CopyAndComputeCrc32(*crc, buf, data, len);
   return true;
 }
 
+const uint8_t* MappedZipFile::GetDataAtOffset(size_t len, off64_t off) const {
+  if (has_fd_) {
+    return nullptr;
+  }
+  if (off < 0 || data_length_ < len || off > data_length_ - len) {
+    ALOGE("Zip: invalid offset: %" PRId64 ", read length: %zu, data length: %" PRId64, off, len,
+          data_length_);
+    return nullptr;
+  }
+  return static_cast<const uint8_t*>(base_ptr_) + off;
+}
+
 void CentralDirectory::Initialize(const void* map_base_ptr, off64_t cd_start_offset,
                                   size_t cd_size) {
   base_ptr_ = static_cast<const uint8_t*>(map_base_ptr) + cd_start_offset;
@@ -21,6 +21,7 @@
 #include <tuple>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/test_utils.h>
 #include <benchmark/benchmark.h>
 #include <ziparchive/zip_archive.h>
@@ -49,6 +50,151 @@ static std::unique_ptr<TemporaryFile> CreateZip(int size = 4, int count = 1000)
   return result;
 }
 
+// Creates an archive with |count| small entries whose names look like those of
+// a large APK.
+static std::unique_ptr<TemporaryFile> CreateManyEntriesZip(int count) {
+  auto result = std::make_unique<TemporaryFile>();
+  FILE* fp = fdopen(result->fd, "w");
+
+  ZipWriter writer(fp);
+  for (int i = 0; i < count; i++) {
+    writer.StartEntry("res/drawable-xxhdpi-v4/asset_" + std::to_string(i) + ".png", 0);
+    writer.WriteBytes("helo", 4);
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+
+  return result;
+}
+
+// Writes the precomputed central directory index of |zip_file| to a new file.
+static std::unique_ptr<TemporaryFile> CreateIndex(const TemporaryFile& zip_file) {
+  auto result = std::make_unique<TemporaryFile>();
+  ZipArchiveHandle handle;
+  if (OpenArchive(zip_file.path, &handle) != 0 ||
+      WriteCentralDirectoryIndex(handle, result->fd) != 0) {
+    result.reset();
+  }
+  CloseArchive(handle);
+  return result;
+}
+
+static void OpenArchive_scan(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(int(state.range(0))));
+  ZipArchiveHandle handle;
+
+  for (auto _ : state) {
+    if (OpenArchive(temp_file->path, &handle)) {
+      state.SkipWithError("Failed to open archive");
+    }
+    CloseArchive(handle);
+  }
+}
+BENCHMARK(OpenArchive_scan)->Arg(1000)->Arg(60000);
+
+static void OpenArchive_index(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(int(state.range(0))));
+  std::unique_ptr<TemporaryFile> index_file(CreateIndex(*temp_file));
+  if (!index_file) {
+    state.SkipWithError("Failed to create index");
+    return;
+  }
+  ZipArchiveHandle handle;
+
+  for (auto _ : state) {
+    if (OpenArchiveWithIndex(temp_file->path, index_file->path, &handle)) {
+      state.SkipWithError("Failed to open archive");
+    }
+    CloseArchive(handle);
+  }
+}
+BENCHMARK(OpenArchive_index)->Arg(1000)->Arg(60000);
+
+// Looks up every entry of an already opened archive.
+static void FindAllEntries(benchmark::State& state, ZipArchiveHandle handle, int count) {
+  std::vector<std::string> names;
+  for (int i = 0; i < count; i++) {
+    names.push_back("res/drawable-xxhdpi-v4/asset_" + std::to_string(i) + ".png");
+  }
+
+  ZipEntry64 data;
+  for (auto _ : state) {
+    for (const auto& name : names) {
+      if (FindEntry(handle, name, &data)) {
+        state.SkipWithError("Failed to find archive entry");
+        break;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+static void FindEntry_all_scan(benchmark::State& state) {
+  const int count = int(state.range(0));
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(count));
+  ZipArchiveHandle handle;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+  }
+  FindAllEntries(state, handle, count);
+  CloseArchive(handle);
+}
+BENCHMARK(FindEntry_all_scan)->Arg(1000)->Arg(60000);
+
+static void FindEntry_all_index(benchmark::State& state) {
+  const int count = int(state.range(0));
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(count));
+  std::unique_ptr<TemporaryFile> index_file(CreateIndex(*temp_file));
+  if (!index_file) {
+    state.SkipWithError("Failed to create index");
+    return;
+  }
+  ZipArchiveHandle handle;
+  if (OpenArchiveWithIndex(temp_file->path, index_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+  }
+  FindAllEntries(state, handle, count);
+  CloseArchive(handle);
+}
+BENCHMARK(FindEntry_all_index)->Arg(1000)->Arg(60000);
+
+// Creates an archive with |count| compressed entries of |size| bytes each.
+static std::unique_ptr<TemporaryFile> CreateLargeEntriesZip(int count, size_t size) {
+  auto result = std::make_unique<TemporaryFile>();
+  FILE* fp = fdopen(result->fd, "w");
+
+  // Somewhat compressible contents, so that inflating isn't trivial.
+  std::vector<uint8_t> contents(size);
+  for (size_t i = 0; i < size; i++) {
+    contents[i] = uint8_t((i * 7 + i / 13 + i / 97) & 0x3f);
+  }
+
+  ZipWriter writer(fp);
+  for (int i = 0; i < count; i++) {
+    writer.StartEntry("lib/arm64-v8a/lib" + std::to_string(i) + ".so", ZipWriter::kCompress);
+    writer.WriteBytes(contents.data(), contents.size());
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+
+  return result;
+}
+
+static std::vector<ZipEntry64> AllEntries(ZipArchiveHandle handle) {
+  std::vector<ZipEntry64> entries;
+  void* iteration_cookie;
+  ZipEntry64 data;
+  std::string_view name;
+  StartIteration(handle, &iteration_cookie);
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    entries.push_back(data);
+  }
+  EndIteration(iteration_cookie);
+  return entries;
+}
+
 static void FindEntry_no_match(benchmark::State& state) {
   // Create a temporary zip archive.
   std::unique_ptr<TemporaryFile> temp_file(CreateZip());
@@ -132,4 +278,104 @@ static void ExtractEntry(benchmark::State& state) {
 
 BENCHMARK(ExtractEntry)->Arg(2)->Arg(16)->Arg(1024);
 
+// Streams and verifies a stored 16MiB entry of an archive in memory, either
+// copying it with Read() (range(0) == 0) or in place with ReadChunk().
+static void StreamStoredEntry(benchmark::State& state) {
+  TemporaryFile temp_file;
+  FILE* fp = fdopen(temp_file.fd, "w");
+  ZipWriter writer(fp);
+  std::vector<uint8_t> contents(16 * 1024 * 1024, 'a');
+  writer.StartEntry("assets/blob.bin", 0);
+  writer.WriteBytes(contents.data(), contents.size());
+  writer.FinishEntry();
+  writer.Finish();
+  fflush(fp);
+
+  std::string zip_contents;
+  android::base::ReadFileToString(temp_file.path, &zip_contents);
+  fclose(fp);
+  ZipArchiveHandle handle;
+  ZipEntry data;
+  if (OpenArchiveFromMemory(zip_contents.data(), zip_contents.size(), "blob", &handle) ||
+      FindEntry(handle, "assets/blob.bin", &data)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+
+  for (auto _ : state) {
+    std::unique_ptr<ZipArchiveStreamEntry> stream(ZipArchiveStreamEntry::Create(handle, data));
+    if (state.range(0) == 0) {
+      while (stream->Read() != nullptr) {
+      }
+    } else {
+      const uint8_t* chunk;
+      size_t size;
+      while (stream->ReadChunk(&chunk, &size)) {
+      }
+    }
+    if (!stream->Verify()) {
+      state.SkipWithError("Failed to verify archive entry");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * contents.size());
+  CloseArchive(handle);
+}
+BENCHMARK(StreamStoredEntry)->Arg(0)->Arg(1);
+
+// Extracts 64 compressed 1MiB entries into memory, one entry at a time.
+static void ExtractEntries_serial(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateLargeEntriesZip(64, 1024 * 1024));
+  ZipArchiveHandle handle;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+  std::vector<ZipEntry64> entries = AllEntries(handle);
+  std::vector<uint8_t> buffer(1024 * 1024);
+
+  for (auto _ : state) {
+    for (const auto& entry : entries) {
+      if (ExtractToMemory(handle, &entry, buffer.data(), buffer.size())) {
+        state.SkipWithError("Failed to extract archive entry");
+        break;
+      }
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * entries.size() * buffer.size());
+  CloseArchive(handle);
+}
+BENCHMARK(ExtractEntries_serial)->UseRealTime();
+
+// Same as above, but with ExtractEntries() on |state.range(0)| threads.
+static void ExtractEntries_batch(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateLargeEntriesZip(64, 1024 * 1024));
+  ZipArchiveHandle handle;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+  std::vector<ZipEntry64> entries = AllEntries(handle);
+  std::vector<std::vector<uint8_t>> buffers(entries.size(), std::vector<uint8_t>(1024 * 1024));
+  std::vector<uint8_t*> begins;
+  std::vector<size_t> sizes;
+  for (auto& buffer : buffers) {
+    begins.push_back(buffer.data());
+    sizes.push_back(buffer.size());
+  }
+  zip_archive::MemoryEntrySink sink(begins.data(), sizes.data());
+  std::vector<int32_t> results(entries.size());
+
+  for (auto _ : state) {
+    if (zip_archive::ExtractEntries(handle, entries.data(), entries.size(), &sink, results.data(),
+                                    size_t(state.range(0)))) {
+      state.SkipWithError("Failed to extract archive entries");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * entries.size() * sizes[0]);
+  CloseArchive(handle);
+}
+BENCHMARK(ExtractEntries_batch)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -56,6 +56,15 @@ class MappedZipFile {
 
   bool ReadAtOffset(uint8_t* buf, size_t len, off64_t off) const;
 
+  // Like ReadAtOffset, but also appends the CRC32 of the data to |crc|. For
+  // archives in memory, the copy and the checksum are done in a single pass.
+  bool ReadAtOffsetWithCrc(uint8_t* buf, size_t len, off64_t off, uint32_t* crc) const;
+
+  // Returns a pointer to |len| bytes at |off| of an archive in memory, or
+  // nullptr if the archive is backed by a file descriptor or the range is out
+  // of bounds.
+  const uint8_t* GetDataAtOffset(size_t len, off64_t off) const;
+
  private:
   // If has_fd_ is true, fd is valid and we'll read contents of a zip archive
   // from the file. Otherwise, we're opening the archive from a memory mapped
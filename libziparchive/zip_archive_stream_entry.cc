@@ -35,6 +35,7 @@
 #include <zlib.h>
 
 #include "zip_archive_private.h"
+#include "zip_crc32.h"
 
 static constexpr size_t kBufSize = 65535;
 
@@ -44,6 +45,16 @@ bool ZipArchiveStreamEntry::Init(const ZipEntry& entry) {
   return true;
 }
 
+bool ZipArchiveStreamEntry::ReadChunk(const uint8_t** data, size_t* size) {
+  const std::vector<uint8_t>* buf = Read();
+  if (buf == nullptr) {
+    return false;
+  }
+  *data = buf->data();
+  *size = buf->size();
+  return true;
+}
+
 class ZipArchiveStreamEntryUncompressed : public ZipArchiveStreamEntry {
  public:
   explicit ZipArchiveStreamEntryUncompressed(ZipArchiveHandle handle)
@@ -52,6 +63,8 @@ class ZipArchiveStreamEntryUncompressed : public ZipArchiveStreamEntry {
 
   const std::vector<uint8_t>* Read() override;
 
+  bool ReadChunk(const uint8_t** data, size_t* size) override;
+
   bool Verify() override;
 
  protected:
@@ -91,7 +104,7 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryUncompressed::Read() {
   size_t bytes = (length_ > data_.size()) ? data_.size() : length_;
   ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
   errno = 0;
-  if (!archive->mapped_zip.ReadAtOffset(data_.data(), bytes, offset_)) {
+  if (!archive->mapped_zip.ReadAtOffsetWithCrc(data_.data(), bytes, offset_, &computed_crc32_)) {
     if (errno != 0) {
       ALOGE("Error reading from archive fd: %s", strerror(errno));
     } else {
@@ -104,13 +117,40 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryUncompressed::Read() {
   if (bytes < data_.size()) {
     data_.resize(bytes);
   }
-  computed_crc32_ = static_cast<uint32_t>(
-      crc32(computed_crc32_, data_.data(), static_cast<uint32_t>(data_.size())));
   length_ -= bytes;
   offset_ += bytes;
   return &data_;
 }
 
+bool ZipArchiveStreamEntryUncompressed::ReadChunk(const uint8_t** data, size_t* size) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+  if (archive->mapped_zip.HasFd()) {
+    // Only archives in memory can hand out chunks without copying them.
+    return ZipArchiveStreamEntry::ReadChunk(data, size);
+  }
+
+  if (length_ == 0) {
+    return false;
+  }
+
+  const size_t bytes = (length_ > kBufSize) ? kBufSize : length_;
+  const uint8_t* chunk = archive->mapped_zip.GetDataAtOffset(bytes, offset_);
+  if (chunk == nullptr) {
+    ALOGE("Short read of zip file, possibly corrupted zip?");
+    length_ = 0;
+    return false;
+  }
+
+  // The chunk is checksummed as it is handed out, while it's still hot in the
+  // cache, instead of in a separate pass over the whole entry.
+  computed_crc32_ = ComputeCrc32(computed_crc32_, chunk, bytes);
+  length_ -= bytes;
+  offset_ += bytes;
+  *data = chunk;
+  *size = bytes;
+  return true;
+}
+
 bool ZipArchiveStreamEntryUncompressed::Verify() {
   return length_ == 0 && crc32_ == computed_crc32_;
 }
@@ -246,16 +286,14 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryCompressed::Read() {
 
     if (z_stream_.avail_out == 0) {
       uncompressed_length_ -= out_.size();
-      computed_crc32_ = static_cast<uint32_t>(
-          crc32(computed_crc32_, out_.data(), static_cast<uint32_t>(out_.size())));
+      computed_crc32_ = ComputeCrc32(computed_crc32_, out_.data(), out_.size());
       return &out_;
     }
     if (zerr == Z_STREAM_END) {
       if (z_stream_.avail_out != 0) {
         // Resize the vector down to the actual size of the data.
         out_.resize(out_.size() - z_stream_.avail_out);
-        computed_crc32_ = static_cast<uint32_t>(
-            crc32(computed_crc32_, out_.data(), static_cast<uint32_t>(out_.size())));
+        computed_crc32_ = ComputeCrc32(computed_crc32_, out_.data(), out_.size());
         uncompressed_length_ -= out_.size();
         return &out_;
       }
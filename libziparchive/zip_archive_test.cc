@@ -31,14 +31,18 @@
 #include <android-base/logging.h>
 #include <android-base/mapped_file.h>
 #include <android-base/memory.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
 #include <ziparchive/zip_archive.h>
 #include <ziparchive/zip_archive_stream_entry.h>
+#include <ziparchive/zip_writer.h>
+#include <zlib.h>
 
 #include "zip_archive_common.h"
 #include "zip_archive_private.h"
+#include "zip_crc32.h"
 
 static std::string test_data_dir = android::base::GetExecutableDirectory() + "/testdata";
 
@@ -82,6 +86,21 @@ class CdEntryMapTest : public ::testing::Test {
         offset += name.size() + separator_.size();
       }
     }
+
+    // Also cover a precomputed index built from the same entries.
+    std::vector<std::pair<std::string_view, uint64_t>> entries;
+    entry_maps_[0]->ResetIteration();
+    for (auto entry = entry_maps_[0]->Next(base_ptr_);
+         entry != std::pair<std::string_view, uint64_t>{}; entry = entry_maps_[0]->Next(base_ptr_)) {
+      entries.push_back(entry);
+    }
+    std::vector<uint8_t> index;
+    ASSERT_TRUE(CdEntryMapPerfectHash::Build(entries, 0, joined_names_.size(), &index));
+    ASSERT_TRUE(android::base::WriteFully(index_file_.fd, index.data(), index.size()));
+    entry_maps_.emplace_back(CdEntryMapPerfectHash::Create(
+        android::base::MappedFile::FromFd(index_file_.fd, 0, index.size(), PROT_READ), 0,
+        joined_names_.size(), names_.size()));
+    ASSERT_NE(nullptr, entry_maps_.back());
   }
 
   std::vector<std::string> names_;
@@ -93,6 +112,7 @@ class CdEntryMapTest : public ::testing::Test {
 
   std::vector<std::unique_ptr<CdEntryMapInterface>> entry_maps_;
   uint8_t* base_ptr_{nullptr};  // Points to the start of the central directory.
+  TemporaryFile index_file_;
 };
 
 TEST_F(CdEntryMapTest, AddDuplicatedEntry) {
@@ -355,6 +375,86 @@ TEST(ziparchive, FindEntry) {
   CloseArchive(handle);
 }
 
+TEST(ziparchive, OpenArchiveWithIndex) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+  TemporaryFile index_file;
+  ASSERT_EQ(0, WriteCentralDirectoryIndex(handle, index_file.fd));
+  CloseArchive(handle);
+
+  const std::string abs_path = test_data_dir + "/" + kValidZip;
+  ASSERT_EQ(0, OpenArchiveWithIndex(abs_path.c_str(), index_file.path, &handle));
+
+  ZipEntry64 data;
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &data));
+  ASSERT_EQ(63, data.offset);
+  ASSERT_EQ(17u, data.uncompressed_length);
+  ASSERT_EQ(0x950821c5, data.crc32);
+  ASSERT_EQ(kEntryNotFound, FindEntry(handle, "this file does not exist", &data));
+
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie));
+  AssertIterationNames(iteration_cookie, {"a.txt", "b.txt", "b/", "b/c.txt", "b/d.txt"});
+  EndIteration(iteration_cookie);
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, OpenArchiveWithInvalidIndex) {
+  TemporaryFile index_file;
+  ASSERT_TRUE(android::base::WriteStringToFd("this is not an index", index_file.fd));
+
+  // An unusable index falls back to scanning the central directory.
+  const std::string abs_path = test_data_dir + "/" + kValidZip;
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(abs_path.c_str(), index_file.path, &handle));
+  ZipEntry64 data;
+  ASSERT_EQ(0, FindEntry(handle, "b/c.txt", &data));
+  CloseArchive(handle);
+
+  ASSERT_EQ(0, OpenArchiveWithIndex(abs_path.c_str(), "/does/not/exist", &handle));
+  ASSERT_EQ(0, FindEntry(handle, "b/c.txt", &data));
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, OpenArchiveWithIndex_DuplicateEntries) {
+  TemporaryFile zip_file;
+  FILE* fp = fdopen(dup(zip_file.fd), "w");
+  ASSERT_NE(nullptr, fp);
+  ZipWriter writer(fp);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(0, writer.StartEntry("dup.txt", 0));
+    ASSERT_EQ(0, writer.WriteBytes("x", 1));
+    ASSERT_EQ(0, writer.FinishEntry());
+  }
+  ASSERT_EQ(0, writer.Finish());
+  ASSERT_EQ(0, fclose(fp));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(kDuplicateEntry, OpenArchive(zip_file.path, &handle));
+
+  // Build an index which only resolves the name to the first entry, as a
+  // crafted index would to hide the duplicate.
+  const uint8_t* cd = handle->central_directory.GetBasePtr();
+  std::vector<std::pair<std::string_view, uint64_t>> entries;
+  uint64_t offset = 0;
+  for (std::string_view name : {"dup.txt", "hidden"}) {
+    auto cdr = reinterpret_cast<const CentralDirectoryRecord*>(cd + offset);
+    entries.emplace_back(name, offset + sizeof(CentralDirectoryRecord));
+    offset += sizeof(CentralDirectoryRecord) + cdr->file_name_length + cdr->extra_field_length +
+              cdr->comment_length;
+  }
+  std::vector<uint8_t> index;
+  ASSERT_TRUE(CdEntryMapPerfectHash::Build(entries, handle->directory_offset,
+                                           handle->central_directory.GetMapLength(), &index));
+  CloseArchive(handle);
+  TemporaryFile index_file;
+  ASSERT_TRUE(android::base::WriteFully(index_file.fd, index.data(), index.size()));
+
+  // The index is rejected, and the scan finds the duplicate.
+  ASSERT_EQ(kDuplicateEntry, OpenArchiveWithIndex(zip_file.path, index_file.path, &handle));
+  CloseArchive(handle);
+}
+
 TEST(ziparchive, FindEntry_empty) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
@@ -608,6 +708,72 @@ TEST(ziparchive, ExtractToFile) {
 }
 
 #if !defined(_WIN32)
+TEST(ziparchive, ExtractEntries) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  std::vector<ZipEntry64> entries;
+  std::vector<std::string> expected;
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie));
+  ZipEntry64 entry;
+  std::string_view name;
+  while (Next(iteration_cookie, &entry, &name) == 0) {
+    std::string contents(entry.uncompressed_length, '\0');
+    ASSERT_EQ(0, ExtractToMemory(handle, &entry, reinterpret_cast<uint8_t*>(contents.data()),
+                                 contents.size()));
+    entries.push_back(entry);
+    expected.push_back(contents);
+  }
+  EndIteration(iteration_cookie);
+  const size_t count = entries.size();
+  ASSERT_EQ(5u, count);
+
+  // Extract every entry to its own memory region.
+  std::vector<std::string> buffers(expected.size());
+  std::vector<uint8_t*> begins;
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < count; i++) {
+    buffers[i].resize(entries[i].uncompressed_length);
+    begins.push_back(reinterpret_cast<uint8_t*>(buffers[i].data()));
+    sizes.push_back(buffers[i].size());
+  }
+  zip_archive::MemoryEntrySink memory_sink(begins.data(), sizes.data());
+  std::vector<int32_t> results(count, -1);
+  ASSERT_EQ(0, zip_archive::ExtractEntries(handle, entries.data(), count, &memory_sink,
+                                           results.data(), 4));
+  ASSERT_EQ(std::vector<int32_t>(count, 0), results);
+  ASSERT_EQ(expected, buffers);
+
+  // Extract all entries back to back into a single file.
+  TemporaryFile tmp_file;
+  std::vector<int> fds(count, tmp_file.fd);
+  std::vector<off64_t> offsets;
+  std::string concatenated;
+  for (size_t i = 0; i < count; i++) {
+    offsets.push_back(static_cast<off64_t>(concatenated.size()));
+    concatenated += expected[i];
+  }
+  zip_archive::FdEntrySink fd_sink(fds.data(), offsets.data());
+  ASSERT_EQ(0, zip_archive::ExtractEntries(handle, entries.data(), count, &fd_sink,
+                                           results.data(), 4));
+  std::string file_contents;
+  ASSERT_TRUE(android::base::ReadFileToString(tmp_file.path, &file_contents));
+  ASSERT_EQ(concatenated, file_contents);
+
+  // Errors are reported per entry.
+  for (size_t i = 0; i < count; i++) {
+    if (sizes[i] > 0) sizes[i]--;
+  }
+  ASSERT_EQ(kIoError, zip_archive::ExtractEntries(handle, entries.data(), count, &memory_sink,
+                                                  results.data(), 4));
+  for (size_t i = 0; i < count; i++) {
+    ASSERT_EQ(entries[i].uncompressed_length > 0 ? kIoError : kSuccess, results[i]);
+  }
+
+  CloseArchive(handle);
+}
+
 TEST(ziparchive, OpenFromMemory) {
   const std::string zip_path = test_data_dir + "/dummy-update.zip";
   android::base::unique_fd fd(open(zip_path.c_str(), O_RDONLY | O_BINARY));
@@ -739,6 +905,51 @@ TEST(ziparchive, StreamUncompressedBadCrc) {
   CloseArchive(handle);
 }
 
+static void ZipArchiveStreamChunkTest(const std::string& zip_file, const std::string& entry_name,
+                                      bool verified, std::vector<uint8_t>* read_data) {
+  std::string zip_contents;
+  ASSERT_TRUE(android::base::ReadFileToString(test_data_dir + "/" + zip_file, &zip_contents));
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFromMemory(zip_contents.data(), zip_contents.size(), zip_file.c_str(),
+                                     &handle));
+
+  ZipEntry entry;
+  ASSERT_EQ(0, FindEntry(handle, entry_name, &entry));
+  std::unique_ptr<ZipArchiveStreamEntry> stream(ZipArchiveStreamEntry::Create(handle, entry));
+  ASSERT_TRUE(stream.get() != nullptr);
+  const uint8_t* data;
+  size_t size;
+  while (stream->ReadChunk(&data, &size)) {
+    if (entry.method == kCompressStored) {
+      // Stored entries are returned in place.
+      ASSERT_GE(data, reinterpret_cast<const uint8_t*>(zip_contents.data()));
+      ASSERT_LE(data + size, reinterpret_cast<const uint8_t*>(zip_contents.data()) +
+                                 zip_contents.size());
+    }
+    read_data->insert(read_data->end(), data, data + size);
+  }
+  ASSERT_EQ(verified, stream->Verify());
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, StreamChunksUncompressed) {
+  std::vector<uint8_t> read_data;
+  ZipArchiveStreamChunkTest(kValidZip, "b.txt", true, &read_data);
+  ASSERT_EQ(kBTxtContents, read_data);
+}
+
+TEST(ziparchive, StreamChunksCompressed) {
+  std::vector<uint8_t> read_data;
+  ZipArchiveStreamChunkTest(kValidZip, "a.txt", true, &read_data);
+  ASSERT_EQ(kATxtContents, read_data);
+}
+
+TEST(ziparchive, StreamChunksUncompressedBadCrc) {
+  std::vector<uint8_t> read_data;
+  ZipArchiveStreamChunkTest(kBadCrcZip, "b.txt", false, &read_data);
+}
+
 // Generated using the following Java program:
 //     public static void main(String[] foo) throws Exception {
 //       FileOutputStream fos = new
@@ -1415,3 +1626,43 @@ TEST(ziparchive, Bug174945959) {
   }
   EndIteration(cookie);
 }
+
+// The hardware kernels only kick in above a minimum length, so cover lengths
+// on both sides of it, as well as unaligned buffers and a non zero crc to
+// append to.
+TEST(ziparchive, ComputeCrc32MatchesZlib) {
+  std::vector<uint8_t> data(64 * 1024 + 64);
+  uint32_t seed = 0x12345678;
+  for (auto& byte : data) {
+    seed = seed * 1103515245 + 12345;
+    byte = static_cast<uint8_t>(seed >> 24);
+  }
+
+  static const size_t kLengths[] = {0,   1,   15,  16,   63,   64,   65,
+                                   127, 128, 129, 255, 1000, 4096, 64 * 1024 + 3};
+  std::vector<uint8_t> copy(data.size());
+  for (size_t len : kLengths) {
+    for (size_t misalignment = 0; misalignment < 8; misalignment++) {
+      const uint8_t* buf = data.data() + misalignment;
+      for (uint32_t crc : {0u, 0xffffffffu, 0x2144df1cu}) {
+        SCOPED_TRACE(android::base::StringPrintf("len %zu, misalignment %zu, crc 0x%08x", len,
+                                                 misalignment, crc));
+        const auto expected = static_cast<uint32_t>(crc32(crc, buf, static_cast<uInt>(len)));
+        ASSERT_EQ(expected, ComputeCrc32(crc, buf, len));
+
+        uint8_t* dst = copy.data() + (7 - misalignment);
+        memset(copy.data(), 0, copy.size());
+        ASSERT_EQ(expected, CopyAndComputeCrc32(crc, dst, buf, len));
+        ASSERT_EQ(0, memcmp(dst, buf, len));
+      }
+    }
+  }
+
+  // The crc of the whole buffer is the same when computed in chunks.
+  uint32_t crc = 0;
+  for (size_t offset = 0, len = 1; offset < data.size(); offset += len, len = len * 3 + 1) {
+    len = std::min(len, data.size() - offset);
+    crc = ComputeCrc32(crc, data.data() + offset, len);
+  }
+  ASSERT_EQ(static_cast<uint32_t>(crc32(0, data.data(), static_cast<uInt>(data.size()))), crc);
+}
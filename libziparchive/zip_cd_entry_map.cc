@@ -16,6 +16,11 @@
 
 #include "zip_cd_entry_map.h"
 
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <log/log.h>
 
@@ -154,3 +159,240 @@ std::pair<std::string_view, uint64_t> CdEntryMapZip64::Next(const uint8_t* /*cd_
 
   return *iterator_++;
 }
+
+// The hash used by the perfect hash index. Unlike ComputeHash, it has to be
+// stable across processes and builds since the index is persisted. Every name
+// in the central directory is hashed when an archive is opened with an index,
+// so this reads the name eight bytes at a time.
+__attribute__((no_sanitize("unsigned-integer-overflow")))
+static uint64_t ComputeIndexHash(std::string_view name) {
+  static constexpr uint64_t kMultiplier = 0x9e3779b97f4a7c15;
+  uint64_t hash = name.size() * kMultiplier;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= name.size(); i += sizeof(uint64_t)) {
+    uint64_t chunk;
+    memcpy(&chunk, name.data() + i, sizeof(chunk));
+    hash = (hash ^ chunk) * kMultiplier;
+    hash ^= hash >> 29;
+  }
+  // Entry names can't contain NUL, so zero padding the tail doesn't make two
+  // names of the same length hash the same.
+  uint64_t tail = 0;
+  memcpy(&tail, name.data() + i, name.size() - i);
+  hash = (hash ^ tail) * kMultiplier;
+  return hash ^ (hash >> 32);
+}
+
+// Mixes the hash of a name with the displacement seed of its bucket.
+__attribute__((no_sanitize("unsigned-integer-overflow")))
+static uint64_t SeedIndexHash(uint64_t hash, uint32_t seed) {
+  hash ^= seed * 0xff51afd7ed558ccd;
+  hash = (hash ^ (hash >> 33)) * 0xc4ceb9fe1a85ec53;
+  return hash ^ (hash >> 33);
+}
+
+static_assert(sizeof(CdEntryIndexHeader) == 40, "unexpected CdEntryIndexHeader layout");
+static_assert(sizeof(ZipStringOffset) == 8, "unexpected ZipStringOffset layout");
+
+static size_t SeedsSize(uint32_t num_buckets) {
+  // Keep the slots that follow the seeds 8-byte aligned.
+  return (num_buckets * sizeof(int32_t) + 7) & ~static_cast<size_t>(7);
+}
+
+static size_t IndexSize(uint32_t num_buckets, uint32_t num_entries) {
+  return sizeof(CdEntryIndexHeader) + SeedsSize(num_buckets) +
+         static_cast<size_t>(num_entries) * sizeof(ZipStringOffset);
+}
+
+std::unique_ptr<CdEntryMapInterface> CdEntryMapPerfectHash::Create(
+    std::unique_ptr<android::base::MappedFile> index, uint64_t cd_start_offset, uint64_t cd_size,
+    uint64_t num_entries) {
+  if (index == nullptr || index->size() < sizeof(CdEntryIndexHeader)) {
+    ALOGW("Zip: central directory index is truncated");
+    return nullptr;
+  }
+
+  auto header = reinterpret_cast<const CdEntryIndexHeader*>(index->data());
+  if (header->magic != CdEntryIndexHeader::kMagic ||
+      header->version != CdEntryIndexHeader::kVersion) {
+    ALOGW("Zip: unrecognized central directory index format");
+    return nullptr;
+  }
+  if (header->cd_start_offset != cd_start_offset || header->cd_size != cd_size ||
+      header->num_entries != num_entries) {
+    ALOGW("Zip: central directory index doesn't match the archive");
+    return nullptr;
+  }
+  if (num_entries == 0 || num_entries > INT32_MAX || header->num_buckets == 0 ||
+      index->size() != IndexSize(header->num_buckets, static_cast<uint32_t>(num_entries))) {
+    ALOGW("Zip: central directory index has an invalid size %zu", index->size());
+    return nullptr;
+  }
+
+  auto entry_map = std::unique_ptr<CdEntryMapPerfectHash>(new CdEntryMapPerfectHash());
+  const uint8_t* seeds = reinterpret_cast<const uint8_t*>(index->data()) + sizeof(*header);
+  entry_map->cd_size_ = cd_size;
+  entry_map->num_entries_ = static_cast<uint32_t>(num_entries);
+  entry_map->num_buckets_ = header->num_buckets;
+  entry_map->seeds_ = reinterpret_cast<const int32_t*>(seeds);
+  entry_map->slots_ =
+      reinterpret_cast<const ZipStringOffset*>(seeds + SeedsSize(header->num_buckets));
+  entry_map->index_ = std::move(index);
+  return entry_map;
+}
+
+bool CdEntryMapPerfectHash::Build(
+    const std::vector<std::pair<std::string_view, uint64_t>>& entries, uint64_t cd_start_offset,
+    uint64_t cd_size, std::vector<uint8_t>* out) {
+  // Negative seeds encode slot indices, so the number of entries has to fit in an int32_t.
+  if (entries.empty() || entries.size() > INT32_MAX) {
+    return false;
+  }
+  const auto num_entries = static_cast<uint32_t>(entries.size());
+  // Two keys per bucket on average keeps the seed search short even for the
+  // last buckets, at the cost of two bytes of seed per entry.
+  const uint32_t num_buckets = num_entries / 2 + 1;
+
+  std::vector<uint64_t> hashes(num_entries);
+  std::vector<std::vector<uint32_t>> buckets(num_buckets);
+  for (uint32_t i = 0; i < num_entries; i++) {
+    if (entries[i].second > UINT32_MAX || entries[i].first.size() > UINT16_MAX) {
+      return false;
+    }
+    hashes[i] = ComputeIndexHash(entries[i].first);
+    buckets[hashes[i] % num_buckets].push_back(i);
+  }
+
+  // Place the largest buckets first, while most of the slots are still free.
+  std::vector<uint32_t> order(num_buckets);
+  for (uint32_t i = 0; i < num_buckets; i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t lhs, uint32_t rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  static constexpr uint32_t kMaxSeedAttempts = 1u << 24;
+  std::vector<int32_t> seeds(num_buckets, 0);
+  std::vector<int64_t> slot_to_entry(num_entries, -1);
+  std::vector<uint32_t> candidate_slots;
+  size_t pos = 0;
+  for (; pos < order.size() && buckets[order[pos]].size() > 1; pos++) {
+    const auto& bucket = buckets[order[pos]];
+    // Names with the same hash would never fit in distinct slots.
+    for (size_t i = 0; i < bucket.size(); i++) {
+      for (size_t j = i + 1; j < bucket.size(); j++) {
+        if (hashes[bucket[i]] == hashes[bucket[j]]) {
+          ALOGW("Zip: entries %" PRIu32 " and %" PRIu32 " have the same index hash", bucket[i],
+                bucket[j]);
+          return false;
+        }
+      }
+    }
+    uint32_t seed = 1;
+    for (; seed < kMaxSeedAttempts; seed++) {
+      candidate_slots.clear();
+      bool fits = true;
+      for (uint32_t entry : bucket) {
+        const auto slot = static_cast<uint32_t>(SeedIndexHash(hashes[entry], seed) % num_entries);
+        if (slot_to_entry[slot] != -1 || std::find(candidate_slots.begin(), candidate_slots.end(),
+                                                   slot) != candidate_slots.end()) {
+          fits = false;
+          break;
+        }
+        candidate_slots.push_back(slot);
+      }
+      if (fits) break;
+    }
+    if (seed == kMaxSeedAttempts) {
+      ALOGW("Zip: unable to find a perfect hash seed for %zu entries", bucket.size());
+      return false;
+    }
+    for (size_t i = 0; i < bucket.size(); i++) {
+      slot_to_entry[candidate_slots[i]] = bucket[i];
+    }
+    seeds[order[pos]] = static_cast<int32_t>(seed);
+  }
+
+  // Buckets with a single entry go straight into the remaining free slots; a
+  // negative seed encodes the slot index directly.
+  uint32_t free_slot = 0;
+  for (; pos < order.size() && buckets[order[pos]].size() == 1; pos++) {
+    while (slot_to_entry[free_slot] != -1) free_slot++;
+    slot_to_entry[free_slot] = buckets[order[pos]][0];
+    seeds[order[pos]] = -static_cast<int32_t>(free_slot) - 1;
+  }
+
+  out->assign(IndexSize(num_buckets, num_entries), 0);
+  CdEntryIndexHeader header = {};
+  header.magic = CdEntryIndexHeader::kMagic;
+  header.version = CdEntryIndexHeader::kVersion;
+  header.cd_start_offset = cd_start_offset;
+  header.cd_size = cd_size;
+  header.num_entries = num_entries;
+  header.num_buckets = num_buckets;
+  uint8_t* ptr = out->data();
+  memcpy(ptr, &header, sizeof(header));
+  memcpy(ptr + sizeof(header), seeds.data(), seeds.size() * sizeof(int32_t));
+  ptr += sizeof(header) + SeedsSize(num_buckets);
+  for (uint32_t slot = 0; slot < num_entries; slot++) {
+    const auto& [name, offset] = entries[slot_to_entry[slot]];
+    auto dst = reinterpret_cast<ZipStringOffset*>(ptr) + slot;
+    dst->name_offset = static_cast<uint32_t>(offset);
+    dst->name_length = static_cast<uint16_t>(name.size());
+  }
+  return true;
+}
+
+ZipError CdEntryMapPerfectHash::AddToMap(std::string_view name, const uint8_t* /*start*/) {
+  ALOGW("Zip: Unable to add entry %.*s to a read-only index", static_cast<int>(name.size()),
+        name.data());
+  return kInvalidHandle;
+}
+
+std::string_view CdEntryMapPerfectHash::SlotName(const ZipStringOffset& slot,
+                                                 const uint8_t* cd_start) const {
+  // The index lives outside of the archive, so don't trust its offsets.
+  if (slot.name_offset == 0 ||
+      static_cast<uint64_t>(slot.name_offset) + slot.name_length > cd_size_) {
+    ALOGW("Zip: Invalid name offset %" PRIu32 " in central directory index", slot.name_offset);
+    return {};
+  }
+  return slot.ToStringView(cd_start);
+}
+
+std::pair<ZipError, uint64_t> CdEntryMapPerfectHash::GetCdEntryOffset(
+    std::string_view name, const uint8_t* cd_start) const {
+  const uint64_t hash = ComputeIndexHash(name);
+  const int32_t seed = seeds_[hash % num_buckets_];
+  uint32_t slot;
+  if (seed < 0) {
+    slot = static_cast<uint32_t>(-static_cast<int64_t>(seed) - 1);
+  } else {
+    slot = static_cast<uint32_t>(SeedIndexHash(hash, static_cast<uint32_t>(seed)) % num_entries_);
+  }
+
+  // A minimal perfect hash maps names that aren't in the archive to arbitrary
+  // slots, so we always need to compare the name.
+  if (slot < num_entries_ && SlotName(slots_[slot], cd_start) == name) {
+    return {kSuccess, slots_[slot].name_offset};
+  }
+
+  ALOGV("Zip: Unable to find entry %.*s", static_cast<int>(name.size()), name.data());
+  return {kEntryNotFound, 0};
+}
+
+void CdEntryMapPerfectHash::ResetIteration() {
+  current_position_ = 0;
+}
+
+std::pair<std::string_view, uint64_t> CdEntryMapPerfectHash::Next(const uint8_t* cd_start) {
+  if (current_position_ >= num_entries_) {
+    return {};
+  }
+
+  const auto& slot = slots_[current_position_++];
+  const std::string_view name = SlotName(slot, cd_start);
+  if (name.empty()) {
+    return {};
+  }
+  return {name, slot.name_offset};
+}
@@ -22,6 +22,9 @@
 #include <memory>
 #include <string_view>
 #include <utility>
+#include <vector>
+
+#include <android-base/mapped_file.h>
 
 #include "zip_error.h"
 
@@ -112,3 +115,68 @@ class CdEntryMapZip64 : public CdEntryMapInterface {
 
   std::map<std::string_view, uint64_t>::iterator iterator_;
 };
+
+// The on-disk header of a precomputed central directory index. The header is
+// followed by |num_buckets| int32_t displacement seeds, padded to 8 bytes, and
+// then by |num_entries| ZipStringOffset slots. All fields are little endian.
+struct CdEntryIndexHeader {
+  static constexpr uint32_t kMagic = 0x5844495a;  // 'ZIDX'
+  static constexpr uint32_t kVersion = 2;
+
+  uint32_t magic;
+  uint32_t version;
+  // These describe the central directory the index was built from, and are
+  // compared against the archive being opened so that a stale index is
+  // rejected early. The entries themselves are always checked against the
+  // central directory when it is opened.
+  uint64_t cd_start_offset;
+  uint64_t cd_size;
+  uint64_t num_entries;
+  uint32_t reserved;
+  uint32_t num_buckets;
+};
+
+// This implementation of CdEntryMap is backed by a precomputed minimal perfect
+// hash index (hash and displace), usually mmapped from a sidecar file. Opening
+// an archive with it doesn't allocate or fill a hash table, and every lookup
+// is a single probe followed by one name comparison.
+class CdEntryMapPerfectHash : public CdEntryMapInterface {
+ public:
+  // Creates a map from the serialized index in |index|. Returns nullptr if the
+  // index is malformed or doesn't describe the central directory identified by
+  // the remaining arguments. The caller still has to check that every entry of
+  // the central directory resolves to itself.
+  static std::unique_ptr<CdEntryMapInterface> Create(
+      std::unique_ptr<android::base::MappedFile> index, uint64_t cd_start_offset,
+      uint64_t cd_size, uint64_t num_entries);
+
+  // Serializes an index of |entries|, which are the [name, cd offset] pairs of
+  // all entries in the central directory, into |out|. Returns false if no
+  // index can be built for these entries.
+  static bool Build(const std::vector<std::pair<std::string_view, uint64_t>>& entries,
+                    uint64_t cd_start_offset, uint64_t cd_size, std::vector<uint8_t>* out);
+
+  // The index is immutable, entries can't be added to it.
+  ZipError AddToMap(std::string_view name, const uint8_t* start) override;
+  std::pair<ZipError, uint64_t> GetCdEntryOffset(std::string_view name,
+                                                 const uint8_t* cd_start) const override;
+  void ResetIteration() override;
+  std::pair<std::string_view, uint64_t> Next(const uint8_t* cd_start) override;
+
+ private:
+  CdEntryMapPerfectHash() = default;
+
+  // Returns the name referenced by |slot|, or an empty view if the slot points
+  // outside of the central directory.
+  std::string_view SlotName(const ZipStringOffset& slot, const uint8_t* cd_start) const;
+
+  std::unique_ptr<android::base::MappedFile> index_;
+  uint64_t cd_size_{0};
+  uint32_t num_entries_{0};
+  uint32_t num_buckets_{0};
+  const int32_t* seeds_{nullptr};
+  const ZipStringOffset* slots_{nullptr};
+
+  // The position of element for the current iteration.
+  uint32_t current_position_{0};
+};
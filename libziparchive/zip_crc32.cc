@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "zip_crc32.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "zlib.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+#define ZIP_CRC32_PCLMUL 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#define ZIP_CRC32_ARMV8 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+// Signature shared by all the kernels. |dst| is nullptr when the data only
+// needs to be checksummed.
+using Crc32Kernel = uint32_t (*)(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len);
+
+static uint32_t ZlibCrc32(uint32_t crc, const uint8_t* buf, size_t len) {
+  uLong result = crc;
+  while (len > 0) {
+    // crc32() takes a 32 bit length.
+    const auto chunk = static_cast<uInt>(std::min<size_t>(len, UINT32_MAX));
+    result = crc32(result, buf, chunk);
+    buf += chunk;
+    len -= chunk;
+  }
+  return static_cast<uint32_t>(result);
+}
+
+static uint32_t GenericCrc32(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len) {
+  if (dst != nullptr) {
+    memcpy(dst, src, len);
+  }
+  return ZlibCrc32(crc, src, len);
+}
+
+#if defined(ZIP_CRC32_PCLMUL)
+
+// Below this size the setup and reduction steps don't pay off.
+static constexpr size_t kPclmulMinLength = 64;
+
+// Folds |len| bytes at |src| into |crc| (a non-inverted CRC32 register) with
+// carry-less multiplication, copying them to |dst| on the way if it isn't
+// nullptr. |len| must be at least 64 and a multiple of 16.
+//
+// This is the algorithm from Intel's "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction" white paper, with the bit-reflected
+// constants for the gzip polynomial given at the end of the paper.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t FoldCrc32Pclmul(uint32_t crc,
+                                                                         uint8_t* dst,
+                                                                         const uint8_t* src,
+                                                                         size_t len) {
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  auto load = [&src, &dst](size_t offset) {
+    const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + offset));
+    if (dst != nullptr) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + offset), value);
+    }
+    return value;
+  };
+  auto advance = [&src, &dst, &len](size_t count) {
+    src += count;
+    if (dst != nullptr) dst += count;
+    len -= count;
+  };
+
+  __m128i x1 = load(0x00);
+  __m128i x2 = load(0x10);
+  __m128i x3 = load(0x20);
+  __m128i x4 = load(0x30);
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+  __m128i x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+  advance(64);
+
+  // Fold 64 bytes at a time into four independent accumulators.
+  while (len >= 64) {
+    const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    const __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    const __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    const __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), load(0x00));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), load(0x10));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), load(0x20));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), load(0x30));
+    advance(64);
+  }
+
+  // Fold the four accumulators into one.
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+  for (__m128i next : {x2, x3, x4}) {
+    const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+  }
+
+  // Fold the remaining 16 byte blocks.
+  while (len >= 16) {
+    const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, load(0)), x5);
+    advance(16);
+  }
+
+  // Fold 128 bits down to 64 bits.
+  __m128i t = _mm_clmulepi64_si128(x1, x0, 0x10);
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+  x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+  t = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00);
+  x1 = _mm_xor_si128(x1, t);
+
+  // Barrett reduction down to 32 bits.
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+  t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+  t = _mm_clmulepi64_si128(_mm_and_si128(t, mask), x0, 0x00);
+  x1 = _mm_xor_si128(x1, t);
+
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static uint32_t PclmulCrc32(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len) {
+  if (len < kPclmulMinLength) {
+    return GenericCrc32(crc, dst, src, len);
+  }
+
+  const size_t folded = len & ~static_cast<size_t>(15);
+  crc = ~FoldCrc32Pclmul(~crc, dst, src, folded);
+  return GenericCrc32(crc, dst != nullptr ? dst + folded : nullptr, src + folded, len - folded);
+}
+
+static Crc32Kernel SelectKernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+    return PclmulCrc32;
+  }
+  return GenericCrc32;
+}
+
+#elif defined(ZIP_CRC32_ARMV8)
+
+__attribute__((target("crc"))) static uint32_t Armv8Crc32(uint32_t crc, uint8_t* dst,
+                                                          const uint8_t* src, size_t len) {
+  crc = ~crc;
+  while (len >= sizeof(uint64_t)) {
+    uint64_t value;
+    memcpy(&value, src, sizeof(value));
+    if (dst != nullptr) {
+      memcpy(dst, &value, sizeof(value));
+      dst += sizeof(value);
+    }
+    crc = __crc32d(crc, value);
+    src += sizeof(value);
+    len -= sizeof(value);
+  }
+  while (len > 0) {
+    if (dst != nullptr) {
+      *dst++ = *src;
+    }
+    crc = __crc32b(crc, *src++);
+    len--;
+  }
+  return ~crc;
+}
+
+static Crc32Kernel SelectKernel() {
+  if ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0) {
+    return Armv8Crc32;
+  }
+  return GenericCrc32;
+}
+
+#else
+
+static Crc32Kernel SelectKernel() {
+  return GenericCrc32;
+}
+
+#endif
+
+static Crc32Kernel GetKernel() {
+  static const Crc32Kernel kernel = SelectKernel();
+  return kernel;
+}
+
+uint32_t ComputeCrc32(uint32_t crc, const uint8_t* buf, size_t len) {
+  return GetKernel()(crc, nullptr, buf, len);
+}
+
+uint32_t CopyAndComputeCrc32(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len) {
+  return GetKernel()(crc, dst, src, len);
+}
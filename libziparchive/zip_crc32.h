@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32 (the zip / gzip polynomial) helpers. Both functions follow the
+// conventions of zlib's crc32(): |crc| is the checksum of the preceding data,
+// 0 for the first chunk, and the updated checksum is returned.
+//
+// A hardware accelerated kernel (PCLMULQDQ folding on x86, the ARMv8 CRC32
+// instructions on arm64) is picked at runtime when the CPU supports it, with
+// zlib as the fallback.
+
+// Returns the CRC32 of |len| bytes at |buf| appended to |crc|.
+uint32_t ComputeCrc32(uint32_t crc, const uint8_t* buf, size_t len);
+
+// Copies |len| bytes from |src| to |dst| and returns their CRC32 appended to
+// |crc|, reading the source only once. The ranges must not overlap.
+uint32_t CopyAndComputeCrc32(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len);
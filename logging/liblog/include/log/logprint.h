@@ -146,6 +146,20 @@ char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
                                 const AndroidLogEntry* p_line,
                                 size_t* p_outLength);
 
+/**
+ * Formats a log message into a caller supplied buffer without allocating
+ *
+ * Returns the length of the formatted message, which is written to buffer
+ * without a terminating NUL if it fits in bufferSize bytes. If the return
+ * value is larger than bufferSize nothing past bufferSize is touched, but the
+ * contents of buffer are unspecified. Callers that format many messages can
+ * append them to one arena and write it out in bulk.
+ */
+
+size_t android_log_formatLogLineToBuffer(AndroidLogFormat* p_format,
+                                         char* buffer, size_t bufferSize,
+                                         const AndroidLogEntry* p_line);
+
 /**
  * Either print or do not print log line, based on filter
  *
@@ -1086,60 +1086,170 @@ int android_log_processBinaryLogBuffer(
   return result;
 }
 
+namespace {
+
 /*
- * Convert to printable from message to p buffer, return string length. If p is
- * NULL, do not copy, but still return the expected string length.
+ * Appends to a caller supplied buffer without ever allocating. Whatever doesn't
+ * fit is counted but not written, so size() is always the length the complete
+ * output needs.
  */
-size_t convertPrintable(char* p, const char* message, size_t messageLen) {
-  char* begin = p;
-  bool print = p != NULL;
+class LineWriter {
+ public:
+  LineWriter(char* buf, size_t bufSize) : buf_(buf), bufSize_(bufSize) {}
+
+  size_t size() const { return pos_; }
+
+  /*
+   * Writes whatever fits, so that a prefix that is later truncated is intact
+   * when the truncated line fits.
+   */
+  void append(const char* s, size_t len) {
+    if (pos_ < bufSize_) {
+      memcpy(buf_ + pos_, s, std::min(len, bufSize_ - pos_));
+    }
+    pos_ += len;
+  }
+
+  void append(char c) {
+    if (pos_ < bufSize_) buf_[pos_] = c;
+    ++pos_;
+  }
+
+  void appendString(const char* s) { append(s, strlen(s)); }
+
+  void appendSpaces(size_t count) {
+    for (size_t i = 0; i < count; ++i) append(' ');
+  }
+
+  /* Equivalent to "%-<width>.*s". */
+  void appendPadded(const char* s, size_t len, size_t width) {
+    append(s, len);
+    if (len < width) appendSpaces(width - len);
+  }
+
+  /* Equivalent to "%<width>lld". */
+  void appendInt(long long value, size_t width) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    unsigned long long magnitude =
+        value < 0 ? 0ULL - static_cast<unsigned long long>(value) : value;
+    do {
+      *--p = '0' + magnitude % 10;
+      magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *--p = '-';
+    size_t len = end - p;
+    if (len < width) appendSpaces(width - len);
+    append(p, len);
+  }
+
+  /* Equivalent to "%0<digits>lu". */
+  void appendZeroPadded(unsigned long value, size_t digits) {
+    char buf[24];
+    digits = std::min(digits, sizeof(buf));
+    for (size_t i = digits; i > 0; --i) {
+      buf[i - 1] = '0' + value % 10;
+      value /= 10;
+    }
+    append(buf, digits);
+  }
+
+  /* Drops everything written past the first |size| bytes. */
+  void truncate(size_t size) { pos_ = std::min(pos_, size); }
+
+  /* Appends a copy of |len| bytes this writer already wrote at |offset|. */
+  void repeat(size_t offset, size_t len) {
+    if (offset + len <= bufSize_ && len <= bufSize_ - std::min(pos_, bufSize_)) {
+      memcpy(buf_ + pos_, buf_ + offset, len);
+    }
+    pos_ += len;
+  }
+
+ private:
+  char* buf_;
+  size_t bufSize_;
+  size_t pos_ = 0;
+};
+
+/* Bytes that convertPrintable() copies through unchanged. */
+static inline bool isPassThrough(unsigned char c) {
+  return (c >= ' ' && c < 0x80 && c != '\\') || c == '\t';
+}
+
+/*
+ * Returns the length of the leading run of pass through bytes, checking 16
+ * bytes at a time where the vector extensions map onto SIMD registers.
+ */
+static size_t passThroughRun(const char* message, size_t messageLen) {
+  size_t i = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+  typedef unsigned char Bytes16 __attribute__((vector_size(16)));
+  for (; i + sizeof(Bytes16) <= messageLen; i += sizeof(Bytes16)) {
+    Bytes16 v;
+    memcpy(&v, message + i, sizeof(v));
+    auto special = ((v < ' ') | (v >= 0x80) | (v == '\\')) & ~(v == '\t');
+    uint64_t mask[2];
+    memcpy(mask, &special, sizeof(mask));
+    if (mask[0] | mask[1]) break;
+  }
+#endif
+  while (i < messageLen && isPassThrough(message[i])) ++i;
+  return i;
+}
+
+static void appendPrintable(LineWriter& out, const char* message, size_t messageLen) {
   mbstate_t mb_state = {};
 
   while (messageLen) {
-    char buf[6];
-    ssize_t len = sizeof(buf) - 1;
-    if ((size_t)len > messageLen) {
-      len = messageLen;
+    size_t run = passThroughRun(message, messageLen);
+    out.append(message, run);
+    message += run;
+    messageLen -= run;
+    if (!messageLen) break;
+
+    unsigned char c = *message;
+    ssize_t len = 1;
+    if (c & 0x80) {
+      len = mbrtowc(nullptr, message, std::min<size_t>(messageLen, 5), &mb_state);
     }
-    len = mbrtowc(nullptr, message, len, &mb_state);
-
-    if (len < 0) {
-      snprintf(buf, sizeof(buf), "\\x%02X", static_cast<unsigned char>(*message));
-      len = 1;
+    if (len > 1) {
+      /* A valid multi-byte character is copied through. */
+      out.append(message, len);
+    } else if (c == '\a') {
+      out.append("\\a", 2);
+    } else if (c == '\b') {
+      out.append("\\b", 2);
+    } else if (c == '\v') {
+      out.append("\\v", 2);
+    } else if (c == '\f') {
+      out.append("\\f", 2);
+    } else if (c == '\r') {
+      out.append("\\r", 2);
+    } else if (c == '\\') {
+      out.append("\\\\", 2);
     } else {
-      buf[0] = '\0';
-      if (len == 1) {
-        if (*message == '\a') {
-          strcpy(buf, "\\a");
-        } else if (*message == '\b') {
-          strcpy(buf, "\\b");
-        } else if (*message == '\t') {
-          strcpy(buf, "\t"); /* Do not escape tabs */
-        } else if (*message == '\v') {
-          strcpy(buf, "\\v");
-        } else if (*message == '\f') {
-          strcpy(buf, "\\f");
-        } else if (*message == '\r') {
-          strcpy(buf, "\\r");
-        } else if (*message == '\\') {
-          strcpy(buf, "\\\\");
-        } else if ((*message < ' ') || (*message & 0x80)) {
-          snprintf(buf, sizeof(buf), "\\x%02X", static_cast<unsigned char>(*message));
-        }
-      }
-      if (!buf[0]) {
-        strncpy(buf, message, len);
-        buf[len] = '\0';
-      }
-    }
-    if (print) {
-      strcpy(p, buf);
+      static const char hex[] = "0123456789ABCDEF";
+      const char escape[] = {'\\', 'x', hex[c >> 4], hex[c & 0xf]};
+      out.append(escape, sizeof(escape));
+      len = 1;
     }
-    p += strlen(buf);
     message += len;
     messageLen -= len;
   }
-  return p - begin;
+}
+
+}  // namespace
+
+/*
+ * Convert to printable from message to p buffer, return string length. If p is
+ * NULL, do not copy, but still return the expected string length.
+ */
+size_t convertPrintable(char* p, const char* message, size_t messageLen) {
+  LineWriter out(p, p ? SIZE_MAX : 0);
+  appendPrintable(out, message, messageLen);
+  if (p) p[out.size()] = '\0';
+  return out.size();
 }
 
 #ifdef __ANDROID__
@@ -1404,33 +1514,90 @@ static void convertMonotonic(struct timespec* result, const AndroidLogEntry* ent
 }
 #endif
 
-/**
- * Formats a log message into a buffer
- *
- * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
- * If return value != defaultBuffer, caller must call free()
- * Returns NULL on malloc error
+/*
+ * Appends the date and time for |now| as strftime() would. Logs arrive many
+ * per second, so the strings formatted for the previous log are reused until
+ * the second changes.
  */
-
-char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
-                                size_t defaultBufferSize, const AndroidLogEntry* entry,
-                                size_t* p_outLength) {
+static void appendDateTime(AndroidLogFormat* p_format, LineWriter& out, time_t now,
+                           const char** zone, size_t* zoneLen) {
+  static thread_local struct {
+    bool valid;
+    time_t sec;
+    bool year_output;
+    bool zone_output;
+    char date[32];
+    size_t dateLen;
+    char zone[16];
+    size_t zoneLen;
+  } cache;
+
+  if (!cache.valid || cache.sec != now || cache.year_output != p_format->year_output ||
+      cache.zone_output != p_format->zone_output) {
 #if !defined(_WIN32)
-  struct tm tmBuf;
+    struct tm tmBuf;
+    struct tm* ptm = localtime_r(&now, &tmBuf);
+#else
+    struct tm* ptm = localtime(&now);
 #endif
-  struct tm* ptm;
-  /* good margin, 23+nul for msec, 26+nul for usec, 29+nul to nsec */
-  char timeBuf[64];
-  char prefixBuf[128], suffixBuf[128];
-  char priChar;
-  int prefixSuffixIsHeaderFooter = 0;
-  char* ret;
-  time_t now;
-  unsigned long nsec;
+    cache.dateLen = strftime(cache.date, sizeof(cache.date),
+                             &"%Y-%m-%d %H:%M:%S"[p_format->year_output ? 0 : 3], ptm);
+    cache.zoneLen = 0;
+    if (p_format->zone_output) {
+      cache.zoneLen = strftime(cache.zone, sizeof(cache.zone), " %z", ptm);
+    }
+    cache.sec = now;
+    cache.year_output = p_format->year_output;
+    cache.zone_output = p_format->zone_output;
+    cache.valid = true;
+  }
+  out.append(cache.date, cache.dateLen);
+  *zone = cache.zone;
+  *zoneLen = cache.zoneLen;
+}
 
-  priChar = filterPriToChar(entry->priority);
-  size_t prefixLen = 0, suffixLen = 0;
-  size_t len;
+/* Appends the "%5d:" style uid column, or nothing if uids aren't printed. */
+static void appendUid(AndroidLogFormat* p_format, LineWriter& out, const AndroidLogEntry* entry,
+                      char separator) {
+  if (!p_format->uid_output) {
+    return;
+  }
+  if (entry->uid < 0) {
+    out.appendSpaces(6);
+    return;
+  }
+/*
+ * This code is Android specific, bionic guarantees that
+ * calls to non-reentrant getpwuid() are thread safe.
+ */
+#ifdef __ANDROID__
+  struct passwd* pwd = getpwuid(entry->uid);
+  if (pwd && (strlen(pwd->pw_name) <= 5)) {
+    size_t len = strlen(pwd->pw_name);
+    out.appendSpaces(5 - len);
+    out.append(pwd->pw_name, len);
+    out.append(separator);
+    return;
+  }
+#endif
+  /* Not worth parsing package list, names all longer than 5 */
+  out.appendInt(entry->uid, 5);
+  out.append(separator);
+}
+
+/*
+ * The prefix and suffix of each line used to be formatted into 128 byte
+ * buffers, so a long tag is still cut off at the same length.
+ */
+static const size_t kMaxPrefixSuffixLen = 127;
+
+size_t android_log_formatLogLineToBuffer(AndroidLogFormat* p_format, char* buffer,
+                                         size_t bufferSize, const AndroidLogEntry* entry) {
+  LineWriter out(buffer, bufferSize);
+  char priChar = filterPriToChar(entry->priority);
+  int prefixSuffixIsHeaderFooter = 0;
+  /* Tags and, unless escaped, messages end at an embedded NUL, as with "%.*s". */
+  size_t tagLen = strnlen(entry->tag, entry->tagLen);
 
   /*
    * Get the current date/time in pretty form
@@ -1444,8 +1611,8 @@ char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
    * The caller may have affected the timezone environment, this is
    * expected to be sensitive to that.
    */
-  now = entry->tv_sec;
-  nsec = entry->tv_nsec;
+  time_t now = entry->tv_sec;
+  unsigned long nsec = entry->tv_nsec;
 #if __ANDROID__
   if (p_format->monotonic_output) {
     struct timespec time;
@@ -1457,235 +1624,204 @@ char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
   if (now < 0) {
     nsec = NS_PER_SEC - nsec;
   }
-  if (p_format->epoch_output || p_format->monotonic_output) {
-    ptm = NULL;
-    snprintf(timeBuf, sizeof(timeBuf), p_format->monotonic_output ? "%6lld" : "%19lld",
-             (long long)now);
-  } else {
-#if !defined(_WIN32)
-    ptm = localtime_r(&now, &tmBuf);
-#else
-    ptm = localtime(&now);
-#endif
-    strftime(timeBuf, sizeof(timeBuf), &"%Y-%m-%d %H:%M:%S"[p_format->year_output ? 0 : 3], ptm);
-  }
-  len = strlen(timeBuf);
-  if (p_format->nsec_time_output) {
-    len += snprintf(timeBuf + len, sizeof(timeBuf) - len, ".%09ld", nsec);
-  } else if (p_format->usec_time_output) {
-    len += snprintf(timeBuf + len, sizeof(timeBuf) - len, ".%06ld", nsec / US_PER_NSEC);
-  } else {
-    len += snprintf(timeBuf + len, sizeof(timeBuf) - len, ".%03ld", nsec / MS_PER_NSEC);
-  }
-  if (p_format->zone_output && ptm) {
-    strftime(timeBuf + len, sizeof(timeBuf) - len, " %z", ptm);
-  }
+  auto appendTime = [&]() {
+    const char* zone = "";
+    size_t zoneLen = 0;
+    if (!p_format->epoch_output && !p_format->monotonic_output) {
+      appendDateTime(p_format, out, now, &zone, &zoneLen);
+    } else {
+      out.appendInt(now, p_format->monotonic_output ? 6 : 19);
+    }
+    out.append('.');
+    if (p_format->nsec_time_output) {
+      out.appendZeroPadded(nsec, 9);
+    } else if (p_format->usec_time_output) {
+      out.appendZeroPadded(nsec / US_PER_NSEC, 6);
+    } else {
+      out.appendZeroPadded(nsec / MS_PER_NSEC, 3);
+    }
+    out.append(zone, zoneLen);
+  };
 
   /*
-   * Construct a buffer containing the log header and log message.
+   * Construct the log header and log message. The prefix and suffix are
+   * written once, then copied for every further line of the message.
    */
+  size_t prefixStart = out.size();
   if (p_format->colored_output) {
-    prefixLen =
-        snprintf(prefixBuf, sizeof(prefixBuf), "\x1B[%dm", colorFromPri(entry->priority));
-    prefixLen = std::min(prefixLen, sizeof(prefixBuf));
-
-    const char suffixContents[] = "\x1B[0m";
-    strcpy(suffixBuf, suffixContents);
-    suffixLen = strlen(suffixContents);
-  }
-
-  char uid[16];
-  uid[0] = '\0';
-  if (p_format->uid_output) {
-    if (entry->uid >= 0) {
-/*
- * This code is Android specific, bionic guarantees that
- * calls to non-reentrant getpwuid() are thread safe.
- */
-#ifdef __ANDROID__
-      struct passwd* pwd = getpwuid(entry->uid);
-      if (pwd && (strlen(pwd->pw_name) <= 5)) {
-        snprintf(uid, sizeof(uid), "%5s:", pwd->pw_name);
-      } else
-#endif
-      {
-        /* Not worth parsing package list, names all longer than 5 */
-        snprintf(uid, sizeof(uid), "%5d:", entry->uid);
-      }
-    } else {
-      snprintf(uid, sizeof(uid), "      ");
-    }
+    out.append("\x1B[", 2);
+    out.appendInt(colorFromPri(entry->priority), 0);
+    out.append('m');
   }
 
   switch (p_format->format) {
     case FORMAT_TAG:
-      len = snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen, "%c/%-8.*s: ", priChar,
-                     (int)entry->tagLen, entry->tag);
-      strcpy(suffixBuf + suffixLen, "\n");
-      ++suffixLen;
+      out.append(priChar);
+      out.append('/');
+      out.appendPadded(entry->tag, tagLen, 8);
+      out.append(": ", 2);
       break;
     case FORMAT_PROCESS:
-      len = snprintf(suffixBuf + suffixLen, sizeof(suffixBuf) - suffixLen, "  (%.*s)\n",
-                     (int)entry->tagLen, entry->tag);
-      suffixLen += std::min(len, sizeof(suffixBuf) - suffixLen);
-      len = snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen, "%c(%s%5d) ", priChar,
-                     uid, entry->pid);
+      out.append(priChar);
+      out.append('(');
+      appendUid(p_format, out, entry, ':');
+      out.appendInt(entry->pid, 5);
+      out.append(") ", 2);
       break;
     case FORMAT_THREAD:
-      len = snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen, "%c(%s%5d:%5d) ",
-                     priChar, uid, entry->pid, entry->tid);
-      strcpy(suffixBuf + suffixLen, "\n");
-      ++suffixLen;
+      out.append(priChar);
+      out.append('(');
+      appendUid(p_format, out, entry, ':');
+      out.appendInt(entry->pid, 5);
+      out.append(':');
+      out.appendInt(entry->tid, 5);
+      out.append(") ", 2);
       break;
     case FORMAT_RAW:
-      prefixBuf[prefixLen] = 0;
-      len = 0;
-      strcpy(suffixBuf + suffixLen, "\n");
-      ++suffixLen;
       break;
     case FORMAT_TIME:
-      len = snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen,
-                     "%s %c/%-8.*s(%s%5d): ", timeBuf, priChar, (int)entry->tagLen, entry->tag, uid,
-                     entry->pid);
-      strcpy(suffixBuf + suffixLen, "\n");
-      ++suffixLen;
+      appendTime();
+      out.append(' ');
+      out.append(priChar);
+      out.append('/');
+      out.appendPadded(entry->tag, tagLen, 8);
+      out.append('(');
+      appendUid(p_format, out, entry, ':');
+      out.appendInt(entry->pid, 5);
+      out.append("): ", 3);
       break;
     case FORMAT_THREADTIME:
-      ret = strchr(uid, ':');
-      if (ret) {
-        *ret = ' ';
-      }
-      len = snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen,
-                     "%s %s%5d %5d %c %-8.*s: ", timeBuf, uid, entry->pid, entry->tid, priChar,
-                     (int)entry->tagLen, entry->tag);
-      strcpy(suffixBuf + suffixLen, "\n");
-      ++suffixLen;
+      appendTime();
+      out.append(' ');
+      appendUid(p_format, out, entry, ' ');
+      out.appendInt(entry->pid, 5);
+      out.append(' ');
+      out.appendInt(entry->tid, 5);
+      out.append(' ');
+      out.append(priChar);
+      out.append(' ');
+      out.appendPadded(entry->tag, tagLen, 8);
+      out.append(": ", 2);
       break;
     case FORMAT_LONG:
-      len = snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen,
-                     "[ %s %s%5d:%5d %c/%-8.*s ]\n", timeBuf, uid, entry->pid, entry->tid, priChar,
-                     (int)entry->tagLen, entry->tag);
-      strcpy(suffixBuf + suffixLen, "\n\n");
-      suffixLen += 2;
+      out.append("[ ", 2);
+      appendTime();
+      out.append(' ');
+      appendUid(p_format, out, entry, ':');
+      out.appendInt(entry->pid, 5);
+      out.append(':');
+      out.appendInt(entry->tid, 5);
+      out.append(' ');
+      out.append(priChar);
+      out.append('/');
+      out.appendPadded(entry->tag, tagLen, 8);
+      out.append(" ]\n", 3);
       prefixSuffixIsHeaderFooter = 1;
       break;
     case FORMAT_BRIEF:
     default:
-      len =
-          snprintf(prefixBuf + prefixLen, sizeof(prefixBuf) - prefixLen,
-                   "%c/%-8.*s(%s%5d): ", priChar, (int)entry->tagLen, entry->tag, uid, entry->pid);
-      strcpy(suffixBuf + suffixLen, "\n");
-      ++suffixLen;
+      out.append(priChar);
+      out.append('/');
+      out.appendPadded(entry->tag, tagLen, 8);
+      out.append('(');
+      appendUid(p_format, out, entry, ':');
+      out.appendInt(entry->pid, 5);
+      out.append("): ", 3);
       break;
   }
-
-  /* snprintf has a weird return value.   It returns what would have been
-   * written given a large enough buffer.  In the case that the prefix is
-   * longer then our buffer(128), it messes up the calculations below
-   * possibly causing heap corruption.  To avoid this we double check and
-   * set the length at the maximum (size minus null byte)
-   */
-  prefixLen += len;
-  if (prefixLen >= sizeof(prefixBuf)) {
-    prefixLen = sizeof(prefixBuf) - 1;
-    prefixBuf[sizeof(prefixBuf) - 1] = '\0';
-  }
-  if (suffixLen >= sizeof(suffixBuf)) {
-    suffixLen = sizeof(suffixBuf) - 1;
-    suffixBuf[sizeof(suffixBuf) - 2] = '\n';
-    suffixBuf[sizeof(suffixBuf) - 1] = '\0';
+  size_t prefixLen = out.size() - prefixStart;
+  if (prefixLen > kMaxPrefixSuffixLen) {
+    out.truncate(prefixStart + kMaxPrefixSuffixLen);
+    prefixLen = kMaxPrefixSuffixLen;
   }
 
-  /* the following code is tragically unreadable */
-
-  size_t numLines;
-  char* p;
-  size_t bufferSize;
-  const char* pm;
+  auto appendMessage = [&](const char* message, size_t messageLen) {
+    if (p_format->printable_output) {
+      appendPrintable(out, message, messageLen);
+    } else {
+      out.append(message, strnlen(message, messageLen));
+    }
+  };
+
+  size_t suffixStart = 0;
+  size_t suffixLen = 0;
+  auto appendSuffix = [&]() {
+    if (suffixLen) {
+      out.repeat(suffixStart, suffixLen);
+      return;
+    }
+    suffixStart = out.size();
+    if (p_format->colored_output) {
+      out.append("\x1B[0m", 4);
+    }
+    if (p_format->format == FORMAT_PROCESS) {
+      out.append("  (", 3);
+      out.append(entry->tag, tagLen);
+      out.append(")\n", 2);
+    } else if (prefixSuffixIsHeaderFooter) {
+      out.append("\n\n", 2);
+    } else {
+      out.append('\n');
+    }
+    suffixLen = out.size() - suffixStart;
+    if (suffixLen > kMaxPrefixSuffixLen) {
+      /* Still end the line. */
+      out.truncate(suffixStart + kMaxPrefixSuffixLen - 1);
+      out.append('\n');
+      suffixLen = kMaxPrefixSuffixLen;
+    }
+  };
 
+  const char* pm = entry->message;
+  const char* end = entry->message + entry->messageLen;
   if (prefixSuffixIsHeaderFooter) {
     /* we're just wrapping message with a header/footer */
-    numLines = 1;
+    appendMessage(pm, entry->messageLen);
+    appendSuffix();
   } else {
-    pm = entry->message;
-    numLines = 0;
+    bool firstLine = true;
+    do {
+      /* Find the next end-of-line in message */
+      const char* lineEnd = static_cast<const char*>(memchr(pm, '\n', end - pm));
+      if (!lineEnd) lineEnd = end;
 
-    /*
-     * The line-end finding here must match the line-end finding
-     * in for ( ... numLines...) loop below
-     */
-    while (pm < (entry->message + entry->messageLen)) {
-      if (*pm++ == '\n') numLines++;
-    }
-    /* plus one line for anything not newline-terminated at the end */
-    if (pm > entry->message && *(pm - 1) != '\n') numLines++;
-  }
+      if (!firstLine) out.repeat(prefixStart, prefixLen);
+      firstLine = false;
+      appendMessage(pm, lineEnd - pm);
+      appendSuffix();
 
-  /*
-   * this is an upper bound--newlines in message may be counted
-   * extraneously
-   */
-  bufferSize = (numLines * (prefixLen + suffixLen)) + 1;
-  if (p_format->printable_output) {
-    /* Calculate extra length to convert non-printable to printable */
-    bufferSize += convertPrintable(NULL, entry->message, entry->messageLen);
-  } else {
-    bufferSize += entry->messageLen;
+      pm = lineEnd;
+      if (pm < end) pm++;
+    } while (pm < end);
   }
 
-  if (defaultBufferSize >= bufferSize) {
-    ret = defaultBuffer;
-  } else {
-    ret = (char*)malloc(bufferSize);
+  return out.size();
+}
+
+/**
+ * Formats a log message into a buffer
+ *
+ * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
+ * If return value != defaultBuffer, caller must call free()
+ * Returns NULL on malloc error
+ */
 
+char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
+                                size_t defaultBufferSize, const AndroidLogEntry* entry,
+                                size_t* p_outLength) {
+  char* ret = defaultBuffer;
+  size_t len = android_log_formatLogLineToBuffer(p_format, defaultBuffer, defaultBufferSize, entry);
+  if (len >= defaultBufferSize) {
+    ret = static_cast<char*>(malloc(len + 1));
     if (ret == NULL) {
       return ret;
     }
+    android_log_formatLogLineToBuffer(p_format, ret, len + 1, entry);
   }
-
-  ret[0] = '\0'; /* to start strcat off */
-
-  p = ret;
-  pm = entry->message;
-
-  if (prefixSuffixIsHeaderFooter) {
-    strcat(p, prefixBuf);
-    p += prefixLen;
-    if (p_format->printable_output) {
-      p += convertPrintable(p, entry->message, entry->messageLen);
-    } else {
-      strncat(p, entry->message, entry->messageLen);
-      p += entry->messageLen;
-    }
-    strcat(p, suffixBuf);
-    p += suffixLen;
-  } else {
-    do {
-      const char* lineStart;
-      size_t lineLen;
-      lineStart = pm;
-
-      /* Find the next end-of-line in message */
-      while (pm < (entry->message + entry->messageLen) && *pm != '\n') pm++;
-      lineLen = pm - lineStart;
-
-      strcat(p, prefixBuf);
-      p += prefixLen;
-      if (p_format->printable_output) {
-        p += convertPrintable(p, lineStart, lineLen);
-      } else {
-        strncat(p, lineStart, lineLen);
-        p += lineLen;
-      }
-      strcat(p, suffixBuf);
-      p += suffixLen;
-
-      if (*pm == '\n') pm++;
-    } while (pm < (entry->message + entry->messageLen));
-  }
+  ret[len] = '\0';
 
   if (p_outLength != NULL) {
-    *p_outLength = p - ret;
+    *p_outLength = len;
   }
 
   return ret;
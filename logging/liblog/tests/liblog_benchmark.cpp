@@ -25,6 +25,7 @@
 #include <unistd.h>
 
 #include <unordered_set>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
@@ -32,6 +33,7 @@
 #include <cutils/sockets.h>
 #include <log/event_tag_map.h>
 #include <log/log_read.h>
+#include <log/logprint.h>
 #include <private/android_logger.h>
 
 BENCHMARK_MAIN();
@@ -1002,3 +1004,82 @@ static void BM_log_verbose_overhead(benchmark::State& state) {
   android::base::SetProperty("log.tag." + test_log_tag, "");
 }
 BENCHMARK(BM_log_verbose_overhead);
+
+/*
+ *	Measure the time it takes to format log entries as logcat does, either
+ * one at a time with android_log_formatLogLine() or appended to a single
+ * arena with android_log_formatLogLineToBuffer(). The argument picks a short
+ * message, a multi-line message or a message that needs escaping with
+ * -v printable.
+ */
+static const char* const kFormatMessages[] = {
+    "test log message 123 456",
+    "first line of a stack trace\n    at frame one\n    at frame two\n    at frame three\n",
+    "tab\tand escapes \a\\ in \xE2\x82\xAC a message that is mostly plain ASCII text",
+};
+
+static AndroidLogFormat* newFormatForBenchmark(benchmark::State& state) {
+  AndroidLogFormat* format = android_log_format_new();
+  android_log_setPrintFormat(format, FORMAT_THREADTIME);
+  if (state.range(0) == 2) {
+    android_log_setPrintFormat(format, FORMAT_MODIFIER_PRINTABLE);
+  }
+  return format;
+}
+
+static AndroidLogEntry entryForBenchmark(benchmark::State& state) {
+  AndroidLogEntry entry = {};
+  entry.tv_sec = time(nullptr);
+  entry.priority = ANDROID_LOG_INFO;
+  entry.uid = -1;
+  entry.pid = getpid();
+  entry.tid = gettid();
+  entry.tag = "liblog_benchmark";
+  entry.tagLen = strlen(entry.tag);
+  entry.message = kFormatMessages[state.range(0)];
+  entry.messageLen = strlen(entry.message);
+  return entry;
+}
+
+static void BM_formatLogLine(benchmark::State& state) {
+  AndroidLogFormat* format = newFormatForBenchmark(state);
+  AndroidLogEntry entry = entryForBenchmark(state);
+  char defaultBuffer[128];
+  size_t bytes = 0;
+  for (auto _ : state) {
+    entry.tv_nsec = (entry.tv_nsec + 1000) % NS_PER_SEC;
+    size_t len;
+    char* line =
+        android_log_formatLogLine(format, defaultBuffer, sizeof(defaultBuffer), &entry, &len);
+    benchmark::DoNotOptimize(line);
+    bytes += len;
+    if (line != defaultBuffer) free(line);
+  }
+  state.SetBytesProcessed(bytes);
+  android_log_format_free(format);
+}
+BENCHMARK(BM_formatLogLine)->DenseRange(0, 2);
+
+static void BM_formatLogLineToBuffer(benchmark::State& state) {
+  AndroidLogFormat* format = newFormatForBenchmark(state);
+  AndroidLogEntry entry = entryForBenchmark(state);
+  std::vector<char> arena(64 * 1024);
+  size_t used = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    entry.tv_nsec = (entry.tv_nsec + 1000) % NS_PER_SEC;
+    size_t len = android_log_formatLogLineToBuffer(format, arena.data() + used,
+                                                   arena.size() - used, &entry);
+    if (len > arena.size() - used) {
+      /* Full, this is where logcat would write the arena out. */
+      used = 0;
+      len = android_log_formatLogLineToBuffer(format, arena.data(), arena.size(), &entry);
+    }
+    used += len;
+    bytes += len;
+  }
+  benchmark::DoNotOptimize(arena.data());
+  state.SetBytesProcessed(bytes);
+  android_log_format_free(format);
+}
+BENCHMARK(BM_formatLogLineToBuffer)->DenseRange(0, 2);
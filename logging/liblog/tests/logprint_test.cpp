@@ -16,6 +16,7 @@
 
 #include <log/logprint.h>
 
+#include <memory>
 #include <string>
 
 #include <gtest/gtest.h>
@@ -29,7 +30,7 @@ TEST(liblog, convertPrintable_ascii) {
   auto output_size = convertPrintable(nullptr, input, strlen(input));
   EXPECT_EQ(output_size, strlen(input));
 
-  char output[output_size];
+  char output[output_size + 1];
 
   output_size = convertPrintable(output, input, strlen(input));
   EXPECT_EQ(output_size, strlen(input));
@@ -43,7 +44,7 @@ TEST(liblog, convertPrintable_escapes) {
   auto output_size = convertPrintable(nullptr, input, strlen(input));
   EXPECT_EQ(output_size, strlen(expected_output));
 
-  char output[output_size];
+  char output[output_size + 1];
 
   output_size = convertPrintable(output, input, strlen(input));
   EXPECT_EQ(output_size, strlen(expected_output));
@@ -55,7 +56,7 @@ TEST(liblog, convertPrintable_validutf8) {
   auto output_size = convertPrintable(nullptr, input, strlen(input));
   EXPECT_EQ(output_size, strlen(input));
 
-  char output[output_size];
+  char output[output_size + 1];
 
   output_size = convertPrintable(output, input, strlen(input));
   EXPECT_EQ(output_size, strlen(input));
@@ -69,7 +70,7 @@ TEST(liblog, convertPrintable_invalidutf8) {
   auto output_size = convertPrintable(nullptr, input, strlen(input));
   EXPECT_EQ(output_size, strlen(expected_output));
 
-  char output[output_size];
+  char output[output_size + 1];
 
   output_size = convertPrintable(output, input, strlen(input));
   EXPECT_EQ(output_size, strlen(expected_output));
@@ -85,7 +86,7 @@ TEST(liblog, convertPrintable_mixed) {
   auto output_size = convertPrintable(nullptr, input, strlen(input));
   EXPECT_EQ(output_size, strlen(expected_output));
 
-  char output[output_size];
+  char output[output_size + 1];
 
   output_size = convertPrintable(output, input, strlen(input));
   EXPECT_EQ(output_size, strlen(expected_output));
@@ -150,4 +151,94 @@ TEST(liblog, log_print_different_header_size) {
   AndroidLogEntry entry_odd_size;
   ASSERT_EQ(0, android_log_processLogBuffer(reinterpret_cast<logger_entry*>(buf), &entry_odd_size));
   check_entry(entry_odd_size);
-}
\ No newline at end of file
+}
+TEST(liblog, formatLogLineToBuffer) {
+  std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format{
+      android_log_format_new(), &android_log_format_free};
+  android_log_setPrintFormat(format.get(), FORMAT_TAG);
+  android_log_setPrintFormat(format.get(), FORMAT_MODIFIER_PRINTABLE);
+
+  AndroidLogEntry entry = {};
+  entry.priority = ANDROID_LOG_INFO;
+  entry.tag = "Tag";
+  entry.tagLen = strlen(entry.tag);
+  entry.message = "line 1\nline\a2\n";
+  entry.messageLen = strlen(entry.message);
+  const std::string expected = "I/Tag     : line 1\nI/Tag     : line\\a2\n";
+
+  // The same output as android_log_formatLogLine(), without a terminating NUL.
+  char buffer[128];
+  memset(buffer, '*', sizeof(buffer));
+  size_t len = android_log_formatLogLineToBuffer(format.get(), buffer, sizeof(buffer), &entry);
+  EXPECT_EQ(expected, std::string(buffer, len));
+  EXPECT_EQ('*', buffer[len]);
+
+  size_t default_len;
+  char* line = android_log_formatLogLine(format.get(), buffer, sizeof(buffer), &entry, &default_len);
+  EXPECT_EQ(expected, line);
+  EXPECT_EQ(len, default_len);
+
+  // Output that doesn't fit is counted but not written.
+  memset(buffer, '*', sizeof(buffer));
+  EXPECT_EQ(expected.size(), android_log_formatLogLineToBuffer(format.get(), buffer, 20, &entry));
+  EXPECT_EQ('*', buffer[20]);
+  EXPECT_EQ(expected.size(), android_log_formatLogLineToBuffer(format.get(), nullptr, 0, &entry));
+}
+
+TEST(liblog, formatLogLineToBuffer_embedded_nul) {
+  std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format{
+      android_log_format_new(), &android_log_format_free};
+  android_log_setPrintFormat(format.get(), FORMAT_TAG);
+
+  static const char kTag[] = "Tag\0hidden";
+  static const char kMessage[] = "line 1\nline\0 2\nline 3";
+  AndroidLogEntry entry = {};
+  entry.priority = ANDROID_LOG_INFO;
+  entry.tag = kTag;
+  entry.tagLen = sizeof(kTag) - 1;
+  entry.message = kMessage;
+  entry.messageLen = sizeof(kMessage) - 1;
+
+  // Each line stops at the NUL, the lines after it are still printed.
+  char buffer[128];
+  size_t len = android_log_formatLogLineToBuffer(format.get(), buffer, sizeof(buffer), &entry);
+  EXPECT_EQ("I/Tag     : line 1\nI/Tag     : line\nI/Tag     : line 3\n", std::string(buffer, len));
+
+  size_t default_len;
+  char* line = android_log_formatLogLine(format.get(), buffer, sizeof(buffer), &entry, &default_len);
+  EXPECT_EQ(len, default_len);
+  EXPECT_EQ(len, strlen(line));
+
+  // -v printable escapes the NUL rather than dropping the rest of the line.
+  android_log_setPrintFormat(format.get(), FORMAT_MODIFIER_PRINTABLE);
+  len = android_log_formatLogLineToBuffer(format.get(), buffer, sizeof(buffer), &entry);
+  EXPECT_EQ("I/Tag     : line 1\nI/Tag     : line\\x00 2\nI/Tag     : line 3\n",
+            std::string(buffer, len));
+}
+
+TEST(liblog, formatLogLineToBuffer_long_tag) {
+  std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format{
+      android_log_format_new(), &android_log_format_free};
+  android_log_setPrintFormat(format.get(), FORMAT_TAG);
+
+  const std::string tag(200, 't');
+  AndroidLogEntry entry = {};
+  entry.priority = ANDROID_LOG_INFO;
+  entry.tag = tag.c_str();
+  entry.tagLen = tag.size();
+  entry.message = "line 1\nline 2";
+  entry.messageLen = strlen(entry.message);
+
+  // Each line's prefix is cut off at 127 bytes, including the ": " after the tag.
+  const std::string prefix = "I/" + tag.substr(0, 125);
+  char buffer[512];
+  size_t len = android_log_formatLogLineToBuffer(format.get(), buffer, sizeof(buffer), &entry);
+  EXPECT_EQ(prefix + "line 1\n" + prefix + "line 2\n", std::string(buffer, len));
+
+  // So is the suffix holding the tag, which still ends the line.
+  android_log_setPrintFormat(format.get(), FORMAT_PROCESS);
+  entry.pid = 1;
+  const std::string suffix = "  (" + tag.substr(0, 123) + "\n";
+  len = android_log_formatLogLineToBuffer(format.get(), buffer, sizeof(buffer), &entry);
+  EXPECT_EQ("I(    1) line 1" + suffix + "I(    1) line 2" + suffix, std::string(buffer, len));
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "binary_stream.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/macros.h>
+
+bool WriteBinaryStreamHeader(int fd) {
+    BinaryStreamHeader header = {};
+    memcpy(header.magic, kBinaryStreamMagic, sizeof(header.magic));
+    header.version = kBinaryStreamVersion;
+    header.header_size = sizeof(header);
+    return android::base::WriteFully(fd, &header, sizeof(header));
+}
+
+BinaryStreamWriter::BinaryStreamWriter(Sink sink) : sink_(std::move(sink)) {
+    filling_.reserve(kBatchSize);
+    thread_ = std::thread(&BinaryStreamWriter::ThreadFunction, this);
+}
+
+BinaryStreamWriter::~BinaryStreamWriter() {
+    {
+        auto lock = std::lock_guard{lock_};
+        stop_ = true;
+    }
+    batch_ready_.notify_one();
+    thread_.join();
+}
+
+void BinaryStreamWriter::Append(const log_msg& msg) {
+    size_t len = msg.entry.hdr_size + msg.entry.len;
+    auto lock = std::unique_lock{lock_};
+    // Only blocks if the previous batch is still being written and this one is full.
+    batch_written_.wait(lock, [this, len] { return filling_.size() + len <= kBatchSize; });
+    bool was_empty = filling_.empty();
+    filling_.insert(filling_.end(), msg.buf, msg.buf + len);
+    if (was_empty || filling_.size() + LOGGER_ENTRY_MAX_LEN > kBatchSize) {
+        batch_ready_.notify_one();
+    }
+}
+
+void BinaryStreamWriter::ThreadFunction() {
+    std::vector<char> writing;
+    writing.reserve(kBatchSize);
+
+    auto lock = std::unique_lock{lock_};
+    while (true) {
+        batch_ready_.wait(lock, [this] { return stop_ || !filling_.empty(); });
+        // Give the batch a chance to fill up before writing it.
+        batch_ready_.wait_for(lock, kFlushInterval, [this] {
+            return stop_ || filling_.size() + LOGGER_ENTRY_MAX_LEN > kBatchSize;
+        });
+        if (filling_.empty()) {
+            // Only reachable once stop_ is set and everything has been written.
+            break;
+        }
+
+        std::swap(filling_, writing);
+        batch_written_.notify_one();
+
+        lock.unlock();
+        sink_(writing.data(), writing.size());
+        writing.clear();
+        lock.lock();
+    }
+}
+
+int BinaryStreamReader::Fill(size_t size) {
+    if (end_ - begin_ >= size) {
+        return 1;
+    }
+    if (begin_ + size > buffer_.size()) {
+        memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    while (end_ - begin_ < size) {
+        ssize_t ret = TEMP_FAILURE_RETRY(read(fd_, buffer_.data() + end_, buffer_.size() - end_));
+        if (ret < 0) {
+            return -errno;
+        }
+        if (ret == 0) {
+            return 0;
+        }
+        end_ += ret;
+    }
+    return 1;
+}
+
+int BinaryStreamReader::Read(log_msg* msg) {
+    while (true) {
+        // Both a record and a header start with at least this much.
+        static constexpr size_t kPrefixSize = offsetof(logger_entry, pid);
+        int ret = Fill(kPrefixSize);
+        if (ret <= 0) {
+            // Running out of data in the middle of a record means the stream was truncated.
+            return (ret == 0 && begin_ != end_) ? -EINVAL : ret;
+        }
+
+        if (memcmp(buffer_.data() + begin_, kBinaryStreamMagic, kPrefixSize) == 0) {
+            BinaryStreamHeader header;
+            if (Fill(sizeof(header)) <= 0) {
+                return -EINVAL;
+            }
+            memcpy(&header, buffer_.data() + begin_, sizeof(header));
+            if (memcmp(header.magic, kBinaryStreamMagic, sizeof(header.magic)) != 0 ||
+                header.version < 1 || header.header_size < sizeof(header) ||
+                header.header_size > buffer_.size() || Fill(header.header_size) <= 0) {
+                return -EINVAL;
+            }
+            begin_ += header.header_size;
+            continue;
+        }
+
+        logger_entry entry;
+        memcpy(&entry, buffer_.data() + begin_, kPrefixSize);
+        if (entry.hdr_size < sizeof(entry) ||
+            entry.hdr_size >= LOGGER_ENTRY_MAX_LEN - sizeof(entry)) {
+            return -EINVAL;
+        }
+        size_t total = entry.hdr_size + entry.len;
+        if (total > LOGGER_ENTRY_MAX_LEN) {
+            return -EINVAL;
+        }
+        if (Fill(total) <= 0) {
+            return -EINVAL;
+        }
+
+        memcpy(msg->buf, buffer_.data() + begin_, total);
+        msg->buf[total] = '\0';
+        begin_ += total;
+        return total;
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <log/log_read.h>
+
+// The `logcat --binary-stream` output format.
+//
+// The stream is a sequence of logger_entry records exactly as logd sends them: hdr_size bytes of
+// header followed by len bytes of payload.  A BinaryStreamHeader is written at the start of every
+// output file and may also appear between records, for example when appending to an existing
+// file.  Its magic can't be mistaken for a record, since read as a logger_entry its hdr_size would
+// exceed LOGGER_ENTRY_MAX_LEN.  The output of `logcat -B` is the same sequence of records without
+// any header and is read the same way.
+struct BinaryStreamHeader {
+    char magic[8];
+    uint32_t version;
+    // The size of the whole header, so that later versions may append fields.
+    uint32_t header_size;
+};
+
+static constexpr char kBinaryStreamMagic[8] = {'\0', '\0', 'L', 'O', 'G', 'B', 'I', 'N'};
+static constexpr uint32_t kBinaryStreamVersion = 1;
+
+// Writes a BinaryStreamHeader to |fd|.  Returns false and sets errno on failure.
+bool WriteBinaryStreamHeader(int fd);
+
+// Batches records and hands them to |sink| from a separate thread, so that reading from logd
+// overlaps with writing the output and each write covers many records.  A partial batch is
+// flushed kFlushInterval after its first record arrives, so a blocking stream never holds logs for
+// long.  The destructor flushes everything appended so far.
+class BinaryStreamWriter {
+  public:
+    using Sink = std::function<void(const char* data, size_t size)>;
+
+    explicit BinaryStreamWriter(Sink sink);
+    ~BinaryStreamWriter();
+
+    void Append(const log_msg& msg);
+
+  private:
+    static constexpr size_t kBatchSize = 256 * 1024;
+    static constexpr std::chrono::milliseconds kFlushInterval{100};
+
+    void ThreadFunction();
+
+    Sink sink_;
+    std::mutex lock_;
+    std::condition_variable batch_ready_;
+    std::condition_variable batch_written_;
+    std::vector<char> filling_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+// Reads records back from a stream written by `logcat --binary-stream` or `logcat -B`.
+class BinaryStreamReader {
+  public:
+    explicit BinaryStreamReader(int fd) : fd_(fd), buffer_(kBufferSize) {}
+
+    // Returns the length of the record copied to |msg|, 0 at the end of the stream, or a negative
+    // errno value if reading fails or the stream is corrupt.  Like android_logger_list_read(), the
+    // payload in |msg| is always followed by a NUL.
+    int Read(log_msg* msg);
+
+  private:
+    static constexpr size_t kBufferSize = 256 * 1024;
+
+    // Ensures that at least |size| unread bytes are buffered.  Returns 1 on success, 0 if the
+    // stream ended first, or a negative errno value.
+    int Fill(size_t size);
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
@@ -57,6 +57,8 @@
 #include <processgroup/sched_policy.h>
 #include <system/thread_defs.h>
 
+#include "binary_stream.h"
+
 #define DEFAULT_MAX_ROTATED_LOGS 4
 
 using android::base::Join;
@@ -74,7 +76,11 @@ class Logcat {
     void RotateLogs();
     void ProcessBuffer(struct log_msg* buf);
     void PrintDividers(log_id_t log_id, bool print_dividers);
+    void AppendOutput(const char* data, size_t size);
+    size_t FormatOutput(const AndroidLogEntry& entry);
+    void FlushOutput();
     void SetupOutputAndSchedulingPolicy(bool blocking);
+    void WriteBinaryStream(const char* data, size_t size);
     int SetLogFormat(const char* format_string);
 
     // Used for all options
@@ -88,12 +94,23 @@ class Logcat {
     size_t max_rotated_logs_ = DEFAULT_MAX_ROTATED_LOGS;  // 0 means "unbounded"
     size_t out_byte_count_ = 0;
 
+    // Formatted logs waiting to be written to output_fd_.  Only dumps (-d) batch many logs per
+    // write, otherwise the output is flushed after every log.
+    static constexpr size_t kOutputBufferSize = 64 * 1024;
+    std::unique_ptr<char[]> output_buffer_{new char[kOutputBufferSize]};
+    size_t output_buffer_used_ = 0;
+    bool batch_output_ = false;
+
     // For binary log buffers
     int print_binary_ = 0;
     std::unique_ptr<EventTagMap, decltype(&android_closeEventTagMap)> event_tag_map_{
             nullptr, &android_closeEventTagMap};
     bool has_opened_event_tag_map_ = false;
 
+    // For --binary-stream.  Declared after output_fd_, which it writes to until it is destroyed.
+    bool binary_stream_ = false;
+    std::unique_ptr<BinaryStreamWriter> binary_stream_writer_;
+
     // For the related --regex, --max-count, --print
     std::unique_ptr<std::regex> regex_;
     size_t max_count_ = 0;  // 0 means "infinite"
@@ -187,7 +204,7 @@ void Logcat::RotateLogs() {
 }
 
 void Logcat::ProcessBuffer(struct log_msg* buf) {
-    int bytesWritten = 0;
+    size_t bytesWritten = 0;
     int err;
     AndroidLogEntry entry;
     char binaryMsgBuf[1024];
@@ -218,18 +235,35 @@ void Logcat::ProcessBuffer(struct log_msg* buf) {
         if (match || print_it_anyway_) {
             PrintDividers(buf->id(), print_dividers_);
 
-            bytesWritten = android_log_printLogLine(logformat_.get(), output_fd_.get(), &entry);
-
-            if (bytesWritten < 0) {
-                error(EXIT_FAILURE, 0, "Output error.");
-            }
+            bytesWritten = FormatOutput(entry);
         }
     }
 
     out_byte_count_ += bytesWritten;
 
+    if (log_rotate_size_kb_ > 0 && (out_byte_count_ / 1024) >= log_rotate_size_kb_) {
+        FlushOutput();
+        RotateLogs();
+    } else if (!batch_output_) {
+        FlushOutput();
+    }
+}
+
+// Called from the BinaryStreamWriter thread, which is the only user of output_fd_ once streaming.
+void Logcat::WriteBinaryStream(const char* data, size_t size) {
+    if (!WriteFully(output_fd_, data, size)) {
+        error(EXIT_FAILURE, errno, "Failed to write to output fd");
+    }
+
+    out_byte_count_ += size;
+
+    // Batches only ever contain whole records, so each rotated file can be decoded on its own.
     if (log_rotate_size_kb_ > 0 && (out_byte_count_ / 1024) >= log_rotate_size_kb_) {
         RotateLogs();
+        if (!WriteBinaryStreamHeader(output_fd_.get())) {
+            error(EXIT_FAILURE, errno, "Failed to write to output fd");
+        }
+        out_byte_count_ += sizeof(BinaryStreamHeader);
     }
 }
 
@@ -238,16 +272,69 @@ void Logcat::PrintDividers(log_id_t log_id, bool print_dividers) {
         return;
     }
     if (!printed_start_[log_id] || print_dividers) {
-        if (dprintf(output_fd_.get(), "--------- %s %s\n",
-                    printed_start_[log_id] ? "switch to" : "beginning of",
-                    android_log_id_to_name(log_id)) < 0) {
-            error(EXIT_FAILURE, errno, "Output error");
-        }
+        std::string divider = StringPrintf("--------- %s %s\n",
+                                           printed_start_[log_id] ? "switch to" : "beginning of",
+                                           android_log_id_to_name(log_id));
+        AppendOutput(divider.data(), divider.size());
     }
     last_printed_id_ = log_id;
     printed_start_[log_id] = true;
 }
 
+void Logcat::AppendOutput(const char* data, size_t size) {
+    if (size > kOutputBufferSize - output_buffer_used_) {
+        FlushOutput();
+        if (size > kOutputBufferSize) {
+            if (!WriteFully(output_fd_, data, size)) {
+                error(EXIT_FAILURE, errno, "Output error");
+            }
+            return;
+        }
+    }
+    memcpy(output_buffer_.get() + output_buffer_used_, data, size);
+    output_buffer_used_ += size;
+}
+
+// Formats |entry| straight into output_buffer_, returning the number of bytes it adds.
+size_t Logcat::FormatOutput(const AndroidLogEntry& entry) {
+    size_t available = kOutputBufferSize - output_buffer_used_;
+    size_t len = android_log_formatLogLineToBuffer(
+            logformat_.get(), output_buffer_.get() + output_buffer_used_, available, &entry);
+    if (len > available) {
+        FlushOutput();
+        len = android_log_formatLogLineToBuffer(logformat_.get(), output_buffer_.get(),
+                                                kOutputBufferSize, &entry);
+        if (len > kOutputBufferSize) {
+            // Only a message of thousands of short lines expands this much; fall back to the
+            // allocating formatter rather than growing the buffer for it.
+            char default_buffer[512];
+            char* line = android_log_formatLogLine(logformat_.get(), default_buffer,
+                                                   sizeof(default_buffer), &entry, &len);
+            if (!line) {
+                error(EXIT_FAILURE, errno, "Output error");
+            }
+            bool written = WriteFully(output_fd_, line, len);
+            if (line != default_buffer) free(line);
+            if (!written) {
+                error(EXIT_FAILURE, errno, "Output error");
+            }
+            return len;
+        }
+    }
+    output_buffer_used_ += len;
+    return len;
+}
+
+void Logcat::FlushOutput() {
+    if (output_buffer_used_ == 0) {
+        return;
+    }
+    if (!WriteFully(output_fd_, output_buffer_.get(), output_buffer_used_)) {
+        error(EXIT_FAILURE, errno, "Output error");
+    }
+    output_buffer_used_ = 0;
+}
+
 void Logcat::SetupOutputAndSchedulingPolicy(bool blocking) {
     if (!output_file_name_) return;
 
@@ -321,6 +408,10 @@ Formatting:
                               modifiers are allowed.
   -D, --dividers              Print dividers between each log buffer.
   -B, --binary                Output the log in binary.
+  --binary-stream             Output the raw log records in batches, with minimal processing.
+                              Much cheaper than formatting text when streaming to a collector.
+                              Filterspecs and -e are not applied; decode the output with
+                              logcat-decode, which accepts filterspecs and -v.
 
 Outfile files:
   -f, --file=<file>           Log to file instead of stdout.
@@ -564,9 +655,11 @@ int Logcat::Run(int argc, char** argv) {
         static const char wrap_str[] = "wrap";
         static const char print_str[] = "print";
         static const char uid_str[] = "uid";
+        static const char binary_stream_str[] = "binary-stream";
         // clang-format off
         static const struct option long_options[] = {
           { "binary",        no_argument,       nullptr, 'B' },
+          { binary_stream_str, no_argument,       nullptr, 0 },
           { "buffer",        required_argument, nullptr, 'b' },
           { "buffer-size",   optional_argument, nullptr, 'g' },
           { "clear",         no_argument,       nullptr, 'c' },
@@ -639,6 +732,10 @@ int Logcat::Run(int argc, char** argv) {
                     debug_ = true;
                     break;
                 }
+                if (long_options[option_index].name == binary_stream_str) {
+                    binary_stream_ = true;
+                    break;
+                }
                 if (long_options[option_index].name == id_str) {
                     setId = (optarg && optarg[0]) ? optarg : nullptr;
                 }
@@ -829,6 +926,9 @@ int Logcat::Run(int argc, char** argv) {
                 "--regex <expr> and --max-count <N>\n");
         print_it_anyway_ = false;
     }
+    if (binary_stream_ && (print_binary_ || regex_)) {
+        error(EXIT_FAILURE, 0, "--binary-stream is incompatible with -B and -e.");
+    }
 
     // If no buffers are specified, default to using these buffers.
     if (id_mask == 0) {
@@ -1076,10 +1176,25 @@ int Logcat::Run(int argc, char** argv) {
     if (getLogSize || setLogSize || clearLog) return EXIT_SUCCESS;
 
     SetupOutputAndSchedulingPolicy(!(mode & ANDROID_LOG_NONBLOCK));
+    batch_output_ = mode & ANDROID_LOG_NONBLOCK;
+
+    if (binary_stream_) {
+        if (!WriteBinaryStreamHeader(output_fd_.get())) {
+            error(EXIT_FAILURE, errno, "Failed to write to output fd");
+        }
+        out_byte_count_ += sizeof(BinaryStreamHeader);
+        binary_stream_writer_ = std::make_unique<BinaryStreamWriter>(
+                [this](const char* data, size_t size) { WriteBinaryStream(data, size); });
+    }
 
     while (!max_count_ || print_count_ < max_count_) {
         struct log_msg log_msg;
         int ret = android_logger_list_read(logger_list.get(), &log_msg);
+        if (ret <= 0) {
+            // Write out anything still batched before exiting, whether or not this is an error.
+            binary_stream_writer_.reset();
+            FlushOutput();
+        }
         if (!ret) {
             error(EXIT_FAILURE, 0, R"init(Unexpected EOF!
 
@@ -1110,7 +1225,10 @@ If you have enabled significant logging, look into using the -G option to increa
             continue;
         }
 
-        if (print_binary_) {
+        if (binary_stream_) {
+            binary_stream_writer_->Append(log_msg);
+            ++print_count_;
+        } else if (print_binary_) {
             if (!WriteFully(output_fd_, &log_msg, log_msg.len())) {
                 error(EXIT_FAILURE, errno, "Failed to write to output fd");
             }
@@ -1118,6 +1236,8 @@ If you have enabled significant logging, look into using the -G option to increa
             ProcessBuffer(&log_msg);
         }
     }
+    binary_stream_writer_.reset();
+    FlushOutput();
     return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Formats the output of `logcat --binary-stream` or `logcat -B` as text, the same way logcat
+// itself would have.
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <log/event_tag_map.h>
+#include <log/logprint.h>
+
+#include "binary_stream.h"
+
+static void show_help(const char* cmd) {
+    fprintf(stderr, R"init(Usage: %s [options] [filterspecs]
+
+Formats logs captured with `logcat --binary-stream` or `logcat -B`.
+
+Options:
+  -f, --file=<file>           Read from <file> instead of stdin.
+  -v, --format=<format>       Sets log print format verb and adverbs, as for logcat.
+  -e, --event-tags=<file>     Event log tags used to format binary buffers, usually a copy of
+                              the device's /system/etc/event-log-tags.
+  -s                          Set default filter to silent.
+
+filterspecs are a series of <tag>[:priority], as for logcat.
+)init",
+            cmd);
+}
+
+int main(int argc, char** argv) {
+    std::unique_ptr<AndroidLogFormat, decltype(&android_log_format_free)> format{
+            android_log_format_new(), &android_log_format_free};
+    const char* input_file_name = nullptr;
+    const char* event_tags_file_name = nullptr;
+    bool format_set = false;
+
+    // clang-format off
+    static const struct option long_options[] = {
+      { "event-tags", required_argument, nullptr, 'e' },
+      { "file",       required_argument, nullptr, 'f' },
+      { "format",     required_argument, nullptr, 'v' },
+      { "help",       no_argument,       nullptr, 'h' },
+      { nullptr,      0,                 nullptr, 0 }
+    };
+    // clang-format on
+
+    int c;
+    while ((c = getopt_long(argc, argv, "e:f:hsv:", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'e':
+                event_tags_file_name = optarg;
+                break;
+            case 'f':
+                input_file_name = optarg;
+                break;
+            case 's':
+                android_log_addFilterRule(format.get(), "*:s");
+                break;
+            case 'v':
+                for (const auto& arg : android::base::Split(optarg, ",")) {
+                    AndroidLogPrintFormat print_format = android_log_formatFromString(arg.c_str());
+                    int err = print_format == FORMAT_OFF
+                                      ? -1
+                                      : android_log_setPrintFormat(format.get(), print_format);
+                    if (err < 0) {
+                        error(EXIT_FAILURE, 0, "Invalid parameter '%s' to -v.", arg.c_str());
+                    }
+                    if (err) format_set = true;
+                }
+                break;
+            case 'h':
+                show_help(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                show_help(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (!format_set) {
+        android_log_setPrintFormat(format.get(), FORMAT_THREADTIME);
+    }
+    for (int i = optind; i < argc; ++i) {
+        if (android_log_addFilterString(format.get(), argv[i]) < 0) {
+            error(EXIT_FAILURE, 0, "Invalid filter expression '%s'.", argv[i]);
+        }
+    }
+
+    android::base::unique_fd input_fd;
+    if (input_file_name) {
+        input_fd.reset(open(input_file_name, O_RDONLY | O_CLOEXEC));
+        if (!input_fd.ok()) {
+            error(EXIT_FAILURE, errno, "Couldn't open '%s'", input_file_name);
+        }
+    } else {
+        input_fd.reset(dup(STDIN_FILENO));
+    }
+
+    std::unique_ptr<EventTagMap, decltype(&android_closeEventTagMap)> event_tag_map{
+            nullptr, &android_closeEventTagMap};
+    bool has_opened_event_tag_map = false;
+
+    BinaryStreamReader reader(input_fd.get());
+    int ret;
+    log_msg msg;
+    while ((ret = reader.Read(&msg)) > 0) {
+        AndroidLogEntry entry;
+        char binary_msg_buf[1024];
+        int err;
+        if (msg.id() == LOG_ID_EVENTS || msg.id() == LOG_ID_STATS ||
+            msg.id() == LOG_ID_SECURITY) {
+            if (!has_opened_event_tag_map) {
+                event_tag_map.reset(android_openEventTagMap(event_tags_file_name));
+                has_opened_event_tag_map = true;
+            }
+            err = android_log_processBinaryLogBuffer(&msg.entry, &entry, event_tag_map.get(),
+                                                     binary_msg_buf, sizeof(binary_msg_buf));
+        } else {
+            err = android_log_processLogBuffer(&msg.entry, &entry);
+        }
+        if (err < 0) {
+            continue;
+        }
+
+        if (android_log_shouldPrintLine(format.get(), std::string(entry.tag, entry.tagLen).c_str(),
+                                        entry.priority) &&
+            android_log_printLogLine(format.get(), STDOUT_FILENO, &entry) < 0) {
+            error(EXIT_FAILURE, errno, "Output error");
+        }
+    }
+    if (ret < 0) {
+        error(EXIT_FAILURE, -ret, "Failed to read log records");
+    }
+    return EXIT_SUCCESS;
+}
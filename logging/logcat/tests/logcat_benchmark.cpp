@@ -20,6 +20,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include "binary_stream.h"
+
 static const char begin[] = "--------- beginning of ";
 
 static void BM_logcat_sorted_order(benchmark::State& state) {
@@ -130,4 +132,52 @@ static void BM_logcat_sorted_order(benchmark::State& state) {
 }
 BENCHMARK(BM_logcat_sorted_order);
 
+// Dumps every buffer as threadtime text, counting output lines.
+static void BM_logcat_dump_text(benchmark::State& state) {
+    size_t lines = 0;
+    for (auto _ : state) {
+        FILE* fp = popen("logcat -b all -d -v threadtime 2>/dev/null", "r");
+        if (!fp) {
+            state.SkipWithError("popen failed");
+            return;
+        }
+        char buffer[64 * 1024];
+        size_t len;
+        while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+            for (size_t i = 0; i < len; ++i) {
+                lines += buffer[i] == '\n';
+            }
+        }
+        pclose(fp);
+    }
+    state.counters["lines/s"] = benchmark::Counter(lines, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_logcat_dump_text);
+
+// Dumps every buffer with --binary-stream, counting each record as a line.  Compare lines/s with
+// BM_logcat_dump_text.
+static void BM_logcat_dump_binary_stream(benchmark::State& state) {
+    size_t lines = 0;
+    for (auto _ : state) {
+        FILE* fp = popen("logcat -b all -d --binary-stream 2>/dev/null", "r");
+        if (!fp) {
+            state.SkipWithError("popen failed");
+            return;
+        }
+        BinaryStreamReader reader(fileno(fp));
+        log_msg msg;
+        int ret;
+        while ((ret = reader.Read(&msg)) > 0) {
+            ++lines;
+        }
+        pclose(fp);
+        if (ret < 0) {
+            state.SkipWithError("corrupt binary stream");
+            return;
+        }
+    }
+    state.counters["lines/s"] = benchmark::Counter(lines, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_logcat_dump_binary_stream);
+
 BENCHMARK_MAIN();
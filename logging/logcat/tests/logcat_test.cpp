@@ -42,6 +42,8 @@
 #include <log/log.h>
 #include <log/log_event_list.h>
 
+#include "binary_stream.h"
+
 #ifndef logcat_executable
 #define USING_LOGCAT_EXECUTABLE_DEFAULT
 #define logcat_executable "logcat"
@@ -1770,3 +1772,42 @@ TEST(logcat, uid_filter) {
 
     EXPECT_EQ(2U, uids_only_top2.size());
 }
+
+TEST(logcat, binary_stream) {
+    static const char kTag[] = logcat_executable "_binary_stream";
+    std::string message = android::base::StringPrintf("%s %d", kTag, getpid());
+    LOG_FAILURE_RETRY(__android_log_print(ANDROID_LOG_WARN, kTag, "%s", message.c_str()));
+    rest();
+
+    TemporaryFile output;
+    std::string command = android::base::StringPrintf(
+            logcat_executable " -b all -d --binary-stream -f %s 2>/dev/null", output.path);
+    ASSERT_EQ(0, system(command.c_str()));
+
+    std::string contents;
+    ASSERT_TRUE(android::base::ReadFileToString(output.path, &contents));
+    ASSERT_GE(contents.size(), sizeof(BinaryStreamHeader));
+    EXPECT_EQ(0, memcmp(contents.data(), kBinaryStreamMagic, sizeof(kBinaryStreamMagic)));
+
+    BinaryStreamReader reader(output.fd);
+    size_t count = 0;
+    bool found = false;
+    log_msg msg;
+    int ret;
+    while ((ret = reader.Read(&msg)) > 0) {
+        ++count;
+        EXPECT_EQ(static_cast<int>(msg.len()), ret);
+        ASSERT_LT(msg.id(), LOG_ID_MAX);
+        if (msg.id() != LOG_ID_MAIN || msg.entry.pid != getpid()) {
+            continue;
+        }
+        // Text payloads are the priority, then the NUL terminated tag and message.
+        const char* tag = msg.msg() + 1;
+        if (strcmp(tag, kTag) == 0 && message == tag + strlen(tag) + 1) {
+            found = true;
+        }
+    }
+    EXPECT_EQ(0, ret);
+    EXPECT_GT(count, 0U);
+    EXPECT_TRUE(found);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ChunkCompressor.h"
+
+#include <sys/prctl.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+#include <android-base/thread_annotations.h>
+
+#include "SerializedLogChunk.h"
+#include "SerializedLogEntry.h"
+
+// The nice value of ANDROID_PRIORITY_BACKGROUND.
+static constexpr int kCompressorPriority = 10;
+
+ChunkCompressor::ChunkCompressor(std::shared_ptr<CompressionEngine> engine, bool train_dictionary,
+                                 LogStatistics* stats)
+    : stats_(stats), train_dictionary_(train_dictionary), engine_(std::move(engine)) {
+    thread_ = std::thread{&ChunkCompressor::ThreadFunction, this};
+}
+
+ChunkCompressor::~ChunkCompressor() {
+    {
+        auto lock = std::lock_guard{logd_lock};
+        stop_ = true;
+        queue_condition_.notify_all();
+    }
+    thread_.join();
+}
+
+bool ChunkCompressor::Enqueue(SerializedLogChunk* chunk) {
+    if (queue_.size() >= kMaxPendingChunks) {
+        return false;
+    }
+    queue_.emplace_back(chunk);
+    queue_condition_.notify_one();
+    return true;
+}
+
+void ChunkCompressor::Cancel(SerializedLogChunk* chunk) {
+    if (in_flight_ == chunk) {
+        in_flight_ = nullptr;
+        return;
+    }
+    auto it = std::find(queue_.begin(), queue_.end(), chunk);
+    if (it != queue_.end()) {
+        queue_.erase(it);
+    }
+}
+
+void ChunkCompressor::Compress(CompressionEngine& engine, SerializedData& in, size_t data_length,
+                               SerializedData& out) {
+    auto start = std::chrono::steady_clock::now();
+    engine.Compress(in, data_length, out);
+    stats_->AddCompression(engine.name(), data_length, out.size(),
+                           std::chrono::steady_clock::now() - start);
+}
+
+void ChunkCompressor::ThreadFunction() {
+    prctl(PR_SET_NAME, "logd.compress");
+    setpriority(PRIO_PROCESS, 0, kCompressorPriority);
+
+    auto lock = std::unique_lock{logd_lock};
+    auto lock_assertion = android::base::ScopedLockAssertion{logd_lock};
+
+    while (true) {
+        while (!stop_ && queue_.empty()) {
+            queue_condition_.wait(lock);
+        }
+        if (stop_) {
+            return;
+        }
+
+        in_flight_ = queue_.front();
+        queue_.pop_front();
+
+        // Compress a copy, since the chunk may be pruned or cleared once logd_lock is released.
+        size_t data_length = in_flight_->write_offset();
+        SerializedData contents(data_length);
+        memcpy(contents.data(), in_flight_->data(), data_length);
+        auto engine = engine_;
+        lock.unlock();
+
+        SerializedData compressed;
+        Compress(*engine, contents, data_length, compressed);
+
+        std::shared_ptr<CompressionEngine> trained_engine;
+        if (train_dictionary_) {
+            AddSamples(contents, data_length);
+            trained_engine = MaybeTrainDictionary();
+        }
+
+        lock.lock();
+        if (in_flight_ != nullptr) {
+            in_flight_->SetCompressed(std::move(compressed), std::move(engine));
+            in_flight_ = nullptr;
+        }
+        if (trained_engine) {
+            engine_ = std::move(trained_engine);
+        }
+    }
+}
+
+// Uses the individual log entries of every chunk as samples, until there are enough of them.
+void ChunkCompressor::AddSamples(const SerializedData& data, size_t data_length) {
+    if (chunks_until_sampling_ > 0) {
+        --chunks_until_sampling_;
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset < data_length && samples_.size() < kDictionarySampleSize) {
+        const auto* entry = reinterpret_cast<const SerializedLogEntry*>(data.data() + offset);
+        size_t total_len = entry->total_len();
+        samples_.insert(samples_.end(), data.data() + offset, data.data() + offset + total_len);
+        sample_sizes_.emplace_back(total_len);
+        offset += total_len;
+    }
+}
+
+std::shared_ptr<CompressionEngine> ChunkCompressor::MaybeTrainDictionary() {
+    if (samples_.size() < kDictionarySampleSize) {
+        return nullptr;
+    }
+
+    auto dictionary = ZstdCompressionEngine::Train(samples_, sample_sizes_, kDictionarySize);
+    std::vector<uint8_t>().swap(samples_);
+    std::vector<size_t>().swap(sample_sizes_);
+    chunks_until_sampling_ = kRetrainInterval;
+
+    if (dictionary.empty()) {
+        return nullptr;
+    }
+    LOG(VERBOSE) << "Trained a " << dictionary.size() << " byte zstd dictionary";
+    return std::make_shared<ZstdCompressionEngine>(std::move(dictionary));
+}
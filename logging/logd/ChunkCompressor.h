@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CompressionEngine.h"
+#include "LogStatistics.h"
+#include "LogdLock.h"
+#include "SerializedData.h"
+
+class SerializedLogChunk;
+
+// Compresses finished SerializedLogChunks on a low priority background thread, so that neither
+// writers nor the holders of logd_lock wait for compression.  Chunks keep their uncompressed
+// contents, and are read from them, until they are compressed.
+//
+// When kMaxPendingChunks chunks are already waiting, Enqueue() fails and the chunk must be
+// compressed synchronously instead.  This bounds the memory held by uncompressed chunks when
+// writers outpace the compressor.
+//
+// If |train_dictionary| is set, the compressor periodically trains a zstd dictionary from the
+// contents of recently compressed chunks and switches to compressing with it.
+class ChunkCompressor {
+  public:
+    ChunkCompressor(std::shared_ptr<CompressionEngine> engine, bool train_dictionary,
+                    LogStatistics* stats);
+    ~ChunkCompressor();
+
+    // Enqueue(), Cancel() and engine() must be called with logd_lock held.
+
+    // Queues |chunk| to be compressed.  Returns false if the queue is full.
+    bool Enqueue(SerializedLogChunk* chunk);
+    // Removes |chunk| from the queue, or discards its result if it's being compressed.
+    void Cancel(SerializedLogChunk* chunk);
+
+    // Compresses |in| with |engine| on the calling thread, recording statistics.
+    void Compress(CompressionEngine& engine, SerializedData& in, size_t data_length,
+                  SerializedData& out);
+
+    std::shared_ptr<CompressionEngine> engine() const { return engine_; }
+
+    static constexpr size_t kMaxPendingChunks = 4;
+    // Chunks compressed between the end of one dictionary training and the start of sampling for
+    // the next.
+    static constexpr size_t kRetrainInterval = 64;
+    static constexpr size_t kDictionarySize = 16 * 1024;
+    static constexpr size_t kDictionarySampleSize = 32 * kDictionarySize;
+
+  private:
+    void ThreadFunction();
+    void AddSamples(const SerializedData& data, size_t data_length);
+    std::shared_ptr<CompressionEngine> MaybeTrainDictionary();
+
+    LogStatistics* stats_;
+    const bool train_dictionary_;
+
+    // Guarded by logd_lock.
+    std::shared_ptr<CompressionEngine> engine_;
+    std::deque<SerializedLogChunk*> queue_;
+    // The chunk being compressed by the thread, reset if the chunk is cancelled in the meantime.
+    SerializedLogChunk* in_flight_ = nullptr;
+    bool stop_ = false;
+    std::condition_variable queue_condition_;
+
+    // Only accessed by the compressor thread.
+    std::vector<uint8_t> samples_;
+    std::vector<size_t> sample_sizes_;
+    size_t chunks_until_sampling_ = 0;
+
+    std::thread thread_;
+};
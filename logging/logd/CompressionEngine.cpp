@@ -17,14 +17,30 @@
 #include "CompressionEngine.h"
 
 #include <limits>
+#include <memory>
 
 #include <android-base/logging.h>
+#include <lz4.h>
+#include <zdict.h>
 #include <zlib.h>
 #include <zstd.h>
 
-CompressionEngine& CompressionEngine::GetInstance() {
-    static CompressionEngine* engine = new ZstdCompressionEngine();
-    return *engine;
+std::shared_ptr<CompressionEngine> CompressionEngine::GetInstance() {
+    static auto engine = std::make_shared<ZstdCompressionEngine>();
+    return engine;
+}
+
+std::shared_ptr<CompressionEngine> CompressionEngine::Create(const std::string& name) {
+    if (name == "zstd" || name == "zstd-dict") {
+        return GetInstance();
+    }
+    if (name == "zlib") {
+        return std::make_shared<ZlibCompressionEngine>();
+    }
+    if (name == "lz4") {
+        return std::make_shared<Lz4CompressionEngine>();
+    }
+    return nullptr;
 }
 
 bool ZlibCompressionEngine::Compress(SerializedData& in, size_t data_length, SerializedData& out) {
@@ -79,13 +95,63 @@ bool ZlibCompressionEngine::Decompress(SerializedData& in, SerializedData& out)
     return true;
 }
 
+ZstdCompressionEngine::ZstdCompressionEngine(std::vector<uint8_t> dictionary)
+    : dictionary_(std::move(dictionary)) {
+    CHECK(!dictionary_.empty());
+    cdict_ = ZSTD_createCDict(dictionary_.data(), dictionary_.size(), 1);
+    ddict_ = ZSTD_createDDict(dictionary_.data(), dictionary_.size());
+    CHECK(cdict_ != nullptr && ddict_ != nullptr);
+}
+
+ZstdCompressionEngine::~ZstdCompressionEngine() {
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+}
+
+std::vector<uint8_t> ZstdCompressionEngine::Train(const std::vector<uint8_t>& samples,
+                                                  const std::vector<size_t>& sample_sizes,
+                                                  size_t max_size) {
+    std::vector<uint8_t> dictionary(max_size);
+    size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                                        sample_sizes.data(), sample_sizes.size());
+    if (ZDICT_isError(size)) {
+        LOG(WARNING) << "ZDICT_trainFromBuffer failed: " << ZDICT_getErrorName(size);
+        return {};
+    }
+    dictionary.resize(size);
+    return dictionary;
+}
+
+// ZSTD contexts are expensive to create, so each thread keeps one of each around.  They are not
+// tied to a dictionary, so they are shared by every ZstdCompressionEngine used on that thread.
+static ZSTD_CCtx* GetThreadCCtx() {
+    static thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(
+            ZSTD_createCCtx(), ZSTD_freeCCtx);
+    CHECK(cctx != nullptr);
+    return cctx.get();
+}
+
+static ZSTD_DCtx* GetThreadDCtx() {
+    static thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(
+            ZSTD_createDCtx(), ZSTD_freeDCtx);
+    CHECK(dctx != nullptr);
+    return dctx.get();
+}
+
 bool ZstdCompressionEngine::Compress(SerializedData& in, size_t data_length, SerializedData& out) {
     CHECK_LE(data_length, in.size());
 
     size_t compress_bound = ZSTD_compressBound(data_length);
     out.Resize(compress_bound);
 
-    size_t out_size = ZSTD_compress(out.data(), out.size(), in.data(), data_length, 1);
+    size_t out_size;
+    if (cdict_ != nullptr) {
+        out_size = ZSTD_compress_usingCDict(GetThreadCCtx(), out.data(), out.size(), in.data(),
+                                            data_length, cdict_);
+    } else {
+        out_size =
+                ZSTD_compressCCtx(GetThreadCCtx(), out.data(), out.size(), in.data(), data_length, 1);
+    }
     if (ZSTD_isError(out_size)) {
         LOG(FATAL) << "ZSTD_compress failed: " << ZSTD_getErrorName(out_size);
     }
@@ -95,10 +161,44 @@ bool ZstdCompressionEngine::Compress(SerializedData& in, size_t data_length, Ser
 }
 
 bool ZstdCompressionEngine::Decompress(SerializedData& in, SerializedData& out) {
-    size_t result = ZSTD_decompress(out.data(), out.size(), in.data(), in.size());
+    size_t result;
+    if (ddict_ != nullptr) {
+        result = ZSTD_decompress_usingDDict(GetThreadDCtx(), out.data(), out.size(), in.data(),
+                                            in.size(), ddict_);
+    } else {
+        result = ZSTD_decompressDCtx(GetThreadDCtx(), out.data(), out.size(), in.data(),
+                                     in.size());
+    }
     if (ZSTD_isError(result)) {
         LOG(FATAL) << "ZSTD_decompress failed: " << ZSTD_getErrorName(result);
     }
     CHECK_EQ(result, out.size());
     return true;
 }
+
+bool Lz4CompressionEngine::Compress(SerializedData& in, size_t data_length, SerializedData& out) {
+    CHECK_LE(data_length, in.size());
+    CHECK_LE(data_length, static_cast<size_t>(LZ4_MAX_INPUT_SIZE));
+
+    out.Resize(LZ4_compressBound(data_length));
+
+    int out_size = LZ4_compress_default(reinterpret_cast<const char*>(in.data()),
+                                        reinterpret_cast<char*>(out.data()), data_length,
+                                        out.size());
+    if (out_size <= 0) {
+        LOG(FATAL) << "LZ4_compress_default failed: " << out_size;
+    }
+    out.Resize(out_size);
+
+    return true;
+}
+
+bool Lz4CompressionEngine::Decompress(SerializedData& in, SerializedData& out) {
+    int result = LZ4_decompress_safe(reinterpret_cast<const char*>(in.data()),
+                                     reinterpret_cast<char*>(out.data()), in.size(), out.size());
+    if (result < 0) {
+        LOG(FATAL) << "LZ4_decompress_safe failed: " << result;
+    }
+    CHECK_EQ(static_cast<size_t>(result), out.size());
+    return true;
+}
@@ -16,16 +16,32 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "SerializedData.h"
 
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+// CompressionEngine objects are immutable once created, so a chunk keeps a reference to the engine
+// that compressed it, which is needed to decompress it even after a newer engine, such as one with
+// a retrained dictionary, is in use.
 class CompressionEngine {
   public:
-    static CompressionEngine& GetInstance();
+    // The default engine, used when no other has been selected.
+    static std::shared_ptr<CompressionEngine> GetInstance();
+    // Returns the engine named |name| ("zlib", "zstd", "zstd-dict" or "lz4"), or nullptr if there is
+    // no such engine.  "zstd-dict" is zstd without a dictionary until ChunkCompressor has trained
+    // one.
+    static std::shared_ptr<CompressionEngine> Create(const std::string& name);
 
     virtual ~CompressionEngine(){};
 
+    virtual const char* name() const = 0;
     virtual bool Compress(SerializedData& in, size_t data_length, SerializedData& out) = 0;
     // Decompress the contents of `in` into `out`.  `out.size()` must be set to the decompressed
     // size of the contents.
@@ -34,12 +50,36 @@ class CompressionEngine {
 
 class ZlibCompressionEngine : public CompressionEngine {
   public:
+    const char* name() const override { return "zlib"; }
     bool Compress(SerializedData& in, size_t data_length, SerializedData& out) override;
     bool Decompress(SerializedData& in, SerializedData& out) override;
 };
 
 class ZstdCompressionEngine : public CompressionEngine {
   public:
+    ZstdCompressionEngine() {}
+    // Compresses with a dictionary, as produced by Train().
+    explicit ZstdCompressionEngine(std::vector<uint8_t> dictionary);
+    ~ZstdCompressionEngine();
+
+    // Trains a dictionary of at most |max_size| bytes from the concatenated |samples|, returning an
+    // empty vector on failure.
+    static std::vector<uint8_t> Train(const std::vector<uint8_t>& samples,
+                                      const std::vector<size_t>& sample_sizes, size_t max_size);
+
+    const char* name() const override { return dictionary_.empty() ? "zstd" : "zstd-dict"; }
     bool Compress(SerializedData& in, size_t data_length, SerializedData& out) override;
     bool Decompress(SerializedData& in, SerializedData& out) override;
-};
\ No newline at end of file
+
+  private:
+    std::vector<uint8_t> dictionary_;
+    ZSTD_CDict_s* cdict_ = nullptr;
+    ZSTD_DDict_s* ddict_ = nullptr;
+};
+
+class Lz4CompressionEngine : public CompressionEngine {
+  public:
+    const char* name() const override { return "lz4"; }
+    bool Compress(SerializedData& in, size_t data_length, SerializedData& out) override;
+    bool Decompress(SerializedData& in, SerializedData& out) override;
+};
@@ -43,9 +43,20 @@ class FlushToState {
 
     LogMask log_mask() const { return log_mask_; }
 
+    // Hints describing logs that the reader's filter is known to skip: those not from pid(), if
+    // non-zero, and those with a realtime before start_time(), if not EPOCH.  A LogBuffer may use
+    // these to avoid examining such logs at all, but the filter passed to FlushTo() is still
+    // authoritative.
+    pid_t pid() const { return pid_; }
+    void set_pid(pid_t pid) { pid_ = pid; }
+    log_time start_time() const { return start_time_; }
+    void set_start_time(log_time start_time) { start_time_ = start_time; }
+
   private:
     uint64_t start_;
     LogMask log_mask_;
+    pid_t pid_ = 0;
+    log_time start_time_{log_time::EPOCH};
 };
 
 // Enum for the return values of the `filter` function passed to FlushTo().
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <type_traits>
+
+#include <android/log.h>
+#include <benchmark/benchmark.h>
+
+#include "ChattyLogBuffer.h"
+#include "LogBuffer.h"
+#include "LogReaderList.h"
+#include "LogStatistics.h"
+#include "LogTags.h"
+#include "PruneList.h"
+#include "SerializedLogBuffer.h"
+#include "SimpleLogBuffer.h"
+
+char* android::uidToName(uid_t) {
+    return nullptr;
+}
+
+// Shared by every thread of the benchmark, and never destroyed.
+template <typename T>
+static LogBuffer* GetLogBuffer() {
+    static LogReaderList reader_list;
+    static LogTags tags;
+    static PruneList prune;
+    static LogStatistics stats{false, true};
+    static LogBuffer* log_buffer = [] {
+        LogBuffer* log_buffer;
+        if constexpr (std::is_same_v<T, ChattyLogBuffer>) {
+            log_buffer = new ChattyLogBuffer(&reader_list, &tags, &prune, &stats);
+        } else {
+            log_buffer = new T(&reader_list, &tags, &stats);
+        }
+        log_id_for_each(i) { log_buffer->SetSize(i, 1024 * 1024); }
+        return log_buffer;
+    }();
+    return log_buffer;
+}
+
+// Measures Log() throughput with several threads writing to the same buffer at once.
+template <typename T>
+static void BM_log_buffer_concurrent_writers(benchmark::State& state) {
+    auto* log_buffer = GetLogBuffer<T>();
+
+    std::string message;
+    message.push_back(ANDROID_LOG_INFO);
+    message += "writer";
+    message.push_back('\0');
+    message += "benchmark message";
+    message.push_back('\0');
+
+    uint32_t i = 0;
+    for (auto _ : state) {
+        log_buffer->Log(LOG_ID_MAIN, log_time(10000, ++i), 0, 1, 1, message.c_str(),
+                        message.size());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_log_buffer_concurrent_writers, ChattyLogBuffer)->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(BM_log_buffer_concurrent_writers, SerializedLogBuffer)->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(BM_log_buffer_concurrent_writers, SimpleLogBuffer)->ThreadRange(1, 8);
+
+BENCHMARK_MAIN();
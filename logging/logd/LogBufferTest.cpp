@@ -21,6 +21,7 @@
 #include <limits>
 #include <memory>
 #include <regex>
+#include <thread>
 #include <vector>
 
 #include <android-base/stringprintf.h>
@@ -481,5 +482,51 @@ TEST_P(LogBufferTest, tail100_blocking_50total_then1000more) {
     CompareLogMessages(expected_log_messages, blocking_reader.read_log_messages());
 }
 
+static std::string ConcurrentWriterMessage(size_t index) {
+    std::string message;
+    message.push_back(ANDROID_LOG_INFO);
+    message += "writer";
+    message.push_back('\0');
+    // Each message is unique, so ChattyLogBuffer doesn't collapse them.
+    message += std::to_string(index);
+    message.push_back('\0');
+    return message;
+}
+
+// Logs from several threads at once.  Every message must then be readable, in the order that its
+// thread logged it.
+TEST_P(LogBufferTest, concurrent_writers) {
+    constexpr size_t kMessagesPerThread = 1000;
+    for (size_t num_threads : {1, 2, 4, 8}) {
+        log_id_for_each(i) { log_buffer_->Clear(i, 0); }
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([this, t]() {
+                for (size_t i = 0; i < kMessagesPerThread; ++i) {
+                    auto message = ConcurrentWriterMessage(i);
+                    EXPECT_GT(log_buffer_->Log(LOG_ID_MAIN, log_time(10000, i * 1000 + 1), 0, 1,
+                                               t + 1, message.c_str(), message.size()),
+                              0);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        auto result = FlushMessages();
+        ASSERT_EQ(num_threads * kMessagesPerThread, result.messages.size());
+        std::vector<size_t> next_index(num_threads, 0);
+        for (const auto& [entry, message, _] : result.messages) {
+            ASSERT_GE(entry.tid, 1U);
+            ASSERT_LE(entry.tid, num_threads);
+            auto& index = next_index[entry.tid - 1];
+            EXPECT_EQ(ConcurrentWriterMessage(index), message);
+            ++index;
+        }
+    }
+}
+
 INSTANTIATE_TEST_CASE_P(LogBufferTests, LogBufferTest,
                         testing::Values("chatty", "serialized", "simple"));
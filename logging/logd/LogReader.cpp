@@ -194,6 +194,8 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
         };
         auto lock = std::lock_guard{logd_lock};
         auto flush_to_state = log_buffer_->CreateFlushToState(sequence, logMask);
+        flush_to_state->set_pid(pid);
+        flush_to_state->set_start_time(start);
         log_buffer_->FlushTo(socket_log_writer.get(), *flush_to_state, log_find_start);
 
         if (!start_time_set) {
@@ -43,6 +43,8 @@ LogReaderThread::LogReaderThread(LogBuffer* log_buffer, LogReaderList* reader_li
       non_block_(non_block) {
     CleanSkip();
     flush_to_state_ = log_buffer_->CreateFlushToState(start, log_mask);
+    flush_to_state_->set_pid(pid);
+    flush_to_state_->set_start_time(start_time);
     auto thread = std::thread{&LogReaderThread::ThreadFunction, this};
     thread.detach();
 }
@@ -67,6 +69,8 @@ void LogReaderThread::ThreadFunction() {
         if (tail_) {
             auto first_pass_state = log_buffer_->CreateFlushToState(flush_to_state_->start(),
                                                                     flush_to_state_->log_mask());
+            first_pass_state->set_pid(pid_);
+            first_pass_state->set_start_time(start_time_);
             log_buffer_->FlushTo(writer_.get(), *first_pass_state,
                                  [this](log_id_t log_id, pid_t pid, uint64_t sequence,
                                         log_time realtime) REQUIRES(logd_lock) {
@@ -86,6 +90,7 @@ void LogReaderThread::ThreadFunction() {
         // solution here is that clients must request events since a specific sequence number.
         start_time_.tv_sec = 0;
         start_time_.tv_nsec = 0;
+        flush_to_state_->set_start_time(log_time(log_time::EPOCH));
 
         if (!flush_success) {
             break;
@@ -123,6 +123,25 @@ void LogStatistics::AddTotal(log_id_t log_id, uint16_t size) {
     ++mElementsTotal[log_id];
 }
 
+void LogStatistics::AddCompression(const std::string& engine, size_t input_size,
+                                   size_t output_size, std::chrono::nanoseconds duration) {
+    auto lock = std::lock_guard{lock_};
+
+    auto& stats = compression_stats_[engine];
+    ++stats.chunks;
+    stats.input_bytes += input_size;
+    stats.output_bytes += output_size;
+    stats.total_time += duration;
+    stats.max_time = std::max(stats.max_time, duration);
+}
+
+CompressionStatistics LogStatistics::GetCompressionStatistics(const std::string& engine) const {
+    auto lock = std::lock_guard{lock_};
+
+    auto it = compression_stats_.find(engine);
+    return it != compression_stats_.end() ? it->second : CompressionStatistics{};
+}
+
 void LogStatistics::Add(LogStatisticsElement element) {
     auto lock = std::lock_guard{lock_};
 
@@ -817,6 +836,29 @@ std::string LogStatistics::ReportInteresting() const {
     return android::base::Join(items, ",");
 }
 
+std::string LogStatistics::FormatCompression() const {
+    if (compression_stats_.empty()) {
+        return "";
+    }
+
+    std::string output = "\n\nCompression:\n";
+    output += android::base::StringPrintf("%-10s%8s%14s%14s%7s%10s%10s", "Engine", "Chunks",
+                                          "Input", "Output", "Ratio", "Avg(us)", "Max(us)");
+    for (const auto& [engine, stats] : compression_stats_) {
+        double ratio = stats.output_bytes ? static_cast<double>(stats.input_bytes) /
+                                                    static_cast<double>(stats.output_bytes)
+                                          : 0;
+        auto average = std::chrono::duration_cast<std::chrono::microseconds>(stats.total_time) /
+                       stats.chunks;
+        auto max = std::chrono::duration_cast<std::chrono::microseconds>(stats.max_time);
+        output += android::base::StringPrintf(
+                "\n%-10s%8zu%14" PRIu64 "%14" PRIu64 "%7.2f%10lld%10lld", engine.c_str(),
+                stats.chunks, stats.input_bytes, stats.output_bytes, ratio,
+                static_cast<long long>(average.count()), static_cast<long long>(max.count()));
+    }
+    return output;
+}
+
 std::string LogStatistics::Format(uid_t uid, pid_t pid, unsigned int logMask) const {
     auto lock = std::lock_guard{lock_};
 
@@ -984,6 +1026,8 @@ std::string LogStatistics::Format(uid_t uid, pid_t pid, unsigned int logMask) co
     if (spaces < 0) spaces = 0;
     output += android::base::StringPrintf("%*s%zu", spaces, "", totalSize);
 
+    output += FormatCompression();
+
     // Report on Chattiest
 
     std::string name;
@@ -25,6 +25,8 @@
 
 #include <algorithm>  // std::max
 #include <array>
+#include <chrono>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -438,6 +440,15 @@ class TagNameEntry : public EntryBase {
     uid_t uid_;
 };
 
+// Totals for the chunks compressed by one compression engine.
+struct CompressionStatistics {
+    size_t chunks = 0;
+    uint64_t input_bytes = 0;
+    uint64_t output_bytes = 0;
+    std::chrono::nanoseconds total_time{0};
+    std::chrono::nanoseconds max_time{0};
+};
+
 class LogStatistics {
     friend UidEntry;
     friend PidEntry;
@@ -564,6 +575,13 @@ class LogStatistics {
         return SizesTotal;
     }
 
+    // Records that the engine named |engine| compressed a chunk of |input_size| bytes into
+    // |output_size| bytes, taking |duration|.
+    void AddCompression(const std::string& engine, size_t input_size, size_t output_size,
+                        std::chrono::nanoseconds duration) EXCLUDES(lock_);
+    CompressionStatistics GetCompressionStatistics(const std::string& engine) const
+            EXCLUDES(lock_);
+
     std::string ReportInteresting() const EXCLUDES(lock_);
     std::string Format(uid_t uid, pid_t pid, unsigned int logMask) const EXCLUDES(lock_);
 
@@ -587,9 +605,11 @@ class LogStatistics {
     void FormatTmp(const char* nameTmp, uid_t uid, std::string& name, std::string& size,
                    size_t nameLen) const REQUIRES(lock_);
     const char* UidToNameLocked(uid_t uid) const REQUIRES(lock_);
+    std::string FormatCompression() const REQUIRES(lock_);
 
     mutable std::mutex lock_;
     bool track_total_size_;
 
     std::optional<size_t> overhead_[LOG_ID_MAX] GUARDED_BY(lock_);
+    std::map<std::string, CompressionStatistics> compression_stats_ GUARDED_BY(lock_);
 };
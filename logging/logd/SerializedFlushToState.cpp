@@ -49,6 +49,7 @@ void SerializedFlushToState::CreateLogPosition(log_id_t log_id) {
     if (it == logs_[log_id].end()) {
         --it;
     }
+    SkipUnmatchedChunks(log_id, it);
     it->AttachReader(this);
     log_position.buffer_it = it;
 
@@ -66,6 +67,18 @@ void SerializedFlushToState::CreateLogPosition(log_id_t log_id) {
     log_positions_[log_id].emplace(log_position);
 }
 
+void SerializedFlushToState::SkipUnmatchedChunks(log_id_t log_id,
+                                                 std::list<SerializedLogChunk>::iterator& it) {
+    if (pid() == 0 && !uid_ && start_time() == log_time::EPOCH) {
+        return;
+    }
+    // The last chunk may still be written to, so it is always attached.
+    auto last = std::prev(logs_[log_id].end());
+    while (it != last && !it->summary().MayMatch(pid(), uid_, start_time())) {
+        ++it;
+    }
+}
+
 void SerializedFlushToState::UpdateLogsNeeded(log_id_t log_id) {
     auto& buffer_it = log_positions_[log_id]->buffer_it;
     auto read_offset = log_positions_[log_id]->read_offset;
@@ -82,6 +95,7 @@ void SerializedFlushToState::UpdateLogsNeeded(log_id_t log_id) {
             // Otherwise, if there is another buffer piece, move to that and do the same check.
             buffer_it->DetachReader(this);
             ++buffer_it;
+            SkipUnmatchedChunks(log_id, buffer_it);
             buffer_it->AttachReader(this);
             log_positions_[log_id]->read_offset = 0;
             if (buffer_it->write_offset() == 0) {
@@ -18,6 +18,7 @@
 
 #include <bitset>
 #include <list>
+#include <optional>
 #include <queue>
 
 #include "LogBuffer.h"
@@ -63,7 +64,16 @@ class SerializedFlushToState : public FlushToState {
     // invalid, so this must be called first to drop the reference to buffer_it, if any.
     void Prune(log_id_t log_id) REQUIRES(logd_lock);
 
+    // Set for readers that may only see logs from a single uid.  Together with pid() and
+    // start_time(), this lets whole chunks be skipped based on their summary.
+    void set_uid(std::optional<uid_t> uid) { uid_ = uid; }
+
   private:
+    // Advances |it| past any chunks, other than the last, whose summary rules out every log in them
+    // for this reader.  These chunks are never attached, so they are never decompressed.
+    void SkipUnmatchedChunks(log_id_t log_id, std::list<SerializedLogChunk>::iterator& it)
+            REQUIRES(logd_lock);
+
     // Set logs_needed_from_next_position_[i] to indicate if log_positions_[i] points to an unread
     // log or to the point at which the next log will appear.
     void UpdateLogsNeeded(log_id_t log_id) REQUIRES(logd_lock);
@@ -85,4 +95,5 @@ class SerializedFlushToState : public FlushToState {
     // next_log_position == logs_write_position_)`.  These will be re-checked in each
     // loop in case new logs came in.
     std::bitset<LOG_ID_MAX> logs_needed_from_next_position_ GUARDED_BY(logd_lock) = {};
+    std::optional<uid_t> uid_;
 };
@@ -308,3 +308,57 @@ TEST(SerializedFlushToState, Prune) {
 
     state.Prune(LOG_ID_MAIN);
 }
+
+TEST(SerializedFlushToState, skip_chunks_by_summary) {
+    auto lock = std::lock_guard{logd_lock};
+    std::list<SerializedLogChunk> log_chunks[LOG_ID_MAX];
+    uint64_t sequence = 1;
+    // Four finished chunks, each from its own pid and uid with increasing timestamps, followed by
+    // the chunk still being written.
+    for (int i = 0; i < 5; ++i) {
+        auto chunk = SerializedLogChunk{kChunkSize};
+        for (int j = 0; j < 3; ++j) {
+            chunk.Log(sequence++, log_time(100 * (i + 1) + j, 0), 1000 + i, 10 + i, 10 + i, "abc",
+                      4);
+        }
+        if (i < 4) {
+            chunk.FinishWriting();
+        }
+        log_chunks[LOG_ID_MAIN].emplace_back(std::move(chunk));
+    }
+
+    auto read_all = [](SerializedFlushToState& state) REQUIRES(logd_lock) {
+        std::vector<uint64_t> read;
+        while (state.HasUnreadLogs()) {
+            read.emplace_back(state.PopNextUnreadLog().entry->sequence());
+        }
+        return read;
+    };
+
+    {
+        // Only the chunk from pid 12 and the last chunk are visited.
+        auto state = SerializedFlushToState{1, kLogMaskAll, log_chunks};
+        state.set_pid(12);
+        ASSERT_TRUE(state.HasUnreadLogs());
+        EXPECT_EQ(7U, state.PopNextUnreadLog().entry->sequence());
+        EXPECT_EQ(0U, log_chunks[LOG_ID_MAIN].begin()->reader_ref_count());
+        EXPECT_EQ(1U, std::next(log_chunks[LOG_ID_MAIN].begin(), 2)->reader_ref_count());
+        auto rest = read_all(state);
+        EXPECT_EQ((std::vector<uint64_t>{8, 9, 13, 14, 15}), rest);
+    }
+    {
+        auto state = SerializedFlushToState{1, kLogMaskAll, log_chunks};
+        state.set_uid(1001);
+        EXPECT_EQ((std::vector<uint64_t>{4, 5, 6, 13, 14, 15}), read_all(state));
+    }
+    {
+        // Chunks entirely before the start time are skipped.
+        auto state = SerializedFlushToState{1, kLogMaskAll, log_chunks};
+        state.set_start_time(log_time(301, 0));
+        EXPECT_EQ((std::vector<uint64_t>{7, 8, 9, 10, 11, 12, 13, 14, 15}), read_all(state));
+    }
+    {
+        auto state = SerializedFlushToState{1, kLogMaskAll, log_chunks};
+        EXPECT_EQ(15U, read_all(state).size());
+    }
+}
@@ -18,9 +18,11 @@
 
 #include <sys/prctl.h>
 
+#include <algorithm>
 #include <limits>
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android-base/scopeguard.h>
 
 #include "LogSize.h"
@@ -30,9 +32,23 @@
 SerializedLogBuffer::SerializedLogBuffer(LogReaderList* reader_list, LogTags* tags,
                                          LogStatistics* stats)
     : reader_list_(reader_list), tags_(tags), stats_(stats) {
+    auto engine_name = android::base::GetProperty("ro.logd.compression", "zstd");
+    auto engine = CompressionEngine::Create(engine_name);
+    if (!engine) {
+        LOG(WARNING) << "Unknown compression engine '" << engine_name << "', using zstd";
+        engine = CompressionEngine::GetInstance();
+    }
+    compressor_ = std::make_unique<ChunkCompressor>(std::move(engine), engine_name == "zstd-dict",
+                                                    stats_);
+
     Init();
 }
 
+SerializedLogBuffer::~SerializedLogBuffer() {
+    auto lock = std::lock_guard{logd_lock};
+    log_id_for_each(i) { logs_[i].clear(); }
+}
+
 void SerializedLogBuffer::Init() {
     log_id_for_each(i) {
         if (!SetSize(i, GetBufferSizeFromProperties(i))) {
@@ -84,27 +100,93 @@ int SerializedLogBuffer::Log(log_id_t log_id, log_time realtime, uid_t uid, pid_
         return -EACCES;
     }
 
-    auto sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+    // Log() only returns once this entry is published, so the thread can reuse it next time.
+    thread_local StagedLog staged;
+    staged.log_id = log_id;
+    staged.realtime = realtime;
+    staged.uid = uid;
+    staged.pid = pid;
+    staged.tid = tid;
+    staged.msg.assign(msg, msg + len);
+    staged.published.store(false, std::memory_order_relaxed);
+    staged.next = staged_logs_.load(std::memory_order_relaxed);
+    while (!staged_logs_.compare_exchange_weak(staged.next, &staged, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+    }
 
+    // The writer currently holding logd_lock publishes every entry pushed by then, which likely
+    // includes this one, so poll for that briefly before queueing up on the lock.
+    for (int i = 0; i < kPublishSpins; ++i) {
+        if (staged.published.load(std::memory_order_acquire)) {
+            return len;
+        }
+        if (logd_lock.try_lock()) {
+            PublishStagedLogs();
+            logd_lock.unlock();
+            return len;
+        }
+        std::this_thread::yield();
+    }
+
+    // Whoever held logd_lock before us either published this entry or left it for us.
     auto lock = std::lock_guard{logd_lock};
+    PublishStagedLogs();
+    return len;
+}
+
+// Publishes every entry pushed so far, in the order they were pushed.  Only takes entries that are
+// already complete, so this never waits for another writer.
+void SerializedLogBuffer::PublishStagedLogs() {
+    auto* staged = staged_logs_.exchange(nullptr, std::memory_order_acquire);
+    if (staged == nullptr) {
+        return;
+    }
+
+    StagedLog* oldest = nullptr;
+    while (staged != nullptr) {
+        auto* next = staged->next;
+        staged->next = oldest;
+        oldest = staged;
+        staged = next;
+    }
+
+    LogMask log_mask = 0;
+    for (auto* entry = oldest; entry != nullptr; entry = entry->next) {
+        LogToChunk(sequence_.fetch_add(1, std::memory_order_relaxed), *entry);
+        log_mask |= 1 << entry->log_id;
+    }
+
+    log_id_for_each(i) {
+        if (log_mask & (1 << i)) {
+            MaybePrune(i);
+        }
+    }
+    reader_list_->NotifyNewLog(log_mask);
 
+    // Each writer may reuse its entry as soon as it sees it published, so read |next| first.
+    while (oldest != nullptr) {
+        auto* next = oldest->next;
+        oldest->published.store(true, std::memory_order_release);
+        oldest = next;
+    }
+}
+
+void SerializedLogBuffer::LogToChunk(uint64_t sequence, const StagedLog& staged) {
+    auto log_id = staged.log_id;
     if (logs_[log_id].empty()) {
-        logs_[log_id].push_back(SerializedLogChunk(max_size_[log_id] / 4));
+        logs_[log_id].push_back(SerializedLogChunk(max_size_[log_id] / 4, compressor_.get()));
     }
 
+    auto len = static_cast<uint16_t>(staged.msg.size());
     auto total_len = sizeof(SerializedLogEntry) + len;
     if (!logs_[log_id].back().CanLog(total_len)) {
         logs_[log_id].back().FinishWriting();
-        logs_[log_id].push_back(SerializedLogChunk(max_size_[log_id] / 4));
+        logs_[log_id].push_back(SerializedLogChunk(max_size_[log_id] / 4, compressor_.get()));
     }
 
-    auto entry = logs_[log_id].back().Log(sequence, realtime, uid, pid, tid, msg, len);
+    auto entry = logs_[log_id].back().Log(sequence, staged.realtime, staged.uid, staged.pid,
+                                          staged.tid, staged.msg.data(), len);
     stats_->Add(entry->ToLogStatisticsElement(log_id));
-
-    MaybePrune(log_id);
-
-    reader_list_->NotifyNewLog(1 << log_id);
-    return len;
 }
 
 void SerializedLogBuffer::MaybePrune(log_id_t log_id) {
@@ -196,7 +278,11 @@ bool SerializedLogBuffer::FlushTo(
         const std::function<FilterResult(log_id_t log_id, pid_t pid, uint64_t sequence,
                                          log_time realtime)>& filter) {
     auto& state = reinterpret_cast<SerializedFlushToState&>(abstract_state);
+    if (!writer->privileged()) {
+        state.set_uid(writer->uid());
+    }
 
+    bool caught_up = true;
     while (state.HasUnreadLogs()) {
         LogWithId top = state.PopNextUnreadLog();
         auto* entry = top.entry;
@@ -217,6 +303,7 @@ bool SerializedLogBuffer::FlushTo(
                 continue;
             }
             if (ret == FilterResult::kStop) {
+                caught_up = false;
                 break;
             }
         }
@@ -238,6 +325,12 @@ bool SerializedLogBuffer::FlushTo(
     }
 
     state.set_start(state.start() + 1);
+    if (caught_up) {
+        // Chunks skipped based on their summary don't advance start(), but having read everything,
+        // this reader is now past every published log.  Sequence numbers are only handed out with
+        // logd_lock held, as entries are published.
+        state.set_start(std::max(state.start(), sequence_.load(std::memory_order_relaxed)));
+    }
     return true;
 }
 
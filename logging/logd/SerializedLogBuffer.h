@@ -26,6 +26,7 @@
 
 #include <android-base/thread_annotations.h>
 
+#include "ChunkCompressor.h"
 #include "LogBuffer.h"
 #include "LogReaderList.h"
 #include "LogStatistics.h"
@@ -37,6 +38,7 @@
 class SerializedLogBuffer final : public LogBuffer {
   public:
     SerializedLogBuffer(LogReaderList* reader_list, LogTags* tags, LogStatistics* stats);
+    ~SerializedLogBuffer();
     void Init() override;
 
     int Log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid, const char* msg,
@@ -55,6 +57,29 @@ class SerializedLogBuffer final : public LogBuffer {
     uint64_t sequence() const override { return sequence_.load(std::memory_order_relaxed); }
 
   private:
+    // Writers push their entry onto staged_logs_ without holding logd_lock.  Whichever writer
+    // holds logd_lock then publishes every entry pushed so far into logs_, so under contention one
+    // lock acquisition covers many writers.  Entries get their sequence number when published, so
+    // a writer that is preempted before pushing its entry never holds up anyone else.
+    struct StagedLog {
+        StagedLog* next = nullptr;
+        log_id_t log_id;
+        log_time realtime;
+        uid_t uid;
+        pid_t pid;
+        pid_t tid;
+        // Each thread reuses its own entry, so only a message longer than any previous one from
+        // that thread allocates.
+        std::vector<char> msg;
+        // Set once the entry is in logs_, after which the publisher no longer touches it.
+        std::atomic<bool> published = false;
+    };
+    // How many times Log() polls for another writer to publish its entry before blocking on
+    // logd_lock.
+    static constexpr int kPublishSpins = 16;
+
+    void PublishStagedLogs() REQUIRES(logd_lock);
+    void LogToChunk(uint64_t sequence, const StagedLog& staged) REQUIRES(logd_lock);
     bool ShouldLog(log_id_t log_id, const char* msg, uint16_t len);
     void MaybePrune(log_id_t log_id) REQUIRES(logd_lock);
     void Prune(log_id_t log_id, size_t bytes_to_free, uid_t uid) REQUIRES(logd_lock);
@@ -65,8 +90,14 @@ class SerializedLogBuffer final : public LogBuffer {
     LogTags* tags_;
     LogStatistics* stats_;
 
+    // Must outlive logs_, as chunks cancel their pending compression when destroyed.
+    std::unique_ptr<ChunkCompressor> compressor_;
+
     size_t max_size_[LOG_ID_MAX] GUARDED_BY(logd_lock) = {};
     std::list<SerializedLogChunk> logs_[LOG_ID_MAX] GUARDED_BY(logd_lock);
 
     std::atomic<uint64_t> sequence_ = 1;
+
+    // Entries pushed by writers that are not yet published, most recent first.
+    std::atomic<StagedLog*> staged_logs_ = nullptr;
 };
@@ -16,18 +16,81 @@
 
 #include "SerializedLogChunk.h"
 
+#include <utility>
+
 #include <android-base/logging.h>
 
 #include "CompressionEngine.h"
 #include "SerializedFlushToState.h"
 
+// Derives two bit indexes from a single multiplicative hash of |value|.
+template <size_t N>
+static std::pair<size_t, size_t> BloomIndexes(uint32_t value) {
+    static_assert((N & (N - 1)) == 0, "bloom filter size must be a power of two");
+    uint64_t hash = (static_cast<uint64_t>(value) + 1) * 0x9e3779b97f4a7c15ULL;
+    return {(hash >> 32) & (N - 1), (hash >> 48) & (N - 1)};
+}
+
+template <size_t N>
+void SerializedLogChunkSummary::BloomAdd(std::bitset<N>& bloom, uint32_t value) {
+    auto [first, second] = BloomIndexes<N>(value);
+    bloom.set(first);
+    bloom.set(second);
+}
+
+template <size_t N>
+bool SerializedLogChunkSummary::BloomMayContain(const std::bitset<N>& bloom, uint32_t value) {
+    auto [first, second] = BloomIndexes<N>(value);
+    return bloom.test(first) && bloom.test(second);
+}
+
+void SerializedLogChunkSummary::Add(uint64_t sequence, log_time realtime, uid_t uid, pid_t pid) {
+    if (count_++ == 0) {
+        lowest_sequence_number_ = sequence;
+        min_realtime_ = realtime;
+        max_realtime_ = realtime;
+    } else {
+        // Realtime may go backwards, so both bounds are tracked.
+        if (realtime < min_realtime_) min_realtime_ = realtime;
+        if (realtime > max_realtime_) max_realtime_ = realtime;
+    }
+    BloomAdd(uids_, uid);
+    BloomAdd(pids_, static_cast<uint32_t>(pid));
+}
+
+bool SerializedLogChunkSummary::MayMatch(pid_t pid, std::optional<uid_t> uid,
+                                         log_time start_time) const {
+    if (count_ == 0) {
+        return false;
+    }
+    if (start_time != log_time::EPOCH && max_realtime_ < start_time) {
+        return false;
+    }
+    if (pid != 0 && !BloomMayContain(pids_, static_cast<uint32_t>(pid))) {
+        return false;
+    }
+    if (uid && !BloomMayContain(uids_, *uid)) {
+        return false;
+    }
+    return true;
+}
+
 SerializedLogChunk::~SerializedLogChunk() {
     CHECK_EQ(reader_ref_count_, 0U);
+    if (compression_pending_) {
+        compressor_->Cancel(this);
+    }
 }
 
 void SerializedLogChunk::Compress() {
     CHECK_EQ(compressed_log_.size(), 0U);
-    CompressionEngine::GetInstance().Compress(contents_, write_offset_, compressed_log_);
+    if (compressor_ != nullptr) {
+        engine_ = compressor_->engine();
+        compressor_->Compress(*engine_, contents_, write_offset_, compressed_log_);
+    } else {
+        engine_ = CompressionEngine::GetInstance();
+        engine_->Compress(contents_, write_offset_, compressed_log_);
+    }
     LOG(VERBOSE) << "Compressed Log, buffer max size: " << contents_.size()
                  << " size used: " << write_offset_
                  << " compressed size: " << compressed_log_.size();
@@ -36,11 +99,11 @@ void SerializedLogChunk::Compress() {
 // TODO: Develop a better reference counting strategy to guard against the case where the writer is
 // much faster than the reader, and we needlessly compess / decompress the logs.
 void SerializedLogChunk::IncReaderRefCount() {
-    if (++reader_ref_count_ != 1 || writer_active_) {
+    if (++reader_ref_count_ != 1 || writer_active_ || compression_pending_) {
         return;
     }
     contents_.Resize(write_offset_);
-    CompressionEngine::GetInstance().Decompress(compressed_log_, contents_);
+    engine_->Decompress(compressed_log_, contents_);
 }
 
 void SerializedLogChunk::DecReaderRefCount() {
@@ -48,7 +111,18 @@ void SerializedLogChunk::DecReaderRefCount() {
     if (--reader_ref_count_ != 0) {
         return;
     }
-    if (!writer_active_) {
+    if (!writer_active_ && !compression_pending_) {
+        contents_.Resize(0);
+    }
+}
+
+void SerializedLogChunk::SetCompressed(SerializedData&& compressed_log,
+                                       std::shared_ptr<CompressionEngine> engine) {
+    CHECK(compression_pending_);
+    compression_pending_ = false;
+    compressed_log_ = std::move(compressed_log);
+    engine_ = std::move(engine);
+    if (reader_ref_count_ == 0) {
         contents_.Resize(0);
     }
 }
@@ -83,6 +157,7 @@ bool SerializedLogChunk::ClearUidLogs(uid_t uid, log_id_t log_id, LogStatistics*
 
     int read_offset = 0;
     int new_write_offset = 0;
+    SerializedLogChunkSummary new_summary;
     while (read_offset < write_offset_) {
         const auto* entry = log_entry(read_offset);
         if (entry->uid() == uid) {
@@ -92,6 +167,7 @@ bool SerializedLogChunk::ClearUidLogs(uid_t uid, log_id_t log_id, LogStatistics*
             }
             continue;
         }
+        new_summary.Add(entry->sequence(), entry->realtime(), entry->uid(), entry->pid());
         size_t entry_total_len = entry->total_len();
         if (read_offset != new_write_offset) {
             memmove(contents_.data() + new_write_offset, contents_.data() + read_offset,
@@ -110,6 +186,11 @@ bool SerializedLogChunk::ClearUidLogs(uid_t uid, log_id_t log_id, LogStatistics*
     // partially cleared log.
     if (new_write_offset != write_offset_) {
         write_offset_ = new_write_offset;
+        summary_ = new_summary;
+        if (compression_pending_) {
+            compressor_->Cancel(this);
+            compression_pending_ = false;
+        }
         if (!writer_active_) {
             compressed_log_.Resize(0);
             Compress();
@@ -132,5 +213,6 @@ SerializedLogEntry* SerializedLogChunk::Log(uint64_t sequence, log_time realtime
     memcpy(entry->msg(), msg, len);
     write_offset_ += entry->total_len();
     highest_sequence_number_ = sequence;
+    summary_.Add(sequence, realtime, uid, pid);
     return entry;
 }
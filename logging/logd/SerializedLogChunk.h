@@ -18,10 +18,15 @@
 
 #include <sys/types.h>
 
+#include <bitset>
+#include <memory>
+#include <optional>
 #include <vector>
 
 #include <android-base/logging.h>
 
+#include "ChunkCompressor.h"
+#include "CompressionEngine.h"
 #include "LogWriter.h"
 #include "LogdLock.h"
 #include "SerializedData.h"
@@ -29,9 +34,45 @@
 
 class SerializedFlushToState;
 
+// A summary of the logs held in a SerializedLogChunk, updated as each log is written, that lets
+// readers rule out a whole chunk without decompressing it.  The pid and uid sets are bloom filters,
+// so MayMatch() can return false positives but never false negatives.
+class SerializedLogChunkSummary {
+  public:
+    void Add(uint64_t sequence, log_time realtime, uid_t uid, pid_t pid);
+
+    // Returns false only if no log in the chunk is from |pid| (if non-zero), is from |uid| (if
+    // set) and has a realtime at or after |start_time|.
+    bool MayMatch(pid_t pid, std::optional<uid_t> uid, log_time start_time) const;
+
+    bool empty() const { return count_ == 0; }
+    uint64_t lowest_sequence_number() const { return lowest_sequence_number_; }
+    log_time min_realtime() const { return min_realtime_; }
+    log_time max_realtime() const { return max_realtime_; }
+
+  private:
+    static constexpr size_t kPidBloomBits = 512;
+    static constexpr size_t kUidBloomBits = 256;
+
+    template <size_t N>
+    static void BloomAdd(std::bitset<N>& bloom, uint32_t value);
+    template <size_t N>
+    static bool BloomMayContain(const std::bitset<N>& bloom, uint32_t value);
+
+    size_t count_ = 0;
+    uint64_t lowest_sequence_number_ = 0;
+    log_time min_realtime_{log_time::EPOCH};
+    log_time max_realtime_{log_time::EPOCH};
+    std::bitset<kPidBloomBits> pids_;
+    std::bitset<kUidBloomBits> uids_;
+};
+
 class SerializedLogChunk {
   public:
-    explicit SerializedLogChunk(size_t size) : contents_(size) {}
+    // Finished chunks are compressed by |compressor| if set, otherwise synchronously by the default
+    // engine.
+    explicit SerializedLogChunk(size_t size, ChunkCompressor* compressor = nullptr)
+        : contents_(size), compressor_(compressor) {}
     SerializedLogChunk(SerializedLogChunk&& other) noexcept = default;
     ~SerializedLogChunk();
 
@@ -59,12 +100,18 @@ class SerializedLogChunk {
 
     void FinishWriting() {
         writer_active_ = false;
-        Compress();
-        if (reader_ref_count_ == 0) {
+        compression_pending_ = compressor_ != nullptr && compressor_->Enqueue(this);
+        if (!compression_pending_) {
+            Compress();
+        }
+        if (!compression_pending_ && reader_ref_count_ == 0) {
             contents_.Resize(0);
         }
     }
 
+    // Called by ChunkCompressor with the compressed contents of this chunk.
+    void SetCompressed(SerializedData&& compressed_log, std::shared_ptr<CompressionEngine> engine);
+
     const SerializedLogEntry* log_entry(int offset) const {
         CHECK(writer_active_ || reader_ref_count_ > 0);
         return reinterpret_cast<const SerializedLogEntry*>(data() + offset);
@@ -72,6 +119,8 @@ class SerializedLogChunk {
     const uint8_t* data() const { return contents_.data(); }
     int write_offset() const { return write_offset_; }
     uint64_t highest_sequence_number() const { return highest_sequence_number_; }
+    const SerializedLogChunkSummary& summary() const { return summary_; }
+    bool compression_pending() const { return compression_pending_; }
 
     // Exposed for testing
     uint32_t reader_ref_count() const { return reader_ref_count_; }
@@ -84,6 +133,12 @@ class SerializedLogChunk {
     uint32_t reader_ref_count_ = 0;
     bool writer_active_ = true;
     uint64_t highest_sequence_number_ = 1;
+    SerializedLogChunkSummary summary_;
     SerializedData compressed_log_;
+    // The engine that compressed compressed_log_.
+    std::shared_ptr<CompressionEngine> engine_;
+    ChunkCompressor* compressor_ = nullptr;
+    // Queued in or being compressed by compressor_.  contents_ is kept until this is cleared.
+    bool compression_pending_ = false;
     std::vector<SerializedFlushToState*> readers_;
 };
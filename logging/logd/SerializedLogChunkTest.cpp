@@ -16,7 +16,11 @@
 
 #include "SerializedLogChunk.h"
 
+#include <chrono>
 #include <limits>
+#include <list>
+#include <optional>
+#include <thread>
 
 #include <android-base/silent_death_test.h>
 #include <android-base/stringprintf.h>
@@ -304,3 +308,215 @@ TEST(SerializedLogChunk, ClearUidLogs_then_FinishWriting) {
     chunk.IncReaderRefCount();
     chunk.DecReaderRefCount();
 }
+
+static std::string NumberedMessage(size_t i) {
+    return StringPrintf("numbered log message %zu from pid %zu", i, i % 37);
+}
+
+static void LogNumberedMessages(SerializedLogChunk& chunk, uint64_t first_sequence, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        auto message = NumberedMessage(i);
+        ASSERT_NE(nullptr, chunk.Log(first_sequence + i, log_time(), 1000, 1, 2, message.c_str(),
+                                     message.size()));
+    }
+}
+
+static void CheckNumberedMessages(SerializedLogChunk& chunk, uint64_t first_sequence,
+                                  size_t count) {
+    chunk.IncReaderRefCount();
+    int read_offset = 0;
+    for (size_t i = 0; i < count && read_offset < chunk.write_offset(); ++i) {
+        auto* entry = chunk.log_entry(read_offset);
+        EXPECT_EQ(first_sequence + i, entry->sequence());
+        EXPECT_EQ(NumberedMessage(i), std::string(entry->msg(), entry->msg_len()));
+        read_offset += entry->total_len();
+    }
+    EXPECT_EQ(chunk.write_offset(), read_offset);
+    chunk.DecReaderRefCount();
+}
+
+static void WaitForCompression(SerializedLogChunk& chunk) {
+    for (int retry = 0; retry < 1000; ++retry) {
+        {
+            auto lock = std::lock_guard{logd_lock};
+            if (!chunk.compression_pending()) {
+                return;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    FAIL() << "Timed out waiting for the chunk to be compressed";
+}
+
+static void CheckRoundTrip(CompressionEngine& engine, const std::string& input) {
+    SerializedData in(input.size());
+    memcpy(in.data(), input.data(), input.size());
+    SerializedData compressed;
+    ASSERT_TRUE(engine.Compress(in, in.size(), compressed));
+    EXPECT_LT(compressed.size(), input.size());
+
+    SerializedData out(input.size());
+    ASSERT_TRUE(engine.Decompress(compressed, out));
+    EXPECT_EQ(input, std::string(reinterpret_cast<char*>(out.data()), out.size()));
+}
+
+TEST(CompressionEngine, round_trip) {
+    std::string input;
+    for (size_t i = 0; i < 1000; ++i) {
+        input += NumberedMessage(i);
+    }
+
+    for (const auto& name : {"zlib", "zstd", "zstd-dict", "lz4"}) {
+        SCOPED_TRACE(name);
+        auto engine = CompressionEngine::Create(name);
+        ASSERT_NE(nullptr, engine);
+        CheckRoundTrip(*engine, input);
+    }
+    EXPECT_EQ(nullptr, CompressionEngine::Create("unknown"));
+}
+
+TEST(CompressionEngine, zstd_dictionary) {
+    std::vector<uint8_t> samples;
+    std::vector<size_t> sample_sizes;
+    for (size_t i = 0; i < 4000; ++i) {
+        auto message = NumberedMessage(i);
+        samples.insert(samples.end(), message.begin(), message.end());
+        sample_sizes.emplace_back(message.size());
+    }
+    auto dictionary = ZstdCompressionEngine::Train(samples, sample_sizes, 4096);
+    ASSERT_FALSE(dictionary.empty());
+    EXPECT_LE(dictionary.size(), 4096U);
+
+    ZstdCompressionEngine engine{std::move(dictionary)};
+    EXPECT_STREQ("zstd-dict", engine.name());
+    CheckRoundTrip(engine, NumberedMessage(4321) + NumberedMessage(4322));
+}
+
+TEST(SerializedLogChunk, background_compression) {
+    static constexpr size_t kChunkSize = 10 * 4096;
+    LogStatistics stats{false, true};
+    ChunkCompressor compressor{CompressionEngine::Create("lz4"), false, &stats};
+
+    SerializedLogChunk chunk{kChunkSize, &compressor};
+    LogNumberedMessages(chunk, 1, 500);
+    {
+        auto lock = std::lock_guard{logd_lock};
+        chunk.FinishWriting();
+        EXPECT_TRUE(chunk.compression_pending());
+        // The uncompressed contents are read until the compressor is done.
+        CheckNumberedMessages(chunk, 1, 500);
+    }
+
+    WaitForCompression(chunk);
+    auto lock = std::lock_guard{logd_lock};
+    EXPECT_LT(chunk.PruneSize(), kChunkSize);
+    CheckNumberedMessages(chunk, 1, 500);
+
+    auto compression_stats = stats.GetCompressionStatistics("lz4");
+    EXPECT_EQ(1U, compression_stats.chunks);
+    EXPECT_EQ(static_cast<uint64_t>(chunk.write_offset()), compression_stats.input_bytes);
+}
+
+// Chunks that can't be queued are compressed synchronously, and chunks destroyed while queued are
+// removed from the queue.
+TEST(SerializedLogChunk, background_compression_queue_full) {
+    static constexpr size_t kChunkSize = 4096;
+    LogStatistics stats{false, true};
+    ChunkCompressor compressor{CompressionEngine::Create("zstd"), false, &stats};
+
+    auto lock = std::lock_guard{logd_lock};
+    std::list<SerializedLogChunk> chunks;
+    for (size_t i = 0; i <= ChunkCompressor::kMaxPendingChunks; ++i) {
+        auto& chunk = chunks.emplace_back(kChunkSize, &compressor);
+        LogNumberedMessages(chunk, 1, 10);
+        // The compressor thread can't dequeue chunks while logd_lock is held.
+        chunk.FinishWriting();
+        EXPECT_EQ(i < ChunkCompressor::kMaxPendingChunks, chunk.compression_pending());
+    }
+    for (auto& chunk : chunks) {
+        CheckNumberedMessages(chunk, 1, 10);
+    }
+    chunks.clear();
+}
+
+// The compressor switches to a trained zstd dictionary once it has seen enough logs, and chunks
+// compressed with and without a dictionary all remain readable.
+TEST(SerializedLogChunk, background_compression_trains_dictionary) {
+    static constexpr size_t kChunkSize = 128 * 1024;
+    LogStatistics stats{false, true};
+    ChunkCompressor compressor{CompressionEngine::Create("zstd-dict"), true, &stats};
+
+    std::list<SerializedLogChunk> chunks;
+    for (int retry = 0; retry < 100; ++retry) {
+        {
+            auto lock = std::lock_guard{logd_lock};
+            if (!strcmp("zstd-dict", compressor.engine()->name())) {
+                break;
+            }
+        }
+        auto& chunk = chunks.emplace_back(kChunkSize, &compressor);
+        LogNumberedMessages(chunk, 1, 1000);
+        {
+            auto lock = std::lock_guard{logd_lock};
+            chunk.FinishWriting();
+        }
+        WaitForCompression(chunk);
+    }
+
+    auto& chunk = chunks.emplace_back(kChunkSize, &compressor);
+    LogNumberedMessages(chunk, 1, 1000);
+    {
+        auto lock = std::lock_guard{logd_lock};
+        EXPECT_STREQ("zstd-dict", compressor.engine()->name());
+        chunk.FinishWriting();
+    }
+    WaitForCompression(chunk);
+
+    auto lock = std::lock_guard{logd_lock};
+    EXPECT_EQ(1U, stats.GetCompressionStatistics("zstd-dict").chunks);
+    for (auto& chunk : chunks) {
+        CheckNumberedMessages(chunk, 1, 1000);
+    }
+    chunks.clear();
+}
+
+TEST(SerializedLogChunk, summary) {
+    const auto kEpoch = log_time(log_time::EPOCH);
+    auto chunk = SerializedLogChunk{4096};
+    EXPECT_TRUE(chunk.summary().empty());
+    EXPECT_FALSE(chunk.summary().MayMatch(0, std::nullopt, kEpoch));
+
+    chunk.Log(10, log_time(200, 0), 1000, 1, 1, "abc", 3);
+    chunk.Log(11, log_time(100, 0), 1000, 2, 2, "abc", 3);
+    chunk.Log(12, log_time(300, 0), 2000, 3, 3, "abc", 3);
+
+    const auto& summary = chunk.summary();
+    EXPECT_EQ(10U, summary.lowest_sequence_number());
+    EXPECT_EQ(log_time(100, 0), summary.min_realtime());
+    EXPECT_EQ(log_time(300, 0), summary.max_realtime());
+
+    EXPECT_TRUE(summary.MayMatch(0, std::nullopt, kEpoch));
+    for (pid_t pid : {1, 2, 3}) {
+        EXPECT_TRUE(summary.MayMatch(pid, std::nullopt, kEpoch)) << pid;
+    }
+    EXPECT_TRUE(summary.MayMatch(0, 1000, kEpoch));
+    EXPECT_TRUE(summary.MayMatch(0, 2000, kEpoch));
+    EXPECT_TRUE(summary.MayMatch(0, std::nullopt, log_time(300, 0)));
+    EXPECT_FALSE(summary.MayMatch(0, std::nullopt, log_time(300, 1)));
+
+    // The bloom filters may have false positives, but nearly all absent values are ruled out.
+    int pid_matches = 0;
+    int uid_matches = 0;
+    for (int i = 100; i < 1100; ++i) {
+        pid_matches += summary.MayMatch(i, std::nullopt, kEpoch);
+        uid_matches += summary.MayMatch(0, 10000 + i, kEpoch);
+    }
+    EXPECT_LT(pid_matches, 10);
+    EXPECT_LT(uid_matches, 10);
+
+    // Clearing a uid recomputes the summary from the remaining logs.
+    EXPECT_FALSE(chunk.ClearUidLogs(2000, LOG_ID_MAIN, nullptr));
+    EXPECT_EQ(log_time(200, 0), chunk.summary().max_realtime());
+    EXPECT_FALSE(chunk.summary().MayMatch(0, std::nullopt, log_time(250, 0)));
+    EXPECT_FALSE(chunk.summary().MayMatch(3, std::nullopt, kEpoch));
+}
@@ -43,18 +43,22 @@ bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* f
   auto it = loc_regs_.upper_bound(pc);
   if (it == loc_regs_.end() || pc < it->second.pc_start) {
     last_error_.code = DWARF_ERROR_NONE;
-    const DwarfFde* fde = GetFdeFromPc(pc);
-    if (fde == nullptr || fde->cie == nullptr) {
-      last_error_.code = DWARF_ERROR_ILLEGAL_STATE;
-      return false;
-    }
-
-    // Now get the location information for this pc.
     DwarfLocations loc_regs;
-    if (!GetCfaLocationInfo(pc, fde, &loc_regs, regs->Arch())) {
-      return false;
+    // A precomputed table already has the rules, without any fde decoding.
+    if (unwind_table_ == nullptr ||
+        !unwind_table_->GetLocations(unwind_table_section_, pc, &loc_regs)) {
+      const DwarfFde* fde = GetFdeFromPc(pc);
+      if (fde == nullptr || fde->cie == nullptr) {
+        last_error_.code = DWARF_ERROR_ILLEGAL_STATE;
+        return false;
+      }
+
+      // Now get the location information for this pc.
+      if (!GetCfaLocationInfo(pc, fde, &loc_regs, regs->Arch())) {
+        return false;
+      }
+      loc_regs.cie = fde->cie;
     }
-    loc_regs.cie = fde->cie;
 
     // Store it in the cache.
     it = loc_regs_.emplace(loc_regs.pc_end, std::move(loc_regs)).first;
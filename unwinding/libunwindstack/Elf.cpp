@@ -30,6 +30,7 @@
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
+#include <unwindstack/UnwindTable.h>
 
 #include "ElfInterfaceArm.h"
 #include "Symbols.h"
@@ -39,6 +40,14 @@ namespace unwindstack {
 bool Elf::cache_enabled_;
 std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>* Elf::cache_;
 std::mutex* Elf::cache_lock_;
+std::string* Elf::unwind_table_dir_;
+bool Elf::symbol_index_enabled_;
+
+Elf::~Elf() {
+  // The symbol index may still be reading memory_ from a background thread,
+  // so the interface has to go first.
+  interface_.reset();
+}
 
 bool Elf::Init() {
   load_bias_ = 0;
@@ -55,6 +64,16 @@ bool Elf::Init() {
   if (valid_) {
     interface_->InitHeaders();
     InitGnuDebugdata();
+    // Only memory that maps the whole elf can be read from another thread.
+    if (symbol_index_enabled_ && memory_->GetPtr() != nullptr) {
+      interface_->BuildSymbolIndexAsync();
+    }
+    if (unwind_table_dir_ != nullptr) {
+      std::string build_id = GetBuildID();
+      if (!build_id.empty()) {
+        LoadUnwindTable(*unwind_table_dir_ + '/' + UnwindTable::GetFileName(build_id));
+      }
+    }
   } else {
     interface_.reset(nullptr);
   }
@@ -154,6 +173,34 @@ std::string Elf::GetBuildID() {
   return interface_->GetBuildID();
 }
 
+bool Elf::LoadUnwindTable(const std::string& path) {
+  if (!valid_) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  // The row caches of the DwarfSections point at cies in the current table,
+  // so it has to live as long as they do.
+  if (unwind_table_ != nullptr) {
+    return false;
+  }
+
+  std::unique_ptr<UnwindTable> table = UnwindTable::Open(path, GetBuildID(), arch_);
+  if (table == nullptr) {
+    return false;
+  }
+
+  interface_->SetUnwindTable(table.get(), UnwindTable::SECTION_DEBUG_FRAME,
+                             UnwindTable::SECTION_EH_FRAME);
+  if (gnu_debugdata_interface_ != nullptr) {
+    gnu_debugdata_interface_->SetUnwindTable(table.get(),
+                                             UnwindTable::SECTION_GNU_DEBUGDATA_DEBUG_FRAME,
+                                             UnwindTable::SECTION_GNU_DEBUGDATA_EH_FRAME);
+  }
+  unwind_table_ = std::move(table);
+  return true;
+}
+
 void Elf::GetLastError(ErrorData* data) {
   if (valid_) {
     *data = interface_->last_error();
@@ -360,6 +407,11 @@ void Elf::SetCachingEnabled(bool enable) {
   }
 }
 
+void Elf::SetUnwindTableDirectory(const std::string& dir) {
+  delete unwind_table_dir_;
+  unwind_table_dir_ = dir.empty() ? nullptr : new std::string(dir);
+}
+
 void Elf::CacheLock() {
   cache_lock_->lock();
 }
@@ -450,6 +450,23 @@ bool ElfInterfaceImpl<ElfTypes>::GetGlobalVariable(const std::string& name,
   return false;
 }
 
+template <typename ElfTypes>
+void ElfInterfaceImpl<ElfTypes>::BuildSymbolIndexAsync() {
+  for (const auto symbol : symbols_) {
+    symbol->template BuildIndexAsync<SymType>(memory_);
+  }
+}
+
+void ElfInterface::SetUnwindTable(UnwindTable* table, UnwindTable::Section debug_frame_section,
+                                  UnwindTable::Section eh_frame_section) {
+  if (debug_frame_ != nullptr) {
+    debug_frame_->SetUnwindTable(table, debug_frame_section);
+  }
+  if (eh_frame_ != nullptr) {
+    eh_frame_->SetUnwindTable(table, eh_frame_section);
+  }
+}
+
 bool ElfInterface::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
                         bool* is_signal_frame) {
   last_error_.code = ERROR_NONE;
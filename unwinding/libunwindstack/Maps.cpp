@@ -28,9 +28,12 @@
 #include <procinfo/process_map.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <unwindstack/Elf.h>
@@ -39,6 +42,16 @@
 
 namespace unwindstack {
 
+static uint64_t GetMapFlags(const android::procinfo::MapInfo& mapinfo) {
+  // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
+  auto flags = mapinfo.flags;
+  if (strncmp(mapinfo.name.c_str(), "/dev/", 5) == 0 &&
+      strncmp(mapinfo.name.c_str() + 5, "ashmem/", 7) != 0) {
+    flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
+  }
+  return flags;
+}
+
 MapInfo* Maps::Find(uint64_t pc) {
   if (maps_.empty()) {
     return nullptr;
@@ -64,14 +77,8 @@ bool Maps::Parse() {
   MapInfo* prev_real_map = nullptr;
   return android::procinfo::ReadMapFile(GetMapsFile(),
                       [&](const android::procinfo::MapInfo& mapinfo) {
-    // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
-    auto flags = mapinfo.flags;
-    if (strncmp(mapinfo.name.c_str(), "/dev/", 5) == 0 &&
-        strncmp(mapinfo.name.c_str() + 5, "ashmem/", 7) != 0) {
-      flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
-    }
     maps_.emplace_back(new MapInfo(prev_map, prev_real_map, mapinfo.start, mapinfo.end,
-                                   mapinfo.pgoff, flags, mapinfo.name));
+                                   mapinfo.pgoff, GetMapFlags(mapinfo), mapinfo.name));
     prev_map = maps_.back().get();
     if (!prev_map->IsBlank()) {
       prev_real_map = prev_map;
@@ -118,14 +125,8 @@ bool BufferMaps::Parse() {
   MapInfo* prev_real_map = nullptr;
   return android::procinfo::ReadMapFileContent(
       &content[0], [&](const android::procinfo::MapInfo& mapinfo) {
-        // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
-        auto flags = mapinfo.flags;
-        if (strncmp(mapinfo.name.c_str(), "/dev/", 5) == 0 &&
-            strncmp(mapinfo.name.c_str() + 5, "ashmem/", 7) != 0) {
-          flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
-        }
         maps_.emplace_back(new MapInfo(prev_map, prev_real_map, mapinfo.start, mapinfo.end,
-                                       mapinfo.pgoff, flags, mapinfo.name));
+                                       mapinfo.pgoff, GetMapFlags(mapinfo), mapinfo.name));
         prev_map = maps_.back().get();
         if (!prev_map->IsBlank()) {
           prev_real_map = prev_map;
@@ -141,106 +142,178 @@ const std::string LocalUpdatableMaps::GetMapsFile() const {
   return "/proc/self/maps";
 }
 
-LocalUpdatableMaps::LocalUpdatableMaps() : Maps() {
-  pthread_rwlock_init(&maps_rwlock_, nullptr);
+// The ranges of the maps in a flat sorted array, so that a search touches
+// as little memory as possible.
+struct LocalUpdatableMaps::Snapshot {
+  struct Entry {
+    uint64_t start;
+    uint64_t end;
+    MapInfo* map_info;
+  };
+  std::vector<Entry> entries;
+
+  MapInfo* Find(uint64_t pc) const {
+    auto entry = std::upper_bound(entries.begin(), entries.end(), pc,
+                                  [](uint64_t pc, const Entry& entry) { return pc < entry.start; });
+    if (entry == entries.begin()) {
+      return nullptr;
+    }
+    --entry;
+    return pc < entry->end ? entry->map_info : nullptr;
+  }
+};
+
+LocalUpdatableMaps::LocalUpdatableMaps() : Maps() {}
+
+LocalUpdatableMaps::~LocalUpdatableMaps() {
+  delete snapshot_.load();
 }
 
-MapInfo* LocalUpdatableMaps::Find(uint64_t pc) {
-  pthread_rwlock_rdlock(&maps_rwlock_);
-  MapInfo* map_info = Maps::Find(pc);
-  pthread_rwlock_unlock(&maps_rwlock_);
+MapInfo* LocalUpdatableMaps::FindInSnapshot(uint64_t pc) {
+  // Register as a reader of the current generation. If the generation moved
+  // on before the registration was visible, the publisher may not have seen
+  // it, so try again.
+  std::atomic_size_t* readers;
+  while (true) {
+    uint64_t generation = generation_.load();
+    readers = &readers_[generation & 1];
+    readers->fetch_add(1);
+    if (generation_.load() == generation) {
+      break;
+    }
+    readers->fetch_sub(1);
+  }
+
+  const Snapshot* snapshot = snapshot_.load();
+  MapInfo* map_info = snapshot != nullptr ? snapshot->Find(pc) : nullptr;
+  readers->fetch_sub(1);
+  return map_info;
+}
 
+void LocalUpdatableMaps::PublishSnapshot() {
+  Snapshot* snapshot = new Snapshot;
+  snapshot->entries.reserve(maps_.size());
+  for (const auto& map_info : maps_) {
+    snapshot->entries.push_back({map_info->start(), map_info->end(), map_info.get()});
+  }
+
+  Snapshot* old_snapshot = snapshot_.exchange(snapshot);
+  uint64_t generation = generation_.fetch_add(1);
+  // Any reader that could still see the old snapshot registered in the
+  // slot of the previous generation. Readers only hold a snapshot for the
+  // length of one search.
+  while (readers_[generation & 1].load() != 0) {
+    std::this_thread::yield();
+  }
+  delete old_snapshot;
+}
+
+MapInfo* LocalUpdatableMaps::Find(uint64_t pc) {
+  MapInfo* map_info = FindInSnapshot(pc);
   if (map_info == nullptr) {
-    pthread_rwlock_wrlock(&maps_rwlock_);
+    std::lock_guard<std::mutex> guard(update_mutex_);
+    // Another thread may have reparsed while this one waited for the lock.
+    map_info = Maps::Find(pc);
     // This is guaranteed not to invalidate any previous MapInfo objects so
     // we don't need to worry about any MapInfo* values already in use.
-    if (Reparse()) {
+    if (map_info == nullptr && ReparseLocked(nullptr)) {
       map_info = Maps::Find(pc);
     }
-    pthread_rwlock_unlock(&maps_rwlock_);
   }
 
   return map_info;
 }
 
 bool LocalUpdatableMaps::Parse() {
-  pthread_rwlock_wrlock(&maps_rwlock_);
+  std::lock_guard<std::mutex> guard(update_mutex_);
   bool parsed = Maps::Parse();
-  pthread_rwlock_unlock(&maps_rwlock_);
+  PublishSnapshot();
   return parsed;
 }
 
 bool LocalUpdatableMaps::Reparse(/*out*/ bool* any_changed) {
-  // New maps will be added at the end without deleting the old ones.
-  size_t last_map_idx = maps_.size();
-  if (!Maps::Parse()) {
-    maps_.resize(last_map_idx);
+  std::lock_guard<std::mutex> guard(update_mutex_);
+  return ReparseLocked(any_changed);
+}
+
+bool LocalUpdatableMaps::ReparseLocked(bool* any_changed) {
+  // Walk the new maps alongside the current ones, which are sorted the same
+  // way. A map that matches a current one reuses it, along with any Elf it
+  // has already created, without allocating anything. Nothing is changed
+  // until the whole file has been read.
+  struct NewMap {
+    size_t old_index;
+    std::unique_ptr<MapInfo> map_info;
+  };
+  static constexpr size_t kNotReused = SIZE_MAX;
+  std::vector<NewMap> new_maps;
+  new_maps.reserve(maps_.size());
+  size_t old_index = 0;
+  size_t num_added = 0;
+  MapInfo* prev_map = nullptr;
+  MapInfo* prev_real_map = nullptr;
+  bool parsed = android::procinfo::ReadMapFile(
+      GetMapsFile(), [&](const android::procinfo::MapInfo& mapinfo) {
+        uint64_t flags = GetMapFlags(mapinfo);
+        // Skip the current maps that come before this one, they are gone.
+        while (old_index < maps_.size() && maps_[old_index]->start() < mapinfo.start) {
+          old_index++;
+        }
+        MapInfo* map_info = nullptr;
+        if (old_index < maps_.size()) {
+          MapInfo* info = maps_[old_index].get();
+          if (info->start() == mapinfo.start && info->end() == mapinfo.end &&
+              info->flags() == flags && info->name() == mapinfo.name) {
+            new_maps.push_back({old_index++, nullptr});
+            map_info = info;
+          }
+        }
+        if (map_info == nullptr) {
+          new_maps.push_back({kNotReused, std::make_unique<MapInfo>(
+                                              prev_map, prev_real_map, mapinfo.start, mapinfo.end,
+                                              mapinfo.pgoff, flags, mapinfo.name)});
+          map_info = new_maps.back().map_info.get();
+          num_added++;
+        }
+        prev_map = map_info;
+        if (!prev_map->IsBlank()) {
+          prev_real_map = prev_map;
+        }
+      });
+  if (!parsed) {
     return false;
   }
 
-  size_t search_map_idx = 0;
-  size_t num_deleted_old_entries = 0;
-  size_t num_deleted_new_entries = 0;
-  for (size_t new_map_idx = last_map_idx; new_map_idx < maps_.size(); new_map_idx++) {
-    auto& new_map_info = maps_[new_map_idx];
-    uint64_t start = new_map_info->start();
-    uint64_t end = new_map_info->end();
-    uint64_t flags = new_map_info->flags();
-    const std::string& name = new_map_info->name();
-    for (size_t old_map_idx = search_map_idx; old_map_idx < last_map_idx; old_map_idx++) {
-      auto& info = maps_[old_map_idx];
-      if (start == info->start() && end == info->end() && flags == info->flags() &&
-          name == info->name()) {
-        // No need to check
-        search_map_idx = old_map_idx + 1;
-        if (new_map_idx + 1 < maps_.size()) {
-          maps_[new_map_idx + 1]->set_prev_map(info.get());
-          maps_[new_map_idx + 1]->set_prev_real_map(info->IsBlank() ? info->prev_real_map()
-                                                                    : info.get());
-        }
-        maps_[new_map_idx] = nullptr;
-        num_deleted_new_entries++;
-        break;
-      } else if (info->start() > start) {
-        // Stop, there isn't going to be a match.
-        search_map_idx = old_map_idx;
-        break;
+  size_t num_reused = new_maps.size() - num_added;
+  size_t num_removed = maps_.size() - num_reused;
+  if (num_added != 0 || num_removed != 0) {
+    std::vector<std::unique_ptr<MapInfo>> maps;
+    maps.reserve(new_maps.size());
+    for (auto& new_map : new_maps) {
+      if (new_map.old_index == kNotReused) {
+        maps.emplace_back(std::move(new_map.map_info));
+      } else {
+        maps.emplace_back(std::move(maps_[new_map.old_index]));
       }
-
-      // Never delete these maps, they may be in use. The assumption is
-      // that there will only every be a handful of these so waiting
-      // to destroy them is not too expensive.
-      saved_maps_.emplace_back(std::move(info));
-      search_map_idx = old_map_idx + 1;
-      maps_[old_map_idx] = nullptr;
-      num_deleted_old_entries++;
     }
-    if (search_map_idx >= last_map_idx) {
-      break;
+
+    // Never delete the maps that went away, they may be in use. The
+    // assumption is that there will only ever be a handful of these so
+    // waiting to destroy them is not too expensive.
+    for (auto& info : maps_) {
+      if (info != nullptr) {
+        saved_maps_.emplace_back(std::move(info));
+      }
     }
+    maps_ = std::move(maps);
   }
 
-  // Now move out any of the maps that never were found.
-  for (size_t i = search_map_idx; i < last_map_idx; i++) {
-    saved_maps_.emplace_back(std::move(maps_[i]));
-    maps_[i] = nullptr;
-    num_deleted_old_entries++;
+  if (num_added != 0 || num_removed != 0 || snapshot_.load() == nullptr) {
+    PublishSnapshot();
   }
 
-  // Sort all of the values such that the nullptrs wind up at the end, then
-  // resize them away.
-  std::sort(maps_.begin(), maps_.end(), [](const auto& a, const auto& b) {
-    if (a == nullptr) {
-      return false;
-    } else if (b == nullptr) {
-      return true;
-    }
-    return a->start() < b->start();
-  });
-  maps_.resize(maps_.size() - num_deleted_old_entries - num_deleted_new_entries);
-
   if (any_changed != nullptr) {
-    *any_changed = num_deleted_old_entries != 0 || maps_.size() != last_map_idx;
+    *any_changed = num_added != 0 || num_removed != 0;
   }
 
   return true;
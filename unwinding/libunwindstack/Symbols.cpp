@@ -16,10 +16,16 @@
 
 #include <elf.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include <unwindstack/Memory.h>
@@ -27,6 +33,9 @@
 #include "Check.h"
 #include "Symbols.h"
 
+// Use the demangler from libc++.
+extern "C" char* __cxa_demangle(const char*, char*, size_t*, int* status);
+
 namespace unwindstack {
 
 Symbols::Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t str_offset,
@@ -37,16 +46,26 @@ Symbols::Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t s
       str_offset_(str_offset),
       str_end_(str_offset_ + str_size) {}
 
+Symbols::~Symbols() {
+  CancelIndexBuild();
+}
+
+void Symbols::ClearCache() {
+  CancelIndexBuild();
+  symbols_.clear();
+  index_.reset();
+  index_ready_ = false;
+}
+
 template <typename SymType>
 static bool IsFunc(const SymType* entry) {
   return entry->st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry->st_info) == STT_FUNC;
 }
 
 // Binary search the symbol table to find function containing the given address.
-// Without remap, the symbol table is assumed to be sorted and accessed directly.
+// The symbol table is assumed to be sorted and accessed directly.
 // If the symbol table is not sorted this method might fail but should not crash.
-// When the indices are remapped, they are guaranteed to be sorted by address.
-template <typename SymType, bool RemapIndices>
+template <typename SymType>
 Symbols::Info* Symbols::BinarySearch(uint64_t addr, Memory* elf_memory, uint64_t* func_offset) {
   // Fast-path: Check if the symbol has been already read from memory.
   // Otherwise use the cache iterator to constrain the binary search range.
@@ -59,15 +78,13 @@ Symbols::Info* Symbols::BinarySearch(uint64_t addr, Memory* elf_memory, uint64_t
       return &it->second;
     }
   }
-  uint32_t count = RemapIndices ? remap_->size() : count_;
-  uint32_t last = (it != symbols_.end()) ? it->second.index : count;
+  uint32_t last = (it != symbols_.end()) ? it->second.index : count_;
   uint32_t first = (it != symbols_.begin()) ? std::prev(it)->second.index + 1 : 0;
 
   while (first < last) {
     uint32_t current = first + (last - first) / 2;
-    uint32_t symbol_index = RemapIndices ? remap_.value()[current] : current;
     SymType sym;
-    if (!elf_memory->ReadFully(offset_ + symbol_index * entry_size_, &sym, sizeof(sym))) {
+    if (!elf_memory->ReadFully(offset_ + current * entry_size_, &sym, sizeof(sym))) {
       return nullptr;
     }
     // There shouldn't be multiple symbols with same end address, but in case there are,
@@ -86,13 +103,27 @@ Symbols::Info* Symbols::BinarySearch(uint64_t addr, Memory* elf_memory, uint64_t
   return nullptr;
 }
 
-// Create remapping table which allows us to access symbols as if they were sorted by address.
+// Store the sorted entries in the order of a breadth first walk of the
+// implicit binary tree where the children of node k are 2k and 2k + 1.
+static size_t FillLayout(const std::vector<uint64_t>& starts, size_t pos, size_t k,
+                         std::vector<uint64_t>* layout, std::vector<uint32_t>* ranks) {
+  if (k <= starts.size()) {
+    pos = FillLayout(starts, pos, 2 * k, layout, ranks);
+    (*layout)[k] = starts[pos];
+    (*ranks)[k] = pos++;
+    pos = FillLayout(starts, pos, 2 * k + 1, layout, ranks);
+  }
+  return pos;
+}
+
 template <typename SymType>
-void Symbols::BuildRemapTable(Memory* elf_memory) {
-  std::vector<uint64_t> addrs;  // Addresses of all symbols (addrs[i] == symbols[i].st_value).
-  addrs.reserve(count_);
-  remap_.emplace();  // Construct the optional remap table.
-  remap_->reserve(count_);
+std::unique_ptr<Symbols::Index> Symbols::BuildIndex(Memory* elf_memory) {
+  struct Entry {
+    uint64_t start;
+    uint32_t size;
+    uint32_t symbol_index;
+  };
+  std::vector<Entry> entries;
   for (size_t symbol_idx = 0; symbol_idx < count_;) {
     // Read symbols from memory.  We intentionally bypass the cache to save memory.
     // Do the reads in batches so that we minimize the number of memory read calls.
@@ -105,47 +136,131 @@ void Symbols::BuildRemapTable(Memory* elf_memory) {
     for (size_t offset = 0; offset + sizeof(SymType) <= size; offset += entry_size_, symbol_idx++) {
       SymType sym;
       memcpy(&sym, &buffer[offset], sizeof(SymType));  // Copy to ensure alignment.
-      addrs.push_back(sym.st_value);  // Always insert so it is indexable by symbol index.
       // NB: It is important to filter our zero-sized symbols since otherwise we can get
       // duplicate end addresses in the table (e.g. if there is custom "end" symbol marker).
       if (IsFunc(&sym) && sym.st_size != 0) {
-        remap_->push_back(symbol_idx);  // Indices of function symbols only.
+        entries.push_back({.start = sym.st_value,
+                           .size = static_cast<uint32_t>(sym.st_size),
+                           .symbol_index = static_cast<uint32_t>(symbol_idx)});
       }
     }
   }
-  // Sort by address to make the remap list binary searchable (stable due to the a<b tie break).
-  auto comp = [&addrs](auto a, auto b) { return std::tie(addrs[a], a) < std::tie(addrs[b], b); };
-  std::sort(remap_->begin(), remap_->end(), comp);
-  // Remove duplicate entries (methods de-duplicated by the linker).
-  auto pred = [&addrs](auto a, auto b) { return addrs[a] == addrs[b]; };
-  remap_->erase(std::unique(remap_->begin(), remap_->end(), pred), remap_->end());
-  remap_->shrink_to_fit();
+  // Sort by address (stable due to the index tie break), and remove duplicate
+  // entries (methods de-duplicated by the linker).
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return std::tie(a.start, a.symbol_index) < std::tie(b.start, b.symbol_index);
+  });
+  auto same_start = [](const Entry& a, const Entry& b) { return a.start == b.start; };
+  entries.erase(std::unique(entries.begin(), entries.end(), same_start), entries.end());
+
+  auto index = std::make_unique<Index>();
+  index->starts.reserve(entries.size());
+  index->sizes.reserve(entries.size());
+  index->symbol_indices.reserve(entries.size());
+  for (const Entry& entry : entries) {
+    index->starts.push_back(entry.start);
+    index->sizes.push_back(entry.size);
+    index->symbol_indices.push_back(entry.symbol_index);
+  }
+  index->names.resize(entries.size());
+  index->layout.resize(entries.size() + 1);
+  index->ranks.resize(entries.size() + 1);
+  FillLayout(index->starts, 0, 1, &index->layout, &index->ranks);
+  return index;
+}
+
+// Indexes waiting for the background thread. There is a single thread that
+// is never stopped, so that indexing the symbols of many elf files at once
+// cannot start more than one thread.
+struct IndexQueue {
+  std::mutex lock;
+  std::condition_variable queued;
+  std::condition_variable built;
+  std::deque<Symbols*> pending;
+  bool thread_started = false;
+};
+static constexpr size_t kMaxQueuedIndexes = 32;
+
+static IndexQueue* GetIndexQueue() {
+  // Never freed, the thread may still be waiting on it at exit.
+  static IndexQueue* queue = new IndexQueue;
+  return queue;
+}
+
+void Symbols::IndexThreadMain() {
+  IndexQueue* queue = GetIndexQueue();
+  std::unique_lock<std::mutex> lock(queue->lock);
+  while (true) {
+    queue->queued.wait(lock, [queue]() { return !queue->pending.empty(); });
+    Symbols* symbols = queue->pending.front();
+    queue->pending.pop_front();
+    symbols->index_build_ = IndexBuild::kRunning;
+    lock.unlock();
+    std::unique_ptr<Index> index = (symbols->*symbols->index_builder_)(symbols->index_memory_);
+    lock.lock();
+    symbols->index_ = std::move(index);
+    symbols->index_ready_.store(true, std::memory_order_release);
+    symbols->index_build_ = IndexBuild::kNone;
+    queue->built.notify_all();
+  }
+}
+
+void Symbols::CancelIndexBuild() {
+  IndexQueue* queue = GetIndexQueue();
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (index_build_ == IndexBuild::kQueued) {
+    queue->pending.erase(std::find(queue->pending.begin(), queue->pending.end(), this));
+    index_build_ = IndexBuild::kNone;
+  }
+  queue->built.wait(lock, [this]() { return index_build_ == IndexBuild::kNone; });
 }
 
 template <typename SymType>
-bool Symbols::GetName(uint64_t addr, Memory* elf_memory, SharedString* name,
-                      uint64_t* func_offset) {
-  Info* info;
-  if (!remap_.has_value()) {
-    // Assume the symbol table is sorted. If it is not, this will gracefully fail.
-    info = BinarySearch<SymType, false>(addr, elf_memory, func_offset);
-    if (info == nullptr) {
-      // Create the remapping table and retry the search.
-      BuildRemapTable<SymType>(elf_memory);
-      symbols_.clear();  // Remove cached symbols since the access pattern will be different.
-      info = BinarySearch<SymType, true>(addr, elf_memory, func_offset);
-    }
-  } else {
-    // Fast search using the previously created remap table.
-    info = BinarySearch<SymType, true>(addr, elf_memory, func_offset);
+void Symbols::BuildIndexAsync(Memory* elf_memory) {
+  if (index_ready_) {
+    return;
   }
-  if (info == nullptr) {
+  IndexQueue* queue = GetIndexQueue();
+  std::lock_guard<std::mutex> lock(queue->lock);
+  if (index_build_ != IndexBuild::kNone || queue->pending.size() >= kMaxQueuedIndexes) {
+    return;
+  }
+  index_builder_ = &Symbols::BuildIndex<SymType>;
+  index_memory_ = elf_memory;
+  index_build_ = IndexBuild::kQueued;
+  queue->pending.push_back(this);
+  if (!queue->thread_started) {
+    std::thread(IndexThreadMain).detach();
+    queue->thread_started = true;
+  }
+  queue->queued.notify_one();
+}
+
+// Find the last symbol that starts at or before addr, and check that addr is
+// inside of it.
+bool Symbols::FindInIndex(uint64_t addr, uint32_t* position) {
+  const std::vector<uint64_t>& layout = index_->layout;
+  size_t count = index_->starts.size();
+  size_t k = 1;
+  while (k <= count) {
+    k = 2 * k + (layout[k] <= addr);
+  }
+  // Undo the trailing right turns and the last left turn, which leaves k at
+  // the first entry that starts after addr, or zero if there is none.
+  k >>= __builtin_ffsll(~k);
+  size_t next = (k == 0) ? count : index_->ranks[k];
+  if (next == 0) {
     return false;
   }
-  // Read and cache the symbol name.
-  if (info->name.is_null()) {
+  *position = next - 1;
+  return addr - index_->starts[*position] < index_->sizes[*position];
+}
+
+template <typename SymType>
+bool Symbols::ReadName(uint32_t symbol_index, Memory* elf_memory, SharedString* cached_name,
+                       SharedString* name) {
+  if (cached_name->is_null()) {
     SymType sym;
-    uint32_t symbol_index = remap_.has_value() ? remap_.value()[info->index] : info->index;
     if (!elf_memory->ReadFully(offset_ + symbol_index * entry_size_, &sym, sizeof(sym))) {
       return false;
     }
@@ -157,12 +272,40 @@ bool Symbols::GetName(uint64_t addr, Memory* elf_memory, SharedString* name,
     if (!IsFunc(&sym) || !elf_memory->ReadString(str, &symbol_name, str_end_ - str)) {
       return false;
     }
-    info->name = SharedString(std::move(symbol_name));
+    *cached_name = SharedString(std::move(symbol_name));
   }
-  *name = info->name;
+  *name = *cached_name;
   return true;
 }
 
+template <typename SymType>
+bool Symbols::GetName(uint64_t addr, Memory* elf_memory, SharedString* name,
+                      uint64_t* func_offset) {
+  if (!index_ready_.load(std::memory_order_acquire)) {
+    // Assume the symbol table is sorted. If it is not, this will gracefully fail.
+    Info* info = BinarySearch<SymType>(addr, elf_memory, func_offset);
+    if (info != nullptr) {
+      return ReadName<SymType>(info->index, elf_memory, &info->name, name);
+    }
+    // Finish the index and retry the search with it, building it here unless
+    // the background thread already started on it.
+    CancelIndexBuild();
+    if (!index_ready_) {
+      index_ = BuildIndex<SymType>(elf_memory);
+      index_ready_ = true;
+    }
+    symbols_.clear();  // Everything the cache knows is in the index now.
+  }
+
+  uint32_t position;
+  if (!FindInIndex(addr, &position)) {
+    return false;
+  }
+  *func_offset = addr - index_->starts[position];
+  return ReadName<SymType>(index_->symbol_indices[position], elf_memory,
+                           &index_->names[position], name);
+}
+
 template <typename SymType>
 bool Symbols::GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* memory_address) {
   // Lookup from cache.
@@ -199,10 +342,43 @@ bool Symbols::GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* m
   return false;
 }
 
+SharedString Symbols::Demangle(const SharedString& name) {
+  // Keep the cache bounded, it is simply dropped when it fills up.
+  constexpr size_t kMaxCachedNames = 4096;
+  [[clang::no_destroy]] static std::mutex lock;
+  [[clang::no_destroy]] static std::unordered_map<std::string, SharedString> cache;
+
+  const std::string& mangled = name;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = cache.find(mangled);
+    if (it != cache.end()) {
+      return it->second;
+    }
+  }
+
+  SharedString result(name);
+  char* demangled_name = __cxa_demangle(mangled.c_str(), nullptr, nullptr, nullptr);
+  if (demangled_name != nullptr) {
+    result = SharedString(demangled_name);
+    free(demangled_name);
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (cache.size() >= kMaxCachedNames) {
+    cache.clear();
+  }
+  cache.emplace(mangled, result);
+  return result;
+}
+
 // Instantiate all of the needed template functions.
 template bool Symbols::GetName<Elf32_Sym>(uint64_t, Memory*, SharedString*, uint64_t*);
 template bool Symbols::GetName<Elf64_Sym>(uint64_t, Memory*, SharedString*, uint64_t*);
 
 template bool Symbols::GetGlobal<Elf32_Sym>(Memory*, const std::string&, uint64_t*);
 template bool Symbols::GetGlobal<Elf64_Sym>(Memory*, const std::string&, uint64_t*);
+
+template void Symbols::BuildIndexAsync<Elf32_Sym>(Memory*);
+template void Symbols::BuildIndexAsync<Elf64_Sym>(Memory*);
 }  // namespace unwindstack
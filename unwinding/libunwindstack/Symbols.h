@@ -19,10 +19,13 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/SharedString.h>
 
@@ -34,14 +37,27 @@ class Memory;
 class Symbols {
   struct Info {
     uint32_t size;   // Symbol size in bytes.
-    uint32_t index;  // Index into *sorted* symbol table.
+    uint32_t index;  // Index into the symbol table.
     SharedString name;
   };
 
+  // Read-only copy of the function symbols sorted by address, built in one
+  // pass over the symbol table. The start addresses are also laid out in
+  // Eytzinger (breadth first) order so that a lookup walks a few adjacent
+  // cache lines and never has to read the elf memory.
+  struct Index {
+    std::vector<uint64_t> layout;  // Start addresses in Eytzinger order, 1-based.
+    std::vector<uint32_t> ranks;   // Position in the sorted arrays of each layout entry.
+    std::vector<uint64_t> starts;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> symbol_indices;
+    std::vector<SharedString> names;  // Read on first use.
+  };
+
  public:
   Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t str_offset,
           uint64_t str_size);
-  virtual ~Symbols() = default;
+  virtual ~Symbols();
 
   template <typename SymType>
   bool GetName(uint64_t addr, Memory* elf_memory, SharedString* name, uint64_t* func_offset);
@@ -49,17 +65,38 @@ class Symbols {
   template <typename SymType>
   bool GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* memory_address);
 
-  void ClearCache() {
-    symbols_.clear();
-    remap_.reset();
-  }
+  // Queues the index to be built by a background thread shared by all
+  // Symbols objects, GetName() keeps using the lazy lookup until it is done.
+  // Nothing is queued if too many other indexes are still waiting. The
+  // elf_memory must be safe to read from another thread and must outlive this
+  // object, or the next ClearCache() call.
+  template <typename SymType>
+  void BuildIndexAsync(Memory* elf_memory);
+
+  void ClearCache();
+
+  // Returns the demangled name, or the name itself if it is not mangled.
+  // The results are cached since the same functions tend to show up in
+  // every unwind.
+  static SharedString Demangle(const SharedString& name);
 
  private:
-  template <typename SymType, bool RemapIndices>
+  template <typename SymType>
   Info* BinarySearch(uint64_t addr, Memory* elf_memory, uint64_t* func_offset);
 
   template <typename SymType>
-  void BuildRemapTable(Memory* elf_memory);
+  std::unique_ptr<Index> BuildIndex(Memory* elf_memory);
+
+  bool FindInIndex(uint64_t addr, uint32_t* position);
+
+  // Takes this object off the background thread's queue, or waits for the
+  // background thread to finish its index.
+  void CancelIndexBuild();
+  static void IndexThreadMain();
+
+  template <typename SymType>
+  bool ReadName(uint32_t symbol_index, Memory* elf_memory, SharedString* cached_name,
+                SharedString* name);
 
   const uint64_t offset_;
   const uint64_t count_;
@@ -68,7 +105,16 @@ class Symbols {
   const uint64_t str_end_;
 
   std::map<uint64_t, Info> symbols_;  // Cache of read symbols (keyed by function *end* address).
-  std::optional<std::vector<uint32_t>> remap_;  // Indices of function symbols sorted by address.
+
+  // Only read by GetName() once index_ready_ is set, or after CancelIndexBuild().
+  std::unique_ptr<Index> index_;
+  std::atomic_bool index_ready_ = false;
+
+  // Guarded by the lock of the background index thread.
+  enum class IndexBuild { kNone, kQueued, kRunning };
+  IndexBuild index_build_ = IndexBuild::kNone;
+  std::unique_ptr<Index> (Symbols::*index_builder_)(Memory*) = nullptr;
+  Memory* index_memory_ = nullptr;
 
   // Cache of global data (non-function) symbols.
   std::unordered_map<std::string, std::optional<uint64_t>> global_variables_;
@@ -20,13 +20,17 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/errno_restorer.h>
 #include <android-base/threads.h>
+#include <procinfo/process.h>
 
 #include <unwindstack/Log.h>
 #include <unwindstack/Regs.h>
@@ -81,18 +85,52 @@ ThreadUnwinder::ThreadUnwinder(size_t max_frames, const ThreadUnwinder* unwinder
   initted_ = unwinder->initted_;
 }
 
+// Serializes changes to the signal action, and the signalling of threads.
+static std::mutex action_mutex;
+
+static bool InstallSignalHandler(int signal, struct sigaction* old_action) {
+  struct sigaction new_action = {.sa_sigaction = SignalHandler,
+                                 .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
+  sigemptyset(&new_action.sa_mask);
+  if (sigaction(signal, &new_action, old_action) != 0) {
+    log_async_safe("sigaction failed: %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// Called when at least one thread did not respond to the signal in time.
+static void RestoreSignalHandler(int signal, const struct sigaction& old_action) {
+  if (old_action.sa_sigaction == nullptr) {
+    // If the wait failed, it could be that the signal could not be delivered
+    // within the timeout. Add a signal handler that's simply going to log
+    // something so that we don't crash if the signal eventually gets
+    // delivered. Only do this if there isn't already an action set up.
+    struct sigaction log_action = {.sa_sigaction = SignalLogOnly,
+                                   .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
+    sigemptyset(&log_action.sa_mask);
+    sigaction(signal, &log_action, nullptr);
+  } else {
+    sigaction(signal, &old_action, nullptr);
+  }
+}
+
+static ErrorCode GetTimeoutError(pid_t pid, pid_t tid) {
+  // Check to see if the thread has disappeared.
+  if (tgkill(pid, tid, 0) == -1 && errno == ESRCH) {
+    return ERROR_THREAD_DOES_NOT_EXIST;
+  }
+  log_async_safe("Timed out waiting for signal handler to get ucontext data.");
+  return ERROR_THREAD_TIMEOUT;
+}
+
 ThreadEntry* ThreadUnwinder::SendSignalToThread(int signal, pid_t tid) {
-  static std::mutex action_mutex;
   std::lock_guard<std::mutex> guard(action_mutex);
 
   ThreadEntry* entry = ThreadEntry::Get(tid);
   entry->Lock();
-  struct sigaction new_action = {.sa_sigaction = SignalHandler,
-                                 .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
   struct sigaction old_action = {};
-  sigemptyset(&new_action.sa_mask);
-  if (sigaction(signal, &new_action, &old_action) != 0) {
-    log_async_safe("sigaction failed: %s", strerror(errno));
+  if (!InstallSignalHandler(signal, &old_action)) {
     ThreadEntry::Remove(entry);
     last_error_.code = ERROR_SYSTEM_CALL;
     return nullptr;
@@ -119,26 +157,8 @@ ThreadEntry* ThreadUnwinder::SendSignalToThread(int signal, pid_t tid) {
     return entry;
   }
 
-  if (old_action.sa_sigaction == nullptr) {
-    // If the wait failed, it could be that the signal could not be delivered
-    // within the timeout. Add a signal handler that's simply going to log
-    // something so that we don't crash if the signal eventually gets
-    // delivered. Only do this if there isn't already an action set up.
-    struct sigaction log_action = {.sa_sigaction = SignalLogOnly,
-                                   .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
-    sigemptyset(&log_action.sa_mask);
-    sigaction(signal, &log_action, nullptr);
-  } else {
-    sigaction(signal, &old_action, nullptr);
-  }
-
-  // Check to see if the thread has disappeared.
-  if (tgkill(getpid(), tid, 0) == -1 && errno == ESRCH) {
-    last_error_.code = ERROR_THREAD_DOES_NOT_EXIST;
-  } else {
-    last_error_.code = ERROR_THREAD_TIMEOUT;
-    log_async_safe("Timed out waiting for signal handler to get ucontext data.");
-  }
+  RestoreSignalHandler(signal, old_action);
+  last_error_.code = GetTimeoutError(getpid(), tid);
 
   ThreadEntry::Remove(entry);
 
@@ -179,4 +199,125 @@ void ThreadUnwinder::UnwindWithSignal(int signal, pid_t tid,
   ThreadEntry::Remove(entry);
 }
 
+std::vector<ThreadUnwindResult> ThreadUnwinder::UnwindThreads(
+    int signal, const std::vector<pid_t>& tids, size_t num_workers,
+    const std::vector<std::string>* initial_map_names_to_skip,
+    const std::vector<std::string>* map_suffixes_to_ignore) {
+  ClearErrors();
+  std::vector<ThreadUnwindResult> results(tids.size());
+  for (size_t i = 0; i < tids.size(); i++) {
+    results[i].tid = tids[i];
+  }
+
+  if (!Init()) {
+    for (auto& result : results) {
+      result.error = last_error_;
+    }
+    return results;
+  }
+
+  // The handler is installed once for the whole set. Each worker signals a
+  // thread only when it is about to unwind it, so at most num_workers threads
+  // are parked in the handler at a time, and none of them waits there for
+  // longer than its own unwind.
+  pid_t self = android::base::GetThreadId();
+  struct sigaction old_action = {};
+  {
+    std::lock_guard<std::mutex> guard(action_mutex);
+    if (!InstallSignalHandler(signal, &old_action)) {
+      last_error_.code = ERROR_SYSTEM_CALL;
+      for (auto& result : results) {
+        result.error = last_error_;
+      }
+      return results;
+    }
+  }
+
+  std::atomic_size_t next_tid = 0;
+  std::atomic_bool timed_out = false;
+  auto unwind_threads = [&]() {
+    ThreadUnwinder unwinder(max_frames_, this);
+    unwinder.SetResolveNames(resolve_names_);
+    unwinder.SetEmbeddedSoname(embedded_soname_);
+    unwinder.SetDisplayBuildID(display_build_id_);
+    for (size_t i = next_tid++; i < tids.size(); i = next_tid++) {
+      ThreadUnwindResult* result = &results[i];
+      if (result->tid == self) {
+        result->error.code = ERROR_UNSUPPORTED;
+        continue;
+      }
+
+      ThreadEntry* entry;
+      {
+        std::lock_guard<std::mutex> guard(action_mutex);
+        entry = ThreadEntry::Get(result->tid);
+        entry->Lock();
+        if (tgkill(getpid(), result->tid, signal) != 0) {
+          result->error.code = errno == ESRCH ? ERROR_THREAD_DOES_NOT_EXIST : ERROR_SYSTEM_CALL;
+          ThreadEntry::Remove(entry);
+          continue;
+        }
+      }
+
+      // Wait for the thread to get the ucontext. If the signal arrives after
+      // the entry is removed, the handler finds no entry and returns.
+      if (!entry->Wait(WAIT_FOR_UCONTEXT)) {
+        result->error.code = GetTimeoutError(getpid(), result->tid);
+        timed_out = true;
+        ThreadEntry::Remove(entry);
+        continue;
+      }
+
+      std::unique_ptr<Regs> regs(
+          Regs::CreateFromUcontext(Regs::CurrentArch(), entry->GetUcontext()));
+      unwinder.SetRegs(regs.get());
+      unwinder.UnwinderFromPid::Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+      result->frames = unwinder.ConsumeFrames();
+      result->error = unwinder.last_error_;
+      result->warnings = unwinder.warnings_;
+
+      // Tell the signal handler to exit, and wait for the thread to indicate
+      // it is done with the ThreadEntry.
+      entry->Wake();
+      if (!entry->Wait(WAIT_FOR_THREAD_TO_RESTART)) {
+        // Send a warning, but do not mark as a failure to unwind.
+        log_async_safe("Timed out waiting for signal handler to indicate it finished.");
+      }
+      ThreadEntry::Remove(entry);
+    }
+  };
+
+  num_workers = std::min(num_workers, tids.size());
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < num_workers; i++) {
+    workers.emplace_back(unwind_threads);
+  }
+  unwind_threads();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  // Only replace the handler once no more threads are going to be signalled.
+  if (timed_out) {
+    std::lock_guard<std::mutex> guard(action_mutex);
+    RestoreSignalHandler(signal, old_action);
+  }
+  return results;
+}
+
+std::vector<ThreadUnwindResult> ThreadUnwinder::UnwindAllThreads(
+    int signal, size_t num_workers, const std::vector<std::string>* initial_map_names_to_skip,
+    const std::vector<std::string>* map_suffixes_to_ignore) {
+  ClearErrors();
+  std::vector<pid_t> tids;
+  if (!android::procinfo::GetProcessTids(getpid(), &tids)) {
+    last_error_.code = ERROR_SYSTEM_CALL;
+    return {};
+  }
+  pid_t self = android::base::GetThreadId();
+  tids.erase(std::remove(tids.begin(), tids.end(), self), tids.end());
+  return UnwindThreads(signal, tids, num_workers, initial_map_names_to_skip,
+                       map_suffixes_to_ignore);
+}
+
 }  // namespace unwindstack
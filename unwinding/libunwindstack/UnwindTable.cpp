@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/mapped_file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/DwarfStructs.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
+#include <unwindstack/UnwindTable.h>
+
+namespace unwindstack {
+
+// The file starts with a TableHeader, followed by the rows of each section
+// sorted by pc, followed by the rules the rows refer to. Rows with the same
+// rules share them. Everything is in the byte order of the machine that
+// wrote the file, and is aligned so that it can be used in place.
+static constexpr char kTableMagic[8] = {'U', 'N', 'W', 'T', 'A', 'B', 'L', 'E'};
+static constexpr uint32_t kTableVersion = 1;
+
+struct TableHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t arch;
+  uint32_t build_id_size;
+  uint8_t build_id[64];
+  struct {
+    uint64_t offset;
+    uint64_t count;
+  } sections[UnwindTable::SECTION_MAX];
+  uint64_t rules_offset;
+  uint64_t rules_count;
+};
+
+struct TableRow {
+  uint64_t pc_start;
+  uint64_t pc_end;
+  uint64_t return_address_register;
+  uint32_t rules_index;
+  uint16_t rules_count;
+  uint8_t is_signal_frame;
+  uint8_t reserved;
+};
+
+struct TableRule {
+  uint32_t reg;
+  uint8_t type;
+  uint8_t reserved[3];
+  uint64_t values[2];
+};
+
+static_assert(sizeof(TableHeader) % alignof(uint64_t) == 0);
+static_assert(sizeof(TableRow) == 32);
+static_assert(sizeof(TableRule) == 24);
+
+namespace {
+
+class TableBuilder {
+ public:
+  TableBuilder(ArchEnum arch) : arch_(arch) {}
+
+  void AddSection(UnwindTable::Section index, DwarfSection* section);
+
+  std::string Finish(const std::string& build_id);
+
+ private:
+  uint32_t AddRules(const DwarfLocations& loc_regs, uint16_t* count);
+
+  ArchEnum arch_;
+  std::vector<TableRow> rows_[UnwindTable::SECTION_MAX];
+  std::vector<TableRule> rules_;
+  // Each distinct set of rules, as raw bytes, and its index in rules_.
+  std::map<std::string, uint32_t> rule_sets_;
+};
+
+void TableBuilder::AddSection(UnwindTable::Section index, DwarfSection* section) {
+  if (section == nullptr) {
+    return;
+  }
+
+  std::vector<const DwarfFde*> fdes;
+  section->GetFdes(&fdes);
+  std::vector<TableRow>& rows = rows_[index];
+  for (const DwarfFde* fde : fdes) {
+    if (fde == nullptr || fde->cie == nullptr) {
+      continue;
+    }
+    // Walk the rows of the fde one at a time. A pc that the section would
+    // look up in a different fde, for instance where fdes overlap, is left
+    // out so that a table lookup never disagrees with the section.
+    uint64_t pc = fde->pc_start;
+    while (pc < fde->pc_end && section->GetFdeFromPc(pc) == fde) {
+      DwarfLocations loc_regs;
+      if (!section->GetCfaLocationInfo(pc, fde, &loc_regs, arch_) || loc_regs.pc_end <= pc) {
+        break;
+      }
+      uint64_t pc_end = std::min(loc_regs.pc_end, fde->pc_end);
+      if (section->GetFdeFromPc(pc_end - 1) != fde) {
+        break;
+      }
+
+      TableRow row = {};
+      row.pc_start = pc;
+      row.pc_end = pc_end;
+      row.return_address_register = fde->cie->return_address_register;
+      row.is_signal_frame = fde->cie->is_signal_frame;
+      row.rules_index = AddRules(loc_regs, &row.rules_count);
+      rows.push_back(row);
+      pc = pc_end;
+    }
+  }
+
+  // Sort the rows and drop any that overlap, which only happens for
+  // overlapping fdes that the section itself can't tell apart.
+  std::sort(rows.begin(), rows.end(),
+            [](const TableRow& a, const TableRow& b) { return a.pc_start < b.pc_start; });
+  size_t kept = 0;
+  for (size_t i = 0; i < rows.size(); i++) {
+    if (kept == 0 || rows[i].pc_start >= rows[kept - 1].pc_end) {
+      rows[kept++] = rows[i];
+    }
+  }
+  rows.resize(kept);
+}
+
+uint32_t TableBuilder::AddRules(const DwarfLocations& loc_regs, uint16_t* count) {
+  std::vector<TableRule> rules;
+  for (const auto& [reg, loc] : loc_regs) {
+    TableRule rule = {};
+    rule.reg = reg;
+    rule.type = loc.type;
+    rule.values[0] = loc.values[0];
+    rule.values[1] = loc.values[1];
+    rules.push_back(rule);
+  }
+  // Order the rules so that identical sets compare equal.
+  std::sort(rules.begin(), rules.end(),
+            [](const TableRule& a, const TableRule& b) { return a.reg < b.reg; });
+  *count = rules.size();
+
+  std::string key(reinterpret_cast<const char*>(rules.data()), rules.size() * sizeof(TableRule));
+  auto [entry, inserted] = rule_sets_.emplace(std::move(key), rules_.size());
+  if (inserted) {
+    rules_.insert(rules_.end(), rules.begin(), rules.end());
+  }
+  return entry->second;
+}
+
+std::string TableBuilder::Finish(const std::string& build_id) {
+  TableHeader header = {};
+  memcpy(header.magic, kTableMagic, sizeof(header.magic));
+  header.version = kTableVersion;
+  header.header_size = sizeof(header);
+  header.arch = arch_;
+  header.build_id_size = build_id.size();
+  memcpy(header.build_id, build_id.data(), build_id.size());
+
+  uint64_t offset = sizeof(header);
+  for (size_t i = 0; i < UnwindTable::SECTION_MAX; i++) {
+    header.sections[i].offset = offset;
+    header.sections[i].count = rows_[i].size();
+    offset += rows_[i].size() * sizeof(TableRow);
+  }
+  header.rules_offset = offset;
+  header.rules_count = rules_.size();
+
+  std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (size_t i = 0; i < UnwindTable::SECTION_MAX; i++) {
+    data.append(reinterpret_cast<const char*>(rows_[i].data()), rows_[i].size() * sizeof(TableRow));
+  }
+  data.append(reinterpret_cast<const char*>(rules_.data()), rules_.size() * sizeof(TableRule));
+  return data;
+}
+
+}  // namespace
+
+UnwindTable::~UnwindTable() = default;
+
+std::string UnwindTable::Create(Elf* elf) {
+  if (!elf->valid()) {
+    return "";
+  }
+  std::string build_id = elf->GetBuildID();
+  if (build_id.empty() || build_id.size() > sizeof(TableHeader::build_id)) {
+    return "";
+  }
+
+  TableBuilder builder(elf->arch());
+  ElfInterface* interface = elf->interface();
+  builder.AddSection(SECTION_DEBUG_FRAME, interface->debug_frame());
+  builder.AddSection(SECTION_EH_FRAME, interface->eh_frame());
+  ElfInterface* gnu = elf->gnu_debugdata_interface();
+  if (gnu != nullptr) {
+    builder.AddSection(SECTION_GNU_DEBUGDATA_DEBUG_FRAME, gnu->debug_frame());
+    builder.AddSection(SECTION_GNU_DEBUGDATA_EH_FRAME, gnu->eh_frame());
+  }
+  return builder.Finish(build_id);
+}
+
+bool UnwindTable::Write(Elf* elf, const std::string& path) {
+  std::string data = Create(elf);
+  if (data.empty()) {
+    return false;
+  }
+  // Write to a temporary file and rename it, so that a process mapping the
+  // table never sees a partial one.
+  std::string tmp_path = path + ".tmp";
+  if (!android::base::WriteStringToFile(data, tmp_path)) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<UnwindTable> UnwindTable::Open(const std::string& path,
+                                               const std::string& build_id, ArchEnum arch) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return nullptr;
+  }
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size < static_cast<off_t>(sizeof(TableHeader))) {
+    return nullptr;
+  }
+
+  std::unique_ptr<UnwindTable> table(new UnwindTable);
+  table->mapped_ = android::base::MappedFile::FromFd(fd, 0, size, PROT_READ);
+  if (table->mapped_ == nullptr) {
+    return nullptr;
+  }
+  table->data_ = reinterpret_cast<const uint8_t*>(table->mapped_->data());
+  table->size_ = table->mapped_->size();
+  if (!table->Init(build_id, arch)) {
+    return nullptr;
+  }
+  return table;
+}
+
+std::unique_ptr<UnwindTable> UnwindTable::FromData(std::string data, const std::string& build_id,
+                                                   ArchEnum arch) {
+  std::unique_ptr<UnwindTable> table(new UnwindTable);
+  table->owned_ = std::move(data);
+  table->data_ = reinterpret_cast<const uint8_t*>(table->owned_.data());
+  table->size_ = table->owned_.size();
+  if (!table->Init(build_id, arch)) {
+    return nullptr;
+  }
+  return table;
+}
+
+std::string UnwindTable::GetFileName(const std::string& build_id) {
+  std::string name;
+  for (const char& c : build_id) {
+    // Use %hhx to avoid sign extension on abis that have signed chars.
+    name += android::base::StringPrintf("%02hhx", c);
+  }
+  return name + ".unwind_table";
+}
+
+// Checks that count entries of size bytes at offset lie within the data.
+static bool InBounds(uint64_t offset, uint64_t count, size_t size, size_t data_size) {
+  if (offset % alignof(uint64_t) != 0 || offset > data_size) {
+    return false;
+  }
+  return count <= (data_size - offset) / size;
+}
+
+bool UnwindTable::Init(const std::string& build_id, ArchEnum arch) {
+  if (size_ < sizeof(TableHeader) || reinterpret_cast<uintptr_t>(data_) % alignof(uint64_t) != 0) {
+    return false;
+  }
+  const TableHeader* header = reinterpret_cast<const TableHeader*>(data_);
+  if (memcmp(header->magic, kTableMagic, sizeof(header->magic)) != 0 ||
+      header->version != kTableVersion || header->header_size != sizeof(TableHeader) ||
+      header->arch != arch || header->build_id_size != build_id.size() ||
+      build_id.size() > sizeof(header->build_id) ||
+      memcmp(header->build_id, build_id.data(), build_id.size()) != 0) {
+    return false;
+  }
+
+  for (size_t i = 0; i < SECTION_MAX; i++) {
+    if (!InBounds(header->sections[i].offset, header->sections[i].count, sizeof(TableRow), size_)) {
+      return false;
+    }
+    rows_offset_[i] = header->sections[i].offset;
+    num_rows_[i] = header->sections[i].count;
+  }
+  if (!InBounds(header->rules_offset, header->rules_count, sizeof(TableRule), size_)) {
+    return false;
+  }
+  rules_offset_ = header->rules_offset;
+  num_rules_ = header->rules_count;
+  return true;
+}
+
+size_t UnwindTable::NumRows(Section section) {
+  return num_rows_[section];
+}
+
+bool UnwindTable::GetLocations(Section section, uint64_t pc, DwarfLocations* loc_regs) {
+  const TableRow* rows = reinterpret_cast<const TableRow*>(data_ + rows_offset_[section]);
+  const TableRow* rows_end = rows + num_rows_[section];
+  auto comp = [](uint64_t pc, const TableRow& row) { return pc < row.pc_end; };
+  const TableRow* row = std::upper_bound(rows, rows_end, pc, comp);
+  if (row == rows_end || pc < row->pc_start) {
+    return false;
+  }
+  if (row->rules_index > num_rules_ || row->rules_count > num_rules_ - row->rules_index) {
+    return false;
+  }
+
+  const TableRule* rules = reinterpret_cast<const TableRule*>(data_ + rules_offset_);
+  for (size_t i = row->rules_index; i < row->rules_index + row->rules_count; i++) {
+    DwarfLocation* loc = &(*loc_regs)[rules[i].reg];
+    loc->type = static_cast<DwarfLocationEnum>(rules[i].type);
+    loc->values[0] = rules[i].values[0];
+    loc->values[1] = rules[i].values[1];
+  }
+  loc_regs->pc_start = row->pc_start;
+  loc_regs->pc_end = row->pc_end;
+
+  auto key = std::make_pair(row->return_address_register, row->is_signal_frame != 0);
+  auto entry = cies_.find(key);
+  if (entry == cies_.end()) {
+    DwarfCie cie;
+    cie.return_address_register = key.first;
+    cie.is_signal_frame = key.second;
+    entry = cies_.emplace(key, cie).first;
+  }
+  loc_regs->cie = &entry->second;
+  return true;
+}
+
+}  // namespace unwindstack
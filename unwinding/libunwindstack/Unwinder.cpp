@@ -37,9 +37,7 @@
 #include <unwindstack/Unwinder.h>
 
 #include "Check.h"
-
-// Use the demangler from libc++.
-extern "C" char* __cxa_demangle(const char*, char*, size_t*, int* status);
+#include "Symbols.h"
 
 namespace unwindstack {
 
@@ -347,15 +345,8 @@ std::string Unwinder::FormatFrame(const FrameData& frame) const {
   }
 
   if (!frame.function_name.empty()) {
-    char* demangled_name = __cxa_demangle(frame.function_name.c_str(), nullptr, nullptr, nullptr);
-    if (demangled_name == nullptr) {
-      data += " (";
-      data += frame.function_name;
-    } else {
-      data += " (";
-      data += demangled_name;
-      free(demangled_name);
-    }
+    data += " (";
+    data += Symbols::Demangle(frame.function_name);
     if (frame.function_offset != 0) {
       data += android::base::StringPrintf("+%" PRId64, frame.function_offset);
     }
@@ -42,11 +42,15 @@ class BenchmarkLocalUpdatableMaps : public unwindstack::LocalUpdatableMaps {
 static constexpr size_t kNumSmallMaps = 100;
 static constexpr size_t kNumLargeMaps = 10000;
 
-static void CreateMap(const char* filename, size_t num_maps, size_t increment = 1) {
+// When churn is non-zero, every churn-th map gets a different name, the way
+// jit code caches get remapped.
+static void CreateMap(const char* filename, size_t num_maps, size_t increment = 1,
+                      size_t churn = 0) {
   std::string maps;
   for (size_t i = 0; i < num_maps; i += increment) {
-    maps += android::base::StringPrintf("%zu-%zu r-xp 0000 00:00 0 name%zu\n", i * 1000,
-                                        (i + 1) * 1000 * increment, i * increment);
+    const char* prefix = (churn != 0 && i % churn == 0) ? "jit" : "name";
+    maps += android::base::StringPrintf("%zu-%zu r-xp 0000 00:00 0 %s%zu\n", i * 1000,
+                                        (i + 1) * 1000 * increment, prefix, i * increment);
   }
   if (!android::base::WriteStringToFile(maps, filename)) {
     errx(1, "WriteStringToFile failed");
@@ -158,3 +162,37 @@ void BM_local_updatable_maps_reparse_few_less_large(benchmark::State& state) {
   ReparseBenchmark(state, maps1.path, kNumLargeMaps, maps2.path, kNumLargeMaps - 4);
 }
 BENCHMARK(BM_local_updatable_maps_reparse_few_less_large);
+
+void BM_local_updatable_maps_reparse_churn_large(benchmark::State& state) {
+  TemporaryFile maps1;
+  CreateMap(maps1.path, kNumLargeMaps);
+
+  TemporaryFile maps2;
+  CreateMap(maps2.path, kNumLargeMaps, 1, 100);
+
+  ReparseBenchmark(state, maps1.path, kNumLargeMaps, maps2.path, kNumLargeMaps);
+}
+BENCHMARK(BM_local_updatable_maps_reparse_churn_large);
+
+void BM_local_updatable_maps_find_large(benchmark::State& state) {
+  static BenchmarkLocalUpdatableMaps* maps = [] {
+    TemporaryFile maps_file;
+    CreateMap(maps_file.path, kNumLargeMaps);
+    auto* maps = new BenchmarkLocalUpdatableMaps;
+    maps->BenchmarkSetMapsFile(maps_file.path);
+    if (!maps->Parse() || maps->Total() != kNumLargeMaps) {
+      errx(1, "Internal Error: parse of maps failed.");
+    }
+    return maps;
+  }();
+
+  size_t index = 0;
+  for (auto _ : state) {
+    // Step through the maps in an order that defeats the cpu caches.
+    index = (index + 7919) % kNumLargeMaps;
+    if (maps->Find(index * 1000 + 500) == nullptr) {
+      errx(1, "Internal Error: map not found.");
+    }
+  }
+}
+BENCHMARK(BM_local_updatable_maps_find_large)->ThreadRange(1, 8);
@@ -86,6 +86,41 @@ static void BenchmarkSymbolLookup(benchmark::State& state, uint64_t pc, std::str
   BenchmarkSymbolLookup(state, std::vector<uint64_t>{pc}, elf_file, expect_found, runs);
 }
 
+// Same as above, but the elf builds the symbol index on a background thread
+// from the moment it is initialized.
+static void BenchmarkIndexedSymbolLookup(benchmark::State& state, std::vector<uint64_t> offsets,
+                                         std::string elf_file, bool expect_found) {
+  unwindstack::Elf::SetSymbolIndexEnabled(true);
+  BenchmarkSymbolLookup(state, offsets, elf_file, expect_found);
+  unwindstack::Elf::SetSymbolIndexEnabled(false);
+}
+
+// Only time lookups in an elf whose symbols have all been looked up once.
+static void BenchmarkWarmSymbolLookup(benchmark::State& state, std::vector<uint64_t> offsets,
+                                      std::string elf_file, bool symbol_index) {
+  unwindstack::Elf elf(unwindstack::Memory::CreateFileMemory(elf_file, 0).release());
+  unwindstack::Elf::SetSymbolIndexEnabled(symbol_index);
+  bool valid = elf.Init() && elf.valid();
+  unwindstack::Elf::SetSymbolIndexEnabled(false);
+  if (!valid) {
+    errx(1, "Internal Error: Cannot open elf.");
+  }
+
+  unwindstack::SharedString name;
+  uint64_t offset;
+  for (auto pc : offsets) {
+    if (!elf.GetFunctionName(pc, &name, &offset)) {
+      errx(1, "expected pc 0x%" PRIx64 " present, but not found.", pc);
+    }
+  }
+
+  for (auto _ : state) {
+    for (auto pc : offsets) {
+      benchmark::DoNotOptimize(elf.GetFunctionName(pc, &name, &offset));
+    }
+  }
+}
+
 void BM_elf_and_symbol_not_present(benchmark::State& state) {
   BenchmarkSymbolLookup(state, 0, GetElfFile(), false);
 }
@@ -129,3 +164,38 @@ void BM_elf_and_symbol_find_multiple_from_sorted(benchmark::State& state) {
                         GetSymbolSortedElfFile(), true);
 }
 BENCHMARK(BM_elf_and_symbol_find_multiple_from_sorted);
+
+static const std::vector<uint64_t> kMultipleOffsets{0x22b2bc, 0xd5d30, 0x1312e8, 0x13582e,
+                                                    0x1389c8};
+static const std::vector<uint64_t> kMultipleSortedOffsets{0x138638, 0x84350, 0x14df18, 0x1f3a38,
+                                                          0x1f3ca8};
+
+void BM_elf_and_symbol_find_multiple_indexed(benchmark::State& state) {
+  BenchmarkIndexedSymbolLookup(state, kMultipleOffsets, GetElfFile(), true);
+}
+BENCHMARK(BM_elf_and_symbol_find_multiple_indexed);
+
+void BM_elf_and_symbol_find_multiple_from_sorted_indexed(benchmark::State& state) {
+  BenchmarkIndexedSymbolLookup(state, kMultipleSortedOffsets, GetSymbolSortedElfFile(), true);
+}
+BENCHMARK(BM_elf_and_symbol_find_multiple_from_sorted_indexed);
+
+void BM_symbol_find_multiple_warm(benchmark::State& state) {
+  BenchmarkWarmSymbolLookup(state, kMultipleOffsets, GetElfFile(), false);
+}
+BENCHMARK(BM_symbol_find_multiple_warm);
+
+void BM_symbol_find_multiple_warm_indexed(benchmark::State& state) {
+  BenchmarkWarmSymbolLookup(state, kMultipleOffsets, GetElfFile(), true);
+}
+BENCHMARK(BM_symbol_find_multiple_warm_indexed);
+
+void BM_symbol_find_multiple_from_sorted_warm(benchmark::State& state) {
+  BenchmarkWarmSymbolLookup(state, kMultipleSortedOffsets, GetSymbolSortedElfFile(), false);
+}
+BENCHMARK(BM_symbol_find_multiple_from_sorted_warm);
+
+void BM_symbol_find_multiple_from_sorted_warm_indexed(benchmark::State& state) {
+  BenchmarkWarmSymbolLookup(state, kMultipleSortedOffsets, GetSymbolSortedElfFile(), true);
+}
+BENCHMARK(BM_symbol_find_multiple_from_sorted_warm_indexed);
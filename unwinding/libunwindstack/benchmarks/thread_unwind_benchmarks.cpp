@@ -19,6 +19,7 @@
 
 #include <atomic>
 #include <thread>
+#include <vector>
 
 #include <android-base/threads.h>
 #include <benchmark/benchmark.h>
@@ -81,3 +82,49 @@ static void BM_thread_unwind(benchmark::State& state) {
   thread.join();
 }
 BENCHMARK(BM_thread_unwind);
+
+static void BM_thread_unwind_all_threads(benchmark::State& state) {
+  size_t num_threads = state.range(0);
+  size_t num_workers = state.range(1);
+  std::vector<std::atomic_int> tids(num_threads);
+  std::atomic_bool done(false);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back([&tids, &done, i] { ThreadCall1(&tids[i], &done); });
+  }
+
+  std::vector<pid_t> tid_list;
+  for (auto& tid : tids) {
+    while (tid.load() == 0) {
+    }
+    tid_list.push_back(tid.load());
+  }
+
+  unwindstack::ThreadUnwinder unwinder(kMaxFrames);
+  if (!unwinder.Init()) {
+    state.SkipWithError("Failed to init.");
+  }
+
+  for (auto _ : state) {
+    std::vector<unwindstack::ThreadUnwindResult> results =
+        unwinder.UnwindThreads(SIGRTMIN, tid_list, num_workers);
+    for (const auto& result : results) {
+      if (result.frames.size() < 5) {
+        state.SkipWithError("Failed to unwind.");
+        break;
+      }
+    }
+  }
+
+  done.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+BENCHMARK(BM_thread_unwind_all_threads)
+    ->Args({64, 1})
+    ->Args({64, 4})
+    ->Args({300, 1})
+    ->Args({300, 4})
+    ->Args({300, 8});
@@ -28,6 +28,7 @@
 #include <unwindstack/DwarfLocation.h>
 #include <unwindstack/DwarfMemory.h>
 #include <unwindstack/DwarfStructs.h>
+#include <unwindstack/UnwindTable.h>
 
 namespace unwindstack {
 
@@ -109,6 +110,13 @@ class DwarfSection {
 
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished, bool* is_signal_frame);
 
+  // Look up pcs in the given section of a precomputed table before decoding
+  // any fdes. The table must outlive this object.
+  void SetUnwindTable(UnwindTable* table, UnwindTable::Section section) {
+    unwind_table_ = table;
+    unwind_table_section_ = section;
+  }
+
  protected:
   DwarfMemory memory_;
   DwarfErrorData last_error_{DWARF_ERROR_NONE, 0};
@@ -120,6 +128,9 @@ class DwarfSection {
   std::unordered_map<uint64_t, DwarfCie> cie_entries_;
   std::unordered_map<uint64_t, DwarfLocations> cie_loc_regs_;
   std::map<uint64_t, DwarfLocations> loc_regs_;  // Single row indexed by pc_end.
+
+  UnwindTable* unwind_table_ = nullptr;
+  UnwindTable::Section unwind_table_section_ = UnwindTable::SECTION_DEBUG_FRAME;
 };
 
 template <typename AddressType>
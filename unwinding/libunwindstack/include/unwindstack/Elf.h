@@ -29,6 +29,7 @@
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/SharedString.h>
+#include <unwindstack/UnwindTable.h>
 
 #if !defined(EM_AARCH64)
 #define EM_AARCH64 183
@@ -43,7 +44,7 @@ class Regs;
 class Elf {
  public:
   Elf(Memory* memory) : memory_(memory) {}
-  virtual ~Elf() = default;
+  virtual ~Elf();
 
   bool Init();
 
@@ -74,6 +75,11 @@ class Elf {
 
   bool GetTextRange(uint64_t* addr, uint64_t* size);
 
+  // Maps a table written by UnwindTable::Write() for this elf, and uses it
+  // before the DWARF sections when stepping. Fails if a table is already
+  // loaded; a loaded table is never replaced.
+  bool LoadUnwindTable(const std::string& path);
+
   void GetLastError(ErrorData* data);
   ErrorCode GetLastErrorCode();
   uint64_t GetLastErrorAddress();
@@ -92,6 +98,8 @@ class Elf {
 
   ElfInterface* gnu_debugdata_interface() { return gnu_debugdata_interface_.get(); }
 
+  UnwindTable* unwind_table() { return unwind_table_.get(); }
+
   static bool IsValidElf(Memory* memory);
 
   static bool GetInfo(Memory* memory, uint64_t* size);
@@ -109,6 +117,15 @@ class Elf {
   static bool CacheGet(MapInfo* info);
   static bool CacheAfterCreateMemory(MapInfo* info);
 
+  // When set, Init() loads the unwind table for each elf from this directory
+  // if one exists. Pass an empty string to stop.
+  static void SetUnwindTableDirectory(const std::string& dir);
+
+  // When enabled, Init() starts indexing the function symbols of each elf
+  // that is mapped in memory on a background thread, so the first
+  // GetFunctionName() calls do not have to search the symbol table.
+  static void SetSymbolIndexEnabled(bool enable) { symbol_index_enabled_ = enable; }
+
  protected:
   bool valid_ = false;
   int64_t load_bias_ = 0;
@@ -123,9 +140,13 @@ class Elf {
   std::unique_ptr<Memory> gnu_debugdata_memory_;
   std::unique_ptr<ElfInterface> gnu_debugdata_interface_;
 
+  std::unique_ptr<UnwindTable> unwind_table_;
+
   static bool cache_enabled_;
   static std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>* cache_;
   static std::mutex* cache_lock_;
+  static std::string* unwind_table_dir_;
+  static bool symbol_index_enabled_;
 };
 
 }  // namespace unwindstack
@@ -83,6 +83,9 @@ class ElfInterface {
 
   virtual bool GetGlobalVariable(const std::string& name, uint64_t* memory_address) = 0;
 
+  // Starts building the function symbol index on a background thread.
+  virtual void BuildSymbolIndexAsync() {}
+
   virtual std::string GetBuildID() = 0;
 
   virtual bool Step(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
@@ -100,6 +103,9 @@ class ElfInterface {
 
   void SetGnuDebugdataInterface(ElfInterface* interface) { gnu_debugdata_interface_ = interface; }
 
+  void SetUnwindTable(UnwindTable* table, UnwindTable::Section debug_frame_section,
+                      UnwindTable::Section eh_frame_section);
+
   uint64_t dynamic_offset() { return dynamic_offset_; }
   uint64_t dynamic_vaddr_start() { return dynamic_vaddr_start_; }
   uint64_t dynamic_vaddr_end() { return dynamic_vaddr_end_; }
@@ -207,6 +213,8 @@ class ElfInterfaceImpl : public ElfInterface {
 
   bool GetGlobalVariable(const std::string& name, uint64_t* memory_address) override;
 
+  void BuildSymbolIndexAsync() override;
+
   std::string GetBuildID() override { return ReadBuildID(); }
 
   static void GetMaxSize(Memory* memory, uint64_t* size);
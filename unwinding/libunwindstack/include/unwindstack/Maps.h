@@ -21,7 +21,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -97,10 +99,14 @@ class LocalMaps : public RemoteMaps {
   virtual ~LocalMaps() = default;
 };
 
+// Maps of the current process that are reparsed whenever a pc can't be
+// found. Find() never takes a lock: it searches an immutable snapshot of
+// the maps, which Parse() and Reparse() replace once no reader can still
+// be using the previous one.
 class LocalUpdatableMaps : public Maps {
  public:
   LocalUpdatableMaps();
-  virtual ~LocalUpdatableMaps() = default;
+  virtual ~LocalUpdatableMaps();
 
   MapInfo* Find(uint64_t pc) override;
 
@@ -108,12 +114,31 @@ class LocalUpdatableMaps : public Maps {
 
   const std::string GetMapsFile() const override;
 
+  // Compares the current maps with the ones read from GetMapsFile().
+  // Unchanged maps, and the Elf objects they hold, are kept. Maps that
+  // changed or went away are moved to saved_maps_ since they may still be
+  // in use.
   bool Reparse(/*out*/ bool* any_changed = nullptr);
 
  protected:
   std::vector<std::unique_ptr<MapInfo>> saved_maps_;
 
-  pthread_rwlock_t maps_rwlock_;
+ private:
+  struct Snapshot;
+
+  bool ReparseLocked(bool* any_changed);
+  void PublishSnapshot();
+  MapInfo* FindInSnapshot(uint64_t pc);
+
+  // Serializes Parse() and Reparse().
+  std::mutex update_mutex_;
+
+  std::atomic<Snapshot*> snapshot_ = nullptr;
+  // Readers register in the slot of the current generation. Publishing a
+  // snapshot moves to the next generation, then waits for the readers of
+  // the previous one before freeing the previous snapshot.
+  std::atomic_uint64_t generation_ = 0;
+  std::atomic_size_t readers_[2] = {};
 };
 
 class BufferMaps : public Maps {
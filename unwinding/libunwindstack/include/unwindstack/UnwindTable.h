@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_UNWIND_TABLE_H
+#define _LIBUNWINDSTACK_UNWIND_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <unwindstack/Arch.h>
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfStructs.h>
+
+namespace android {
+namespace base {
+class MappedFile;
+}  // namespace base
+}  // namespace android
+
+namespace unwindstack {
+
+// Forward declarations.
+class DwarfSection;
+class Elf;
+
+// The CFA and register rules for every pc range of an elf's DWARF unwind
+// sections, evaluated ahead of time and stored in a file keyed by the elf's
+// build id. A process that maps the file can step through the elf without
+// finding and decoding any FDEs, which is most of the cost of a cold unwind.
+//
+// The file is only valid for the elf it was created from, since expression
+// rules refer to the expressions by their offset in the elf.
+class UnwindTable {
+ public:
+  enum Section : uint32_t {
+    SECTION_DEBUG_FRAME = 0,
+    SECTION_EH_FRAME,
+    SECTION_GNU_DEBUGDATA_DEBUG_FRAME,
+    SECTION_GNU_DEBUGDATA_EH_FRAME,
+    SECTION_MAX,
+  };
+
+  ~UnwindTable();
+
+  // Evaluates the rules for every pc covered by the unwind sections of an
+  // initialized elf and returns them in the file format, or an empty string
+  // if the elf has no build id.
+  static std::string Create(Elf* elf);
+
+  // Creates the table for an elf and writes it to path.
+  static bool Write(Elf* elf, const std::string& path);
+
+  // Maps a file written by Write(). Returns nullptr if the file can't be
+  // read, is corrupt, or wasn't created for an elf with this build id and arch.
+  static std::unique_ptr<UnwindTable> Open(const std::string& path, const std::string& build_id,
+                                           ArchEnum arch);
+
+  // Like Open(), for a table that is already in memory.
+  static std::unique_ptr<UnwindTable> FromData(std::string data, const std::string& build_id,
+                                               ArchEnum arch);
+
+  // The name of the table file for an elf, in the directory given to
+  // Elf::SetUnwindTableDirectory().
+  static std::string GetFileName(const std::string& build_id);
+
+  // Gets the rules for pc in one of the sections, or returns false if the
+  // table doesn't cover pc. loc_regs->cie points at a cie owned by the table
+  // that carries the return address register and signal frame flag.
+  bool GetLocations(Section section, uint64_t pc, DwarfLocations* loc_regs);
+
+  size_t NumRows(Section section);
+
+ private:
+  UnwindTable() = default;
+
+  bool Init(const std::string& build_id, ArchEnum arch);
+
+  std::unique_ptr<android::base::MappedFile> mapped_;
+  std::string owned_;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+
+  // Where each section's rows are in data_, and how many.
+  uint64_t rows_offset_[SECTION_MAX] = {};
+  uint64_t num_rows_[SECTION_MAX] = {};
+  uint64_t rules_offset_ = 0;
+  uint64_t num_rules_ = 0;
+
+  // The cies handed out by GetLocations(), one for each distinct combination
+  // of return address register and signal frame flag.
+  std::map<std::pair<uint64_t, bool>, DwarfCie> cies_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_UNWIND_TABLE_H
@@ -63,6 +63,13 @@ struct FrameData {
   int map_flags = 0;
 };
 
+struct ThreadUnwindResult {
+  pid_t tid;
+  std::vector<FrameData> frames;
+  ErrorData error{ERROR_NONE, 0};
+  uint64_t warnings = WARNING_NONE;
+};
+
 class Unwinder {
  public:
   Unwinder(size_t max_frames, Maps* maps, Regs* regs, std::shared_ptr<Memory> process_memory)
@@ -201,6 +208,23 @@ class ThreadUnwinder : public UnwinderFromPid {
                         const std::vector<std::string>* initial_map_names_to_skip = nullptr,
                         const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
 
+  // Unwinds a set of threads together. Up to num_workers threads, including
+  // the calling one, each signal a thread and unwind it while it waits in the
+  // signal handler, using the maps and elf caches of this object. Returns one
+  // result per tid, in the same order.
+  // The calling thread can't be unwound this way, and gets ERROR_UNSUPPORTED.
+  std::vector<ThreadUnwindResult> UnwindThreads(
+      int signal, const std::vector<pid_t>& tids, size_t num_workers,
+      const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+      const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  // Same as UnwindThreads() for every thread of this process except the
+  // calling one.
+  std::vector<ThreadUnwindResult> UnwindAllThreads(
+      int signal, size_t num_workers,
+      const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+      const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
  protected:
   ThreadEntry* SendSignalToThread(int signal, pid_t tid);
 };
@@ -129,6 +129,8 @@ class ElfInterface32Fake : public ElfInterface32 {
   void FakeSetEhFrameSize(uint64_t size) { eh_frame_size_ = size; }
   void FakeSetDebugFrameOffset(uint64_t offset) { debug_frame_offset_ = offset; }
   void FakeSetDebugFrameSize(uint64_t size) { debug_frame_size_ = size; }
+  void FakeSetBuildIDOffset(uint64_t offset) { gnu_build_id_offset_ = offset; }
+  void FakeSetBuildIDSize(uint64_t size) { gnu_build_id_size_ = size; }
 };
 
 class ElfInterface64Fake : public ElfInterface64 {
@@ -140,6 +142,8 @@ class ElfInterface64Fake : public ElfInterface64 {
   void FakeSetEhFrameSize(uint64_t size) { eh_frame_size_ = size; }
   void FakeSetDebugFrameOffset(uint64_t offset) { debug_frame_offset_ = offset; }
   void FakeSetDebugFrameSize(uint64_t size) { debug_frame_size_ = size; }
+  void FakeSetBuildIDOffset(uint64_t offset) { gnu_build_id_offset_ = offset; }
+  void FakeSetBuildIDSize(uint64_t size) { gnu_build_id_size_ = size; }
 };
 
 class ElfInterfaceArmFake : public ElfInterfaceArm {
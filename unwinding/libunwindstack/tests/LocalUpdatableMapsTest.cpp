@@ -17,7 +17,9 @@
 #include <stdint.h>
 #include <sys/mman.h>
 
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -383,4 +385,82 @@ TEST_F(LocalUpdatableMapsTest, add_map_prev_real_name_updated) {
   EXPECT_EQ(maps_.Get(4), map_info->prev_real_map());
 }
 
+TEST_F(LocalUpdatableMapsTest, find_reparses_on_miss) {
+  MapInfo* map_info = maps_.Find(0x3000);
+  ASSERT_TRUE(map_info != nullptr);
+  EXPECT_EQ(map_info, maps_.Get(0));
+  EXPECT_TRUE(maps_.Find(0x5000) == nullptr);
+
+  TemporaryFile tf;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("3000-4000 r-xp 00000 00:00 0\n"
+                                       "5000-6000 r-xp 00000 00:00 0\n"
+                                       "8000-9000 r-xp 00000 00:00 0\n",
+                                       tf.path));
+  maps_.TestSetMapsFile(tf.path);
+
+  MapInfo* new_map_info = maps_.Find(0x5800);
+  ASSERT_TRUE(new_map_info != nullptr);
+  EXPECT_EQ(0x5000U, new_map_info->start());
+  EXPECT_EQ(0x6000U, new_map_info->end());
+  ASSERT_EQ(3U, maps_.Total());
+
+  // The unchanged maps are the same objects as before.
+  EXPECT_EQ(map_info, maps_.Find(0x3fff));
+  EXPECT_EQ(map_info, maps_.Get(0));
+  EXPECT_EQ(new_map_info, maps_.Get(1));
+  EXPECT_EQ(map_info, new_map_info->prev_map());
+  EXPECT_EQ(0U, maps_.TestGetSavedMaps().size());
+}
+
+TEST_F(LocalUpdatableMapsTest, find_while_reparsing) {
+  static constexpr size_t kNumThreads = 4;
+
+  TemporaryFile tf1;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("3000-4000 r-xp 00000 00:00 0\n"
+                                       "5000-6000 r-xp 00000 00:00 0\n"
+                                       "8000-9000 r-xp 00000 00:00 0\n",
+                                       tf1.path));
+  TemporaryFile tf2;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("3000-4000 r-xp 00000 00:00 0\n"
+                                       "5000-6000 r-xp 00000 00:00 0 /fake/lib.so\n"
+                                       "8000-9000 r-xp 00000 00:00 0\n",
+                                       tf2.path));
+  maps_.TestSetMapsFile(tf1.path);
+  ASSERT_TRUE(maps_.Reparse());
+
+  // The maps that don't change must always be found while the one in the
+  // middle keeps being replaced.
+  std::atomic_bool done(false);
+  std::atomic_size_t failures(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([this, &done, &failures]() {
+      while (!done) {
+        MapInfo* map_info = maps_.Find(0x3800);
+        if (map_info == nullptr || map_info->start() != 0x3000) {
+          failures++;
+        }
+        map_info = maps_.Find(0x8800);
+        if (map_info == nullptr || map_info->start() != 0x8000) {
+          failures++;
+        }
+      }
+    });
+  }
+
+  for (size_t i = 0; i < 200; i++) {
+    EXPECT_TRUE(maps_.Reparse());
+    maps_.TestSetMapsFile(i % 2 == 0 ? tf2.path : tf1.path);
+  }
+  done = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0U, failures.load());
+  ASSERT_EQ(3U, maps_.Total());
+}
+
 }  // namespace unwindstack
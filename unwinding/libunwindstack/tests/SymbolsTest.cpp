@@ -26,6 +26,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <android-base/file.h>
@@ -405,11 +407,126 @@ TYPED_TEST_P(SymbolsTest, get_global) {
   EXPECT_FALSE(symbols.GetGlobal<TypeParam>(&this->memory_, "global_2", &offset));
 }
 
+TYPED_TEST_P(SymbolsTest, build_index_async) {
+  constexpr size_t kNumSymbols = 100;
+  Symbols symbols(0x1000, (kNumSymbols + 1) * sizeof(TypeParam), sizeof(TypeParam), 0xa000,
+                  0x1000);
+
+  // Add the symbols in reverse order, with gaps between them and a zero sized
+  // and a non-function symbol that must be skipped.
+  TypeParam sym;
+  uint64_t offset = 0x1000;
+  for (size_t i = 0; i < kNumSymbols; i++) {
+    uint64_t start = 0x10000 + (kNumSymbols - i - 1) * 0x100;
+    this->InitSym(&sym, start, (i == 50) ? 0 : 0x80, 0x10 * i);
+    if (i == 60) {
+      sym.st_info = STT_OBJECT;
+    }
+    this->memory_.SetMemory(offset, &sym, sizeof(sym));
+    offset += sizeof(sym);
+    std::string fake_name = "function_" + std::to_string(i);
+    this->memory_.SetMemory(0xa000 + 0x10 * i, fake_name.c_str(), fake_name.size() + 1);
+  }
+  this->InitSym(&sym, 0x8000, 0x10, 0x0);
+  sym.st_shndx = SHN_UNDEF;
+  this->memory_.SetMemory(offset, &sym, sizeof(sym));
+
+  symbols.template BuildIndexAsync<TypeParam>(&this->memory_);
+
+  SharedString name;
+  uint64_t func_offset;
+  for (size_t i = 0; i < kNumSymbols; i++) {
+    uint64_t start = 0x10000 + (kNumSymbols - i - 1) * 0x100;
+    SCOPED_TRACE(i);
+    if (i == 50 || i == 60) {
+      ASSERT_FALSE(symbols.GetName<TypeParam>(start, &this->memory_, &name, &func_offset));
+      continue;
+    }
+    ASSERT_TRUE(symbols.GetName<TypeParam>(start + 0x7f, &this->memory_, &name, &func_offset));
+    ASSERT_EQ("function_" + std::to_string(i), name);
+    ASSERT_EQ(0x7fU, func_offset);
+    ASSERT_FALSE(symbols.GetName<TypeParam>(start + 0x80, &this->memory_, &name, &func_offset));
+  }
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0xffff, &this->memory_, &name, &func_offset));
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0x8000, &this->memory_, &name, &func_offset));
+  ASSERT_FALSE(symbols.GetName<TypeParam>(UINT64_MAX, &this->memory_, &name, &func_offset));
+
+  // The names that were read are cached with the index.
+  this->memory_.Clear();
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x10000, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("function_99", name);
+  ASSERT_EQ(0U, func_offset);
+}
+
+TYPED_TEST_P(SymbolsTest, build_index_after_clear_cache) {
+  Symbols symbols(0x1000, 2 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0x10, 0x100);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x3000, 0x10, 0x200);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+  this->memory_.SetMemory(0xa100, "first_entry");
+  this->memory_.SetMemory(0xa200, "second_entry");
+
+  symbols.template BuildIndexAsync<TypeParam>(&this->memory_);
+  SharedString name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x3001, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("second_entry", name);
+
+  this->InitSym(&sym, 0x3000, 0x20, 0x100);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+  symbols.ClearCache();
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x3011, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first_entry", name);
+  ASSERT_EQ(0x11U, func_offset);
+}
+
+TYPED_TEST_P(SymbolsTest, build_index_async_many) {
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0x10, 0x100);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x3000, 0x10, 0x200);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+  this->memory_.SetMemory(0xa100, "first_entry");
+  this->memory_.SetMemory(0xa200, "second_entry");
+
+  // More than the background thread queues at once, some are destroyed
+  // before it gets to them.
+  std::vector<std::unique_ptr<Symbols>> all_symbols;
+  for (size_t i = 0; i < 100; i++) {
+    all_symbols.emplace_back(
+        new Symbols(0x1000, 2 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000));
+    all_symbols.back()->template BuildIndexAsync<TypeParam>(&this->memory_);
+  }
+  all_symbols.resize(50);
+
+  SharedString name;
+  uint64_t func_offset;
+  for (auto& symbols : all_symbols) {
+    ASSERT_TRUE(symbols->GetName<TypeParam>(0x3001, &this->memory_, &name, &func_offset));
+    ASSERT_EQ("second_entry", name);
+    ASSERT_TRUE(symbols->GetName<TypeParam>(0x5002, &this->memory_, &name, &func_offset));
+    ASSERT_EQ("first_entry", name);
+    ASSERT_EQ(2U, func_offset);
+  }
+}
+
 REGISTER_TYPED_TEST_SUITE_P(SymbolsTest, function_bounds_check, no_symbol, multiple_entries,
                             multiple_entries_nonstandard_size, symtab_value_out_of_bounds,
-                            symtab_read_cached, get_global, symtab_end_marker);
+                            symtab_read_cached, get_global, symtab_end_marker, build_index_async,
+                            build_index_after_clear_cache, build_index_async_many);
 
 typedef ::testing::Types<Elf32_Sym, Elf64_Sym> SymbolsTestTypes;
 INSTANTIATE_TYPED_TEST_SUITE_P(Libunwindstack, SymbolsTest, SymbolsTestTypes);
 
+TEST(SymbolsDemangleTest, demangle) {
+  EXPECT_EQ("android::Func()", Symbols::Demangle("_ZN7android4FuncEv"));
+  // Cached result.
+  EXPECT_EQ("android::Func()", Symbols::Demangle("_ZN7android4FuncEv"));
+  EXPECT_EQ("main", Symbols::Demangle("main"));
+  EXPECT_EQ("", Symbols::Demangle(""));
+}
+
 }  // namespace unwindstack
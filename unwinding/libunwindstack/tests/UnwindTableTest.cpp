@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+
+#include <gtest/gtest.h>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/MachineArm.h>
+#include <unwindstack/RegsArm.h>
+#include <unwindstack/UnwindTable.h>
+
+#include "ElfFake.h"
+#include "MemoryFake.h"
+
+namespace unwindstack {
+
+class UnwindTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memory_.Clear();
+
+    // Cie: version 1, code alignment 1, data alignment -4, return address
+    // register lr, cfa is sp.
+    memory_.SetData32(0x5000, 0x10);
+    memory_.SetData32(0x5004, 0xffffffff);
+    memory_.SetMemory(0x5008, std::vector<uint8_t>{1, '\0', 1, 0x7c, ARM_REG_LR, 0x0c, ARM_REG_SP,
+                                                   0, 0, 0, 0, 0});
+
+    // Fde for 0x1000-0x1100 with three rows: advance 4, cfa is sp + 8,
+    // lr is at cfa - 4, advance 8, cfa is sp + 16.
+    memory_.SetData32(0x5014, 0x18);
+    memory_.SetData32(0x5018, 0);
+    memory_.SetData32(0x501c, 0x1000);
+    memory_.SetData32(0x5020, 0x100);
+    memory_.SetMemory(0x5024, std::vector<uint8_t>{0x44, 0x0e, 0x08, 0x80 | ARM_REG_LR, 0x01, 0x48,
+                                                   0x0e, 0x10, 0, 0, 0, 0});
+
+    // Build id note.
+    Elf32_Nhdr nhdr = {.n_namesz = 4, .n_descsz = 4, .n_type = NT_GNU_BUILD_ID};
+    memory_.SetMemory(0x6000, &nhdr, sizeof(nhdr));
+    memory_.SetMemory(0x6000 + sizeof(nhdr), "GNU\0\xde\xad\xbe\xef", 8);
+
+    interface_ = new ElfInterface32Fake(&memory_);
+    interface_->FakeSetDebugFrameOffset(0x5000);
+    interface_->FakeSetDebugFrameSize(0x30);
+    interface_->FakeSetBuildIDOffset(0x6000);
+    interface_->FakeSetBuildIDSize(sizeof(nhdr) + 8);
+    interface_->InitHeaders();
+
+    elf_.reset(new ElfFake(nullptr));
+    elf_->FakeSetArch(ARCH_ARM);
+    elf_->FakeSetInterface(interface_);
+  }
+
+  MemoryFake memory_;
+  ElfInterface32Fake* interface_;
+  std::unique_ptr<ElfFake> elf_;
+  const std::string build_id_ = "\xde\xad\xbe\xef";
+};
+
+TEST_F(UnwindTableTest, create) {
+  ASSERT_EQ(build_id_, elf_->GetBuildID());
+
+  std::unique_ptr<UnwindTable> table =
+      UnwindTable::FromData(UnwindTable::Create(elf_.get()), build_id_, ARCH_ARM);
+  ASSERT_TRUE(table != nullptr);
+  EXPECT_EQ(3U, table->NumRows(UnwindTable::SECTION_DEBUG_FRAME));
+  EXPECT_EQ(0U, table->NumRows(UnwindTable::SECTION_EH_FRAME));
+
+  // Every pc gets exactly the rules that decoding the fde gives.
+  DwarfSection* section = interface_->debug_frame();
+  const DwarfFde* fde = section->GetFdeFromPc(0x1000);
+  ASSERT_TRUE(fde != nullptr);
+  for (uint64_t pc = 0x1000; pc < 0x1100; pc++) {
+    DwarfLocations expected;
+    ASSERT_TRUE(section->GetCfaLocationInfo(pc, fde, &expected, ARCH_ARM));
+    DwarfLocations loc_regs;
+    ASSERT_TRUE(table->GetLocations(UnwindTable::SECTION_DEBUG_FRAME, pc, &loc_regs)) << pc;
+    EXPECT_EQ(expected.pc_start, loc_regs.pc_start) << pc;
+    EXPECT_EQ(expected.pc_end, loc_regs.pc_end) << pc;
+    ASSERT_EQ(expected.size(), loc_regs.size()) << pc;
+    for (const auto& [reg, loc] : expected) {
+      auto entry = loc_regs.find(reg);
+      ASSERT_TRUE(entry != loc_regs.end()) << pc;
+      EXPECT_EQ(loc.type, entry->second.type) << pc;
+      EXPECT_EQ(loc.values[0], entry->second.values[0]) << pc;
+      EXPECT_EQ(loc.values[1], entry->second.values[1]) << pc;
+    }
+    ASSERT_TRUE(loc_regs.cie != nullptr);
+    EXPECT_EQ(static_cast<uint64_t>(ARM_REG_LR), loc_regs.cie->return_address_register);
+    EXPECT_FALSE(loc_regs.cie->is_signal_frame);
+  }
+
+  DwarfLocations loc_regs;
+  EXPECT_FALSE(table->GetLocations(UnwindTable::SECTION_DEBUG_FRAME, 0xfff, &loc_regs));
+  EXPECT_FALSE(table->GetLocations(UnwindTable::SECTION_DEBUG_FRAME, 0x1100, &loc_regs));
+  EXPECT_FALSE(table->GetLocations(UnwindTable::SECTION_EH_FRAME, 0x1000, &loc_regs));
+}
+
+TEST_F(UnwindTableTest, create_without_build_id) {
+  interface_->FakeSetBuildIDSize(0);
+  EXPECT_EQ("", UnwindTable::Create(elf_.get()));
+}
+
+TEST_F(UnwindTableTest, open_mismatch) {
+  std::string data = UnwindTable::Create(elf_.get());
+  ASSERT_FALSE(data.empty());
+
+  EXPECT_TRUE(UnwindTable::FromData(data, build_id_, ARCH_ARM) != nullptr);
+  EXPECT_TRUE(UnwindTable::FromData(data, "\xde\xad\xbe\xee", ARCH_ARM) == nullptr);
+  EXPECT_TRUE(UnwindTable::FromData(data, build_id_, ARCH_X86) == nullptr);
+  EXPECT_TRUE(UnwindTable::FromData(data.substr(0, data.size() - 1), build_id_, ARCH_ARM) ==
+              nullptr);
+  EXPECT_TRUE(UnwindTable::FromData("", build_id_, ARCH_ARM) == nullptr);
+
+  data[0] = 'X';
+  EXPECT_TRUE(UnwindTable::FromData(data, build_id_, ARCH_ARM) == nullptr);
+}
+
+TEST_F(UnwindTableTest, step_uses_table) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + '/' + UnwindTable::GetFileName(build_id_);
+  EXPECT_EQ("deadbeef.unwind_table", UnwindTable::GetFileName(build_id_));
+  ASSERT_TRUE(UnwindTable::Write(elf_.get(), path));
+  EXPECT_FALSE(elf_->LoadUnwindTable(path + ".missing"));
+  ASSERT_TRUE(elf_->LoadUnwindTable(path));
+  UnwindTable* table = elf_->unwind_table();
+  ASSERT_TRUE(table != nullptr);
+  // Cached rows point into the loaded table, so it is never replaced.
+  EXPECT_FALSE(elf_->LoadUnwindTable(path));
+  EXPECT_EQ(table, elf_->unwind_table());
+
+  // Without the dwarf data, the only way to step is through the table.
+  memory_.Clear();
+
+  MemoryFake process_memory;
+  process_memory.SetData32(0x8004, 0x2222);
+  RegsArm regs;
+  regs[ARM_REG_PC] = 0x1008;
+  regs[ARM_REG_SP] = 0x8000;
+  regs[ARM_REG_LR] = 0x1111;
+  bool finished;
+  bool is_signal_frame;
+  ASSERT_TRUE(elf_->Step(0x1008, &regs, &process_memory, &finished, &is_signal_frame));
+  EXPECT_FALSE(finished);
+  EXPECT_FALSE(is_signal_frame);
+  EXPECT_EQ(0x2222U, regs.pc());
+  EXPECT_EQ(0x8008U, regs.sp());
+
+  regs[ARM_REG_PC] = 0x2000;
+  regs[ARM_REG_SP] = 0x8000;
+  EXPECT_FALSE(elf_->Step(0x2000, &regs, &process_memory, &finished, &is_signal_frame));
+}
+
+}  // namespace unwindstack
@@ -700,4 +700,101 @@ TEST_F(UnwindTest, thread_unwind_multiple_thread_from_threads_updatable_maps) {
   }
 }
 
+static void VerifyThreadUnwindResult(ThreadUnwinder* unwinder, ThreadUnwindResult* result) {
+  ASSERT_EQ(ERROR_NONE, result->error.code) << "tid " << result->tid;
+  unwinder->frames() = std::move(result->frames);
+  VerifyUnwindFrames(unwinder, kFunctionOrder);
+}
+
+TEST_F(UnwindTest, thread_unwind_threads) {
+  static constexpr size_t kNumThreads = 100;
+  ResetGlobals();
+
+  std::atomic_int tids[kNumThreads] = {};
+  std::vector<std::thread*> threads;
+  for (size_t i = 0; i < kNumThreads; i++) {
+    std::thread* thread = new std::thread([&tids, i]() {
+      tids[i] = android::base::GetThreadId();
+      OuterFunction(TEST_TYPE_LOCAL_WAIT_FOR_FINISH);
+    });
+    threads.push_back(thread);
+  }
+
+  while (g_waiters.load() != kNumThreads)
+    ;
+
+  ThreadUnwinder unwinder(512);
+  ASSERT_TRUE(unwinder.Init());
+
+  std::vector<pid_t> tid_list;
+  for (size_t i = 0; i < kNumThreads; i++) {
+    tid_list.push_back(tids[i]);
+  }
+  std::vector<ThreadUnwindResult> results = unwinder.UnwindThreads(SIGRTMIN, tid_list, 4);
+  ASSERT_EQ(kNumThreads, results.size());
+  for (size_t i = 0; i < kNumThreads; i++) {
+    ASSERT_EQ(tid_list[i], results[i].tid);
+    VerifyThreadUnwindResult(&unwinder, &results[i]);
+  }
+
+  g_finish = true;
+
+  for (auto* thread : threads) {
+    thread->join();
+    delete thread;
+  }
+}
+
+TEST_F(UnwindTest, thread_unwind_all_threads) {
+  static constexpr size_t kNumThreads = 10;
+  ResetGlobals();
+
+  std::atomic_int tids[kNumThreads] = {};
+  std::vector<std::thread*> threads;
+  for (size_t i = 0; i < kNumThreads; i++) {
+    std::thread* thread = new std::thread([&tids, i]() {
+      tids[i] = android::base::GetThreadId();
+      OuterFunction(TEST_TYPE_LOCAL_WAIT_FOR_FINISH);
+    });
+    threads.push_back(thread);
+  }
+
+  while (g_waiters.load() != kNumThreads)
+    ;
+
+  ThreadUnwinder unwinder(512);
+  ASSERT_TRUE(unwinder.Init());
+  std::vector<ThreadUnwindResult> results = unwinder.UnwindAllThreads(SIGRTMIN, 4);
+
+  pid_t self = android::base::GetThreadId();
+  size_t found = 0;
+  for (auto& result : results) {
+    ASSERT_NE(self, result.tid);
+    for (size_t i = 0; i < kNumThreads; i++) {
+      if (result.tid == tids[i]) {
+        VerifyThreadUnwindResult(&unwinder, &result);
+        found++;
+      }
+    }
+  }
+  EXPECT_EQ(kNumThreads, found);
+
+  g_finish = true;
+
+  for (auto* thread : threads) {
+    thread->join();
+    delete thread;
+  }
+}
+
+TEST_F(UnwindTest, thread_unwind_threads_cur_thread) {
+  ThreadUnwinder unwinder(512);
+  ASSERT_TRUE(unwinder.Init());
+  pid_t self = android::base::GetThreadId();
+  std::vector<ThreadUnwindResult> results = unwinder.UnwindThreads(SIGRTMIN, {self}, 2);
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(ERROR_UNSUPPORTED, results[0].error.code);
+  EXPECT_EQ(0U, results[0].frames.size());
+}
+
 }  // namespace unwindstack
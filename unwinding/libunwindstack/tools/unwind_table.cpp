@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/UnwindTable.h>
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    printf("Usage: unwind_table ELF_FILE OUTPUT_DIR\n");
+    printf("  Precompute the unwind rules for every pc in ELF_FILE and write\n");
+    printf("  them to OUTPUT_DIR, named after the build id of the elf. Point\n");
+    printf("  Elf::SetUnwindTableDirectory() at OUTPUT_DIR to use them.\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (stat(argv[1], &st) == -1) {
+    printf("Cannot stat %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    printf("%s is not a regular file.\n", argv[1]);
+    return 1;
+  }
+
+  unwindstack::Elf elf(unwindstack::Memory::CreateFileMemory(argv[1], 0).release());
+  if (!elf.Init() || !elf.valid()) {
+    printf("%s is not a valid elf file.\n", argv[1]);
+    return 1;
+  }
+
+  std::string build_id = elf.GetBuildID();
+  if (build_id.empty()) {
+    printf("%s has no build id.\n", argv[1]);
+    return 1;
+  }
+
+  std::string path = std::string(argv[2]) + '/' + unwindstack::UnwindTable::GetFileName(build_id);
+  if (!unwindstack::UnwindTable::Write(&elf, path)) {
+    printf("Failed to write %s\n", path.c_str());
+    return 1;
+  }
+  printf("Wrote %s\n", path.c_str());
+  return 0;
+}
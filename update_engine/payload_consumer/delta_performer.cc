@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <linux/fs.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cstring>
@@ -76,6 +77,7 @@ const unsigned DeltaPerformer::kProgressLogTimeoutSeconds = 30;
 const unsigned DeltaPerformer::kProgressDownloadWeight = 50;
 const unsigned DeltaPerformer::kProgressOperationsWeight = 50;
 const uint64_t DeltaPerformer::kCheckpointFrequencySeconds = 1;
+const size_t DeltaPerformer::kMaxOperationThreads = 8;
 
 namespace {
 const int kUpdateStateOperationInvalid = -1;
@@ -225,7 +227,18 @@ int DeltaPerformer::CloseCurrentPartition() {
   if (!partition_writer_) {
     return 0;
   }
-  int err = partition_writer_->Close();
+  // Stop the worker threads before closing the writers they use.
+  executor_.reset();
+  int err = 0;
+  for (auto& writer : parallel_writers_) {
+    int writer_err = writer->Close();
+    if (!err)
+      err = writer_err;
+  }
+  parallel_writers_.clear();
+  int writer_err = partition_writer_->Close();
+  if (!err)
+    err = writer_err;
   partition_writer_ = nullptr;
   return err;
 }
@@ -255,10 +268,43 @@ bool DeltaPerformer::OpenCurrentPartition() {
 
   TEST_AND_RETURN_FALSE(partition_writer_->Init(
       install_plan_, source_may_exist, partition_operation_num));
+  StartOperationExecutor(source_may_exist);
   CheckpointUpdateProgress(true);
   return true;
 }
 
+void DeltaPerformer::StartOperationExecutor(bool source_may_exist) {
+  size_t num_threads = max_operation_threads_;
+  if (num_threads == 0) {
+    num_threads = min(
+        static_cast<size_t>(std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L)),
+        kMaxOperationThreads);
+  }
+
+  vector<PartitionWriter*> writers = {partition_writer_.get()};
+  while (writers.size() < num_threads) {
+    auto writer =
+        partition_writer_->CreateParallelWriter(install_plan_, source_may_exist);
+    if (!writer)
+      break;
+    writers.push_back(writer.get());
+    parallel_writers_.push_back(std::move(writer));
+  }
+  if (writers.size() < 2)
+    return;
+
+  const string& partition_name =
+      partitions_[current_partition_].partition_name();
+  LOG(INFO) << "Applying the operations of partition \"" << partition_name
+            << "\" on " << writers.size() << " threads.";
+  executor_ =
+      std::make_unique<InstallOperationExecutor>(partition_name, writers);
+}
+
+bool DeltaPerformer::WaitForOperations(ErrorCode* error) {
+  return !executor_ || executor_->Wait(error);
+}
+
 size_t DeltaPerformer::GetPartitionOperationNum() {
   return next_operation_num_ -
          (current_partition_ ? acc_num_operations_[current_partition_ - 1] : 0);
@@ -391,13 +437,20 @@ MetadataParseResult DeltaPerformer::ParsePayloadMetadata(
   return MetadataParseResult::kSuccess;
 }
 
-#define OP_DURATION_HISTOGRAM(_op_name, _start_time)                         \
-  LOCAL_HISTOGRAM_CUSTOM_TIMES(                                              \
-      "UpdateEngine.DownloadAction.InstallOperation::" _op_name ".Duration", \
-      (base::TimeTicks::Now() - _start_time),                                \
-      base::TimeDelta::FromMilliseconds(10),                                 \
-      base::TimeDelta::FromMinutes(5),                                       \
-      20);
+// With |executor_|, the operations are only submitted here, and the executor
+// records the time they take to apply.
+#define OP_DURATION_HISTOGRAM(_op_name, _start_time)                           \
+  do {                                                                         \
+    if (!executor_) {                                                          \
+      LOCAL_HISTOGRAM_CUSTOM_TIMES(                                            \
+          "UpdateEngine.DownloadAction.InstallOperation::" _op_name            \
+          ".Duration",                                                         \
+          (base::TimeTicks::Now() - _start_time),                              \
+          base::TimeDelta::FromMilliseconds(10),                               \
+          base::TimeDelta::FromMinutes(5),                                     \
+          20);                                                                 \
+    }                                                                          \
+  } while (0)
 
 // Wrapper around write. Returns true if all requested bytes
 // were written, or false on any error, regardless of progress
@@ -499,6 +552,7 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
     // |num_total_operations_| limit yet.
     if (next_operation_num_ >= acc_num_operations_[current_partition_]) {
       if (partition_writer_) {
+        TEST_AND_RETURN_FALSE(WaitForOperations(error));
         TEST_AND_RETURN_FALSE(partition_writer_->FinishedInstallOps());
       }
       CloseCurrentPartition();
@@ -552,12 +606,12 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
       case InstallOperation::REPLACE:
       case InstallOperation::REPLACE_BZ:
       case InstallOperation::REPLACE_XZ:
-        op_result = PerformReplaceOperation(op);
+        op_result = PerformReplaceOperation(op, error);
         OP_DURATION_HISTOGRAM("REPLACE", op_start_time);
         break;
       case InstallOperation::ZERO:
       case InstallOperation::DISCARD:
-        op_result = PerformZeroOrDiscardOperation(op);
+        op_result = PerformZeroOrDiscardOperation(op, error);
         OP_DURATION_HISTOGRAM("ZERO_OR_DISCARD", op_start_time);
         break;
       case InstallOperation::SOURCE_COPY:
@@ -585,6 +639,7 @@ bool DeltaPerformer::Write(const void* bytes, size_t count, ErrorCode* error) {
   }
 
   if (partition_writer_) {
+    TEST_AND_RETURN_FALSE(WaitForOperations(error));
     TEST_AND_RETURN_FALSE(partition_writer_->FinishedInstallOps());
   }
   CloseCurrentPartition();
@@ -845,7 +900,7 @@ bool DeltaPerformer::CanPerformInstallOperation(
 }
 
 bool DeltaPerformer::PerformReplaceOperation(
-    const InstallOperation& operation) {
+    const InstallOperation& operation, ErrorCode* error) {
   CHECK(operation.type() == InstallOperation::REPLACE ||
         operation.type() == InstallOperation::REPLACE_BZ ||
         operation.type() == InstallOperation::REPLACE_XZ);
@@ -854,6 +909,10 @@ bool DeltaPerformer::PerformReplaceOperation(
   // the data we need should be exactly at the beginning of the buffer.
   TEST_AND_RETURN_FALSE(buffer_.size() >= operation.data_length());
 
+  if (executor_) {
+    return executor_->Submit(
+        operation, GetPartitionOperationNum(), TakeBuffer(), error);
+  }
   TEST_AND_RETURN_FALSE(partition_writer_->PerformReplaceOperation(
       operation, buffer_.data(), buffer_.size()));
   // Update buffer
@@ -862,7 +921,7 @@ bool DeltaPerformer::PerformReplaceOperation(
 }
 
 bool DeltaPerformer::PerformZeroOrDiscardOperation(
-    const InstallOperation& operation) {
+    const InstallOperation& operation, ErrorCode* error) {
   CHECK(operation.type() == InstallOperation::DISCARD ||
         operation.type() == InstallOperation::ZERO);
 
@@ -870,6 +929,10 @@ bool DeltaPerformer::PerformZeroOrDiscardOperation(
   TEST_AND_RETURN_FALSE(!operation.has_data_offset());
   TEST_AND_RETURN_FALSE(!operation.has_data_length());
 
+  if (executor_) {
+    return executor_->Submit(
+        operation, GetPartitionOperationNum(), brillo::Blob(), error);
+  }
   return partition_writer_->PerformZeroOrDiscardOperation(operation);
 }
 
@@ -917,6 +980,10 @@ bool DeltaPerformer::PerformSourceCopyOperation(
     TEST_AND_RETURN_FALSE(operation.src_length() % block_size_ == 0);
   if (operation.has_dst_length())
     TEST_AND_RETURN_FALSE(operation.dst_length() % block_size_ == 0);
+  if (executor_) {
+    return executor_->Submit(
+        operation, GetPartitionOperationNum(), brillo::Blob(), error);
+  }
   return partition_writer_->PerformSourceCopyOperation(operation, error);
 }
 
@@ -953,6 +1020,10 @@ bool DeltaPerformer::PerformSourceBsdiffOperation(
   if (operation.has_dst_length())
     TEST_AND_RETURN_FALSE(operation.dst_length() % block_size_ == 0);
 
+  if (executor_) {
+    return executor_->Submit(
+        operation, GetPartitionOperationNum(), TakeBuffer(), error);
+  }
   TEST_AND_RETURN_FALSE(partition_writer_->PerformSourceBsdiffOperation(
       operation, error, buffer_.data(), buffer_.size()));
   DiscardBuffer(true, buffer_.size());
@@ -965,6 +1036,10 @@ bool DeltaPerformer::PerformPuffDiffOperation(const InstallOperation& operation,
   // the data we need should be exactly at the beginning of the buffer.
   TEST_AND_RETURN_FALSE(buffer_offset_ == operation.data_offset());
   TEST_AND_RETURN_FALSE(buffer_.size() >= operation.data_length());
+  if (executor_) {
+    return executor_->Submit(
+        operation, GetPartitionOperationNum(), TakeBuffer(), error);
+  }
   TEST_AND_RETURN_FALSE(partition_writer_->PerformPuffDiffOperation(
       operation, error, buffer_.data(), buffer_.size()));
   DiscardBuffer(true, buffer_.size());
@@ -1322,6 +1397,16 @@ void DeltaPerformer::DiscardBuffer(bool do_advance_offset,
   brillo::Blob().swap(buffer_);
 }
 
+brillo::Blob DeltaPerformer::TakeBuffer() {
+  buffer_offset_ += buffer_.size();
+  payload_hash_calculator_.Update(buffer_.data(), buffer_.size());
+  signed_hash_calculator_.Update(buffer_.data(), buffer_.size());
+
+  brillo::Blob data;
+  data.swap(buffer_);
+  return data;
+}
+
 bool DeltaPerformer::CanResumeUpdate(PrefsInterface* prefs,
                                      const string& update_check_response_hash) {
   int64_t next_operation = kUpdateStateOperationInvalid;
@@ -1406,6 +1491,12 @@ bool DeltaPerformer::CheckpointUpdateProgress(bool force) {
   if (!force && !ShouldCheckpoint()) {
     return false;
   }
+  // The checkpoint must not cover operations which are still being applied.
+  // Failures are reported by the next call to the executor.
+  if (executor_) {
+    ErrorCode error;
+    TEST_AND_RETURN_FALSE(executor_->Wait(&error));
+  }
   Terminator::set_exit_blocked(true);
   if (last_updated_operation_num_ != next_operation_num_ || force) {
     // Resets the progress in case we die in the middle of the state update.
@@ -1450,7 +1541,9 @@ bool DeltaPerformer::CheckpointUpdateProgress(bool force) {
       TEST_AND_RETURN_FALSE(
           prefs_->SetInt64(kPrefsUpdateStateNextDataLength, 0));
     }
-    if (partition_writer_) {
+    if (executor_) {
+      executor_->CheckpointUpdateProgress(GetPartitionOperationNum());
+    } else if (partition_writer_) {
       partition_writer_->CheckpointUpdateProgress(GetPartitionOperationNum());
     } else {
       CHECK_EQ(next_operation_num_, num_total_operations_)
@@ -34,6 +34,7 @@
 #include "update_engine/common/platform_constants.h"
 #include "update_engine/payload_consumer/file_descriptor.h"
 #include "update_engine/payload_consumer/file_writer.h"
+#include "update_engine/payload_consumer/install_operation_executor.h"
 #include "update_engine/payload_consumer/install_plan.h"
 #include "update_engine/payload_consumer/partition_writer.h"
 #include "update_engine/payload_consumer/payload_metadata.h"
@@ -64,6 +65,9 @@ class DeltaPerformer : public FileWriter {
   static const unsigned kProgressDownloadWeight;
   static const unsigned kProgressOperationsWeight;
   static const uint64_t kCheckpointFrequencySeconds;
+  // Upper bound on the number of threads applying the operations of a
+  // partition when set_max_operation_threads() is given 0.
+  static const size_t kMaxOperationThreads;
 
   DeltaPerformer(PrefsInterface* prefs,
                  BootControlInterface* boot_control,
@@ -162,6 +166,14 @@ class DeltaPerformer : public FileWriter {
     public_key_path_ = public_key_path;
   }
 
+  // Sets the number of threads applying the operations of a partition. 1, the
+  // default, applies them on the thread calling Write(). 0 picks a number
+  // based on the number of CPUs. Applying operations on several threads is
+  // experimental and off unless enabled here.
+  void set_max_operation_threads(size_t max_operation_threads) {
+    max_operation_threads_ = max_operation_threads;
+  }
+
   void set_update_certificates_path(
       const std::string& update_certificates_path) {
     update_certificates_path_ = update_certificates_path;
@@ -271,8 +283,10 @@ class DeltaPerformer : public FileWriter {
   // These perform a specific type of operation and return true on success.
   // |error| will be set if source hash mismatch, otherwise |error| might not be
   // set even if it fails.
-  bool PerformReplaceOperation(const InstallOperation& operation);
-  bool PerformZeroOrDiscardOperation(const InstallOperation& operation);
+  bool PerformReplaceOperation(const InstallOperation& operation,
+                               ErrorCode* error);
+  bool PerformZeroOrDiscardOperation(const InstallOperation& operation,
+                                     ErrorCode* error);
   bool PerformSourceCopyOperation(const InstallOperation& operation,
                                   ErrorCode* error);
   bool PerformSourceBsdiffOperation(const InstallOperation& operation,
@@ -292,6 +306,18 @@ class DeltaPerformer : public FileWriter {
   // accordingly.
   void DiscardBuffer(bool do_advance_offset, size_t signed_hash_buffer_size);
 
+  // Same as DiscardBuffer(true, buffer_.size()), but returns the content of
+  // |buffer_| instead of discarding it.
+  brillo::Blob TakeBuffer();
+
+  // Starts the threads applying the operations of the current partition, if
+  // the partition writer supports it and more than one thread is allowed.
+  void StartOperationExecutor(bool source_may_exist);
+
+  // Waits for the operations submitted to |executor_|, if any. Returns false
+  // and sets |error| if one of them failed.
+  bool WaitForOperations(ErrorCode* error);
+
   // Primes the required update state. Returns true if the update state was
   // successfully initialized to a saved resume state or if the update is a new
   // update. Returns false otherwise.
@@ -436,6 +462,17 @@ class DeltaPerformer : public FileWriter {
 
   std::unique_ptr<PartitionWriter> partition_writer_;
 
+  // The maximum number of threads applying operations, see
+  // set_max_operation_threads().
+  size_t max_operation_threads_{1};
+
+  // The writers used by the threads of |executor_| besides
+  // |partition_writer_|, and the executor applying the operations of the
+  // current partition. |executor_| is null when operations are applied on the
+  // thread calling Write().
+  std::vector<std::unique_ptr<PartitionWriter>> parallel_writers_;
+  std::unique_ptr<InstallOperationExecutor> executor_;
+
   DISALLOW_COPY_AND_ASSIGN(DeltaPerformer);
 };
 
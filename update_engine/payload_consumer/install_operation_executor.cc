@@ -0,0 +1,270 @@
+//
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/install_operation_executor.h"
+
+#include <utility>
+
+#include <base/logging.h>
+#include <base/metrics/histogram_macros.h>
+#include <base/time/time.h>
+
+#include "update_engine/payload_consumer/payload_constants.h"
+
+using std::string;
+using std::vector;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+// Number of operations queued per worker thread before Submit() blocks. This
+// bounds the memory used by the data blobs of the pending operations.
+constexpr size_t kMaxPendingOperationsPerThread = 2;
+
+bool ApplyOperation(PartitionWriter* writer,
+                    const InstallOperation& operation,
+                    const brillo::Blob& data,
+                    ErrorCode* error) {
+  switch (operation.type()) {
+    case InstallOperation::REPLACE:
+    case InstallOperation::REPLACE_BZ:
+    case InstallOperation::REPLACE_XZ:
+      return writer->PerformReplaceOperation(
+          operation, data.data(), data.size());
+    case InstallOperation::ZERO:
+    case InstallOperation::DISCARD:
+      return writer->PerformZeroOrDiscardOperation(operation);
+    case InstallOperation::SOURCE_COPY:
+      return writer->PerformSourceCopyOperation(operation, error);
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+      return writer->PerformSourceBsdiffOperation(
+          operation, error, data.data(), data.size());
+    case InstallOperation::PUFFDIFF:
+      return writer->PerformPuffDiffOperation(
+          operation, error, data.data(), data.size());
+    default:
+      return false;
+  }
+}
+
+#define OP_DURATION_HISTOGRAM(_op_name, _duration)                           \
+  LOCAL_HISTOGRAM_CUSTOM_TIMES(                                              \
+      "UpdateEngine.DownloadAction.InstallOperation::" _op_name ".Duration", \
+      _duration,                                                             \
+      base::TimeDelta::FromMilliseconds(10),                                 \
+      base::TimeDelta::FromMinutes(5),                                       \
+      20);
+
+// Records the time it took to apply an operation of type |type|, in the same
+// histograms as DeltaPerformer does when it applies them itself.
+void RecordOperationDuration(InstallOperation::Type type,
+                             base::TimeDelta duration) {
+  switch (type) {
+    case InstallOperation::REPLACE:
+    case InstallOperation::REPLACE_BZ:
+    case InstallOperation::REPLACE_XZ:
+      OP_DURATION_HISTOGRAM("REPLACE", duration);
+      break;
+    case InstallOperation::ZERO:
+    case InstallOperation::DISCARD:
+      OP_DURATION_HISTOGRAM("ZERO_OR_DISCARD", duration);
+      break;
+    case InstallOperation::SOURCE_COPY:
+      OP_DURATION_HISTOGRAM("SOURCE_COPY", duration);
+      break;
+    case InstallOperation::SOURCE_BSDIFF:
+    case InstallOperation::BROTLI_BSDIFF:
+      OP_DURATION_HISTOGRAM("SOURCE_BSDIFF", duration);
+      break;
+    case InstallOperation::PUFFDIFF:
+      OP_DURATION_HISTOGRAM("PUFFDIFF", duration);
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+InstallOperationExecutor::InstallOperationExecutor(
+    const string& partition_name, const vector<PartitionWriter*>& writers)
+    : partition_name_(partition_name),
+      max_pending_operations_(kMaxPendingOperationsPerThread * writers.size()),
+      task_queued_(&lock_),
+      task_done_(&lock_),
+      writers_(writers) {
+  for (PartitionWriter* writer : writers_) {
+    workers_.push_back(std::make_unique<Worker>(this, writer));
+    threads_.push_back(std::make_unique<base::DelegateSimpleThread>(
+        workers_.back().get(), "install-operation"));
+    threads_.back()->Start();
+  }
+}
+
+InstallOperationExecutor::~InstallOperationExecutor() {
+  {
+    base::AutoLock auto_lock(lock_);
+    shutting_down_ = true;
+    task_queued_.Broadcast();
+  }
+  for (auto& thread : threads_)
+    thread->Join();
+}
+
+bool InstallOperationExecutor::Submit(const InstallOperation& operation,
+                                      size_t op_index,
+                                      brillo::Blob data,
+                                      ErrorCode* error) {
+  base::AutoLock auto_lock(lock_);
+  if (OverlapsUnflushedOperations(operation)) {
+    // Payloads normally never write the same block twice, so this is rare.
+    // The earlier writes may still sit in the cache of another writer, flush
+    // them all before going on.
+    LOG(INFO) << "Operation " << op_index << " of partition \""
+              << partition_name_
+              << "\" overlaps earlier operations, waiting for them.";
+    if (!WaitLocked(error))
+      return false;
+    CheckpointUpdateProgressLocked(op_index);
+  }
+
+  while (num_pending_ >= max_pending_operations_ &&
+         error_ == ErrorCode::kSuccess) {
+    task_done_.Wait();
+  }
+  if (error_ != ErrorCode::kSuccess) {
+    *error = error_;
+    return false;
+  }
+
+  for (const Extent& extent : operation.dst_extents()) {
+    if (extent.num_blocks())
+      unflushed_extents_[extent.start_block()] = extent.num_blocks();
+  }
+  queue_.push_back({&operation, op_index, std::move(data)});
+  num_pending_++;
+  task_queued_.Signal();
+  return true;
+}
+
+bool InstallOperationExecutor::Wait(ErrorCode* error) {
+  base::AutoLock auto_lock(lock_);
+  return WaitLocked(error);
+}
+
+bool InstallOperationExecutor::WaitLocked(ErrorCode* error) {
+  while (num_pending_ > 0)
+    task_done_.Wait();
+  if (error_ != ErrorCode::kSuccess) {
+    *error = error_;
+    return false;
+  }
+  return true;
+}
+
+void InstallOperationExecutor::CheckpointUpdateProgress(size_t next_op_index) {
+  base::AutoLock auto_lock(lock_);
+  CheckpointUpdateProgressLocked(next_op_index);
+}
+
+void InstallOperationExecutor::CheckpointUpdateProgressLocked(
+    size_t next_op_index) {
+  DCHECK_EQ(num_pending_, 0u);
+  for (PartitionWriter* writer : writers_)
+    writer->CheckpointUpdateProgress(next_op_index);
+  unflushed_extents_.clear();
+}
+
+bool InstallOperationExecutor::OverlapsUnflushedOperations(
+    const InstallOperation& operation) const {
+  for (const Extent& extent : operation.dst_extents()) {
+    if (!extent.num_blocks())
+      continue;
+    // The last unflushed extent starting before the end of |extent| is the
+    // only one which may overlap it, since unflushed extents are disjoint.
+    auto it = unflushed_extents_.lower_bound(extent.start_block() +
+                                             extent.num_blocks());
+    if (it == unflushed_extents_.begin())
+      continue;
+    --it;
+    if (it->first + it->second > extent.start_block())
+      return true;
+  }
+  return false;
+}
+
+bool InstallOperationExecutor::NextTask(Task* task) {
+  base::AutoLock auto_lock(lock_);
+  while (true) {
+    while (queue_.empty() && !shutting_down_)
+      task_queued_.Wait();
+
+    if (shutting_down_) {
+      while (!queue_.empty()) {
+        FinishTaskLocked(queue_.front());
+        queue_.pop_front();
+      }
+      return false;
+    }
+
+    *task = std::move(queue_.front());
+    queue_.pop_front();
+    if (error_ == ErrorCode::kSuccess)
+      return true;
+    // Don't apply anything after a failed operation.
+    FinishTaskLocked(*task);
+  }
+}
+
+void InstallOperationExecutor::FinishTask(const Task& task,
+                                          bool success,
+                                          ErrorCode error) {
+  base::AutoLock auto_lock(lock_);
+  if (!success && error_ == ErrorCode::kSuccess) {
+    LOG(ERROR) << "Failed to perform "
+               << InstallOperationTypeName(task.operation->type())
+               << " operation " << task.op_index << " in partition \""
+               << partition_name_ << "\"";
+    error_ = error == ErrorCode::kSuccess
+                 ? ErrorCode::kDownloadOperationExecutionError
+                 : error;
+  }
+  FinishTaskLocked(task);
+}
+
+void InstallOperationExecutor::FinishTaskLocked(const Task& task) {
+  // The extents of |task| stay in |unflushed_extents_| until the next flush.
+  num_pending_--;
+  task_done_.Broadcast();
+}
+
+void InstallOperationExecutor::Worker::Run() {
+  Task task;
+  while (executor_->NextTask(&task)) {
+    ErrorCode error = ErrorCode::kSuccess;
+    base::TimeTicks start_time = base::TimeTicks::Now();
+    bool success = ApplyOperation(writer_, *task.operation, task.data, &error);
+    RecordOperationDuration(task.operation->type(),
+                            base::TimeTicks::Now() - start_time);
+    // Release the data blob before waiting for the next task.
+    brillo::Blob().swap(task.data);
+    executor_->FinishTask(task, success, error);
+  }
+}
+
+}  // namespace chromeos_update_engine
@@ -0,0 +1,156 @@
+//
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UPDATE_ENGINE_PAYLOAD_CONSUMER_INSTALL_OPERATION_EXECUTOR_H_
+#define UPDATE_ENGINE_PAYLOAD_CONSUMER_INSTALL_OPERATION_EXECUTOR_H_
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+#include <brillo/secure_blob.h>
+
+#include "update_engine/common/error_code.h"
+#include "update_engine/payload_consumer/partition_writer.h"
+#include "update_engine/update_metadata.pb.h"
+
+namespace chromeos_update_engine {
+
+// Applies the InstallOperations of a partition on a pool of worker threads,
+// so that decompression, diff application and I/O of several operations
+// overlap with each other and with the download. Each worker thread applies
+// operations through its own PartitionWriter, so that writers never share
+// file descriptors or write caches.
+//
+// Operations are started in the order they are submitted. An operation whose
+// destination extents overlap those of an earlier operation is held back until
+// all the pending operations are applied and all the writers are flushed, so
+// that the result is the same as applying them in order. This holds for
+// completed operations too, since their writes may still sit in the write
+// cache of another writer until the next flush.
+class InstallOperationExecutor {
+ public:
+  // Each of |writers| gets a worker thread. The writers must outlive the
+  // executor. |partition_name| is only used for logging.
+  InstallOperationExecutor(const std::string& partition_name,
+                           const std::vector<PartitionWriter*>& writers);
+
+  // Stops the worker threads once the operations being applied complete.
+  // Operations not started yet are dropped.
+  ~InstallOperationExecutor();
+
+  // Queues |operation|, which is the operation |op_index| of the partition,
+  // with its |data| blob. |operation| must stay valid until it is applied.
+  // Blocks while too many operations are pending. Returns false and sets
+  // |error| if an operation failed; after a failure, no other operation is
+  // applied.
+  bool Submit(const InstallOperation& operation,
+              size_t op_index,
+              brillo::Blob data,
+              ErrorCode* error);
+
+  // Waits for all the submitted operations to be applied. Returns false and
+  // sets |error| if any of them failed.
+  bool Wait(ErrorCode* error);
+
+  // Forwards to the CheckpointUpdateProgress() of every writer, which flushes
+  // them. Must only be called when no operation is pending, i.e. after Wait().
+  void CheckpointUpdateProgress(size_t next_op_index);
+
+  size_t num_threads() const { return workers_.size(); }
+
+ private:
+  struct Task {
+    const InstallOperation* operation;
+    size_t op_index;
+    brillo::Blob data;
+  };
+
+  class Worker : public base::DelegateSimpleThread::Delegate {
+   public:
+    Worker(InstallOperationExecutor* executor, PartitionWriter* writer)
+        : executor_(executor), writer_(writer) {}
+    ~Worker() override = default;
+
+    // Overrides DelegateSimpleThread::Delegate.
+    void Run() override;
+
+   private:
+    InstallOperationExecutor* executor_;
+    PartitionWriter* writer_;
+
+    DISALLOW_COPY_AND_ASSIGN(Worker);
+  };
+
+  // Returns whether the destination of |operation| overlaps with that of an
+  // operation submitted since the writers were last flushed. Must be called
+  // with |lock_| held.
+  bool OverlapsUnflushedOperations(const InstallOperation& operation) const;
+
+  // Flushes all the writers. Must be called with |lock_| held and no
+  // operation pending.
+  void CheckpointUpdateProgressLocked(size_t next_op_index);
+
+  // Waits for the pending operations. Must be called with |lock_| held.
+  bool WaitLocked(ErrorCode* error);
+
+  // Pops the next task, blocking until there is one. Returns false once the
+  // executor is shutting down.
+  bool NextTask(Task* task);
+
+  // Records the completion of |task|.
+  void FinishTask(const Task& task, bool success, ErrorCode error);
+  // Same as FinishTask() for a task which was not applied. Must be called
+  // with |lock_| held.
+  void FinishTaskLocked(const Task& task);
+
+  const std::string partition_name_;
+  const size_t max_pending_operations_;
+
+  base::Lock lock_;
+  // Signaled when a task is queued or the executor is shutting down.
+  base::ConditionVariable task_queued_;
+  // Signaled when a task completes.
+  base::ConditionVariable task_done_;
+
+  // All the fields below are protected by |lock_|.
+  std::deque<Task> queue_;
+  // Number of tasks submitted and not completed yet, including the queued
+  // ones.
+  size_t num_pending_{0};
+  // The destination extents of the operations submitted since the writers
+  // were last flushed, as a map from the first block to the number of blocks.
+  // These extents never overlap.
+  std::map<uint64_t, uint64_t> unflushed_extents_;
+  bool shutting_down_{false};
+  ErrorCode error_{ErrorCode::kSuccess};
+
+  std::vector<PartitionWriter*> writers_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstallOperationExecutor);
+};
+
+}  // namespace chromeos_update_engine
+
+#endif  // UPDATE_ENGINE_PAYLOAD_CONSUMER_INSTALL_OPERATION_EXECUTOR_H_
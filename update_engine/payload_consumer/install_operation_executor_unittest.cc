@@ -0,0 +1,201 @@
+//
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "update_engine/payload_consumer/install_operation_executor.h"
+
+#include <atomic>
+#include <vector>
+
+#include <base/synchronization/lock.h>
+#include <base/threading/platform_thread.h>
+#include <base/time/time.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "update_engine/payload_consumer/mock_partition_writer.h"
+#include "update_engine/payload_generator/extent_ranges.h"
+
+using std::vector;
+using testing::_;
+using testing::Invoke;
+
+namespace chromeos_update_engine {
+
+namespace {
+
+InstallOperation MakeOperation(InstallOperation::Type type,
+                               uint64_t start_block,
+                               uint64_t num_blocks) {
+  InstallOperation op;
+  op.set_type(type);
+  *op.add_dst_extents() = ExtentForRange(start_block, num_blocks);
+  return op;
+}
+
+}  // namespace
+
+class InstallOperationExecutorTest : public testing::Test {
+ protected:
+  vector<PartitionWriter*> Writers() {
+    return {&writers_[0], &writers_[1], &writers_[2]};
+  }
+
+  MockPartitionWriter writers_[3];
+};
+
+TEST_F(InstallOperationExecutorTest, AppliesAllOperationsTest) {
+  std::atomic<size_t> num_applied{0};
+  for (auto& writer : writers_) {
+    EXPECT_CALL(writer, PerformZeroOrDiscardOperation(_))
+        .WillRepeatedly(Invoke([&num_applied](const InstallOperation&) {
+          num_applied++;
+          return true;
+        }));
+  }
+
+  vector<InstallOperation> ops;
+  for (size_t i = 0; i < 100; i++)
+    ops.push_back(MakeOperation(InstallOperation::ZERO, i * 2, 2));
+
+  InstallOperationExecutor executor("system", Writers());
+  EXPECT_EQ(3u, executor.num_threads());
+  ErrorCode error = ErrorCode::kSuccess;
+  for (size_t i = 0; i < ops.size(); i++)
+    ASSERT_TRUE(executor.Submit(ops[i], i, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Wait(&error));
+  EXPECT_EQ(ErrorCode::kSuccess, error);
+  EXPECT_EQ(ops.size(), num_applied);
+}
+
+TEST_F(InstallOperationExecutorTest, PassesDataTest) {
+  brillo::Blob data = {'a', 'b', 'c', 'd'};
+  EXPECT_CALL(writers_[0], PerformReplaceOperation(_, _, data.size()))
+      .WillOnce(Invoke([&data](const InstallOperation&,
+                               const void* blob,
+                               size_t size) {
+        return brillo::Blob(static_cast<const uint8_t*>(blob),
+                            static_cast<const uint8_t*>(blob) + size) == data;
+      }));
+
+  InstallOperation op = MakeOperation(InstallOperation::REPLACE, 0, 1);
+  InstallOperationExecutor executor("system", {&writers_[0]});
+  ErrorCode error = ErrorCode::kSuccess;
+  EXPECT_TRUE(executor.Submit(op, 0, data, &error));
+  EXPECT_TRUE(executor.Wait(&error));
+}
+
+TEST_F(InstallOperationExecutorTest, FailureStopsOperationsTest) {
+  // With a single thread operations are applied in order, so none of the
+  // operations after the failing one may be applied.
+  EXPECT_CALL(writers_[0], PerformSourceCopyOperation(_, _))
+      .WillRepeatedly(Invoke([](const InstallOperation& op, ErrorCode* error) {
+        EXPECT_LE(op.dst_extents(0).start_block(), 5u);
+        if (op.dst_extents(0).start_block() == 5u) {
+          *error = ErrorCode::kDownloadStateInitializationError;
+          return false;
+        }
+        return true;
+      }));
+
+  vector<InstallOperation> ops;
+  for (size_t i = 0; i < 50; i++)
+    ops.push_back(MakeOperation(InstallOperation::SOURCE_COPY, i, 1));
+
+  InstallOperationExecutor executor("system", {&writers_[0]});
+  ErrorCode error = ErrorCode::kSuccess;
+  size_t i = 0;
+  while (i < ops.size() && executor.Submit(ops[i], i, brillo::Blob(), &error))
+    i++;
+  EXPECT_FALSE(executor.Wait(&error));
+  EXPECT_EQ(ErrorCode::kDownloadStateInitializationError, error);
+
+  // The error is sticky.
+  error = ErrorCode::kSuccess;
+  InstallOperation op = MakeOperation(InstallOperation::SOURCE_COPY, 100, 1);
+  EXPECT_FALSE(executor.Submit(op, ops.size(), brillo::Blob(), &error));
+  EXPECT_EQ(ErrorCode::kDownloadStateInitializationError, error);
+}
+
+TEST_F(InstallOperationExecutorTest, OverlappingOperationsInOrderTest) {
+  base::Lock lock;
+  vector<uint64_t> applied;
+  for (auto& writer : writers_) {
+    EXPECT_CALL(writer, PerformZeroOrDiscardOperation(_))
+        .WillRepeatedly(Invoke([&](const InstallOperation& op) {
+          // Give the next operation a chance to overtake this one.
+          if (op.dst_extents(0).start_block() == 0)
+            base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(20));
+          base::AutoLock auto_lock(lock);
+          applied.push_back(op.dst_extents(0).start_block());
+          return true;
+        }));
+    // The writes of the first operation are flushed before the second one is
+    // applied.
+    EXPECT_CALL(writer, CheckpointUpdateProgress(1));
+    EXPECT_CALL(writer, CheckpointUpdateProgress(2)).Times(0);
+  }
+
+  InstallOperation first = MakeOperation(InstallOperation::ZERO, 0, 4);
+  InstallOperation second = MakeOperation(InstallOperation::ZERO, 3, 2);
+  InstallOperationExecutor executor("system", Writers());
+  ErrorCode error = ErrorCode::kSuccess;
+  EXPECT_TRUE(executor.Submit(first, 0, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Submit(second, 1, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Wait(&error));
+  EXPECT_EQ((vector<uint64_t>{0, 3}), applied);
+}
+
+TEST_F(InstallOperationExecutorTest, OverlapsCompletedOperationsTest) {
+  for (auto& writer : writers_) {
+    EXPECT_CALL(writer, PerformZeroOrDiscardOperation(_))
+        .WillRepeatedly(Invoke([](const InstallOperation&) { return true; }));
+    // The first operation is complete when the second one is submitted, but
+    // its writes may still be in the cache of its writer.
+    EXPECT_CALL(writer, CheckpointUpdateProgress(1));
+  }
+
+  InstallOperation first = MakeOperation(InstallOperation::ZERO, 0, 4);
+  InstallOperation second = MakeOperation(InstallOperation::ZERO, 2, 4);
+  InstallOperationExecutor executor("system", Writers());
+  ErrorCode error = ErrorCode::kSuccess;
+  EXPECT_TRUE(executor.Submit(first, 0, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Wait(&error));
+  EXPECT_TRUE(executor.Submit(second, 1, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Wait(&error));
+}
+
+TEST_F(InstallOperationExecutorTest, CheckpointForwardedToAllWritersTest) {
+  for (auto& writer : writers_) {
+    EXPECT_CALL(writer, PerformZeroOrDiscardOperation(_))
+        .WillRepeatedly(Invoke([](const InstallOperation&) { return true; }));
+    EXPECT_CALL(writer, CheckpointUpdateProgress(42));
+  }
+
+  InstallOperation first = MakeOperation(InstallOperation::ZERO, 0, 4);
+  InstallOperationExecutor executor("system", Writers());
+  ErrorCode error = ErrorCode::kSuccess;
+  EXPECT_TRUE(executor.Submit(first, 41, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Wait(&error));
+  executor.CheckpointUpdateProgress(42);
+
+  // The checkpoint flushed the writes of the first operation, so an operation
+  // overlapping it doesn't need another flush.
+  InstallOperation second = MakeOperation(InstallOperation::ZERO, 2, 4);
+  EXPECT_TRUE(executor.Submit(second, 42, brillo::Blob(), &error));
+  EXPECT_TRUE(executor.Wait(&error));
+}
+
+}  // namespace chromeos_update_engine
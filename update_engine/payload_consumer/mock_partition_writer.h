@@ -61,6 +61,12 @@ class MockPartitionWriter : public PartitionWriter {
               PerformPuffDiffOperation,
               (const InstallOperation&, ErrorCode*, const void*, size_t),
               (override));
+
+  // Mocks apply operations on the calling thread, in order.
+  std::unique_ptr<PartitionWriter> CreateParallelWriter(const InstallPlan*,
+                                                        bool) override {
+    return nullptr;
+  }
 };
 
 }  // namespace chromeos_update_engine
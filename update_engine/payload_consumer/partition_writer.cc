@@ -273,18 +273,8 @@ bool PartitionWriter::OpenSourcePartition(uint32_t source_slot,
   return true;
 }
 
-bool PartitionWriter::Init(const InstallPlan* install_plan,
-                           bool source_may_exist,
-                           size_t next_op_index) {
+bool PartitionWriter::OpenTargetPartition(uint32_t target_slot) {
   const PartitionUpdate& partition = partition_update_;
-  uint32_t source_slot = install_plan->source_slot;
-  uint32_t target_slot = install_plan->target_slot;
-  TEST_AND_RETURN_FALSE(OpenSourcePartition(source_slot, source_may_exist));
-
-  // We shouldn't open the source partition in certain cases, e.g. some dynamic
-  // partitions in delta payload, partitions included in the full payload for
-  // partial updates. Use the source size as the indicator.
-
   target_path_ = install_part_.target_path;
   int err;
 
@@ -303,6 +293,22 @@ bool PartitionWriter::Init(const InstallPlan* install_plan,
                << target_path_;
     return false;
   }
+  return true;
+}
+
+bool PartitionWriter::Init(const InstallPlan* install_plan,
+                           bool source_may_exist,
+                           size_t next_op_index) {
+  const PartitionUpdate& partition = partition_update_;
+  uint32_t source_slot = install_plan->source_slot;
+  uint32_t target_slot = install_plan->target_slot;
+  TEST_AND_RETURN_FALSE(OpenSourcePartition(source_slot, source_may_exist));
+
+  // We shouldn't open the source partition in certain cases, e.g. some dynamic
+  // partitions in delta payload, partitions included in the full payload for
+  // partial updates. Use the source size as the indicator.
+
+  TEST_AND_RETURN_FALSE(OpenTargetPartition(target_slot));
 
   LOG(INFO) << "Applying " << partition.operations().size()
             << " operations to partition \"" << partition.partition_name()
@@ -650,6 +656,28 @@ int PartitionWriter::Close() {
   return -err;
 }
 
+std::unique_ptr<PartitionWriter> PartitionWriter::CreateParallelWriter(
+    const InstallPlan* install_plan, bool source_may_exist) {
+  // Operations may read blocks that other operations write, in which case
+  // they have to be applied in order.
+  if (source_may_exist && !install_part_.source_path.empty() &&
+      install_part_.source_path == install_part_.target_path) {
+    return nullptr;
+  }
+
+  auto writer = std::make_unique<PartitionWriter>(partition_update_,
+                                                  install_part_,
+                                                  dynamic_control_,
+                                                  block_size_,
+                                                  interactive_);
+  if (!writer->OpenSourcePartition(install_plan->source_slot,
+                                   source_may_exist) ||
+      !writer->OpenTargetPartition(install_plan->target_slot)) {
+    return nullptr;
+  }
+  return writer;
+}
+
 void PartitionWriter::CheckpointUpdateProgress(size_t next_op_index) {
   target_fd_->Flush();
 }
@@ -83,6 +83,14 @@ class PartitionWriter {
       const void* data,
       size_t count);
 
+  // Returns a writer for the same partition, with its own file descriptors,
+  // which can apply operations concurrently with this one as long as their
+  // destination extents don't overlap. Returns nullptr if operations of this
+  // partition can't be applied in parallel. Subclasses which don't write
+  // through |target_fd_| must override this.
+  [[nodiscard]] virtual std::unique_ptr<PartitionWriter> CreateParallelWriter(
+      const InstallPlan* install_plan, bool source_may_exist);
+
   // |DeltaPerformer| calls this when all Install Ops are sent to partition
   // writer. No |Perform*Operation| methods will be called in the future, and
   // the partition writer is expected to be closed soon.
@@ -93,6 +101,7 @@ class PartitionWriter {
   FRIEND_TEST(PartitionWriterTest, ChooseSourceFDTest);
 
   bool OpenSourcePartition(uint32_t source_slot, bool source_may_exist);
+  bool OpenTargetPartition(uint32_t target_slot);
 
   bool OpenCurrentECCPartition();
   // For a given operation, choose the source fd to be used (raw device or error
@@ -47,6 +47,12 @@ class VABCPartitionWriter final : public PartitionWriter {
 
   void CheckpointUpdateProgress(size_t next_op_index) override;
 
+  // All the operations go through the single |cow_writer_|, in order.
+  [[nodiscard]] std::unique_ptr<PartitionWriter> CreateParallelWriter(
+      const InstallPlan* install_plan, bool source_may_exist) override {
+    return nullptr;
+  }
+
   static bool WriteAllCowOps(size_t block_size,
                              const std::vector<CowOperation>& converted,
                              android::snapshot::ICowWriter* cow_writer,
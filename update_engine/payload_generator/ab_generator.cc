@@ -49,13 +49,15 @@ bool ABGenerator::GenerateOperations(const PayloadGenerationConfig& config,
   size_t soft_chunk_blocks = config.soft_chunk_size / config.block_size;
 
   aops->clear();
-  TEST_AND_RETURN_FALSE(diff_utils::DeltaReadPartition(aops,
-                                                       old_part,
-                                                       new_part,
-                                                       hard_chunk_blocks,
-                                                       soft_chunk_blocks,
-                                                       config.version,
-                                                       blob_file));
+  TEST_AND_RETURN_FALSE(
+      diff_utils::DeltaReadPartition(aops,
+                                     old_part,
+                                     new_part,
+                                     hard_chunk_blocks,
+                                     soft_chunk_blocks,
+                                     config.version,
+                                     diff_utils::GetMaxThreads(config),
+                                     blob_file));
   LOG(INFO) << "done reading " << new_part.name;
 
   SortOperationsByDestination(aops);
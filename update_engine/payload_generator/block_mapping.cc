@@ -20,29 +20,115 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include <base/logging.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+
 #include "update_engine/common/utils.h"
 
 using std::string;
 using std::vector;
 
+namespace chromeos_update_engine {
+
 namespace {
 
-size_t HashValue(const brillo::Blob& blob) {
-  std::hash<string> hash_fn;
-  return hash_fn(string(blob.begin(), blob.end()));
+// Number of blocks each thread reads and hashes at once in
+// AddManyDiskBlocks(), 4 MiB with 4 KiB blocks.
+const size_t kBlocksPerHashTask = 1024;
+
+size_t HashValue(const uint8_t* data, size_t size) {
+  std::hash<std::string_view> hash_fn;
+  return hash_fn(std::string_view(reinterpret_cast<const char*>(data), size));
 }
 
-}  // namespace
+// Reads |num_blocks| contiguous blocks from |fd| into |data| and computes the
+// hash value of each one of them into |hashes|. Wait() blocks until Run() is
+// done, which may be on a different thread.
+class BlockHasher : public base::DelegateSimpleThread::Delegate {
+ public:
+  BlockHasher(int fd,
+              off_t byte_offset,
+              size_t block_size,
+              size_t num_blocks,
+              uint8_t* data,
+              size_t* hashes,
+              base::Lock* lock,
+              base::ConditionVariable* done)
+      : fd_(fd),
+        byte_offset_(byte_offset),
+        block_size_(block_size),
+        num_blocks_(num_blocks),
+        data_(data),
+        hashes_(hashes),
+        lock_(lock),
+        done_(done) {}
+  ~BlockHasher() override = default;
 
-namespace chromeos_update_engine {
+  // Overrides DelegateSimpleThread::Delegate.
+  void Run() override {
+    bool succeeded = ReadAndHash();
+    base::AutoLock auto_lock(*lock_);
+    succeeded_ = succeeded;
+    finished_ = true;
+    done_->Broadcast();
+  }
+
+  // Returns whether all the blocks were read once Run() is done.
+  bool Wait() {
+    base::AutoLock auto_lock(*lock_);
+    while (!finished_)
+      done_->Wait();
+    return succeeded_;
+  }
+
+ private:
+  bool ReadAndHash() {
+    size_t size = num_blocks_ * block_size_;
+    ssize_t bytes_read = 0;
+    if (!utils::PReadAll(fd_, data_, size, byte_offset_, &bytes_read) ||
+        static_cast<size_t>(bytes_read) != size) {
+      return false;
+    }
+    for (size_t i = 0; i < num_blocks_; i++)
+      hashes_[i] = HashValue(data_ + i * block_size_, block_size_);
+    return true;
+  }
+
+  int fd_;
+  off_t byte_offset_;
+  size_t block_size_;
+  size_t num_blocks_;
+  uint8_t* data_;
+  size_t* hashes_;
+
+  base::Lock* lock_;
+  base::ConditionVariable* done_;
+  bool finished_{false};
+  bool succeeded_{false};
+
+  DISALLOW_COPY_AND_ASSIGN(BlockHasher);
+};
+
+}  // namespace
 
 BlockMapping::BlockId BlockMapping::AddBlock(const brillo::Blob& block_data) {
-  return AddBlock(-1, 0, block_data);
+  if (block_data.size() != block_size_)
+    return -1;
+  return AddBlock(-1,
+                  0,
+                  block_data.data(),
+                  HashValue(block_data.data(), block_data.size()));
 }
 
 BlockMapping::BlockId BlockMapping::AddDiskBlock(int fd, off_t byte_offset) {
@@ -52,7 +138,8 @@ BlockMapping::BlockId BlockMapping::AddDiskBlock(int fd, off_t byte_offset) {
     return -1;
   if (static_cast<size_t>(bytes_read) != block_size_)
     return -1;
-  return AddBlock(fd, byte_offset, blob);
+  return AddBlock(
+      fd, byte_offset, blob.data(), HashValue(blob.data(), blob.size()));
 }
 
 bool BlockMapping::AddManyDiskBlocks(int fd,
@@ -61,21 +148,99 @@ bool BlockMapping::AddManyDiskBlocks(int fd,
                                      vector<BlockId>* block_ids) {
   bool ret = true;
   block_ids->resize(num_blocks);
-  for (size_t block = 0; block < num_blocks; block++) {
-    (*block_ids)[block] =
-        AddDiskBlock(fd, initial_byte_offset + block * block_size_);
-    ret = ret && (*block_ids)[block] != -1;
+
+  // The blocks are read and hashed in slices of |kBlocksPerHashTask| blocks
+  // by a single thread pool, which is kept up to |max_pending| slices ahead of
+  // this thread. The slices are added here in order, so the block ids don't
+  // depend on the number of threads.
+  const size_t num_tasks =
+      (num_blocks + kBlocksPerHashTask - 1) / kBlocksPerHashTask;
+  const size_t num_threads =
+      std::min(std::max(num_threads_, static_cast<size_t>(1)), num_tasks);
+  const size_t max_pending = std::min(2 * num_threads, num_tasks);
+
+  std::unique_ptr<base::DelegateSimpleThreadPool> thread_pool;
+  if (num_threads > 1) {
+    thread_pool = std::make_unique<base::DelegateSimpleThreadPool>(
+        "block-mapping", num_threads);
+    thread_pool->Start();
+  }
+
+  base::Lock lock;
+  base::ConditionVariable done(&lock);
+  vector<brillo::Blob> data(max_pending);
+  vector<vector<size_t>> hashes(max_pending);
+  std::deque<std::unique_ptr<BlockHasher>> hashers;
+  size_t next_task = 0;
+  for (size_t task = 0; task < num_tasks; task++) {
+    for (; next_task < std::min(task + max_pending, num_tasks); next_task++) {
+      const size_t slot = next_task % max_pending;
+      const size_t first_block = next_task * kBlocksPerHashTask;
+      const size_t task_blocks =
+          std::min(kBlocksPerHashTask, num_blocks - first_block);
+      data[slot].resize(task_blocks * block_size_);
+      hashes[slot].resize(task_blocks);
+      hashers.push_back(std::make_unique<BlockHasher>(
+          fd,
+          initial_byte_offset + first_block * block_size_,
+          block_size_,
+          task_blocks,
+          data[slot].data(),
+          hashes[slot].data(),
+          &lock,
+          &done));
+      if (thread_pool)
+        thread_pool->AddWork(hashers.back().get());
+      else
+        hashers.back()->Run();
+    }
+
+    std::unique_ptr<BlockHasher> hasher = std::move(hashers.front());
+    hashers.pop_front();
+    const size_t slot = task % max_pending;
+    const size_t first_block = task * kBlocksPerHashTask;
+    const size_t task_blocks =
+        std::min(kBlocksPerHashTask, num_blocks - first_block);
+    const off_t first_offset = initial_byte_offset + first_block * block_size_;
+    if (!hasher->Wait()) {
+      // Add the blocks one by one, so only the ones that can't be read fail.
+      LOG(WARNING) << "Failed to read blocks " << first_block << "-"
+                   << first_block + task_blocks - 1 << " at offset "
+                   << first_offset << ", reading them one at a time.";
+      size_t failed_blocks = 0;
+      for (size_t block = 0; block < task_blocks; block++) {
+        BlockId block_id = AddDiskBlock(fd, first_offset + block * block_size_);
+        (*block_ids)[first_block + block] = block_id;
+        if (block_id == -1)
+          failed_blocks++;
+      }
+      if (failed_blocks) {
+        LOG(ERROR) << failed_blocks << " of the blocks " << first_block << "-"
+                   << first_block + task_blocks - 1 << " couldn't be read.";
+        ret = false;
+      }
+      continue;
+    }
+
+    for (size_t block = 0; block < task_blocks; block++) {
+      BlockId block_id = AddBlock(fd,
+                                  first_offset + block * block_size_,
+                                  data[slot].data() + block * block_size_,
+                                  hashes[slot][block]);
+      (*block_ids)[first_block + block] = block_id;
+      ret = ret && block_id != -1;
+    }
   }
+
+  if (thread_pool)
+    thread_pool->JoinAll();
   return ret;
 }
 
 BlockMapping::BlockId BlockMapping::AddBlock(int fd,
                                              off_t byte_offset,
-                                             const brillo::Blob& block_data) {
-  if (block_data.size() != block_size_)
-    return -1;
-  size_t h = HashValue(block_data);
-
+                                             const uint8_t* block_data,
+                                             size_t h) {
   // We either reuse a UniqueBlock or create a new one. If we need a new
   // UniqueBlock it could also be part of a new or existing bucket (if there is
   // a hash collision).
@@ -87,7 +252,7 @@ BlockMapping::BlockId BlockMapping::AddBlock(int fd,
   } else {
     for (UniqueBlock& existing_block : mapping_it->second) {
       bool equals = false;
-      if (!existing_block.CompareData(block_data, &equals))
+      if (!existing_block.CompareData(block_data, block_size_, &equals))
         return -1;
       if (equals)
         return existing_block.block_id;
@@ -106,25 +271,25 @@ BlockMapping::BlockId BlockMapping::AddBlock(int fd,
   new_ublock->block_id = used_block_ids++;
   // We need to cache blocks that are not referencing any disk location.
   if (fd == -1)
-    new_ublock->block_data = block_data;
+    new_ublock->block_data.assign(block_data, block_data + block_size_);
 
   return new_ublock->block_id;
 }
 
-bool BlockMapping::UniqueBlock::CompareData(const brillo::Blob& other_block,
+bool BlockMapping::UniqueBlock::CompareData(const uint8_t* other_block,
+                                            size_t block_size,
                                             bool* equals) {
   if (!block_data.empty()) {
-    *equals = block_data == other_block;
+    *equals = std::equal(block_data.begin(), block_data.end(), other_block);
     return true;
   }
-  const size_t block_size = other_block.size();
   brillo::Blob blob(block_size);
   ssize_t bytes_read = 0;
   if (!utils::PReadAll(fd, blob.data(), block_size, byte_offset, &bytes_read))
     return false;
   if (static_cast<size_t>(bytes_read) != block_size)
     return false;
-  *equals = blob == other_block;
+  *equals = std::equal(blob.begin(), blob.end(), other_block);
 
   // We increase the number of times we had to read this block from disk and
   // we cache this block based on that. This caching method is optimized for
@@ -142,9 +307,10 @@ bool MapPartitionBlocks(const string& old_part,
                         size_t old_size,
                         size_t new_size,
                         size_t block_size,
+                        size_t num_threads,
                         vector<BlockMapping::BlockId>* old_block_ids,
                         vector<BlockMapping::BlockId>* new_block_ids) {
-  BlockMapping mapping(block_size);
+  BlockMapping mapping(block_size, num_threads);
   if (mapping.AddBlock(brillo::Blob(block_size, '\0')) != 0)
     return false;
   int old_fd = HANDLE_EINTR(open(old_part.c_str(), O_RDONLY));
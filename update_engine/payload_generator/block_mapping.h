@@ -17,8 +17,8 @@
 #ifndef UPDATE_ENGINE_PAYLOAD_GENERATOR_BLOCK_MAPPING_H_
 #define UPDATE_ENGINE_PAYLOAD_GENERATOR_BLOCK_MAPPING_H_
 
-#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <brillo/secure_blob.h>
@@ -39,6 +39,11 @@ class BlockMapping {
 
   explicit BlockMapping(size_t block_size) : block_size_(block_size) {}
 
+  // Same as above, but AddManyDiskBlocks() reads and hashes the blocks on
+  // |num_threads| threads.
+  BlockMapping(size_t block_size, size_t num_threads)
+      : block_size_(block_size), num_threads_(num_threads) {}
+
   // Add a single data block to the mapping. Returns its unique block id.
   // In case of error returns -1.
   BlockId AddBlock(const brillo::Blob& block_data);
@@ -52,7 +57,8 @@ class BlockMapping {
   // This is a helper method to add |num_blocks| contiguous blocks reading them
   // from the file descriptor |fd| starting at offset |initial_byte_offset|.
   // Returns whether it succeeded to add all the disk blocks and stores in
-  // |block_ids| the block id for each one of the added blocks.
+  // |block_ids| the block id for each one of the added blocks. The block ids
+  // are the same as if the blocks were added one by one with AddDiskBlock().
   bool AddManyDiskBlocks(int fd,
                          off_t initial_byte_offset,
                          size_t num_blocks,
@@ -61,12 +67,16 @@ class BlockMapping {
  private:
   FRIEND_TEST(BlockMappingTest, BlocksAreNotKeptInMemory);
 
-  // Add a single block passed in |block_data|. If |fd| is not -1, the block
-  // can be discarded to save RAM and retrieved later from |fd| at the position
-  // |byte_offset|.
-  BlockId AddBlock(int fd, off_t byte_offset, const brillo::Blob& block_data);
+  // Add a single block of |block_size_| bytes passed in |block_data|, whose
+  // hash value is |hash|. If |fd| is not -1, the block can be discarded to save
+  // RAM and retrieved later from |fd| at the position |byte_offset|.
+  BlockId AddBlock(int fd,
+                   off_t byte_offset,
+                   const uint8_t* block_data,
+                   size_t hash);
 
   size_t block_size_;
+  size_t num_threads_{1};
 
   BlockId used_block_ids{0};
 
@@ -85,14 +95,16 @@ class BlockMapping {
     // Number of times we have seen this data block. Used for caching.
     uint32_t times_read{0};
 
-    // Compares the UniqueBlock data with the other_block data and stores if
-    // they are equal in |equals|. Returns whether there was an error reading
-    // the block from disk while comparing it.
-    bool CompareData(const brillo::Blob& other_block, bool* equals);
+    // Compares the UniqueBlock data with the |block_size| bytes of
+    // |other_block| and stores if they are equal in |equals|. Returns whether
+    // there was an error reading the block from disk while comparing it.
+    bool CompareData(const uint8_t* other_block,
+                     size_t block_size,
+                     bool* equals);
   };
 
   // A mapping from hash values to possible block ids.
-  std::map<size_t, std::vector<UniqueBlock>> mapping_;
+  std::unordered_map<size_t, std::vector<UniqueBlock>> mapping_;
 };
 
 // Maps the blocks of the old and new partitions |old_part| and |new_part| whose
@@ -100,12 +112,14 @@ class BlockMapping {
 // with the same data will have the same block id and vice versa, regardless of
 // the partition they are on.
 // The block ids number 0 corresponds to the block with all zeros, but any
-// other block id number is assigned randomly.
+// other block id number is assigned randomly. The blocks are read and hashed
+// on |num_threads| threads.
 bool MapPartitionBlocks(const std::string& old_part,
                         const std::string& new_part,
                         size_t old_size,
                         size_t new_size,
                         size_t block_size,
+                        size_t num_threads,
                         std::vector<BlockMapping::BlockId>* old_block_ids,
                         std::vector<BlockMapping::BlockId>* new_block_ids);
 
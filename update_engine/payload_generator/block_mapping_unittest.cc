@@ -104,6 +104,7 @@ TEST_F(BlockMappingTest, MapPartitionBlocks) {
                                  old_contents.size(),
                                  new_contents.size(),
                                  block_size_,
+                                 1,  // num_threads
                                  &old_ids,
                                  &new_ids));
 
@@ -112,4 +113,73 @@ TEST_F(BlockMappingTest, MapPartitionBlocks) {
   EXPECT_EQ((vector<BlockMapping::BlockId>{0, 11, 12, 13, 1, 2}), new_ids);
 }
 
+TEST_F(BlockMappingTest, MapPartitionBlocksWithThreadsTest) {
+  // Enough blocks for several hashing tasks, with a few repeated blocks in
+  // each partition and between them.
+  const size_t num_blocks = 2500;
+  string old_contents(num_blocks * block_size_, '\0');
+  string new_contents(num_blocks * block_size_, '\0');
+  for (size_t block = 0; block < num_blocks; block++) {
+    old_contents[block * block_size_] = block % 1000;
+    old_contents[block * block_size_ + 1] = block % 1000 >> 8;
+    new_contents[block * block_size_] = block % 700;
+    new_contents[block * block_size_ + 2] = block % 700 >> 8;
+  }
+  test_utils::WriteFileString(old_part_.path(), old_contents);
+  test_utils::WriteFileString(new_part_.path(), new_contents);
+
+  vector<BlockMapping::BlockId> old_ids, new_ids;
+  EXPECT_TRUE(MapPartitionBlocks(old_part_.path(),
+                                 new_part_.path(),
+                                 old_contents.size(),
+                                 new_contents.size(),
+                                 block_size_,
+                                 1,  // num_threads
+                                 &old_ids,
+                                 &new_ids));
+
+  // The block ids don't depend on the number of threads.
+  vector<BlockMapping::BlockId> threaded_old_ids, threaded_new_ids;
+  EXPECT_TRUE(MapPartitionBlocks(old_part_.path(),
+                                 new_part_.path(),
+                                 old_contents.size(),
+                                 new_contents.size(),
+                                 block_size_,
+                                 4,  // num_threads
+                                 &threaded_old_ids,
+                                 &threaded_new_ids));
+  EXPECT_EQ(old_ids, threaded_old_ids);
+  EXPECT_EQ(new_ids, threaded_new_ids);
+
+  EXPECT_EQ(old_ids[0], new_ids[0]);
+  EXPECT_EQ(old_ids[5], old_ids[1005]);
+  EXPECT_EQ(new_ids[3], new_ids[2103]);
+  EXPECT_EQ(old_ids[1], new_ids[1]);
+  EXPECT_NE(old_ids[300], new_ids[300]);
+}
+
+TEST_F(BlockMappingTest, AddManyDiskBlocksFailsOnlyUnreadableBlocks) {
+  // The second hashing task runs past the end of the file.
+  const size_t file_blocks = 1500;
+  string contents(file_blocks * block_size_, '\0');
+  for (size_t block = 0; block < file_blocks; block++)
+    contents[block * block_size_] = block % 200;
+  test_utils::WriteFileString(old_part_.path(), contents);
+  int old_fd = HANDLE_EINTR(open(old_part_.path().c_str(), O_RDONLY));
+  ScopedFdCloser old_fd_closer(&old_fd);
+
+  BlockMapping mapping(block_size_, 4);
+  vector<BlockMapping::BlockId> ids;
+  EXPECT_FALSE(mapping.AddManyDiskBlocks(old_fd, 0, file_blocks + 100, &ids));
+  ASSERT_EQ(file_blocks + 100, ids.size());
+
+  BlockMapping serial_mapping(block_size_);
+  for (size_t block = 0; block < file_blocks + 100; block++) {
+    EXPECT_EQ(serial_mapping.AddDiskBlock(old_fd, block * block_size_),
+              ids[block]);
+  }
+  EXPECT_NE(-1, ids[file_blocks - 1]);
+  EXPECT_EQ(-1, ids[file_blocks]);
+}
+
 }  // namespace chromeos_update_engine
@@ -24,12 +24,14 @@
 
 #include <algorithm>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <base/logging.h>
 #include <base/threading/simple_thread.h>
+#include <base/time/time.h>
 
 #include "update_engine/common/utils.h"
 #include "update_engine/payload_consumer/delta_performer.h"
@@ -77,6 +79,7 @@ class PartitionProcessor : public base::DelegateSimpleThread::Delegate {
       std::vector<AnnotatedOperation>* aops,
       std::vector<CowMergeOperation>* cow_merge_sequence,
       size_t* cow_size,
+      base::TimeDelta* generation_time,
       std::unique_ptr<chromeos_update_engine::OperationsGenerator> strategy)
       : config_(config),
         old_part_(old_part),
@@ -85,14 +88,17 @@ class PartitionProcessor : public base::DelegateSimpleThread::Delegate {
         aops_(aops),
         cow_merge_sequence_(cow_merge_sequence),
         cow_size_(cow_size),
+        generation_time_(generation_time),
         strategy_(std::move(strategy)) {}
   PartitionProcessor(PartitionProcessor&&) noexcept = default;
 
   void Run() override {
     LOG(INFO) << "Started an async task to process partition "
               << new_part_.name;
+    base::TimeTicks start = base::TimeTicks::Now();
     bool success = strategy_->GenerateOperations(
         config_, old_part_, new_part_, file_writer_, aops_);
+    *generation_time_ = base::TimeTicks::Now() - start;
     if (!success) {
       // ABORT the entire process, so that developer can look
       // at recent logs and diagnose what happened
@@ -155,6 +161,7 @@ class PartitionProcessor : public base::DelegateSimpleThread::Delegate {
   std::vector<AnnotatedOperation>* aops_;
   std::vector<CowMergeOperation>* cow_merge_sequence_;
   size_t* cow_size_;
+  base::TimeDelta* generation_time_;
   std::unique_ptr<chromeos_update_engine::OperationsGenerator> strategy_;
   DISALLOW_COPY_AND_ASSIGN(PartitionProcessor);
 };
@@ -189,9 +196,11 @@ bool GenerateUpdatePayloadFile(const PayloadGenerationConfig& config,
     all_merge_sequences.resize(config.target.partitions.size());
 
     std::vector<size_t> all_cow_sizes(config.target.partitions.size(), 0);
+    std::vector<base::TimeDelta> all_generation_times(
+        config.target.partitions.size());
 
     std::vector<PartitionProcessor> partition_tasks{};
-    auto thread_count = std::min<int>(diff_utils::GetMaxThreads(),
+    auto thread_count = std::min<int>(diff_utils::GetMaxThreads(config),
                                       config.target.partitions.size());
     base::DelegateSimpleThreadPool thread_pool{"partition-thread-pool",
                                                thread_count};
@@ -224,6 +233,7 @@ bool GenerateUpdatePayloadFile(const PayloadGenerationConfig& config,
                                                    &all_aops[i],
                                                    &all_merge_sequences[i],
                                                    &all_cow_sizes[i],
+                                                   &all_generation_times[i],
                                                    std::move(strategy)));
     }
     thread_pool.Start();
@@ -232,6 +242,19 @@ bool GenerateUpdatePayloadFile(const PayloadGenerationConfig& config,
     }
     thread_pool.JoinAll();
 
+    // Report the slowest partitions first, they bound the generation time.
+    std::vector<size_t> order(config.target.partitions.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return all_generation_times[a] > all_generation_times[b];
+    });
+    for (size_t i : order) {
+      LOG(INFO) << "Generated " << all_aops[i].size()
+                << " operations for partition "
+                << config.target.partitions[i].name << " in "
+                << all_generation_times[i];
+    }
+
     for (size_t i = 0; i < config.target.partitions.size(); i++) {
       const PartitionConfig& old_part =
           config.is_delta ? config.source.partitions[i] : empty_part;
@@ -274,6 +274,7 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
                         ssize_t hard_chunk_blocks,
                         size_t soft_chunk_blocks,
                         const PayloadVersion& version,
+                        size_t max_threads,
                         BlobFileWriter* blob_file) {
   ExtentRanges old_visited_blocks;
   ExtentRanges new_visited_blocks;
@@ -291,6 +292,7 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
   }
 
   ExtentRanges old_zero_blocks;
+  base::TimeTicks start = base::TimeTicks::Now();
   TEST_AND_RETURN_FALSE(DeltaMovedAndZeroBlocks(aops,
                                                 old_part.path,
                                                 new_part.path,
@@ -298,10 +300,13 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
                                                 new_part.size / kBlockSize,
                                                 soft_chunk_blocks,
                                                 version,
+                                                max_threads,
                                                 blob_file,
                                                 &old_visited_blocks,
                                                 &new_visited_blocks,
                                                 &old_zero_blocks));
+  LOG(INFO) << "Found moved and zeroed blocks of " << new_part.name << " in "
+            << (base::TimeTicks::Now() - start);
 
   bool puffdiff_allowed = version.OperationAllowed(InstallOperation::PUFFDIFF);
   map<string, FilesystemInterface::File> old_files_map;
@@ -353,6 +358,38 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
         FilterExtentRanges(old_file.extents, old_zero_blocks);
     old_visited_blocks.AddExtents(old_file_extents);
 
+    // A file bigger than |hard_chunk_blocks| is diffed one chunk at a time
+    // anyway, so give each chunk its own task. Otherwise the few biggest
+    // files keep a single thread busy long after the others are done.
+    uint64_t file_blocks = utils::BlocksInExtents(new_file_extents);
+    if (hard_chunk_blocks > 0 &&
+        file_blocks > static_cast<uint64_t>(hard_chunk_blocks)) {
+      for (uint64_t block_offset = 0; block_offset < file_blocks;
+           block_offset += hard_chunk_blocks) {
+        // Same chunks and operation names as DeltaReadFile() would use.
+        vector<Extent> old_extents_chunk =
+            ExtentsSublist(old_file_extents, block_offset, hard_chunk_blocks);
+        vector<Extent> new_extents_chunk =
+            ExtentsSublist(new_file_extents, block_offset, hard_chunk_blocks);
+        NormalizeExtents(&old_extents_chunk);
+        NormalizeExtents(&new_extents_chunk);
+        file_delta_processors.emplace_back(
+            old_part.path,
+            new_part.path,
+            version,
+            std::move(old_extents_chunk),
+            std::move(new_extents_chunk),
+            old_file.deflates,
+            new_file.deflates,
+            base::StringPrintf("%s:%" PRIu64,
+                               new_file.name.c_str(),
+                               block_offset / hard_chunk_blocks),
+            hard_chunk_blocks,
+            blob_file);
+      }
+      continue;
+    }
+
     file_delta_processors.emplace_back(old_part.path,
                                        new_part.path,
                                        version,
@@ -395,14 +432,13 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
         blob_file);
   }
 
-  size_t max_threads = GetMaxThreads();
-
   // Sort the files in descending order based on number of new blocks to make
   // sure we start the largest ones first.
   if (file_delta_processors.size() > max_threads) {
     file_delta_processors.sort(std::greater<FileDeltaProcessor>());
   }
 
+  start = base::TimeTicks::Now();
   base::DelegateSimpleThreadPool thread_pool("incremental-update-generator",
                                              max_threads);
   thread_pool.Start();
@@ -410,6 +446,10 @@ bool DeltaReadPartition(vector<AnnotatedOperation>* aops,
     thread_pool.AddWork(&processor);
   }
   thread_pool.JoinAll();
+  LOG(INFO) << "Encoded " << file_delta_processors.size() << " files and "
+            << "chunks of " << new_part.name << " in "
+            << (base::TimeTicks::Now() - start) << " using " << max_threads
+            << " threads";
 
   for (auto& processor : file_delta_processors) {
     TEST_AND_RETURN_FALSE(processor.MergeOperation(aops));
@@ -425,6 +465,7 @@ bool DeltaMovedAndZeroBlocks(vector<AnnotatedOperation>* aops,
                              size_t new_num_blocks,
                              ssize_t chunk_blocks,
                              const PayloadVersion& version,
+                             size_t max_threads,
                              BlobFileWriter* blob_file,
                              ExtentRanges* old_visited_blocks,
                              ExtentRanges* new_visited_blocks,
@@ -436,6 +477,7 @@ bool DeltaMovedAndZeroBlocks(vector<AnnotatedOperation>* aops,
                                            old_num_blocks * kBlockSize,
                                            new_num_blocks * kBlockSize,
                                            kBlockSize,
+                                           max_threads,
                                            &old_block_ids,
                                            &new_block_ids));
 
@@ -946,6 +988,10 @@ size_t GetMaxThreads() {
   return std::max(sysconf(_SC_NPROCESSORS_ONLN), 4L);
 }
 
+size_t GetMaxThreads(const PayloadGenerationConfig& config) {
+  return config.max_threads ? config.max_threads : GetMaxThreads();
+}
+
 }  // namespace diff_utils
 
 }  // namespace chromeos_update_engine
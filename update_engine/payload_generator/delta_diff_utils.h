@@ -42,13 +42,16 @@ namespace diff_utils {
 // and soft chunk limits in number of blocks respectively. The soft chunk limit
 // is used to split MOVE and SOURCE_COPY operations and REPLACE_BZ of zeroed
 // blocks, while the hard limit is used to split a file when generating other
-// operations. A value of -1 in |hard_chunk_blocks| means whole files.
+// operations. A value of -1 in |hard_chunk_blocks| means whole files. The
+// files, and the chunks of the files bigger than |hard_chunk_blocks|, are
+// processed on |max_threads| threads.
 bool DeltaReadPartition(std::vector<AnnotatedOperation>* aops,
                         const PartitionConfig& old_part,
                         const PartitionConfig& new_part,
                         ssize_t hard_chunk_blocks,
                         size_t soft_chunk_blocks,
                         const PayloadVersion& version,
+                        size_t max_threads,
                         BlobFileWriter* blob_file);
 
 // Create operations in |aops| for identical blocks that moved around in the old
@@ -60,7 +63,8 @@ bool DeltaReadPartition(std::vector<AnnotatedOperation>* aops,
 // The collections |old_visited_blocks| and |new_visited_blocks| state what
 // blocks already have operations reading or writing them and only operations
 // for unvisited blocks are produced by this function updating both collections
-// with the used blocks.
+// with the used blocks. The partitions are read and hashed on |max_threads|
+// threads.
 bool DeltaMovedAndZeroBlocks(std::vector<AnnotatedOperation>* aops,
                              const std::string& old_part,
                              const std::string& new_part,
@@ -68,6 +72,7 @@ bool DeltaMovedAndZeroBlocks(std::vector<AnnotatedOperation>* aops,
                              size_t new_num_blocks,
                              ssize_t chunk_blocks,
                              const PayloadVersion& version,
+                             size_t max_threads,
                              BlobFileWriter* blob_file,
                              ExtentRanges* old_visited_blocks,
                              ExtentRanges* new_visited_blocks,
@@ -143,6 +148,10 @@ bool IsExtFilesystem(const std::string& device);
 // Returns the max number of threads to process the files(chunks) in parallel.
 size_t GetMaxThreads();
 
+// Returns the number of threads requested in |config|, or GetMaxThreads() if
+// none was.
+size_t GetMaxThreads(const PayloadGenerationConfig& config);
+
 // Returns the old file which file name has the shortest levenshtein distance to
 // |new_file_name|.
 FilesystemInterface::File GetOldFile(
@@ -134,6 +134,7 @@ class DeltaDiffUtilsTest : public ::testing::Test {
                                                new_part_.size / block_size_,
                                                chunk_blocks,
                                                version,
+                                               1,  // max_threads
                                                &blob_file,
                                                &old_visited_blocks_,
                                                &new_visited_blocks_,
@@ -172,6 +173,7 @@ TEST_F(DeltaDiffUtilsTest, SkipVerityExtentsTest) {
       -1,
       PayloadVersion(kMaxSupportedMajorPayloadVersion,
                      kVerityMinorPayloadVersion),
+      diff_utils::GetMaxThreads(),
       &blob_file));
   for (const auto& aop : aops_) {
     new_visited_blocks_.AddRepeatedExtents(aop.op.dst_extents());
@@ -184,6 +186,41 @@ TEST_F(DeltaDiffUtilsTest, SkipVerityExtentsTest) {
   }
 }
 
+TEST_F(DeltaDiffUtilsTest, BigFileSplitInChunksTest) {
+  EXPECT_TRUE(InitializePartitionWithUniqueBlocks(old_part_, block_size_, 42));
+  EXPECT_TRUE(InitializePartitionWithUniqueBlocks(new_part_, block_size_, 5));
+  static_cast<FakeFilesystem*>(old_part_.fs_interface.get())
+      ->AddFile("big", {ExtentForRange(10, 40)});
+  static_cast<FakeFilesystem*>(new_part_.fs_interface.get())
+      ->AddFile("big", {ExtentForRange(20, 40)});
+
+  BlobFileWriter blob_file(tmp_blob_file_.fd(), &blob_size_);
+  EXPECT_TRUE(diff_utils::DeltaReadPartition(
+      &aops_,
+      old_part_,
+      new_part_,
+      16,  // hard_chunk_blocks
+      16,  // soft_chunk_blocks
+      PayloadVersion(kBrilloMajorPayloadVersion, kSourceMinorPayloadVersion),
+      4,  // max_threads
+      &blob_file));
+
+  // Each chunk of the file is generated on its own, with the same operation
+  // names as when the whole file is processed at once.
+  ExtentRanges file_blocks;
+  for (const auto& aop : aops_) {
+    if (aop.name.find("big") != 0)
+      continue;
+    EXPECT_TRUE(aop.name == "big:0" || aop.name == "big:1" ||
+                aop.name == "big:2")
+        << aop.name;
+    EXPECT_LE(utils::BlocksInExtents(aop.op.dst_extents()), 16u);
+    file_blocks.AddRepeatedExtents(aop.op.dst_extents());
+  }
+  EXPECT_EQ((vector<Extent>{ExtentForRange(20, 40)}),
+            file_blocks.GetExtentsForBlockCount(file_blocks.blocks()));
+}
+
 TEST_F(DeltaDiffUtilsTest, ReplaceSmallTest) {
   // The old file is on a different block than the new one.
   vector<Extent> old_extents = {ExtentForRange(1, 1)};
@@ -25,6 +25,7 @@
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
+#include <base/time/time.h>
 #include <brillo/flag_helper.h>
 #include <brillo/key_value_store.h>
 #include <brillo/message_loops/base_message_loop.h>
@@ -40,6 +41,7 @@
 #include "update_engine/payload_consumer/filesystem_verifier_action.h"
 #include "update_engine/payload_consumer/payload_constants.h"
 #include "update_engine/payload_generator/delta_diff_generator.h"
+#include "update_engine/payload_generator/delta_diff_utils.h"
 #include "update_engine/payload_generator/payload_generation_config.h"
 #include "update_engine/payload_generator/payload_properties.h"
 #include "update_engine/payload_generator/payload_signer.h"
@@ -427,6 +429,10 @@ int Main(int argc, char** argv) {
       "Whether to disable Virtual AB Compression when installing the OTA");
   DEFINE_string(
       apex_info_file, "", "Path to META/apex_info.pb found in target build");
+  DEFINE_int32(threads,
+               0,
+               "Number of threads used to generate the operations of each "
+               "partition, 0 for one per CPU.");
 
   brillo::FlagHelper::Init(
       argc,
@@ -613,6 +619,8 @@ int Main(int argc, char** argv) {
   // Use the default soft_chunk_size defined in the config.
   payload_config.hard_chunk_size = FLAGS_chunk_size;
   payload_config.block_size = kBlockSize;
+  CHECK_GE(FLAGS_threads, 0) << "--threads must not be negative.";
+  payload_config.max_threads = FLAGS_threads;
 
   // The partition size is never passed to the delta_generator, so we
   // need to detect those from the provided files.
@@ -708,10 +716,14 @@ int Main(int argc, char** argv) {
   }
 
   uint64_t metadata_size;
+  base::TimeTicks start = base::TimeTicks::Now();
   if (!GenerateUpdatePayloadFile(
           payload_config, FLAGS_out_file, FLAGS_private_key, &metadata_size)) {
     return 1;
   }
+  LOG(INFO) << "Generated the payload in " << (base::TimeTicks::Now() - start)
+            << " using up to " << diff_utils::GetMaxThreads(payload_config)
+            << " threads per partition.";
   if (!FLAGS_out_metadata_size_file.empty()) {
     string metadata_size_string = std::to_string(metadata_size);
     CHECK(utils::WriteFile(FLAGS_out_metadata_size_file.c_str(),
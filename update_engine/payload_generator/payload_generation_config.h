@@ -228,6 +228,10 @@ struct PayloadGenerationConfig {
   // The block size used for all the operations in the manifest.
   size_t block_size = 4096;
 
+  // The number of threads used to generate the operations of each partition.
+  // A value of 0 means one per CPU, see diff_utils::GetMaxThreads().
+  size_t max_threads = 0;
+
   // The maximum timestamp of the OS allowed to apply this payload.
   int64_t max_timestamp = 0;
 